@@ -0,0 +1,161 @@
+#include <stdafx.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <BoundKernel.h>
+
+// Compares the shared bound tightening kernel with the loops it replaced, one sweep over a set of random consistency equations
+// Usage: bound_kernel_benchmark [terms per equation] [number of equations]
+// Every equation is solved for each of its cells in turn, as in Unpicker and Eliminate, and the bounds from the kernel must match the loops exactly
+
+#define DEFAULT_TERMS 64
+#define DEFAULT_EQUATIONS 20000
+#define CELLS_PER_TERM 4
+
+bool debugging = false;
+Logger *logger = NULL;
+System sys;
+Profiler profiler;
+
+struct Equation {
+    int_fast64_t RHS;
+    int size;
+    int *cell;
+    int *sign;
+};
+
+// The loops used by Eliminate before the kernel, solving for each cell with a full pass over the other terms
+static void reference_sweep(std::vector<Equation> &equations, Bounds<int_fast64_t> *bounds) {
+    for (size_t i = 0; i < equations.size(); i++) {
+        Equation *eqtn = &equations[i];
+
+        for (int k = 0; k < eqtn->size; k++) {
+            int_fast64_t result = (eqtn->sign[k] == 1)? eqtn->RHS: -eqtn->RHS;
+
+            for (int j = 0; j < eqtn->size; j++) {
+                if (j != k) {
+                    if (eqtn->sign[j] == eqtn->sign[k]) {
+                        result = result - bounds[eqtn->cell[j]].upper;
+                    } else {
+                        result = result + bounds[eqtn->cell[j]].lower;
+                    }
+                }
+            }
+
+            if (bounds[eqtn->cell[k]].lower < result) {
+                bounds[eqtn->cell[k]].lower = result;
+            }
+        }
+
+        for (int k = 0; k < eqtn->size; k++) {
+            int_fast64_t result = (eqtn->sign[k] == 1)? eqtn->RHS: -eqtn->RHS;
+
+            for (int j = 0; j < eqtn->size; j++) {
+                if (j != k) {
+                    if (eqtn->sign[j] == eqtn->sign[k]) {
+                        result = result - bounds[eqtn->cell[j]].lower;
+                    } else {
+                        result = result + bounds[eqtn->cell[j]].upper;
+                    }
+                }
+            }
+
+            if (bounds[eqtn->cell[k]].upper > result) {
+                bounds[eqtn->cell[k]].upper = result;
+            }
+        }
+    }
+}
+
+template <typename T>
+static void kernel_sweep(std::vector<Equation> &equations, Bounds<T> *bounds) {
+    for (size_t i = 0; i < equations.size(); i++) {
+        Equation *eqtn = &equations[i];
+
+        BoundKernel<T>::tighten_lower_bounds((T)eqtn->RHS, eqtn->cell, eqtn->sign, eqtn->size, bounds, [bounds](int cell, T result) {
+            bounds[cell].lower = result;
+            return true;
+        });
+
+        BoundKernel<T>::tighten_upper_bounds((T)eqtn->RHS, eqtn->cell, eqtn->sign, eqtn->size, bounds, [bounds](int cell, T result) {
+            bounds[cell].upper = result;
+            return true;
+        });
+    }
+}
+
+int main(int argc, char *argv[]) {
+    logger = new Logger(1, "BoundKernelBenchmarkLog.txt");
+
+    int terms = (argc > 1)? atoi(argv[1]): DEFAULT_TERMS;
+    int nequations = (argc > 2)? atoi(argv[2]): DEFAULT_EQUATIONS;
+    int ncells = MAX(terms * nequations / CELLS_PER_TERM, terms);
+
+    // Each equation is a total of random cells, with bounds around their values wide enough for some to tighten
+    std::vector<int_fast64_t> value(ncells);
+    std::vector<Bounds<int_fast64_t> > initial(ncells);
+    std::vector<int> cells((size_t)terms * nequations);
+    std::vector<int> signs((size_t)terms * nequations);
+    std::vector<Equation> equations(nequations);
+
+    srand(1);
+    for (int c = 0; c < ncells; c++) {
+        value[c] = 1 + rand() % 1000000;
+        initial[c].lower = value[c] - rand() % 2000000;
+        initial[c].upper = value[c] + rand() % 2000000;
+    }
+
+    for (int i = 0; i < nequations; i++) {
+        Equation *eqtn = &equations[i];
+
+        eqtn->size = terms;
+        eqtn->cell = &cells[(size_t)i * terms];
+        eqtn->sign = &signs[(size_t)i * terms];
+        eqtn->RHS = 0;
+
+        for (int k = 0; k < terms; k++) {
+            eqtn->cell[k] = rand() % ncells;
+            eqtn->sign[k] = (k == 0)? -1: 1;
+            eqtn->RHS += eqtn->sign[k] * value[eqtn->cell[k]];
+        }
+    }
+
+    logger->log(1, "%d equations of %d terms over %d cells", nequations, terms, ncells);
+#if defined(__AVX2__)
+    logger->log(1, "Integer kernel uses AVX2");
+#else
+    logger->log(1, "Integer kernel is scalar");
+#endif
+
+    std::vector<Bounds<int_fast64_t> > reference(initial);
+    double start = sys.wall_time();
+    reference_sweep(equations, reference.data());
+    double reference_time = sys.wall_time() - start;
+
+    std::vector<Bounds<int_fast64_t> > kernel(initial);
+    start = sys.wall_time();
+    kernel_sweep<int_fast64_t>(equations, kernel.data());
+    double kernel_time = sys.wall_time() - start;
+
+    if (memcmp(reference.data(), kernel.data(), sizeof(Bounds<int_fast64_t>) * ncells) != 0) {
+        logger->error(1, "Integer kernel bounds differ from the original loops");
+    }
+
+    std::vector<Bounds<double> > floating(ncells);
+    for (int c = 0; c < ncells; c++) {
+        floating[c].lower = (double)initial[c].lower;
+        floating[c].upper = (double)initial[c].upper;
+    }
+
+    start = sys.wall_time();
+    kernel_sweep<double>(equations, floating.data());
+    double floating_time = sys.wall_time() - start;
+
+    logger->log(1, "Original integer loops %.3f s", reference_time);
+    logger->log(1, "Integer kernel %.3f s (%.1fx)", kernel_time, reference_time / kernel_time);
+    logger->log(1, "Floating point kernel %.3f s", floating_time);
+
+    delete logger;
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <stdafx.h>
+#include <stdlib.h>
+#include <string.h>
+#include <UWECellSuppression.h>
+#include <JJData.h>
+
+// Measures the throughput of the text JJ reader and writer on a synthetic table
+// Usage: jj_parse_benchmark [number of cells]
+// The table consists of groups of ten cells and their total, so every consistency equation has eleven terms
+
+#define DEFAULT_BENCHMARK_CELLS 10000000
+#define CELLS_PER_GROUP 10
+
+bool debugging = false;
+Logger *logger = NULL;
+System sys;
+Profiler profiler;
+
+static long long file_size(const char *filename) {
+    time_t modified;
+    long size;
+
+    return sys.get_file_stamp(filename, &modified, &size)? (long long)size: 0;
+}
+
+static void generate(const char *filename, int groups) {
+    FILE *ofp;
+
+    if ((ofp = fopen(filename, "w")) == NULL) {
+        logger->error(1, "Unable to create file: %s", filename);
+    }
+
+    int ncells = groups * (CELLS_PER_GROUP + 1);
+
+    fprintf(ofp, "0\n%d \n", ncells);
+
+    srand(1);
+    for (int g = 0; g < groups; g++) {
+        double total = 0.0;
+        for (int i = 0; i < CELLS_PER_GROUP; i++) {
+            double value = (double)(1 + rand() % 10000) + (double)(rand() % 100) / 100.0;
+            total += value;
+            fprintf(ofp, "%d %f %f %c %f %f %f %f %f\n", g * (CELLS_PER_GROUP + 1) + i, value, value, (rand() % 20 == 0)? 'u': 's', 0.0, value * 2, value / 10, value / 10, 0.0);
+        }
+        fprintf(ofp, "%d %f %f %c %f %f %f %f %f\n", g * (CELLS_PER_GROUP + 1) + CELLS_PER_GROUP, total, total, 's', 0.0, total * 2, total / 10, total / 10, 0.0);
+    }
+
+    fprintf(ofp, "%d\n", groups);
+
+    for (int g = 0; g < groups; g++) {
+        fprintf(ofp, "0 %d :", CELLS_PER_GROUP + 1);
+        for (int i = 0; i <= CELLS_PER_GROUP; i++) {
+            fprintf(ofp, " %d (%d)", g * (CELLS_PER_GROUP + 1) + i, (i == CELLS_PER_GROUP)? -1: 1);
+        }
+        fprintf(ofp, "\n");
+    }
+
+    fclose(ofp);
+}
+
+int main(int argc, char *argv[]) {
+    logger = new Logger(1, "JJParseBenchmarkLog.txt");
+
+    int ncells = (argc > 1)? atoi(argv[1]): DEFAULT_BENCHMARK_CELLS;
+    int groups = MAX(ncells / (CELLS_PER_GROUP + 1), 1);
+
+    char infilename[MAX_FILENAME_SIZE];
+    char outfilename[MAX_FILENAME_SIZE];
+    sys.make_tempfile(infilename, MAX_FILENAME_SIZE);
+    sys.make_tempfile(outfilename, MAX_FILENAME_SIZE);
+
+    logger->log(1, "Generating %d cells", groups * (CELLS_PER_GROUP + 1));
+    generate(infilename, groups);
+
+    double megabytes = (double)file_size(infilename) / (1024.0 * 1024.0);
+    logger->log(1, "Input file %.1f MB, %u threads", megabytes, sys.number_of_processors());
+
+    double start = sys.wall_time();
+    JJData *jjData = new JJData(infilename);
+    double read_time = sys.wall_time() - start;
+
+    logger->log(1, "Read %d cells and %d equations in %.3f s (%.1f MB/s)", jjData->ncells, jjData->nsums, read_time, megabytes / read_time);
+
+    start = sys.wall_time();
+    jjData->write_jj_file(outfilename);
+    double write_time = sys.wall_time() - start;
+
+    megabytes = (double)file_size(outfilename) / (1024.0 * 1024.0);
+    logger->log(1, "Wrote %.1f MB in %.3f s (%.1f MB/s)", megabytes, write_time, megabytes / write_time);
+
+    delete jjData;
+
+    sys.remove_file(infilename);
+    sys.remove_file(outfilename);
+
+    delete logger;
+
+    return 0;
+}
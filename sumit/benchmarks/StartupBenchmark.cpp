@@ -0,0 +1,167 @@
+#include <stdafx.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <UWECellSuppression.h>
+#include <JJData.h>
+#include <CellStore.h>
+#include <Groups.h>
+#include <ExchangeSort.h>
+
+// Measures the orderings done before the GA starts, on a synthetic table with many primary cells
+// Usage: startup_benchmark [number of cells] [largest size compared with the original loops]
+// Weights and protection levels are rounded so that many are equal, and the orderings must match the original exchange sorts exactly
+
+#define DEFAULT_BENCHMARK_CELLS 200000
+#define DEFAULT_REFERENCE_LIMIT 20000
+#define MAX_CELLS_PER_GROUP 20
+
+bool debugging = false;
+Logger *logger = NULL;
+System sys;
+Profiler profiler;
+
+static void generate(const char *filename, int ncells) {
+    FILE *ofp;
+
+    if ((ofp = fopen(filename, "w")) == NULL) {
+        logger->error(1, "Unable to create file: %s", filename);
+    }
+
+    // Groups of 2 to MAX_CELLS_PER_GROUP cells and their total
+    std::vector<int> group_size;
+    int total_cells = 0;
+
+    srand(1);
+    while (total_cells < ncells) {
+        int size = 2 + rand() % (MAX_CELLS_PER_GROUP - 1);
+        group_size.push_back(size);
+        total_cells += size + 1;
+    }
+
+    fprintf(ofp, "0\n%d \n", total_cells);
+
+    int cell = 0;
+    for (size_t g = 0; g < group_size.size(); g++) {
+        double total = 0.0;
+        for (int i = 0; i < group_size[g]; i++) {
+            double value = (double)(1 + rand() % 1000);
+            double protection = (double)(1 + rand() % 50);
+            total += value;
+            fprintf(ofp, "%d %f %f %c %f %f %f %f %f\n", cell++, value, value, (rand() % 3 == 0)? 'u': 's', 0.0, value * 2, protection, protection, 0.0);
+        }
+        fprintf(ofp, "%d %f %f %c %f %f %f %f %f\n", cell++, total, total, 's', 0.0, total * 2, total / 10, total / 10, 0.0);
+    }
+
+    fprintf(ofp, "%d\n", (int)group_size.size());
+
+    cell = 0;
+    for (size_t g = 0; g < group_size.size(); g++) {
+        fprintf(ofp, "0 %d :", group_size[g] + 1);
+        for (int i = 0; i <= group_size[g]; i++) {
+            fprintf(ofp, " %d (%d)", cell++, (i == group_size[g])? -1: 1);
+        }
+        fprintf(ofp, "\n");
+    }
+
+    fclose(ofp);
+}
+
+// The all pairs exchange sort CellStore used before, largest first
+static void reference_cell_order(JJData *jjData, CellIndex *cells, int size) {
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            if (jjData->cells[cells[i]].loss_of_information_weight > jjData->cells[cells[j]].loss_of_information_weight) {
+                CellIndex temp = cells[i];
+                cells[i] = cells[j];
+                cells[j] = temp;
+            }
+        }
+    }
+}
+
+// The exchange sort Groups used before, smallest equation first
+static void reference_equation_order(JJData *jjData, SumIndex *permutation) {
+    for (SumIndex i = 0; i < jjData->nsums; i++) {
+        for (SumIndex j = i + 1; j < jjData->nsums; j++) {
+            if (jjData->consistency_eqtns[permutation[i]].size_of_eqtn > jjData->consistency_eqtns[permutation[j]].size_of_eqtn) {
+                SumIndex temp = permutation[i];
+                permutation[i] = permutation[j];
+                permutation[j] = temp;
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    logger = new Logger(1, "StartupBenchmarkLog.txt");
+
+    int ncells = (argc > 1)? atoi(argv[1]): DEFAULT_BENCHMARK_CELLS;
+    int reference_limit = (argc > 2)? atoi(argv[2]): DEFAULT_REFERENCE_LIMIT;
+
+    char infilename[MAX_FILENAME_SIZE];
+    sys.make_tempfile(infilename, MAX_FILENAME_SIZE);
+    generate(infilename, MAX(ncells, 3));
+
+    JJData *jjData = new JJData(infilename);
+    logger->log(1, "%d cells and %d equations", jjData->ncells, jjData->nsums);
+
+    CellStore *stored_cells = new CellStore(jjData);
+    stored_cells->store_selected_cells();
+    std::vector<CellIndex> primaries(stored_cells->cells, stored_cells->cells + stored_cells->size);
+
+    double start = sys.wall_time();
+    stored_cells->order_cells_by_largest_weighting();
+    double cell_time = sys.wall_time() - start;
+    logger->log(1, "Ordered %d primary cells by weight in %.3f s", stored_cells->size, cell_time);
+
+    std::vector<SumIndex> permutation(jjData->nsums);
+    for (SumIndex i = 0; i < jjData->nsums; i++) {
+        permutation[i] = i;
+    }
+
+    start = sys.wall_time();
+    exchange_sort(permutation.data(), jjData->nsums, [jjData](SumIndex i) { return -jjData->consistency_eqtns[i].size_of_eqtn; });
+    double equation_time = sys.wall_time() - start;
+    logger->log(1, "Ordered %d equations by size in %.3f s", jjData->nsums, equation_time);
+
+    if (stored_cells->size <= reference_limit) {
+        start = sys.wall_time();
+        reference_cell_order(jjData, primaries.data(), (int)primaries.size());
+        logger->log(1, "Original cell loops %.3f s", sys.wall_time() - start);
+
+        if (memcmp(primaries.data(), stored_cells->cells, sizeof(CellIndex) * primaries.size()) != 0) {
+            logger->error(1, "Cell order differs from the original loops");
+        }
+    }
+
+    if (jjData->nsums <= reference_limit) {
+        std::vector<SumIndex> reference(jjData->nsums);
+        for (SumIndex i = 0; i < jjData->nsums; i++) {
+            reference[i] = i;
+        }
+
+        start = sys.wall_time();
+        reference_equation_order(jjData, reference.data());
+        logger->log(1, "Original equation loops %.3f s", sys.wall_time() - start);
+
+        if (reference != permutation) {
+            logger->error(1, "Equation order differs from the original loops");
+        }
+    }
+
+    delete stored_cells;
+
+    start = sys.wall_time();
+    Groups *groups = new Groups(jjData);
+    logger->log(1, "Built %d groups in %.3f s", groups->number_of_groups, sys.wall_time() - start);
+
+    delete groups;
+    delete jjData;
+
+    sys.remove_file(infilename);
+
+    delete logger;
+
+    return 0;
+}
@@ -1,12 +1,13 @@
 #include <stdafx.h>
 #include <time.h>
+#include <math.h>
 #include <JJData.h>
 #include <CellStore.h>
 #include <Groups.h>
 #include <UWECellSuppression.h>
-#include "Solver.h"
+#include "LPSolver.h"
 
-Solver::Solver(const char *injjfilename, bool group_protection) {
+LPSolver::LPSolver(const char *injjfilename, bool group_protection) {
     jjData = new JJData(injjfilename);
 
     if (group_protection) {
@@ -21,19 +22,34 @@ Solver::Solver(const char *injjfilename, bool group_protection) {
     YminusOffset = 0;
     YplusOffset = jjData->ncells;
 
+    persistent = false;
+    model_loaded = false;
+    suppressed_cells = new CellIndex[jjData->ncells];
+    number_of_suppressed_cells = 0;
+
+    prefix_cache = NULL;
+    suppressed_offsets = new CellIndex[number_of_groups];
+
 #if SOLVER == CPLEX
     si = new OsiCpxSolverInterface;
-    logger->log(1, "Using CPLEX");
+    logger->log(3, "Using CPLEX");
 #elif SOLVER == GLPK
     si = new OsiGlpkSolverInterface;
-    logger->log(1, "Using GLPK");
+    logger->log(3, "Using GLPK");
 #else
     si = new OsiClpSolverInterface;
-    logger->log(1, "Using CLP");
+    logger->log(3, "Using CLP");
 #endif
 }
 
-Solver::~Solver() {
+LPSolver::~LPSolver() {
+    if (model_loaded) {
+        release_coin_memory();
+    }
+
+    delete[] suppressed_cells;
+    delete[] suppressed_offsets;
+
     delete si;
 
     if (groups) {
@@ -43,23 +59,30 @@ Solver::~Solver() {
     delete jjData;
 }
 
-double* Solver::run_individual_protection(const char* perm_filename, int model_type, double max_cost, int* costs_size) {
+double* LPSolver::run_individual_protection(const char* perm_filename, int model_type, double max_cost, int* costs_size) {
     CellIndex* ordered_cells = read_permutation_file(perm_filename);
 
-    jjData->reset();
+    double* costs = run_individual_protection(ordered_cells, model_type, max_cost, costs_size);
 
-    allocate_coin_memory();
+    delete[] ordered_cells;
 
-    si->messageHandler()->setLogLevel((logger->getLevel() > 6)? 4: 0);
-    si->loadProblem(*matrixA, varLB, varUB, objCoeffs, rowLB, rowUB);
-    si->setIntParam(OsiMaxNumIteration, 1000000);
-    si->initialSolve();
+    return costs;
+}
+
+double* LPSolver::run_individual_protection(const CellIndex* ordered_cells, int model_type, double max_cost, int* costs_size) {
+    telemetry.clear();
+    telemetry.number_of_genes = number_of_groups;
+
+    load_model();
 
     double* costs = new double[number_of_groups];
 
     *costs_size = 0;
 
-    for (CellIndex i = 0; i < number_of_groups; i++) {
+    CellIndex first = resume_prefix(ordered_cells, max_cost, costs, costs_size);
+    telemetry.genes_resumed = *costs_size;
+
+    for (CellIndex i = first; i < number_of_groups; i++) {
         CellIndex cell = ordered_cells[i];
 
         time(&current_seconds);
@@ -72,22 +95,9 @@ double* Solver::run_individual_protection(const char* perm_filename, int model_t
             logger->log(5, "Solving Y minus for cell %d", cell);
             si->setColBounds(YminusOffset + cell, jjData->cells[cell].lower_protection_level + 0.1, MAX(jjData->cells[cell].nominal_value, jjData->cells[cell].lower_protection_level + 0.1));
             si->setColBounds(YplusOffset + cell, 0.0, 0.0);
-            si->resolve();
-            logModel();
-
-            for (CellIndex j = 0; j < jjData->ncells; j++) {
-                logger->log(5, "%d %lf %lf", j, si->getColSolution()[YminusOffset + j], si->getColSolution()[YplusOffset + j]);
-                if ((si->getColSolution()[YminusOffset + j] + si->getColSolution()[YplusOffset + j]) > 0.01) {
-                    if (jjData->cells[j].status == 's') {
-                        logger->log(5, "Suppress secondary cell %d", j);
-                        jjData->cells[j].status = 'm';
-
-                         // Set primary cell coefficient to 0
-                        si->setObjCoeff(YminusOffset + j, 0.0);
-                        si->setObjCoeff(YplusOffset + j, 0.0);
-                    }
-                }
-            }
+            resolve();
+
+            suppress_secondary_cells();
         }
 
         // Y plus
@@ -95,22 +105,9 @@ double* Solver::run_individual_protection(const char* perm_filename, int model_t
             logger->log(5, "Solving Y plus for cell %d", cell);
             si->setColBounds(YminusOffset + cell, 0.0, 0.0);
             si->setColBounds(YplusOffset + cell, jjData->cells[cell].upper_protection_level + 0.1, MAX(jjData->cells[cell].nominal_value, jjData->cells[cell].upper_protection_level + 0.1));
-            si->resolve();
-            logModel();
-
-            for (CellIndex j = 0; j < jjData->ncells; j++) {
-                logger->log(5, "%d %lf %lf", j, si->getColSolution()[YminusOffset + j], si->getColSolution()[YplusOffset + j]);
-                if ((si->getColSolution()[YminusOffset + j] + si->getColSolution()[YplusOffset + j]) > 0.01) {
-                    if (jjData->cells[j].status == 's') {
-                        logger->log(5, "Suppress secondary cell %d", j);
-                        jjData->cells[j].status = 'm';
-
-                         // Set primary cell coefficient to 0
-                        si->setObjCoeff(YminusOffset + j, 0.0);
-                        si->setObjCoeff(YplusOffset + j, 0.0);
-                    }
-                }
-            }
+            resolve();
+
+            suppress_secondary_cells();
         }
 
         // Reset lower and upper variable bounds
@@ -119,6 +116,7 @@ double* Solver::run_individual_protection(const char* perm_filename, int model_t
 
         // Note cost
         costs[i] = get_cost();
+        suppressed_offsets[i] = number_of_suppressed_cells;
         (*costs_size)++;
 
         // Terminate early if cost limit specified and reached
@@ -127,30 +125,40 @@ double* Solver::run_individual_protection(const char* perm_filename, int model_t
         }
     }
 
-    delete[] ordered_cells;
+    record_prefix(ordered_cells, costs, *costs_size);
+
+    telemetry.genes_solved = *costs_size - telemetry.genes_resumed;
+    telemetry.terminated_at = (*costs_size < number_of_groups)? *costs_size: 0;
 
-    release_coin_memory();
+    unload_model();
 
     return costs;
 }
 
-double* Solver::run_group_protection(const char* perm_filename, int model_type, double max_cost, int* costs_size) {
+double* LPSolver::run_group_protection(const char* perm_filename, int model_type, double max_cost, int* costs_size) {
     int* ordered_groups = read_permutation_file(perm_filename);
 
-    jjData->reset();
+    double* costs = run_group_protection(ordered_groups, model_type, max_cost, costs_size);
 
-    allocate_coin_memory();
+    delete[] ordered_groups;
 
-    si->messageHandler()->setLogLevel((logger->getLevel() > 6)? 4: 0);
-    si->loadProblem(*matrixA, varLB, varUB, objCoeffs, rowLB, rowUB);
-    si->setIntParam(OsiMaxNumIteration, 1000000);
-    si->initialSolve();
+    return costs;
+}
+
+double* LPSolver::run_group_protection(const int* ordered_groups, int model_type, double max_cost, int* costs_size) {
+    telemetry.clear();
+    telemetry.number_of_genes = number_of_groups;
+
+    load_model();
 
     double* costs = new double[number_of_groups];
 
     *costs_size = 0;
 
-    for (int i = 0; i < number_of_groups; i++) {
+    int first = resume_prefix(ordered_groups, max_cost, costs, costs_size);
+    telemetry.genes_resumed = *costs_size;
+
+    for (int i = first; i < number_of_groups; i++) {
         int grp = ordered_groups[i];
 
         CellIndex size = groups->group[grp].size;
@@ -168,20 +176,9 @@ double* Solver::run_group_protection(const char* perm_filename, int model_type,
                 }
 
                 logger->log(5, "Solving Y minus for group %d", grp);
-                si->resolve();
-                logModel();
-
-                for (CellIndex j = 0; j < jjData->ncells; j++) {
-                    if ((si->getColSolution()[YminusOffset + j] + si->getColSolution()[YplusOffset + j]) > 0.01) {
-                        if (jjData->cells[j].status == 's') {
-                            logger->log(5, "Suppress secondary cell %d", j);
-                            jjData->cells[j].status = 'm';
-                            // Set primary cell coefficient to 0
-                            si->setObjCoeff(YminusOffset + j, 0.0);
-                            si->setObjCoeff(YplusOffset + j, 0.0);
-                        }
-                    }
-                }
+                resolve();
+
+                suppress_secondary_cells();
             }
 
             // Y plus
@@ -193,20 +190,9 @@ double* Solver::run_group_protection(const char* perm_filename, int model_type,
                 }
 
                 logger->log(5, "Solving Y plus for group %d", grp);
-                si->resolve();
-                logModel();
-
-                for (CellIndex j = 0; j < jjData->ncells; j++) {
-                    if ((si->getColSolution()[YminusOffset + j] + si->getColSolution()[YplusOffset + j]) > 0.01) {
-                        if (jjData->cells[j].status == 's') {
-                            logger->log(5, "Suppress secondary cell %d", j);
-                            jjData->cells[j].status = 'm';
-                            // Set primary cell coefficient to 0
-                            si->setObjCoeff(YminusOffset + j, 0.0);
-                            si->setObjCoeff(YplusOffset + j, 0.0);
-                        }
-                    }
-                }
+                resolve();
+
+                suppress_secondary_cells();
             }
 
             // Reset lower and upper variable bounds
@@ -219,6 +205,7 @@ double* Solver::run_group_protection(const char* perm_filename, int model_type,
 
         // Note cost
         costs[i] = get_cost();
+        suppressed_offsets[i] = number_of_suppressed_cells;
         (*costs_size)++;
 
         // Terminate early if cost limit specified and reached
@@ -227,18 +214,150 @@ double* Solver::run_group_protection(const char* perm_filename, int model_type,
         }
     }
 
-    delete[] ordered_groups;
+    record_prefix(ordered_groups, costs, *costs_size);
 
-    release_coin_memory();
+    telemetry.genes_solved = *costs_size - telemetry.genes_resumed;
+    telemetry.terminated_at = (*costs_size < number_of_groups)? *costs_size: 0;
+
+    unload_model();
 
     return costs;
 }
 
-int Solver::get_number_of_groups() {
+int LPSolver::get_number_of_groups() {
     return number_of_groups;
 }
 
-double Solver::get_cost() {
+// In persistent mode the model is built and solved once and kept loaded between runs
+void LPSolver::set_persistent(bool persistent) {
+    this->persistent = persistent;
+
+    if ((! persistent) && model_loaded) {
+        release_coin_memory();
+        model_loaded = false;
+    }
+}
+
+void LPSolver::load_model() {
+    if (model_loaded) {
+        // Undo the secondary suppressions made by the previous run
+        // Column bounds are reset after every gene, so the objective coefficients are the only difference from the initial model
+        // The next resolve then warm-starts from the basis left by the previous run
+        for (CellIndex i = 0; i < number_of_suppressed_cells; i++) {
+            CellIndex cell = suppressed_cells[i];
+            jjData->cells[cell].status = 's';
+            si->setObjCoeff(YminusOffset + cell, objCoeffs[YminusOffset + cell]);
+            si->setObjCoeff(YplusOffset + cell, objCoeffs[YplusOffset + cell]);
+        }
+    } else {
+        double start = sys.wall_time();
+
+        jjData->reset();
+
+        allocate_coin_memory();
+
+        si->messageHandler()->setLogLevel((logger->getLevel() > 6)? 4: 0);
+        si->loadProblem(*matrixA, varLB, varUB, objCoeffs, rowLB, rowUB);
+        si->setIntParam(OsiMaxNumIteration, 1000000);
+
+        double loaded = sys.wall_time();
+        si->initialSolve();
+
+        telemetry.build_time = loaded - start;
+        telemetry.initial_solve_time = sys.wall_time() - loaded;
+
+        model_loaded = true;
+    }
+
+    number_of_suppressed_cells = 0;
+}
+
+void LPSolver::unload_model() {
+    if (! persistent) {
+        release_coin_memory();
+        model_loaded = false;
+    }
+}
+
+void LPSolver::resolve() {
+    double start = sys.wall_time();
+    si->resolve();
+
+    telemetry.resolve_time += sys.wall_time() - start;
+    telemetry.resolves++;
+    telemetry.iterations += si->getIterationCount();
+
+    logModel();
+}
+
+void LPSolver::suppress_secondary_cells() {
+    for (CellIndex j = 0; j < jjData->ncells; j++) {
+        logger->log(5, "%d %lf %lf", j, si->getColSolution()[YminusOffset + j], si->getColSolution()[YplusOffset + j]);
+        if ((si->getColSolution()[YminusOffset + j] + si->getColSolution()[YplusOffset + j]) > 0.01) {
+            if (jjData->cells[j].status == 's') {
+                logger->log(5, "Suppress secondary cell %d", j);
+                jjData->cells[j].status = 'm';
+                suppressed_cells[number_of_suppressed_cells++] = j;
+
+                // Set primary cell coefficient to 0
+                si->setObjCoeff(YminusOffset + j, 0.0);
+                si->setObjCoeff(YplusOffset + j, 0.0);
+            }
+        }
+    }
+}
+
+void LPSolver::set_prefix_cache(PrefixCache *prefix_cache) {
+    this->prefix_cache = prefix_cache;
+}
+
+// Restore the state reached by the longest cached prefix of the permutation and return the index of the first gene still to be solved
+// Returns the number of genes if the cost limit is reached within the prefix
+int LPSolver::resume_prefix(const int* ordered_genes, double max_cost, double* costs, int* costs_size) {
+    if (prefix_cache == NULL) {
+        return 0;
+    }
+
+    int length = prefix_cache->lookup(ordered_genes, number_of_groups, costs, suppressed_cells, suppressed_offsets);
+    if (length == 0) {
+        return 0;
+    }
+
+    // Terminate early if cost limit specified and reached, in which case only the genes up to the one that reached it are applied
+    int used = length;
+    bool limit_reached = false;
+
+    for (int i = 0; i < length; i++) {
+        if ((fabs(max_cost) >= FLOAT_PRECISION) && (costs[i] >= max_cost)) {
+            used = i + 1;
+            limit_reached = true;
+            break;
+        }
+    }
+
+    number_of_suppressed_cells = suppressed_offsets[used - 1];
+
+    for (CellIndex i = 0; i < number_of_suppressed_cells; i++) {
+        CellIndex cell = suppressed_cells[i];
+        jjData->cells[cell].status = 'm';
+        si->setObjCoeff(YminusOffset + cell, 0.0);
+        si->setObjCoeff(YplusOffset + cell, 0.0);
+    }
+
+    logger->log(5, "Resuming from cached prefix of %d genes", used);
+
+    *costs_size += used;
+
+    return limit_reached? number_of_groups: length;
+}
+
+void LPSolver::record_prefix(const int* ordered_genes, const double* costs, int costs_size) {
+    if (prefix_cache != NULL) {
+        prefix_cache->insert(ordered_genes, costs_size, costs, suppressed_cells, suppressed_offsets);
+    }
+}
+
+double LPSolver::get_cost() {
     double cost = 0.0;
     for (CellIndex i = 0; i < jjData->ncells; i++) {
         if ((jjData->cells[i].status == 'u') || (jjData->cells[i].status == 'm')) {
@@ -249,7 +368,7 @@ double Solver::get_cost() {
     return cost;
 }
 
-int* Solver::read_permutation_file(const char* filename) {
+int* LPSolver::read_permutation_file(const char* filename) {
     FILE *ifp;
 
     if ((ifp = fopen(filename, "r")) == NULL) {
@@ -291,7 +410,38 @@ int* Solver::read_permutation_file(const char* filename) {
     return permutation;
 }
 
-void Solver::write_cost_file(const char* filename, double* costs, int size) {
+// A batch file holds, for each of count permutations in turn, its max_cost followed by its genes, one to a line
+// Returns the permutations one after another
+int* LPSolver::read_batch_file(const char* filename, int count, double* max_costs) {
+    FILE *ifp;
+
+    if ((ifp = fopen(filename, "r")) == NULL) {
+        logger->error(306, "Batch file not found: %s", filename);
+    }
+
+    int* permutations = new int[(size_t)count * number_of_groups];
+
+    int line = 0;
+    for (int k = 0; k < count; k++) {
+        if (fscanf(ifp, "%lf\n", &max_costs[k]) != 1) {
+            logger->error(307, "Error reading batch file at line %d: %s", line, filename);
+        }
+        line++;
+
+        for (int i = 0; i < number_of_groups; i++) {
+            if (fscanf(ifp, "%d\n", &permutations[(size_t)k * number_of_groups + i]) != 1) {
+                logger->error(307, "Error reading batch file at line %d: %s", line, filename);
+            }
+            line++;
+        }
+    }
+
+    fclose(ifp);
+
+    return permutations;
+}
+
+void LPSolver::write_cost_file(const char* filename, double* costs, int size) {
     FILE *ofp;
 
     if (*filename != '\0') {
@@ -307,16 +457,16 @@ void Solver::write_cost_file(const char* filename, double* costs, int size) {
     }
 }
 
-void Solver::write_jj_file(const char* filename) {
+void LPSolver::write_jj_file(const char* filename) {
     jjData->write_jj_file(filename);
 }
 
-void Solver::allocate_coin_memory() {
-    int number_of_elements = 0;
+SolverTelemetry* LPSolver::get_telemetry() {
+    return &telemetry;
+}
 
-    for (CellIndex i = 0; i < jjData->nsums; i++) {
-        number_of_elements = number_of_elements + 2 * jjData->consistency_eqtns[i].size_of_eqtn;
-    }
+void LPSolver::allocate_coin_memory() {
+    int number_of_elements = 2 * (int)jjData->equation_offsets[jjData->nsums];
 
     varLB = new double[2 * jjData->ncells];
     varUB = new double[2 * jjData->ncells];
@@ -329,18 +479,20 @@ void Solver::allocate_coin_memory() {
 
     int element = 0;
 
+    // Rows come straight from the equation store
     for (SumIndex i = 0; i < jjData->nsums; i++) {
-        for (CellIndex j = 0; j < jjData->consistency_eqtns[i].size_of_eqtn; j++) {
-            CellIndex cell = jjData->consistency_eqtns[i].cell_index[j];
+        for (int64_t k = jjData->equation_offsets[i]; k < jjData->equation_offsets[i + 1]; k++) {
+            CellIndex cell = jjData->equation_cells[k];
+            double sign = (double)jjData->term_sign(k);
 
             row_indices[element] = i;
             col_indices[element] = YminusOffset + cell;
-            elements[element] = -1.0 * (double)jjData->consistency_eqtns[i].plus_or_minus[j];
+            elements[element] = -1.0 * sign;
             element++;
 
             row_indices[element] = i;
             col_indices[element] = YplusOffset + cell;
-            elements[element] = (double)jjData->consistency_eqtns[i].plus_or_minus[j];
+            elements[element] = sign;
             element++;
         }
     }
@@ -380,7 +532,7 @@ void Solver::allocate_coin_memory() {
     matrixA = new CoinPackedMatrix(ROW_ORDERED, row_indices, col_indices, elements, element);
 }
 
-void Solver::release_coin_memory() {
+void LPSolver::release_coin_memory() {
     if (row_indices != NULL) {
         delete[] row_indices;
     }
@@ -418,7 +570,7 @@ void Solver::release_coin_memory() {
     }
 }
 
-void Solver::logModel() {
+void LPSolver::logModel() {
     logger->log(6, "Model iteration count: %d", si->getIterationCount());
     logger->log(6, "Model abandoned: %s", si->isAbandoned()? "true" : "false");
     logger->log(6, "Model dual objective limit reached: %s", si->isDualObjectiveLimitReached()? "true" : "false");
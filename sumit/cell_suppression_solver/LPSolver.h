@@ -17,6 +17,8 @@
 #endif
 #include <JJData.h>
 #include <Groups.h>
+#include <SolverTelemetry.h>
+#include "PrefixCache.h"
 
 #define INDIVIDUAL_PROTECTION 0
 #define GROUP_PROTECTION 1
@@ -25,18 +27,23 @@
 #define YPLUS_MODEL	1
 #define YMINUS_MODEL	2
 
-class Solver {
+class LPSolver {
 
 public:
-    Solver(const char* injjfilename, bool groupProtection);
-    ~Solver();
+    LPSolver(const char* injjfilename, bool groupProtection);
+    ~LPSolver();
 
+    int* read_batch_file(const char* filename, int count, double* max_costs);
     double* run_individual_protection(const char* perm_filename, int model_type, double max_cost, int* costs_size);
+    double* run_individual_protection(const CellIndex* ordered_cells, int model_type, double max_cost, int* costs_size);
     double* run_group_protection(const char* perm_filename, int model_type, double max_cost, int* costs_size);
+    double* run_group_protection(const int* ordered_groups, int model_type, double max_cost, int* costs_size);
     int get_number_of_groups();
+    void set_persistent(bool persistent);
+    void set_prefix_cache(PrefixCache *prefix_cache);
     void write_cost_file(const char* filename, double* costs, int size);
     void write_jj_file(const char* filename);
-    bool Solver::getCompletedSuccessfully();
+    SolverTelemetry* get_telemetry();
 
 private:
     JJData *jjData;
@@ -83,10 +90,30 @@ private:
     int YminusOffset;
     int YplusOffset;
 
+    // Persistent model state
+    bool persistent;
+    bool model_loaded;
+    CellIndex *suppressed_cells;
+    CellIndex number_of_suppressed_cells;
+
+    // Runs resume from, and add to, the prefix cache if there is one
+    // The cache must only be shared by solvers for the same JJ file, protection type and model type
+    PrefixCache *prefix_cache;
+    CellIndex *suppressed_offsets;
+
+    // Measurements of the latest run
+    SolverTelemetry telemetry;
+
     double get_cost();
     int* read_permutation_file(const char* filename);
     void allocate_coin_memory();
     void release_coin_memory();
+    void load_model();
+    void unload_model();
+    void suppress_secondary_cells();
+    void resolve();
+    int resume_prefix(const int* ordered_genes, double max_cost, double* costs, int* costs_size);
+    void record_prefix(const int* ordered_genes, const double* costs, int costs_size);
     void logModel();
 
 };
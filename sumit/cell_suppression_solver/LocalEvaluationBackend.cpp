@@ -0,0 +1,390 @@
+#include <stdafx.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include "LPSolver.h"
+#include "PrefixCache.h"
+#include "LocalEvaluationBackend.h"
+
+LocalEvaluationJob::LocalEvaluationJob(LocalEvaluationBackend *backend, int id, const char *injjfilename, const CellIndex *perm, int size, int protection_type, int model_type, double max_cost) {
+    this->backend = backend;
+    sprintf(name, "local-%d", id);
+
+    strcpy(this->injjfilename, injjfilename);
+    this->perm = new CellIndex[size];
+    for (int i = 0; i < size; i++) {
+        this->perm[i] = perm[i];
+    }
+    this->size = size;
+    this->protection_type = protection_type;
+    this->model_type = model_type;
+    this->max_cost = max_cost;
+
+    status = -2;
+
+    result = 0.0;
+    elapsed_time = 0;
+    costs = NULL;
+    costs_size = 0;
+    outjjfilename[0] = '\0';
+}
+
+LocalEvaluationJob::~LocalEvaluationJob() {
+    backend->release(this);
+
+    if (outjjfilename[0] != '\0') {
+        sys.remove_file(outjjfilename);
+    }
+
+    if (costs != NULL) {
+        delete[] costs;
+    }
+
+    delete[] perm;
+}
+
+const char *LocalEvaluationJob::getName() {
+    return name;
+}
+
+int LocalEvaluationJob::getStatus() {
+    std::lock_guard<std::mutex> lock(backend->mutex);
+    return status;
+}
+
+double LocalEvaluationJob::getResult() {
+    return result;
+}
+
+int LocalEvaluationJob::getElapsedTime() {
+    return elapsed_time;
+}
+
+int LocalEvaluationJob::getCosts(double *costs, int size) {
+    int n = MIN(size, costs_size);
+
+    for (int i = 0; i < n; i++) {
+        costs[i] = this->costs[i];
+    }
+
+    return n;
+}
+
+void LocalEvaluationJob::getJJFile(const char *filename) {
+    sys.copy_file(filename, outjjfilename);
+}
+
+bool LocalEvaluationJob::getTelemetry(SolverTelemetry *telemetry) {
+    *telemetry = this->telemetry;
+    return true;
+}
+
+// Called on a worker thread without the backend mutex held
+void LocalEvaluationJob::run(LPSolver *solver) {
+    time_t start_time = time(NULL);
+    double start_wall_time = sys.wall_time();
+
+    if (size != solver->get_number_of_groups()) {
+        logger->error(304, "Permutation size (%d) does not match number of groups (%d)", size, solver->get_number_of_groups());
+    }
+
+    if (protection_type == INDIVIDUAL_PROTECTION) {
+        costs = solver->run_individual_protection(perm, model_type, max_cost, &costs_size);
+    } else {
+        costs = solver->run_group_protection(perm, model_type, max_cost, &costs_size);
+    }
+
+    sys.make_tempfile(outjjfilename, MAX_FILENAME_SIZE);
+    solver->write_jj_file(outjjfilename);
+
+    result = costs[costs_size - 1];
+    elapsed_time = (int)(time(NULL) - start_time);
+
+    telemetry = *solver->get_telemetry();
+    telemetry.run_time = sys.wall_time() - start_wall_time;
+}
+
+LocalEvaluationBackend::LocalEvaluationBackend(int threads) {
+    // The GA requires at least two solvers
+    limit = MAX(threads, 2);
+    sessions = 0;
+    next_id = 0;
+    stopping = false;
+    warm_hits = 0;
+    warm_misses = 0;
+
+    for (int i = 0; i < PREFIX_CACHE_MODELS; i++) {
+        prefix_models[i].cache = NULL;
+        prefix_models[i].users = 0;
+    }
+    prefix_clock = 0;
+    prefix_genes_reused = 0;
+    prefix_genes_solved = 0;
+
+    for (int i = 0; i < limit; i++) {
+        workers.push_back(std::thread(&LocalEvaluationBackend::worker, this));
+    }
+
+    logger->log(3, "Local solver threads %d", limit);
+}
+
+LocalEvaluationBackend::~LocalEvaluationBackend() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_queued.notify_all();
+
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+
+    logger->log(3, "Local solver warm model hits %d, misses %d", warm_hits, warm_misses);
+
+    for (int i = 0; i < PREFIX_CACHE_MODELS; i++) {
+        if (prefix_models[i].cache != NULL) {
+            log_prefix_cache(&prefix_models[i]);
+            delete prefix_models[i].cache;
+        }
+    }
+    logger->log(3, "Local solver prefix cache genes reused %lld, solved %lld", prefix_genes_reused, prefix_genes_solved);
+}
+
+const char *LocalEvaluationBackend::getName() {
+    return "local";
+}
+
+int LocalEvaluationBackend::getLimit() {
+    return limit;
+}
+
+EvaluationJob *LocalEvaluationBackend::runProtection(const char *injjfilename, const CellIndex *perm, int size, int protection_type, int model_type, double max_cost) {
+    int id;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (sessions >= limit) {
+            throw SESSION_EXCEPTION;
+        }
+
+        sessions++;
+        id = ++next_id;
+    }
+
+    LocalEvaluationJob *job = new LocalEvaluationJob(this, id, injjfilename, perm, size, protection_type, model_type, max_cost);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(job);
+    }
+    job_queued.notify_one();
+
+    return job;
+}
+
+void LocalEvaluationBackend::worker() {
+    struct WarmModel models[WARM_MODELS_PER_WORKER];
+    unsigned long now = 0;
+
+    for (int i = 0; i < WARM_MODELS_PER_WORKER; i++) {
+        models[i].solver = NULL;
+    }
+
+    for (;;) {
+        LocalEvaluationJob *job;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            while ((! stopping) && queue.empty()) {
+                job_queued.wait(lock);
+            }
+
+            if (queue.empty()) {
+                break;
+            }
+
+            job = queue.front();
+            queue.pop_front();
+            job->status = -1;
+        }
+
+        job->set_started_time(sys.wall_time());
+
+        bool warm;
+        LPSolver *solver = acquire_solver(models, ++now, job, &warm);
+
+        PrefixCache *cache = acquire_prefix_cache(job);
+        solver->set_prefix_cache(cache);
+
+        job->run(solver);
+
+        solver->set_prefix_cache(NULL);
+        release_prefix_cache(cache);
+
+        if (! warm) {
+            delete solver;
+        }
+
+        job->set_completed_time(sys.wall_time());
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job->status = 0;
+        }
+        job_completed.notify_all();
+        notify_completion();
+    }
+
+    for (int i = 0; i < WARM_MODELS_PER_WORKER; i++) {
+        if (models[i].solver != NULL) {
+            delete models[i].solver;
+        }
+    }
+}
+
+// Get a solver for a job, reusing a model already loaded by this worker where possible
+// YMINUS models start from intermediate JJ files that are only used once, so they are not kept
+LPSolver *LocalEvaluationBackend::acquire_solver(struct WarmModel models[], unsigned long now, LocalEvaluationJob *job, bool *warm) {
+    time_t modified;
+    long size;
+
+    if ((job->model_type != YPLUS_MODEL) || (! sys.get_file_stamp(job->injjfilename, &modified, &size))) {
+        *warm = false;
+        return new LPSolver(job->injjfilename, (job->protection_type == GROUP_PROTECTION));
+    }
+
+    *warm = true;
+
+    int lru = 0;
+
+    for (int i = 0; i < WARM_MODELS_PER_WORKER; i++) {
+        if ((models[i].solver != NULL) && (models[i].protection_type == job->protection_type) && (models[i].modified == modified) && (models[i].size == size) && (strcmp(models[i].injjfilename, job->injjfilename) == 0)) {
+            models[i].last_used = now;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            warm_hits++;
+
+            return models[i].solver;
+        }
+
+        if ((models[i].solver == NULL) || ((models[lru].solver != NULL) && (models[i].last_used < models[lru].last_used))) {
+            lru = i;
+        }
+    }
+
+    if (models[lru].solver != NULL) {
+        delete models[lru].solver;
+    }
+
+    strcpy(models[lru].injjfilename, job->injjfilename);
+    models[lru].modified = modified;
+    models[lru].size = size;
+    models[lru].protection_type = job->protection_type;
+    models[lru].last_used = now;
+    models[lru].solver = new LPSolver(job->injjfilename, (job->protection_type == GROUP_PROTECTION));
+    models[lru].solver->set_persistent(true);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        warm_misses++;
+    }
+
+    return models[lru].solver;
+}
+
+// Get the prefix cache for a job's model, replacing the least recently used cache that is not in use if there is none for it yet
+// Returns NULL if every cache is in use by jobs for other models
+// YMINUS models start from intermediate JJ files that are only used once, so they are not cached
+PrefixCache *LocalEvaluationBackend::acquire_prefix_cache(LocalEvaluationJob *job) {
+    time_t modified;
+    long size;
+
+    if ((job->model_type != YPLUS_MODEL) || (! sys.get_file_stamp(job->injjfilename, &modified, &size))) {
+        return NULL;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    prefix_clock++;
+
+    int lru = -1;
+
+    for (int i = 0; i < PREFIX_CACHE_MODELS; i++) {
+        struct PrefixModel *model = &prefix_models[i];
+
+        if ((model->cache != NULL) && (model->protection_type == job->protection_type) && (model->modified == modified) && (model->size == size) && (strcmp(model->injjfilename, job->injjfilename) == 0)) {
+            model->last_used = prefix_clock;
+            model->users++;
+
+            return model->cache;
+        }
+
+        if ((model->users == 0) && ((lru == -1) || (model->cache == NULL) || ((prefix_models[lru].cache != NULL) && (model->last_used < prefix_models[lru].last_used)))) {
+            lru = i;
+        }
+    }
+
+    if (lru == -1) {
+        return NULL;
+    }
+
+    struct PrefixModel *model = &prefix_models[lru];
+
+    if (model->cache != NULL) {
+        log_prefix_cache(model);
+        delete model->cache;
+    }
+
+    strcpy(model->injjfilename, job->injjfilename);
+    model->modified = modified;
+    model->size = size;
+    model->protection_type = job->protection_type;
+    model->last_used = prefix_clock;
+    model->users = 1;
+    model->cache = new PrefixCache();
+
+    return model->cache;
+}
+
+void LocalEvaluationBackend::release_prefix_cache(PrefixCache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (int i = 0; i < PREFIX_CACHE_MODELS; i++) {
+        if (prefix_models[i].cache == cache) {
+            prefix_models[i].users--;
+            break;
+        }
+    }
+}
+
+// Called with the backend mutex held, or once the workers have stopped
+void LocalEvaluationBackend::log_prefix_cache(struct PrefixModel *model) {
+    PrefixCache *cache = model->cache;
+
+    logger->log(4, "Prefix cache for %s: genes reused %lld, solved %lld, cleared %d times", model->injjfilename, cache->genes_reused, cache->genes_solved, cache->clears);
+
+    prefix_genes_reused += cache->genes_reused;
+    prefix_genes_solved += cache->genes_solved;
+}
+
+// Called when a job is deleted - a queued job is withdrawn and a running job is waited for
+void LocalEvaluationBackend::release(LocalEvaluationJob *job) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    std::deque<LocalEvaluationJob *>::iterator it = std::find(queue.begin(), queue.end(), job);
+    if (it != queue.end()) {
+        queue.erase(it);
+    }
+
+    while (job->status == -1) {
+        job_completed.wait(lock);
+    }
+
+    sessions--;
+}
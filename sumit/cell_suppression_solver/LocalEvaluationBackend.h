@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdafx.h>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <EvaluationBackend.h>
+
+// Number of loaded models kept by each worker thread
+#define WARM_MODELS_PER_WORKER 4
+
+// Number of models with a prefix cache, so that partitions evaluated at the same time each keep their own
+#define PREFIX_CACHE_MODELS 8
+
+class LPSolver;
+class PrefixCache;
+class LocalEvaluationBackend;
+
+class LocalEvaluationJob: public EvaluationJob {
+
+    friend class LocalEvaluationBackend;
+
+public:
+    LocalEvaluationJob(LocalEvaluationBackend *backend, int id, const char *injjfilename, const CellIndex *perm, int size, int protection_type, int model_type, double max_cost);
+    ~LocalEvaluationJob();
+    const char *getName();
+    int getStatus();
+    double getResult();
+    int getElapsedTime();
+    int getCosts(double *costs, int size);
+    void getJJFile(const char *filename);
+    bool getTelemetry(SolverTelemetry *telemetry);
+
+private:
+    LocalEvaluationBackend *backend;
+    char name[32];
+
+    // Job definition
+    char injjfilename[MAX_FILENAME_SIZE];
+    CellIndex *perm;
+    int size;
+    int protection_type;
+    int model_type;
+    double max_cost;
+
+    // Guarded by the backend mutex
+    int status;
+
+    // Job results - only valid once the status is zero
+    double result;
+    int elapsed_time;
+    double *costs;
+    int costs_size;
+    char outjjfilename[MAX_FILENAME_SIZE];
+    SolverTelemetry telemetry;
+
+    void run(LPSolver *solver);
+
+};
+
+// Runs CLP solvers on a pool of threads within the client process
+class LocalEvaluationBackend: public EvaluationBackend {
+
+    friend class LocalEvaluationJob;
+
+public:
+    LocalEvaluationBackend(int threads);
+    ~LocalEvaluationBackend();
+    const char *getName();
+    int getLimit();
+    EvaluationJob *runProtection(const char *injjfilename, const CellIndex *perm, int size, int protection_type, int model_type, double max_cost);
+
+private:
+    // A model loaded by a worker thread and kept for reuse by later jobs on the same JJ file
+    struct WarmModel {
+        char injjfilename[MAX_FILENAME_SIZE];
+        time_t modified;
+        long size;
+        int protection_type;
+        unsigned long last_used;
+        LPSolver *solver;
+    };
+
+    int limit;
+    int sessions;
+    int next_id;
+    bool stopping;
+    int warm_hits;
+    int warm_misses;
+
+    // A prefix cache shared by all workers for the yplus model of one JJ file
+    struct PrefixModel {
+        char injjfilename[MAX_FILENAME_SIZE];
+        time_t modified;
+        long size;
+        int protection_type;
+        unsigned long last_used;
+        int users;
+        PrefixCache *cache;
+    };
+
+    // Guarded by the mutex - the least recently used cache that no running job is using is replaced by a cache for a new model
+    struct PrefixModel prefix_models[PREFIX_CACHE_MODELS];
+    unsigned long prefix_clock;
+    long long prefix_genes_reused;
+    long long prefix_genes_solved;
+
+    std::vector<std::thread> workers;
+    std::deque<LocalEvaluationJob *> queue;
+    std::mutex mutex;
+    std::condition_variable job_queued;
+    std::condition_variable job_completed;
+
+    void worker();
+    LPSolver *acquire_solver(struct WarmModel models[], unsigned long now, LocalEvaluationJob *job, bool *warm);
+    PrefixCache *acquire_prefix_cache(LocalEvaluationJob *job);
+    void release_prefix_cache(PrefixCache *cache);
+    void log_prefix_cache(struct PrefixModel *model);
+    void release(LocalEvaluationJob *job);
+
+};
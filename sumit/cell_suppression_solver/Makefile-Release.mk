@@ -35,7 +35,8 @@ OBJECTDIR=${CND_BUILDDIR}/${CND_CONF}/${CND_PLATFORM}
 
 # Object Files
 OBJECTFILES= \
-	${OBJECTDIR}/Solver.o \
+	${OBJECTDIR}/LPSolver.o \
+	${OBJECTDIR}/PrefixCache.o \
 	${OBJECTDIR}/UWESolver.o
 
 
@@ -67,10 +68,15 @@ ${CND_DISTDIR}/${CND_CONF}/${CND_PLATFORM}/uwesolver: ${OBJECTFILES}
 	${MKDIR} -p ${CND_DISTDIR}/${CND_CONF}/${CND_PLATFORM}
 	${LINK.cc} -o ${CND_DISTDIR}/${CND_CONF}/${CND_PLATFORM}/uwesolver ${OBJECTFILES} ${LDLIBSOPTIONS}
 
-${OBJECTDIR}/Solver.o: Solver.cpp
+${OBJECTDIR}/LPSolver.o: LPSolver.cpp
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
-	$(COMPILE.cc) -O3 -Wall -I../UWECellSuppressionLib -I/usr/local/include/clp -std=c++11 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/Solver.o Solver.cpp
+	$(COMPILE.cc) -O3 -Wall -I../UWECellSuppressionLib -I/usr/local/include/clp -std=c++11 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/LPSolver.o LPSolver.cpp
+
+${OBJECTDIR}/PrefixCache.o: PrefixCache.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O3 -Wall -I../UWECellSuppressionLib -I/usr/local/include/clp -std=c++11 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/PrefixCache.o PrefixCache.cpp
 
 ${OBJECTDIR}/UWESolver.o: UWESolver.cpp
 	${MKDIR} -p ${OBJECTDIR}
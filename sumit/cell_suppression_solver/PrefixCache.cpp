@@ -0,0 +1,130 @@
+#include <stdafx.h>
+#include <vector>
+#include "PrefixCache.h"
+
+PrefixCache::PrefixCache() {
+    root.gene = -1;
+    root.cost = 0.0;
+    root.number_of_cells = 0;
+    root.cells = NULL;
+    root.child = NULL;
+    root.sibling = NULL;
+
+    memory_used = 0;
+
+    genes_reused = 0;
+    genes_solved = 0;
+    clears = 0;
+}
+
+PrefixCache::~PrefixCache() {
+    clear();
+}
+
+struct PrefixCache::Node *PrefixCache::find_child(struct Node *parent, int gene) {
+    for (struct Node *node = parent->child; node != NULL; node = node->sibling) {
+        if (node->gene == gene) {
+            return node;
+        }
+    }
+
+    return NULL;
+}
+
+// Delete every node - iterative because the trie is as deep as the longest permutation
+void PrefixCache::clear() {
+    std::vector<struct Node *> stack;
+
+    if (root.child != NULL) {
+        stack.push_back(root.child);
+    }
+
+    while (! stack.empty()) {
+        struct Node *node = stack.back();
+        stack.pop_back();
+
+        if (node->child != NULL) {
+            stack.push_back(node->child);
+        }
+        if (node->sibling != NULL) {
+            stack.push_back(node->sibling);
+        }
+
+        if (node->cells != NULL) {
+            delete[] node->cells;
+        }
+        delete node;
+    }
+
+    root.child = NULL;
+    memory_used = 0;
+}
+
+int PrefixCache::lookup(const int *genes, int size, double *costs, CellIndex *cells, CellIndex *offsets) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    struct Node *node = &root;
+    CellIndex number_of_cells = 0;
+    int length = 0;
+
+    while (length < size) {
+        node = find_child(node, genes[length]);
+        if (node == NULL) {
+            break;
+        }
+
+        for (CellIndex j = 0; j < node->number_of_cells; j++) {
+            cells[number_of_cells++] = node->cells[j];
+        }
+
+        costs[length] = node->cost;
+        offsets[length] = number_of_cells;
+        length++;
+    }
+
+    genes_reused += length;
+
+    return length;
+}
+
+void PrefixCache::insert(const int *genes, int length, const double *costs, const CellIndex *cells, const CellIndex *offsets) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Start again rather than track usage of individual nodes - the GA population soon re-creates the prefixes that matter
+    if (memory_used > (long long)PREFIX_CACHE_BUDGET_MB * 1024 * 1024) {
+        logger->log(4, "Prefix cache cleared (%lld bytes in use)", memory_used);
+        clear();
+        clears++;
+    }
+
+    struct Node *parent = &root;
+
+    for (int i = 0; i < length; i++) {
+        struct Node *node = find_child(parent, genes[i]);
+
+        if (node == NULL) {
+            CellIndex first = (i == 0)? 0: offsets[i - 1];
+
+            node = new Node;
+            node->gene = genes[i];
+            node->cost = costs[i];
+            node->number_of_cells = offsets[i] - first;
+            if (node->number_of_cells > 0) {
+                node->cells = new CellIndex[node->number_of_cells];
+                for (CellIndex j = 0; j < node->number_of_cells; j++) {
+                    node->cells[j] = cells[first + j];
+                }
+            } else {
+                node->cells = NULL;
+            }
+            node->child = NULL;
+            node->sibling = parent->child;
+            parent->child = node;
+
+            memory_used += (long long)(sizeof(struct Node) + node->number_of_cells * sizeof(CellIndex));
+            genes_solved++;
+        }
+
+        parent = node;
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdafx.h>
+#include <mutex>
+#include <JJData.h>
+
+// Memory limit for a prefix cache - the whole trie is discarded when this is exceeded
+#define PREFIX_CACHE_BUDGET_MB 256
+
+// Solver results for permutation prefixes, shared by all solvers working on the same model
+// The solver state after k genes is the set of secondary cells suppressed so far, so a run can resume from the longest cached prefix of its permutation
+// Each trie node holds the cumulative cost after its gene and the secondary cells newly suppressed by it
+class PrefixCache {
+
+public:
+    PrefixCache();
+    ~PrefixCache();
+
+    // Find the longest cached prefix of genes and return its length
+    // costs, cells and offsets receive the cost after each prefix gene, the suppressed secondary cells in suppression order and the number of cells suppressed after each prefix gene
+    int lookup(const int *genes, int size, double *costs, CellIndex *cells, CellIndex *offsets);
+
+    // Record the results of a run over the first length genes, in the same form as returned by lookup
+    void insert(const int *genes, int length, const double *costs, const CellIndex *cells, const CellIndex *offsets);
+
+    // Statistics for log messages
+    long long genes_reused;
+    long long genes_solved;
+    int clears;
+
+private:
+    struct Node {
+        int gene;
+        double cost;
+        CellIndex number_of_cells;
+        CellIndex *cells;
+        struct Node *child;
+        struct Node *sibling;
+    };
+
+    struct Node root;
+    long long memory_used;
+    std::mutex mutex;
+
+    struct Node *find_child(struct Node *parent, int gene);
+    void clear();
+
+};
@@ -2,7 +2,8 @@
 #include <stdlib.h>
 #include <time.h>
 #include <UWECellSuppression.h>
-#include "Solver.h"
+#include "LPSolver.h"
+#include "PrefixCache.h"
 #ifndef UWEVERSION
 #define UWEVERSION "1.7.0"
 #endif
@@ -11,19 +12,24 @@
 bool debugging = false;
 Logger *logger = NULL;
 System sys;
+Profiler profiler;
 
 char session[64];
 char injjfilename[MAX_FILENAME_SIZE];
 char outjjfilename[MAX_FILENAME_SIZE];
 char permfilename[MAX_FILENAME_SIZE];
 char costfilename[MAX_FILENAME_SIZE];
+char telemetryfilename[MAX_FILENAME_SIZE];
 int protection = INDIVIDUAL_PROTECTION;
 int model = FULL_MODEL;
 double max_cost = 0.0;
+int batch_size = 0; // Number of permutations in the permutation file, or zero for a single permutation without a max_cost line
 
 void setKeyValue(const char *key, const char *value) {
     if (sys.string_case_compare(key, "session") == 0) {
         // Ignore
+    } else if (sys.string_case_compare(key, "jj") == 0) {
+        // Ignore - the server passes the stored model as the input file
     } else if (sys.string_case_compare(key, "infile") == 0) {
         if (strlen(value) < MAX_FILENAME_SIZE) {
             if (*value == '\0') {
@@ -60,6 +66,12 @@ void setKeyValue(const char *key, const char *value) {
         } else {
             logger->error(116, "Cost file name too long: %s", value);
         }
+    } else if (sys.string_case_compare(key, "telemetryfile") == 0) {
+        if (strlen(value) < MAX_FILENAME_SIZE) {
+            strcpy(telemetryfilename, value);
+        } else {
+            logger->error(120, "Telemetry file name too long: %s", value);
+        }
     } else if (sys.string_case_compare(key, "protection") == 0) {
         if (sys.string_case_compare(value, "individual") == 0) {
             protection = INDIVIDUAL_PROTECTION;
@@ -78,6 +90,10 @@ void setKeyValue(const char *key, const char *value) {
         } else {
             logger->error(106, "Invalid model type: %s", value);
         }
+    } else if (sys.string_case_compare(key, "count") == 0) {
+        if ((sscanf(value, "%d", &batch_size) != 1) || (batch_size < 1)) {
+            logger->error(121, "Invalid batch size: %s", value);
+        }
     } else if (sys.string_case_compare(key, "maxcost") == 0) {
         if (sscanf(value, "%lf", &max_cost) != 1) {
             logger->error(119, "Invalid maximum cost: %s", value);
@@ -87,13 +103,78 @@ void setKeyValue(const char *key, const char *value) {
     }
 }
 
+// Run each permutation of a batch in turn on the same model, writing the costs of them all to the cost file and the JJ file of each to the
+// output file name followed by its index
+// The model is built once, and each permutation resumes from the longest prefix it shares with an earlier one
+// Returns the final cost of the last permutation
+double run_batch(LPSolver *solver) {
+    PrefixCache *prefix_cache = new PrefixCache();
+    solver->set_persistent(true);
+    solver->set_prefix_cache(prefix_cache);
+
+    int number_of_genes = solver->get_number_of_groups();
+    double *max_costs = new double[batch_size];
+    int *permutations = solver->read_batch_file(permfilename, batch_size, max_costs);
+
+    FILE *ofp;
+
+    if ((ofp = fopen(costfilename, "w")) == NULL) {
+        logger->error(302, "Unable to create file: %s", costfilename);
+    }
+
+    SolverTelemetry batch_telemetry;
+    double result = 0.0;
+
+    for (int k = 0; k < batch_size; k++) {
+        const int *permutation = &permutations[(size_t)k * number_of_genes];
+        double *costs;
+        int costs_size;
+
+        if (protection == INDIVIDUAL_PROTECTION) {
+            costs = solver->run_individual_protection(permutation, model, max_costs[k], &costs_size);
+        } else {
+            costs = solver->run_group_protection(permutation, model, max_costs[k], &costs_size);
+        }
+
+        fprintf(ofp, "%d\n", costs_size);
+        for (int i = 0; i < costs_size; i++) {
+            fprintf(ofp, "%lf\n", costs[i]);
+        }
+
+        char filename[MAX_FILENAME_SIZE + 16];
+        sprintf(filename, "%s.%d", outjjfilename, k);
+        solver->write_jj_file(filename);
+
+        batch_telemetry.add(solver->get_telemetry());
+        result = costs[costs_size - 1];
+        logger->log(3, "Permutation %d result: %lf", k, result);
+
+        delete[] costs;
+    }
+
+    fclose(ofp);
+
+    *solver->get_telemetry() = batch_telemetry;
+
+    solver->set_prefix_cache(NULL);
+    solver->set_persistent(false);
+
+    delete prefix_cache;
+    delete[] permutations;
+    delete[] max_costs;
+
+    return result;
+}
+
 int main(int argc, char *argv[]) {
     injjfilename[0] = '\0';
     outjjfilename[0] = '\0';
     permfilename[0] = '\0';
     costfilename[0] = '\0';
+    telemetryfilename[0] = '\0';
 
     time_t startTime = time(NULL);
+    double start_wall_time = sys.wall_time();
 
     char log_file_name[MAX_FILENAME_SIZE];
     sprintf(log_file_name, "Solver%dLog.txt", sys.get_process_id());
@@ -154,26 +235,40 @@ int main(int argc, char *argv[]) {
         setKeyValue(key, value);
     }
 
-    Solver *solver = new Solver(injjfilename, (protection == GROUP_PROTECTION));
+    LPSolver *solver = new LPSolver(injjfilename, (protection == GROUP_PROTECTION));
 
     logger->log(3, "%d groups", solver->get_number_of_groups());
 
-    double* costs;
-    int costs_size;
-    if (protection == INDIVIDUAL_PROTECTION) {
-        costs = solver->run_individual_protection(permfilename, model, max_cost, &costs_size);
+    double result;
+    if (batch_size > 0) {
+        result = run_batch(solver);
     } else {
-        costs = solver->run_group_protection(permfilename, model, max_cost, &costs_size);
-    }
+        double* costs;
+        int costs_size;
+        if (protection == INDIVIDUAL_PROTECTION) {
+            costs = solver->run_individual_protection(permfilename, model, max_cost, &costs_size);
+        } else {
+            costs = solver->run_group_protection(permfilename, model, max_cost, &costs_size);
+        }
+
+        solver->write_cost_file(costfilename, costs, costs_size);
+        solver->write_jj_file(outjjfilename);
 
-    solver->write_cost_file(costfilename, costs, costs_size);
+        result = costs[costs_size - 1];
+        delete[] costs;
+    }
 
     time_t now = time(NULL);
     int elapsedTime = (int)(now - startTime);
 
-    solver->write_jj_file(outjjfilename);
+    // Telemetry is optional so that the solver can still be run by older servers
+    if (telemetryfilename[0] != '\0') {
+        SolverTelemetry *telemetry = solver->get_telemetry();
+        telemetry->run_time = sys.wall_time() - start_wall_time;
+        telemetry->write_file(telemetryfilename);
+    }
 
-    logger->log(3, "Result: %lf", costs[costs_size  - 1]);
+    logger->log(3, "Result: %lf", result);
     logger->log(3, "Elapsed time: %d", elapsedTime);
     logger->log(3, "Done");
 
@@ -182,9 +277,8 @@ int main(int argc, char *argv[]) {
     delete logger;
 
     // This is the only output allowed to the original stdout
-    printf("%lf %d", costs[costs_size - 1], elapsedTime);
+    printf("%lf %d", result, elapsedTime);
 
-    delete[] costs;
     delete solver;
 
     exit(0);
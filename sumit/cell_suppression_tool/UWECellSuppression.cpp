@@ -9,7 +9,10 @@
 #include <Unpicker.h>
 #include <Eliminate.h>
 #include <ServerConnection.h>
+#include <RemoteEvaluationBackend.h>
+#include <FarmEvaluationBackend.h>
 #include <ProgressLog.h>
+#include <BudgetScheduler.h>
 #include <Partitioning.h>
 #include <NoPartitioning.h>
 #include <LegacyTabularPartitioning.h>
@@ -39,6 +42,10 @@
 #include <HMETISPartitioning.h>
 #endif
 
+#if USE_LOCAL_SOLVER
+#include <LocalEvaluationBackend.h>
+#endif
+
 
 struct Arg : public option::Arg {
 
@@ -94,11 +101,15 @@ struct Arg : public option::Arg {
 };
 
 enum optionIndex {
-    UNKNOWN, CONSTRUCTIVE, CSV, DEBUGGING, HELP, CORES, GAELIMINATION, GROUPTHRESHOLD, ITERATIONS, LINREGRESS,LOGLEVEL, NOCOSTLIMIT, PARTITIONING, PARTITION1, PARTITION2, PORT, SERVER, SEED, SILENT, TABLE
+    UNKNOWN, BACKEND, BATCH, CACHEEVICTION, CACHEMEMORY, CONSTRUCTIVE, CSV, DEBUGGING, HELP, CORES, GAELIMINATION, GROUPTHRESHOLD, ITERATIONS, LINREGRESS,LOGLEVEL, NOCOSTLIMIT, PARTITIONING, PARTITIONTHREADS, PARTITION1, PARTITION2, PORT, PROFILE, SERVER, SEED, SILENT, STEADYSTATE, TABLE
 };
 
 const option::Descriptor usage[] = {
     { UNKNOWN, 0, "", "", Arg::Unknown, "Usage: UWECellSuppression [options]\n\nOptions:"},
+    { BACKEND, 0, "", "backend", Arg::NonEmpty, "\t--backend\tSolver backend: server or local (default server)."},
+    { BATCH, 0, "", "batch", Arg::Numeric, "\t--batch\tNumber of yplus evaluations run by one solver (default 1)."},
+    { CACHEEVICTION, 0, "", "cacheeviction", Arg::NonEmpty, "\t--cacheeviction\tEvaluation cache eviction policy: lru or fitness (default lru)."},
+    { CACHEMEMORY, 0, "", "cachememory", Arg::Numeric, "\t--cachememory\tEvaluation cache memory budget in MB, including cached JJ files (default 1024)."},
     {  CONSTRUCTIVE, 0, "", "constructive", Arg::None,"\t--constructive\tSelect tree-based constructive algorithm"},
     { CORES, 0, "", "cores", Arg::Numeric, "\t--cores\tNumber of CPU cores to use (default automatic)."},
     { CSV, 0, "", "csv", Arg::None, "\t--csv  \tWrite CSV output file (default JJ files only)."},
@@ -111,12 +122,15 @@ const option::Descriptor usage[] = {
     { LOGLEVEL, 0, "l", "loglevel", Arg::Numeric, "\t-l --loglevel\tLogging level to use (default 0)."},
     { NOCOSTLIMIT, 0, "", "nocostlimit", Arg::None, "\t--nocostlimit\tAlways run the solver to completion."},
     { PARTITIONING, 0, "", "partitioning", Arg::NonEmpty, "\t--partitioning\tPartitioning algorithm (default none)."},
+    { PARTITIONTHREADS, 0, "", "partitionthreads", Arg::Numeric, "\t--partitionthreads\tNumber of partitions protected at once (default one per solver slot)."},
     { PARTITION1, 0, "", "part1", Arg::NonEmpty, "\t--part1\tPartition parameter 1 (legacy partitioning only)."},
     { PARTITION2, 0, "", "part2", Arg::NonEmpty, "\t--part2\tPartition parameter 2 (legacy partitioning only)."},
-    { PORT, 0, "", "port", Arg::NonEmpty, "\t--port\tServer port (default 1081)."},
+    { PORT, 0, "", "port", Arg::NonEmpty, "\t--port\tServer port, for servers listed without one (default 1081)."},
+    { PROFILE, 0, "", "profile", Arg::NonEmpty, "\t--profile\tWrite the time and memory used by each stage to this JSON file at exit."},
     { SEED, 0, "", "seed", Arg::Numeric, "\t--seed\tSeed for random number generator."},
-    { SERVER, 0, "", "server", Arg::NonEmpty, "\t--server\tServer name or IP address (default localhost)."},
+    { SERVER, 0, "", "server", Arg::NonEmpty, "\t--server\tServer name or IP address, or a comma-separated list of them, each with an optional :port, to share the solvers between (default localhost)."},
     { SILENT, 0, "s", "silent", Arg::None, "\t-s --silent\tNo console progress display."},
+    { STEADYSTATE, 0, "", "steadystate", Arg::None, "\t--steadystate\tSelect the steady-state GA (keeps every solver busy)."},
     { TABLE, 0, "", "table", Arg::NonEmpty, "\t--table\tTable input file (TAB or JJ format)."},
     { 0, 0, 0, 0, 0, 0}
 };
@@ -124,6 +138,7 @@ const option::Descriptor usage[] = {
 bool debugging = false;
 Logger* logger = NULL;
 System sys;
+Profiler profiler;
 ProgressLog* plog = NULL;
 
 #define SAVE_BEST 1
@@ -141,9 +156,14 @@ char partitioning_algorithm[MAX_KEY_SIZE];
 char partition_by_1[MAX_KEY_SIZE];
 char partition_by_2[MAX_KEY_SIZE];
 
-char server[MAX_HOST_NAME_SIZE];
+char server[MAX_FARM_LIST_SIZE];
 char port[MAX_PORT_NUMBER_SIZE];
 
+char profile_filename[MAX_FILENAME_SIZE];
+
+char backend_name[MAX_KEY_SIZE];
+EvaluationBackend* backend = NULL;
+
 unsigned int seed = 0;
 unsigned int cores = 0;
 int groupThreshold = 151;
@@ -155,6 +175,11 @@ int total_counted_evals=0;
 int logLevel = 0;
 bool csv_output = false;
 bool no_cost_limit = false;
+bool steady_state = false;
+int cache_memory = DEFAULT_CACHE_BUDGET_MB;
+int cache_eviction = EVICTION_LRU;
+int partition_threads = 0;
+int batch_size = 1;
 
 bool tabular_format = false; // Whether the input file is in TAB format (else JJ)
 bool legacy_partitioning = false; // Whether legacy tabular partitioning is in use
@@ -236,6 +261,36 @@ bool parseInputs(int argc, char *argv[])
 
         switch (opt.index()) {
 
+            case BACKEND:
+                logger->log(1, "Backend: %s", opt.arg);
+                if (strlen(opt.arg) < MAX_KEY_SIZE) {
+                    strcpy(backend_name, opt.arg);
+                } else {
+                    logger->error(1, "Backend key name is too long");
+                }
+                break;
+
+            case BATCH:
+                logger->log(1, "Batch size: %s", opt.arg);
+                sscanf(opt.arg, "%d", &batch_size);
+                break;
+
+            case CACHEEVICTION:
+                logger->log(1, "Cache eviction: %s", opt.arg);
+                if (sys.string_case_compare(opt.arg, "lru") == 0) {
+                    cache_eviction = EVICTION_LRU;
+                } else if (sys.string_case_compare(opt.arg, "fitness") == 0) {
+                    cache_eviction = EVICTION_FITNESS;
+                } else {
+                    logger->error(1, "Unknown cache eviction policy %s", opt.arg);
+                }
+                break;
+
+            case CACHEMEMORY:
+                logger->log(1, "Cache memory: %s MB", opt.arg);
+                sscanf(opt.arg, "%d", &cache_memory);
+                break;
+
             case CONSTRUCTIVE:
                 logger->log(1,"Tree-Based Constructive");
                 gaConstructive = true;
@@ -295,6 +350,11 @@ bool parseInputs(int argc, char *argv[])
                 }
                 break;
 
+            case PARTITIONTHREADS:
+                logger->log(1, "Partition threads: %s", opt.arg);
+                sscanf(opt.arg, "%d", &partition_threads);
+                break;
+
             case PARTITION1:
                 logger->log(1, "Part1: %s", opt.arg);
                 if (strlen(opt.arg) < MAX_KEY_SIZE) {
@@ -322,9 +382,19 @@ bool parseInputs(int argc, char *argv[])
                 }
                 break;
 
+            case PROFILE:
+                logger->log(1, "Profile file: %s", opt.arg);
+                if (strlen(opt.arg) < MAX_FILENAME_SIZE) {
+                    strcpy(profile_filename, opt.arg);
+                    profiler.enable();
+                } else {
+                    logger->error(1, "Profile file name is too long");
+                }
+                break;
+
             case SERVER:
                 logger->log(1, "Server: %s", opt.arg);
-                if (strlen(opt.arg) < MAX_HOST_NAME_SIZE) {
+                if (strlen(opt.arg) < MAX_FARM_LIST_SIZE) {
                     strcpy(server, opt.arg);
                 } else {
                     logger->error(1, "Server key name is too long");
@@ -341,6 +411,11 @@ bool parseInputs(int argc, char *argv[])
                 silent = true;
                 break;
 
+            case STEADYSTATE:
+                logger->log(1, "Steady-state GA");
+                steady_state = true;
+                break;
+
             case TABLE:
                 logger->log(1, "Table file: %s", opt.arg);
                 size_t len = strlen(opt.arg);
@@ -392,22 +467,50 @@ void Standard_Inits(void)
 
     tableFilename[0] = '\0';
     metadataFilename[0] = '\0';
+    profile_filename[0] = '\0';
 
     partitioning_algorithm[0] = '\0';
     partition_by_1[0] = '\0';
     partition_by_2[0] = '\0';
 
+    strcpy(backend_name, "server");
+}
+
+EvaluationBackend* CreateEvaluationBackend(void)
+{
+    if (sys.string_case_compare(backend_name, "server") == 0) {
+        // A list of servers, or a server on a port of its own, is a farm
+        if ((strchr(server, ',') != NULL) || (strchr(server, ':') != NULL)) {
+            return new FarmEvaluationBackend(server, port);
+        }
+        return new RemoteEvaluationBackend(server, port);
+    }
+    else if (sys.string_case_compare(backend_name, "local") == 0) {
+        #if USE_LOCAL_SOLVER
+        return new LocalEvaluationBackend((cores != 0)? cores: std::thread::hardware_concurrency());
+        #else
+        logger->error(1, "Local solver backend not supported in this version");
+        #endif
+    }
+    else {
+        logger->error(1, "Unknown backend %s", backend_name);
+    }
+
+    // Keep the compiler from complaining
+    return NULL;
 }
 
 PartitionData*  makePartitionFiles(int *number_of_partitions)
 {
     int numbermade=0;
     logger->log(1, "Partitioning");
+    ScopedTimer timer("Partitioning");
 
     Partitioning* partitioning;
 
     // Convert TAB file input data to JJ format
     if (tabular_format) {
+        ScopedTimer tabular_timer("TabularData");
         TabularData* tabular = new TabularData(metadataFilename, tabdataFilename);
         tabular->PrintJJFile(tableFilename);
         tabular->PrintJJFileMapping("Mapping.txt");
@@ -529,45 +632,59 @@ logger->log(3, "Total_allocated_execution_time: %d", total_allocated_execution_t
 
 void  CreateAndTestFirstSetOfSolutionsForPartition(PartitionData *partition, int i){
 logger->log(1, "Protect partition %d", i + 1);
+ScopedTimer timer("GA initialisation");
 
 
 #if USE_EXPERIMENTAL_GA
 
 if (gaConstructive==true  ) {
-    partition[i].protection = new ConstructiveGAProtection(server, port, partition[i].in_jj_file, partition[i].out_jj_file, partition[i].sam_file, seed, cores, partition[i].execution_time_seconds, gaElimination);
+    partition[i].protection = new ConstructiveGAProtection(backend, partition[i].in_jj_file, partition[i].out_jj_file, partition[i].sam_file, seed, cores, partition[i].execution_time_seconds, gaElimination);
 }
 else if (gaLinRegress==true ) {
-        partition[i].protection = new LinRegressGAProtection(server, port, partition[i].in_jj_file, partition[i].out_jj_file, partition[i].sam_file, seed, cores, partition[i].execution_time_seconds, gaElimination);
+        partition[i].protection = new LinRegressGAProtection(backend, partition[i].in_jj_file, partition[i].out_jj_file, partition[i].sam_file, seed, cores, partition[i].execution_time_seconds, gaElimination);
     }
 else if (partition[i].number_of_primary_cells < groupThreshold)
 {
-    partition[i].protection = new IncrementalGAProtection(server, port, partition[i].in_jj_file, partition[i].out_jj_file, partition[i].sam_file, seed, cores, partition[i].execution_time_seconds, gaElimination);
+    partition[i].protection = new IncrementalGAProtection(backend, partition[i].in_jj_file, partition[i].out_jj_file, partition[i].sam_file, seed, cores, partition[i].execution_time_seconds, gaElimination);
 }
 else
 {
-    partition[i].protection = new GroupedGAProtection(server, port, partition[i].in_jj_file, partition[i].out_jj_file, partition[i].sam_file, seed, cores, partition[i].execution_time_seconds, gaElimination);
+    partition[i].protection = new GroupedGAProtection(backend, partition[i].in_jj_file, partition[i].out_jj_file, partition[i].sam_file, seed, cores, partition[i].execution_time_seconds, gaElimination);
 }
 
 #else
 if (partition[i].number_of_primary_cells < groupThreshold)
 {
-    partition[i].protection = new IncrementalGAProtection(server, port, partition[i].in_jj_file, partition[i].out_jj_file, partition[i].sam_file, seed, cores, partition[i].execution_time_seconds, gaElimination);
+    partition[i].protection = new IncrementalGAProtection(backend, partition[i].in_jj_file, partition[i].out_jj_file, partition[i].sam_file, seed, cores, partition[i].execution_time_seconds, gaElimination);
 }
 else
 {
-    partition[i].protection = new GroupedGAProtection(server, port, partition[i].in_jj_file, partition[i].out_jj_file, partition[i].sam_file, seed, cores, partition[i].execution_time_seconds, gaElimination);
+    partition[i].protection = new GroupedGAProtection(backend, partition[i].in_jj_file, partition[i].out_jj_file, partition[i].sam_file, seed, cores, partition[i].execution_time_seconds, gaElimination);
 }
 #endif
 
-
+partition[i].protection->set_steady_state(steady_state);
+partition[i].protection->set_batch_size(batch_size);
+partition[i].protection->set_cache_budget((long long)cache_memory * 1024 * 1024, cache_eviction);
 
 
 partition[i].cost = partition[i].protection->fitness();
 }
 
 
+// Number of partitions whose GAs run at once
+// Partitions spend most of their time waiting for solvers, and all of them share the backend's solver slots, so by default there is one
+// for each slot that a partition could be using
+int PartitionThreads(int number_of_partitions)
+{
+    int threads = (partition_threads > 0)? partition_threads: backend->getLimit();
+
+    return MAX(1, MIN(threads, number_of_partitions));
+}
+
 void UnpickFile(char *jj_filename, double cost)
 {
+    ScopedTimer timer("Unpick");
     Unpicker* unpicker = new Unpicker(jj_filename);
     unpicker->Attack();
     char log_message[200];
@@ -592,6 +709,7 @@ void UnpickFile(char *jj_filename, double cost)
 void RecombinePartitionsAndTestResultforThisIteration( PartitionData *partition,int number_of_partitions, int iteration)
 {
     logger->log(1, "Recombine partitions");
+    ScopedTimer timer("Recombination");
 
     sprintf(recombined_jj_filename, "Recombined_%05d.jj", iteration);
 
@@ -702,6 +820,7 @@ void RemoveUnneededFiles(void){
 
 void Elimination(char *recombined_jj_filename){
     logger->log(1, "Eliminate");
+    ScopedTimer timer("Elimination");
 
     double cost_after_elimination = 0.0;
 #if USE_SMALLER_ELIMINATION
@@ -743,14 +862,27 @@ int main(int argc, char* argv[]) {
     // Switch off console output if required
     logger->consoleSummary(! silent);
 
+    backend = CreateEvaluationBackend();
+
     // Create one or more partitions: each with its own JJ and mapping files, and holding its own state
     PartitionData* partition = makePartitionFiles(&number_of_partitions);
     AllocatePartitionRuntimes( partition,  number_of_partitions );
 
 
+    int threads = PartitionThreads(number_of_partitions);
+    if (number_of_partitions > 1) {
+        logger->log(3, "Protecting up to %d of %d partitions at once", threads, number_of_partitions);
+    }
+
     // Initial evaluation of each partition to create first set of partial solutions
+    sys.parallel_for(number_of_partitions, threads, [partition](int i) {
+        CreateAndTestFirstSetOfSolutionsForPartition(partition, i);
+    });
+
+    // Time left by partitions that finish or converge early goes to those still improving
+    BudgetScheduler *budget_scheduler = new BudgetScheduler(plog);
     for (int i = 0; i < number_of_partitions; i++) {
-            CreateAndTestFirstSetOfSolutionsForPartition(partition, i);
+        budget_scheduler->add(partition[i].protection);
     }
 
 
@@ -763,15 +895,32 @@ int main(int argc, char* argv[]) {
         logger->log(1, "Iteration %d", iteration);
         total_counted_evals=0;
         done = true;
-        for (int i = 0; i < number_of_partitions; i++) {
 
-            //each partition gets its own allocation of runtime since some may be faster to iterate
-            if (! partition[i].protection->time_to_terminate()) {
-                if (iteration > 0) {
-                    //run next generation of EA optimisation to create new partial solutions
-                    partition[i].protection->protect(! no_cost_limit);
-                    partition[i].cost = partition[i].protection->fitness();
+        //each partition gets its own allocation of runtime since some may be faster to iterate
+        //the generations of all partitions with time left run at once, sharing the backend's solver slots
+        std::vector<char> running(number_of_partitions);
+        sys.parallel_for(number_of_partitions, threads, [partition, number_of_partitions, iteration, &running](int i) {
+            running[i] = ! partition[i].protection->time_to_terminate();
+            if (running[i] && (iteration > 0)) {
+                //run next generation of EA optimisation to create new partial solutions
+                ScopedTimer timer("GA generation");
+                partition[i].protection->protect(! no_cost_limit);
+
+                // Steady-state evaluations left running would hold solver slots needed by the other partitions
+                if (number_of_partitions > 1) {
+                    partition[i].protection->finish_evaluations();
                 }
+
+                partition[i].cost = partition[i].protection->fitness();
+            }
+        });
+
+        if (number_of_partitions > 1) {
+            budget_scheduler->rebalance();
+        }
+
+        for (int i = 0; i < number_of_partitions; i++) {
+            if (running[i]) {
                 done = false;
                 total_counted_evals = total_counted_evals + partition[i].protection->number_of_evaluations();
             }
@@ -802,7 +951,10 @@ int main(int argc, char* argv[]) {
         iteration++;
     } while (! done);
 
+    delete budget_scheduler;
+
     CleanupPartitions(partition, number_of_partitions);//do this here as the post processign can be memory-hungry
+    delete backend;
 
     // Elimination Post processing to optimise final solution
     Elimination(recombined_jj_filename);
@@ -811,6 +963,11 @@ int main(int argc, char* argv[]) {
     // Finish up
     RemoveUnneededFiles();
     logger->log(1, "Total elapsed time %d seconds", (long)(time(NULL) - start_time));
+
+    if (profiler.enabled()) {
+        profiler.write_json_file(profile_filename);
+    }
+
     logger->log(1, "Done");
     delete logger;
     delete plog;
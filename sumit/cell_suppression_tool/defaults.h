@@ -9,5 +9,10 @@ default settings for cell suppression
 #define USE_HMETIS 0
 #define USE_KAHYPAR 0
 
+// Set by the LOCAL_SOLVER build option
+#ifndef USE_LOCAL_SOLVER
+#define USE_LOCAL_SOLVER 0
+#endif
+
 
 int TOTAL_EXECUTION_TIME= 3600;
@@ -0,0 +1,58 @@
+#include <stdafx.h>
+#include <string.h>
+#include <time.h>
+#include <UWECellSuppression.h>
+#include <JJData.h>
+
+// Converts a JJ file between the text and binary formats
+// Usage: jj_converter [--binary | --text] infile outfile
+// Without an option the output is in the other format to the input
+
+bool debugging = false;
+Logger *logger = NULL;
+System sys;
+Profiler profiler;
+
+int main(int argc, char *argv[]) {
+    logger = new Logger(1, "JJConverterLog.txt");
+    logger->log(1, "JJ converter v%s", VERSION);
+
+    int arg = 1;
+    int format = 0;
+
+    if ((argc > 1) && (strcmp(argv[1], "--binary") == 0)) {
+        format = 1;
+        arg++;
+    } else if ((argc > 1) && (strcmp(argv[1], "--text") == 0)) {
+        format = 2;
+        arg++;
+    }
+
+    if (argc - arg != 2) {
+        logger->error(1, "Usage: jj_converter [--binary | --text] infile outfile");
+    }
+
+    const char *infilename = argv[arg];
+    const char *outfilename = argv[arg + 1];
+
+    if (format == 0) {
+        format = JJData::is_binary_jj_file(infilename)? 2: 1;
+    }
+
+    time_t start_time = time(NULL);
+
+    JJData *jjData = new JJData(infilename);
+
+    if (format == 1) {
+        jjData->write_binary_jj_file(outfilename);
+    } else {
+        jjData->write_jj_file(outfilename);
+    }
+
+    logger->log(1, "Wrote %s JJ file %s (%d cells, %d equations) in %d seconds", (format == 1)? "binary": "text", outfilename, jjData->ncells, jjData->nsums, (int)(time(NULL) - start_time));
+
+    delete jjData;
+    delete logger;
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include "stdafx.h"
+#include "Arena.h"
+
+Arena::Arena(size_t block_size) {
+    this->block_size = block_size;
+    allocated = 0;
+}
+
+Arena::~Arena() {
+    release();
+}
+
+// Blocks come from new char[], which is aligned for any fundamental type, so aligning the offset within the block is enough
+void* Arena::allocate_bytes(size_t bytes, size_t alignment) {
+    if (!blocks.empty()) {
+        Block *block = &blocks.back();
+        size_t offset = (block->used + alignment - 1) & ~(alignment - 1);
+
+        if (offset + bytes <= block->size) {
+            block->used = offset + bytes;
+            allocated += bytes;
+            return block->memory + offset;
+        }
+    }
+
+    Block block;
+
+    block.size = MAX(block_size, bytes);
+    block.memory = new char[block.size];
+    block.used = bytes;
+    blocks.push_back(block);
+
+    allocated += bytes;
+
+    return block.memory;
+}
+
+void Arena::release() {
+    for (size_t i = 0; i < blocks.size(); i++) {
+        delete[] blocks[i].memory;
+    }
+
+    blocks.clear();
+    allocated = 0;
+}
+
+size_t Arena::bytes_allocated() {
+    return allocated;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "stdafx.h"
+#include <cstddef>
+#include <vector>
+
+// Size of each block of memory taken from the heap, unless a single allocation needs more
+#define ARENA_BLOCK_SIZE (1 << 20)
+
+// Bump allocator for arrays of plain structures that are all freed together
+// Memory is handed out from large blocks in turn and is only returned to the heap by release() or the destructor, so no constructors or
+// destructors are run for the objects in it
+class Arena {
+
+public:
+    Arena(size_t block_size = ARENA_BLOCK_SIZE);
+    ~Arena();
+
+    template <typename T>
+    T* allocate(size_t n) {
+        return (T*)allocate_bytes(n * sizeof(T), alignof(T));
+    }
+
+    void release();
+    size_t bytes_allocated();
+
+private:
+    struct Block {
+        char *memory;
+        size_t size;
+        size_t used;
+    };
+
+    std::vector<Block> blocks;
+    size_t block_size;
+    size_t allocated;
+
+    void* allocate_bytes(size_t bytes, size_t alignment);
+
+};
@@ -0,0 +1,22 @@
+#include "stdafx.h"
+#include "Barrier.h"
+
+Barrier::Barrier(int count) {
+    this->count = count;
+    waiting = 0;
+    generation = 0;
+}
+
+void Barrier::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    unsigned long arrival_generation = generation;
+
+    if (++waiting == count) {
+        waiting = 0;
+        generation++;
+        released.notify_all();
+        return;
+    }
+
+    released.wait(lock, [this, arrival_generation]() { return generation != arrival_generation; });
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "stdafx.h"
+#include <mutex>
+#include <condition_variable>
+
+// Holds each of a fixed team of threads at wait() until every member of the team has arrived
+// The barrier may be reused as soon as it has released the team
+class Barrier {
+
+public:
+    Barrier(int count);
+    void wait();
+
+private:
+    std::mutex mutex;
+    std::condition_variable released;
+    int count;
+    int waiting;
+    unsigned long generation;
+
+};
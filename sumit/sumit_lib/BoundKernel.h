@@ -0,0 +1,205 @@
+#pragma once
+
+#include "stdafx.h"
+#include <cstdint>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Bound tightening for one consistency equation, the sum of sign[k] * x[cell[k]] equal to RHS, shared by Unpicker and Eliminate
+// Solving for cell j gives it the lower bound sign[j] * RHS plus the lower bounds of the cells with the other sign less the upper bounds of
+// the other cells with the same sign, and the upper bound with lower and upper swapped
+// Cells are solved in turn, and each new bound is passed to update(cell, bound), which applies it and returns false to stop, so the cells
+// after it see the new bound
+
+template <typename T>
+struct Bounds {
+    T lower;
+    T upper;
+};
+
+// Floating point sums are taken in the same order as the original loops, so bounds are unchanged to the last bit
+template <typename T>
+class BoundKernel {
+public:
+    template <typename Update>
+    static bool tighten_lower_bounds(T RHS, const int *cell, const int *sign, int size, Bounds<T> *bounds, Update update) {
+        for (int j = 0; j < size; j++) {
+            T result = (sign[j] == 1)? RHS: -RHS;
+
+            for (int k = 0; k < size; k++) {
+                if ((k != j) && (sign[k] != sign[j])) {
+                    result = result + bounds[cell[k]].lower;
+                }
+            }
+
+            for (int k = 0; k < size; k++) {
+                if ((k != j) && (sign[k] == sign[j])) {
+                    result = result - bounds[cell[k]].upper;
+                }
+            }
+
+            if (bounds[cell[j]].lower < result) {
+                if (!update(cell[j], result)) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    template <typename Update>
+    static bool tighten_upper_bounds(T RHS, const int *cell, const int *sign, int size, Bounds<T> *bounds, Update update) {
+        for (int j = 0; j < size; j++) {
+            T result = (sign[j] == 1)? RHS: -RHS;
+
+            for (int k = 0; k < size; k++) {
+                if ((k != j) && (sign[k] != sign[j])) {
+                    result = result + bounds[cell[k]].upper;
+                }
+            }
+
+            for (int k = 0; k < size; k++) {
+                if ((k != j) && (sign[k] == sign[j])) {
+                    result = result - bounds[cell[k]].lower;
+                }
+            }
+
+            if (bounds[cell[j]].upper > result) {
+                if (!update(cell[j], result)) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+};
+
+// Integer sums are exact in any order, so the bounds of each sign are totalled once and each cell's own term taken back out, which is
+// linear rather than quadratic in the size of the equation
+// Totals are kept unsigned so that an intermediate overflow wraps as it did in the original loops
+template <>
+class BoundKernel<int_fast64_t> {
+public:
+    template <typename Update>
+    static bool tighten_lower_bounds(int_fast64_t RHS, const int *cell, const int *sign, int size, Bounds<int_fast64_t> *bounds, Update update) {
+        uint64_t lower[2];
+        uint64_t upper[2];
+
+        sum_bounds(cell, sign, size, bounds, lower, upper);
+
+        for (int j = 0; j < size; j++) {
+            int same = (sign[j] == 1)? 0: 1;
+            uint64_t total = (uint64_t)((sign[j] == 1)? RHS: -RHS) + lower[1 - same] - (upper[same] - (uint64_t)bounds[cell[j]].upper);
+            int_fast64_t result = (int_fast64_t)total;
+
+            if (bounds[cell[j]].lower < result) {
+                Bounds<int_fast64_t> before = bounds[cell[j]];
+
+                if (!update(cell[j], result)) {
+                    return false;
+                }
+
+                adjust_sums(cell, sign, size, cell[j], before, bounds[cell[j]], lower, upper);
+            }
+        }
+
+        return true;
+    }
+
+    template <typename Update>
+    static bool tighten_upper_bounds(int_fast64_t RHS, const int *cell, const int *sign, int size, Bounds<int_fast64_t> *bounds, Update update) {
+        uint64_t lower[2];
+        uint64_t upper[2];
+
+        sum_bounds(cell, sign, size, bounds, lower, upper);
+
+        for (int j = 0; j < size; j++) {
+            int same = (sign[j] == 1)? 0: 1;
+            uint64_t total = (uint64_t)((sign[j] == 1)? RHS: -RHS) + upper[1 - same] - (lower[same] - (uint64_t)bounds[cell[j]].lower);
+            int_fast64_t result = (int_fast64_t)total;
+
+            if (bounds[cell[j]].upper > result) {
+                Bounds<int_fast64_t> before = bounds[cell[j]];
+
+                if (!update(cell[j], result)) {
+                    return false;
+                }
+
+                adjust_sums(cell, sign, size, cell[j], before, bounds[cell[j]], lower, upper);
+            }
+        }
+
+        return true;
+    }
+
+    // Totals of the lower and upper bounds of the cells with sign 1, in [0], and sign -1, in [1]
+    static void sum_bounds(const int *cell, const int *sign, int size, const Bounds<int_fast64_t> *bounds, uint64_t lower[2], uint64_t upper[2]) {
+        int k = 0;
+
+        lower[0] = lower[1] = 0;
+        upper[0] = upper[1] = 0;
+
+#if defined(__AVX2__)
+        // Four terms at a time, gathering the bounds of each cell as two 64-bit words from cell * 2
+        static_assert(sizeof(Bounds<int_fast64_t>) == 2 * sizeof(long long), "Bounds must be two 64-bit words");
+
+        const long long *base = (const long long *)bounds;
+        __m256i one = _mm256_set1_epi64x(1);
+        __m256i lower_plus = _mm256_setzero_si256();
+        __m256i lower_minus = _mm256_setzero_si256();
+        __m256i upper_plus = _mm256_setzero_si256();
+        __m256i upper_minus = _mm256_setzero_si256();
+
+        for (; k + 4 <= size; k += 4) {
+            __m128i index = _mm_slli_epi32(_mm_loadu_si128((const __m128i *)(cell + k)), 1);
+            __m256i plus = _mm256_cmpeq_epi64(_mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(sign + k))), one);
+            __m256i l = _mm256_i32gather_epi64(base, index, 8);
+            __m256i u = _mm256_i32gather_epi64(base + 1, index, 8);
+
+            lower_plus = _mm256_add_epi64(lower_plus, _mm256_and_si256(plus, l));
+            lower_minus = _mm256_add_epi64(lower_minus, _mm256_andnot_si256(plus, l));
+            upper_plus = _mm256_add_epi64(upper_plus, _mm256_and_si256(plus, u));
+            upper_minus = _mm256_add_epi64(upper_minus, _mm256_andnot_si256(plus, u));
+        }
+
+        lower[0] = horizontal_sum(lower_plus);
+        lower[1] = horizontal_sum(lower_minus);
+        upper[0] = horizontal_sum(upper_plus);
+        upper[1] = horizontal_sum(upper_minus);
+#endif
+
+        for (; k < size; k++) {
+            int s = (sign[k] == 1)? 0: 1;
+
+            lower[s] += (uint64_t)bounds[cell[k]].lower;
+            upper[s] += (uint64_t)bounds[cell[k]].upper;
+        }
+    }
+
+private:
+    // A cell may appear in more than one term, so every term of the updated cell moves its total
+    static void adjust_sums(const int *cell, const int *sign, int size, int updated, Bounds<int_fast64_t> before, Bounds<int_fast64_t> after, uint64_t lower[2], uint64_t upper[2]) {
+        uint64_t lower_change = (uint64_t)after.lower - (uint64_t)before.lower;
+        uint64_t upper_change = (uint64_t)after.upper - (uint64_t)before.upper;
+
+        for (int k = 0; k < size; k++) {
+            if (cell[k] == updated) {
+                int s = (sign[k] == 1)? 0: 1;
+
+                lower[s] += lower_change;
+                upper[s] += upper_change;
+            }
+        }
+    }
+
+#if defined(__AVX2__)
+    static uint64_t horizontal_sum(__m256i v) {
+        __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+
+        return (uint64_t)_mm_cvtsi128_si64(sum) + (uint64_t)_mm_extract_epi64(sum, 1);
+    }
+#endif
+};
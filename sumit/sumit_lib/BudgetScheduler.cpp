@@ -0,0 +1,140 @@
+#include "stdafx.h"
+#include <stdarg.h>
+#include "BudgetScheduler.h"
+
+BudgetScheduler::BudgetScheduler(ProgressLog *plog) {
+    this->plog = plog;
+    spare_seconds = 0;
+}
+
+BudgetScheduler::~BudgetScheduler() {
+}
+
+// Partitions are numbered from one in the order they are added
+void BudgetScheduler::add(GAProtection *protection) {
+    Budget budget;
+
+    budget.protection = protection;
+    budget.fitness = protection->best_parent_fitness();
+    budget.evaluations = protection->number_of_evaluations();
+    budget.rate = 0.0;
+    budget.observed = false;
+    budget.released = false;
+
+    budgets.push_back(budget);
+}
+
+// Call between rounds of generations, when no GA is running
+void BudgetScheduler::rebalance() {
+    int number_of_budgets = (int)budgets.size();
+
+    // Release the time of the finished and converged partitions
+    for (int i = 0; i < number_of_budgets; i++) {
+        Budget *budget = &budgets[i];
+        GAProtection *protection = budget->protection;
+
+        measure(budget);
+
+        int limit = protection->get_time_limit();
+        int remaining = limit - protection->get_elapsed_seconds();
+
+        if (protection->has_terminated()) {
+            if (! budget->released) {
+                budget->released = true;
+
+                if (remaining > 0) {
+                    spare_seconds += remaining;
+                    protection->set_time_limit(limit - remaining);
+                    report("BUDGET> Partition %d finished, releasing %d s", i + 1, remaining);
+                }
+            }
+        } else if (protection->get_stable_generations() >= BUDGET_STABLE_GENERATIONS) {
+            // Keep half of the time above the minimum in case the GA finds a better region
+            int released = (remaining - BUDGET_MIN_REMAINING_SECONDS) / 2;
+
+            if (released > 0) {
+                spare_seconds += released;
+                protection->set_time_limit(limit - released);
+                report("BUDGET> Partition %d converged (stable for %d generations), releasing %d s, limit now %d s", i + 1, protection->get_stable_generations(), released, limit - released);
+            }
+        }
+    }
+
+    if (spare_seconds == 0) {
+        return;
+    }
+
+    // Share it between the partitions still improving
+    double total_rate = 0.0;
+    for (int i = 0; i < number_of_budgets; i++) {
+        if ((! budgets[i].protection->has_terminated()) && (budgets[i].rate > 0.0)) {
+            total_rate += budgets[i].rate;
+        }
+    }
+
+    if (total_rate <= 0.0) {
+        logger->log(3, "Budget scheduler holding %d s with no partition improving", spare_seconds);
+        return;
+    }
+
+    int given = 0;
+    for (int i = 0; i < number_of_budgets; i++) {
+        Budget *budget = &budgets[i];
+        GAProtection *protection = budget->protection;
+
+        if ((! protection->has_terminated()) && (budget->rate > 0.0)) {
+            int extra = (int)(spare_seconds * (budget->rate / total_rate));
+
+            if (extra > 0) {
+                protection->set_time_limit(protection->get_time_limit() + extra);
+                given += extra;
+                report("BUDGET> Partition %d improving (%.3g%% of cost per evaluation), given %d s, limit now %d s", i + 1, budget->rate * 100.0, extra, protection->get_time_limit());
+            }
+        }
+    }
+
+    // Rounding leaves a few seconds for the next round
+    spare_seconds -= given;
+}
+
+// Update the improvement rate from the change in best fitness since the last round
+void BudgetScheduler::measure(Budget *budget) {
+    GAProtection *protection = budget->protection;
+
+    double fitness = protection->best_parent_fitness();
+    int evaluations = protection->number_of_evaluations();
+
+    if (evaluations > budget->evaluations) {
+        double improvement = 0.0;
+
+        if (budget->fitness > FLOAT_PRECISION) {
+            improvement = (budget->fitness - fitness) / budget->fitness / (evaluations - budget->evaluations);
+        }
+
+        if (budget->observed) {
+            budget->rate = BUDGET_RATE_SMOOTHING * budget->rate + (1.0 - BUDGET_RATE_SMOOTHING) * improvement;
+        } else {
+            budget->rate = improvement;
+            budget->observed = true;
+        }
+
+        budget->fitness = fitness;
+        budget->evaluations = evaluations;
+    }
+}
+
+// Write a decision to both the progress log and the log file
+void BudgetScheduler::report(const char *fmt, ...) {
+    char message[256];
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+
+    logger->log(3, "%s", message);
+
+    if (plog != NULL) {
+        plog->write_log_message(message);
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "stdafx.h"
+#include <vector>
+#include "GAProtection.h"
+#include "ProgressLog.h"
+
+// A partition has converged once its best fitness has not changed for this many generations
+#define BUDGET_STABLE_GENERATIONS 20
+
+// and a converged partition keeps at least this many of its remaining seconds
+#define BUDGET_MIN_REMAINING_SECONDS 60
+
+// Weight of the previous improvement rate when smoothing the rate of each partition
+#define BUDGET_RATE_SMOOTHING 0.5
+
+// Moves the remaining solver time of partitions whose GAs have finished or converged to those still improving
+// Each partition starts with the time limit it was given, and after each round of generations the time released by the finished and
+// converged partitions is shared between the others in proportion to their recent relative drop in cost per evaluation
+// The decisions are reported in the progress log
+class BudgetScheduler {
+
+public:
+    BudgetScheduler(ProgressLog *plog);
+    ~BudgetScheduler();
+    void add(GAProtection *protection);
+    void rebalance();
+
+private:
+    struct Budget {
+        GAProtection *protection;
+        double fitness;
+        int evaluations;
+        double rate;        // Smoothed fraction of the cost removed per evaluation
+        bool observed;      // Whether the rate has been measured
+        bool released;      // Whether the time left by a finished GA has been released
+    };
+
+    std::vector<Budget> budgets;
+    int spare_seconds;      // Released time not yet given to any partition
+    ProgressLog *plog;
+
+    void measure(Budget *budget);
+    void report(const char *fmt, ...);
+
+};
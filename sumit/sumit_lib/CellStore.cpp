@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "CellStore.h"
+#include "ExchangeSort.h"
 
 CellStore::CellStore(JJData *jjData) {
     this->jjData = jjData;
@@ -40,60 +41,19 @@ void CellStore::store_all_potential_cells() {
     }
 }
 
-void CellStore::swap_stored_cells(CellIndex i, CellIndex j) {
-    CellIndex temp = cells[i];
-    cells[i] = cells[j];
-    cells[j] = temp;
-}
-
+// The orderings are the same as those of the original all pairs exchange sorts, which the GA seeds depend on, in O(n log n)
 void CellStore::order_cells_by_largest_protection_level() {
-    for (CellIndex i = 0; i < size; i++) {
-        for (CellIndex j = 0; j < size; j++) {
-            CellIndex k = cells[i];
-            CellIndex l = cells[j];
-
-            if (jjData->cells[k].upper_protection_level > jjData->cells[l].upper_protection_level) {
-                swap_stored_cells(i, j);
-            }
-        }
-    }
+    all_pairs_sort(cells, size, [this](CellIndex c) { return jjData->cells[c].upper_protection_level; });
 }
 
 void CellStore::order_cells_by_largest_weighting() {
-    for (CellIndex i = 0; i < size; i++) {
-        for (CellIndex j = 0; j < size; j++) {
-            CellIndex k = cells[i];
-            CellIndex l = cells[j];
-
-            if (jjData->cells[k].loss_of_information_weight > jjData->cells[l].loss_of_information_weight) {
-                swap_stored_cells(i, j);
-            }
-        }
-    }
+    all_pairs_sort(cells, size, [this](CellIndex c) { return jjData->cells[c].loss_of_information_weight; });
 }
 
 void CellStore::order_cells_by_smallest_protection_level() {
-    for (CellIndex i = 0; i < size; i++) {
-        for (CellIndex j = 0; j < size; j++) {
-            CellIndex k = cells[i];
-            CellIndex l = cells[j];
-
-            if (jjData->cells[k].upper_protection_level < jjData->cells[l].upper_protection_level) {
-                swap_stored_cells(i, j);
-            }
-        }
-    }
+    all_pairs_sort(cells, size, [this](CellIndex c) { return -jjData->cells[c].upper_protection_level; });
 }
 
 void CellStore::order_cells_by_smallest_weighting() {
-    for (CellIndex i = 0; i < size; i++) {
-        for (CellIndex j = 0; j < size; j++) {
-            CellIndex k = cells[i];
-            CellIndex l = cells[j];
-
-            if (jjData->cells[k].loss_of_information_weight < jjData->cells[l].loss_of_information_weight) {
-                swap_stored_cells(i, j);
-            }
-        }
-    }
+    all_pairs_sort(cells, size, [this](CellIndex c) { return -jjData->cells[c].loss_of_information_weight; });
 }
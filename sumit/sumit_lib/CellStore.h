@@ -23,6 +23,5 @@ private:
     JJData *jjData;
 
     void store_cell(CellIndex i);
-    void swap_stored_cells(CellIndex i, CellIndex j);
 
 };
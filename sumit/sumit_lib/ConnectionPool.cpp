@@ -0,0 +1,140 @@
+#include "stdafx.h"
+#include <string.h>
+#include "ConnectionPool.h"
+
+ConnectionPool::ConnectionPool() {
+}
+
+ConnectionPool::~ConnectionPool() {
+    clear();
+
+    for (size_t i = 0; i < endpoints.size(); i++) {
+        if (endpoints[i]->address != NULL) {
+            sys.free_address(endpoints[i]->address);
+        }
+        delete endpoints[i];
+    }
+}
+
+// Call with the mutex held
+ConnectionPool::Endpoint *ConnectionPool::find_endpoint(const char *host, const char *port) {
+    for (size_t i = 0; i < endpoints.size(); i++) {
+        if ((strcmp(endpoints[i]->host, host) == 0) && (strcmp(endpoints[i]->port, port) == 0)) {
+            return endpoints[i];
+        }
+    }
+
+    if ((strlen(host) >= MAX_HOST_NAME_SIZE) || (strlen(port) >= MAX_PORT_NUMBER_SIZE)) {
+        logger->error(1, "Server address too long: %s:%s", host, port);
+    }
+
+    Endpoint *endpoint = new Endpoint();
+    strcpy(endpoint->host, host);
+    strcpy(endpoint->port, port);
+    endpoint->address = NULL;
+    endpoint->failover = false;
+    endpoints.push_back(endpoint);
+
+    return endpoint;
+}
+
+SOCKET ConnectionPool::acquire(const char *host, const char *port, bool *reused, bool *failover) {
+    struct addrinfo *address;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Endpoint *endpoint = find_endpoint(host, port);
+        double now = sys.wall_time();
+
+        *failover = endpoint->failover;
+
+        // The most recently released connection is the least likely to have been closed by the server
+        while (! endpoint->idle.empty()) {
+            Connection connection = endpoint->idle.back();
+            endpoint->idle.pop_back();
+
+            if ((now - connection.released_time) < CONNECTION_IDLE_TIMEOUT) {
+                *reused = true;
+                return connection.sock;
+            }
+
+            sys.close_socket(connection.sock);
+        }
+
+        address = endpoint->address;
+    }
+
+    // Connect without holding the lock - the address is not freed until the pool is destroyed
+    *reused = false;
+
+    if (address == NULL) {
+        address = resolve(host, port, *failover);
+        if (address == NULL) {
+            return -1;
+        }
+    }
+
+    if (! *failover) {
+        return sys.connect_socket(address, host);
+    }
+
+    SOCKET sock = sys.try_connect_socket(address);
+    if (sock != -1) {
+        sys.set_socket_timeout(sock, FAILOVER_RESPONSE_TIMEOUT);
+    }
+
+    return sock;
+}
+
+// Look up the server's address when it is first connected to, and for a server with failover again after a failed lookup, so that a
+// server whose name cannot be resolved is reported as not reachable rather than ending the run
+// Looked up without holding the lock, as it may wait for a name server
+struct addrinfo *ConnectionPool::resolve(const char *host, const char *port, bool failover) {
+    struct addrinfo *address = failover ? sys.try_resolve_address(host, port) : sys.resolve_address(host, port);
+    if (address == NULL) {
+        return NULL;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Endpoint *endpoint = find_endpoint(host, port);
+
+    // Another thread may have looked it up first
+    if (endpoint->address == NULL) {
+        endpoint->address = address;
+    } else {
+        sys.free_address(address);
+    }
+
+    return endpoint->address;
+}
+
+void ConnectionPool::release(const char *host, const char *port, SOCKET sock) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Endpoint *endpoint = find_endpoint(host, port);
+
+    if (endpoint->idle.size() >= MAX_IDLE_CONNECTIONS) {
+        sys.close_socket(sock);
+        return;
+    }
+
+    Connection connection;
+    connection.sock = sock;
+    connection.released_time = sys.wall_time();
+    endpoint->idle.push_back(connection);
+}
+
+void ConnectionPool::set_failover(const char *host, const char *port) {
+    std::lock_guard<std::mutex> lock(mutex);
+    find_endpoint(host, port)->failover = true;
+}
+
+void ConnectionPool::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (size_t i = 0; i < endpoints.size(); i++) {
+        for (size_t j = 0; j < endpoints[i]->idle.size(); j++) {
+            sys.close_socket(endpoints[i]->idle[j].sock);
+        }
+        endpoints[i]->idle.clear();
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "stdafx.h"
+#include <mutex>
+#include <vector>
+
+// Idle connections are closed by the client before the server would close them (after SERVER_IDLE_TIMEOUT seconds)
+#define CONNECTION_IDLE_TIMEOUT 30.0
+
+// Most idle connections kept for each server
+#define MAX_IDLE_CONNECTIONS 64
+
+// Seconds without progress after which a request to a server with failover fails
+// Wait requests are held open for at most a few seconds, so only a server that has stopped responding takes this long
+#define FAILOVER_RESPONSE_TIMEOUT 30
+
+// Keep-alive connections to cell suppression servers, shared by all threads
+// Each server's address is looked up once, when it is first connected to, and a connection that has finished a request is kept for the next request to the same server
+class ConnectionPool {
+
+public:
+    ConnectionPool();
+    ~ConnectionPool();
+
+    // Return an idle connection to the server, or a new one if there is none
+    // reused is set if the connection has carried earlier requests, when the server may have closed it in the meantime
+    // failover is set if the server has failover, when -1 is returned if its address cannot be looked up or it cannot be reached, and
+    // otherwise that is an error
+    SOCKET acquire(const char *host, const char *port, bool *reused, bool *failover);
+
+    // Return a connection whose replies have all been read, so that it can be used again
+    void release(const char *host, const char *port, SOCKET sock);
+
+    // Close all idle connections
+    void clear();
+
+    // Report the failures of a server to the caller rather than treating them as errors, as other servers can stand in for it
+    void set_failover(const char *host, const char *port);
+
+private:
+    struct Connection {
+        SOCKET sock;
+        double released_time;
+    };
+
+    struct Endpoint {
+        char host[MAX_HOST_NAME_SIZE];
+        char port[MAX_PORT_NUMBER_SIZE];
+        struct addrinfo *address;      // NULL until it has been looked up
+        bool failover;
+        std::vector<Connection> idle;
+    };
+
+    std::vector<Endpoint*> endpoints;
+    std::mutex mutex;
+
+    Endpoint *find_endpoint(const char *host, const char *port);
+    struct addrinfo *resolve(const char *host, const char *port, bool failover);
+
+};
@@ -1,6 +1,9 @@
 #include "stdafx.h"
 #include <stdlib.h>
+#include <string.h>
+#include <set>
 #include "Eliminate.h"
+#include "ExchangeSort.h"
 
 Eliminate::Eliminate(const char* injjfilename) {
     jjData = new JJData(injjfilename);
@@ -43,29 +46,34 @@ Eliminate::Eliminate(const char* injjfilename) {
         }
     }
 
-    consistency_eqtns = new ConsistencyEquation[jjData->nsums];
+    // The terms of the consistency equations are used directly from the equation store in jjData
+    equation_RHS = new int_fast64_t[jjData->nsums];
 
     for (SumIndex i = 0; i < jjData->nsums; i++) {
-        consistency_eqtns[i].RHS = (int_fast64_t)(jjData->consistency_eqtns[i].RHS * INT64_PRECISION);
-        consistency_eqtns[i].cell_index = jjData->consistency_eqtns[i].cell_index;
-        consistency_eqtns[i].plus_or_minus = jjData->consistency_eqtns[i].plus_or_minus;
-        consistency_eqtns[i].size_of_eqtn = jjData->consistency_eqtns[i].size_of_eqtn;
+        equation_RHS[i] = (int_fast64_t)(jjData->consistency_eqtns[i].RHS * INT64_PRECISION);
     }
 
     OrderedCells = NULL;
 
     cell_bounds = NULL;
-    savedCellBounds = NULL;
 
     consolidated_eqtns = NULL;
+    consolidated_cells = NULL;
+    consolidated_signs = NULL;
+    consolidated_terms = 0;
     no_consolidated_eqtns = 0;
-    saved_consolidated_equations = NULL;
-    num_BackupConsolidatedEquations = 0;
 
-    processing_eqtns_lower = NULL;
-    processing_eqtns_upper = NULL;
-
-    biggestConsEqn = 0;
+    undo_generation = 0;
+    cell_bounds_stamp = NULL;
+    equation_stamp = NULL;
+
+    current_nsup_found = 0;
+    current_nsup_bounds_broken = 0;
+    cell_eqtn_offsets = NULL;
+    cell_eqtns = NULL;
+    queued = NULL;
+    cell_component = NULL;
+    number_of_components = 0;
 }
 
 Eliminate::~Eliminate(void) {
@@ -75,10 +83,8 @@ Eliminate::~Eliminate(void) {
     delete[] primaryCells;
     primaryCells = NULL;
 
-    // Do not delete memory for consistency_eqtns[i].cell_number consistency_eqtns[i].plus_or_minus
-    // as these are pointers into jjData and will be handled when jjData is destroyed
-    delete[] consistency_eqtns;
-    consistency_eqtns = NULL;
+    delete[] equation_RHS;
+    equation_RHS = NULL;
 
     delete jjData;
 }
@@ -94,7 +100,6 @@ void Eliminate::WriteJJFile(const char* outfilename) {
 
 void Eliminate::allocate_cell_bounds_memory() {
     cell_bounds = new CellBounds[jjData->ncells];
-    savedCellBounds = new CellBounds[jjData->ncells];
 }
 
 void Eliminate::init_cell_bounds() {
@@ -119,247 +124,158 @@ void Eliminate::release_cell_bounds_memory() {
         delete[] cell_bounds;
         cell_bounds = NULL;
     }
-    if (savedCellBounds != NULL) {
-        delete[] savedCellBounds;
-        savedCellBounds = NULL;
-    }
 }
 
 void Eliminate::release_Consolidated_Eqtns_memory(void) {
-    int i;
-
     if (consolidated_eqtns != NULL) {
-        for (i = 0; i < no_consolidated_eqtns; i++) {
-            if (consolidated_eqtns[i].cell_number != NULL) {
-                delete[] consolidated_eqtns[i].cell_number;
-                consolidated_eqtns[i].cell_number = NULL;
-            }
-
-            if (consolidated_eqtns[i].plus_or_minus != NULL) {
-                delete[] consolidated_eqtns[i].plus_or_minus;
-                consolidated_eqtns[i].plus_or_minus = NULL;
-            }
-        }
-
         delete[] consolidated_eqtns;
+        delete[] consolidated_cells;
+        delete[] consolidated_signs;
+
         no_consolidated_eqtns= 0;
+        consolidated_terms = 0;
         consolidated_eqtns = (ConsolidatedEquation *) NULL;
+        consolidated_cells = NULL;
+        consolidated_signs = NULL;
     }
 }
 
 
-void Eliminate::release_SavedConsolidated_Eqtns_memory(void) {
-    int i;
+void Eliminate::allocate_undo_log() {
+    release_undo_log();
 
-    if (saved_consolidated_equations != NULL) {
-        for (i = 0; i < num_BackupConsolidatedEquations; i++) {
-            if (saved_consolidated_equations[i].cell_number != NULL) {
-                delete[] saved_consolidated_equations[i].cell_number;
-                saved_consolidated_equations[i].cell_number = NULL;
-            }
-
-            if (saved_consolidated_equations[i].plus_or_minus != NULL) {
-                delete[] saved_consolidated_equations[i].plus_or_minus;
-                saved_consolidated_equations[i].plus_or_minus = NULL;
-            }
-        }
+    cell_bounds_stamp = new int[jjData->ncells];
+    equation_stamp = new int[no_consolidated_eqtns];
 
-        delete[] saved_consolidated_equations;
-        num_BackupConsolidatedEquations= 0;
-        saved_consolidated_equations = (ConsolidatedEquation *) NULL;
+    for (CellIndex i = 0; i < jjData->ncells; i++) {
+        cell_bounds_stamp[i] = -1;
     }
-}
-
-void Eliminate::restoreConsolidated_EquationsFromBackup(void)
-{
-    int i,j;
-    release_Consolidated_Eqtns_memory( );
-    consolidated_eqtns = new ConsolidatedEquation[num_BackupConsolidatedEquations];
-    no_consolidated_eqtns = num_BackupConsolidatedEquations;
 
+    for (int i = 0; i < no_consolidated_eqtns; i++) {
+        equation_stamp[i] = -1;
+    }
 
-    for (i = 0; i < num_BackupConsolidatedEquations; i++)
-      {
-        consolidated_eqtns[i].size_of_eqtn = saved_consolidated_equations[i].size_of_eqtn;
-        consolidated_eqtns[i].RHS = saved_consolidated_equations[i].RHS;
-        consolidated_eqtns[i].cell_number = new int [saved_consolidated_equations[i].size_of_eqtn];
-        consolidated_eqtns[i].plus_or_minus = new int [saved_consolidated_equations[i].size_of_eqtn];
+    undo_generation = 0;
+}
 
+void Eliminate::release_undo_log() {
+    if (cell_bounds_stamp != NULL) {
+        delete[] cell_bounds_stamp;
+        cell_bounds_stamp = NULL;
+    }
 
-        for (j=0;j< saved_consolidated_equations[i].size_of_eqtn;j++)
-          {
-            consolidated_eqtns[i].cell_number[j] = saved_consolidated_equations[i].cell_number[j];
-            consolidated_eqtns[i].plus_or_minus[j] = saved_consolidated_equations[i].plus_or_minus[j];
-          }
-      }
+    if (equation_stamp != NULL) {
+        delete[] equation_stamp;
+        equation_stamp = NULL;
+    }
 }
 
+// Called before every change to the bounds of a cell
+// Changes made outside a test, with no log, are not recorded
+void Eliminate::save_cell_bounds(UndoLog *log, int cell) {
+    if ((log != NULL) && (cell_bounds_stamp[cell] != log->generation)) {
+        BoundsUndo entry;
 
-void Eliminate::backup_Consolidated_Equations(void)
-{
-    int i,j, nonzeroConsolidatedEquations=0;
-    int numEqnsCopied;
+        entry.cell = cell;
+        entry.bounds = cell_bounds[cell];
+        log->bounds_undo.push_back(entry);
 
-    release_SavedConsolidated_Eqtns_memory( );
-
-    for(i=0;i<no_consolidated_eqtns;i++)
-      {
-        if (consolidated_eqtns[i].size_of_eqtn>0) {
-            nonzeroConsolidatedEquations++;
-        }
-      }
+        cell_bounds_stamp[cell] = log->generation;
+    }
+}
 
-    saved_consolidated_equations = new ConsolidatedEquation[nonzeroConsolidatedEquations];
-    num_BackupConsolidatedEquations = nonzeroConsolidatedEquations;
+// Called before every change to a consolidated equation
+// Equations only shrink in place, so saving the terms it has now is enough to restore it
+void Eliminate::save_equation(UndoLog *log, int i) {
+    if ((log != NULL) && (equation_stamp[i] != log->generation)) {
+        EquationUndo entry;
 
+        entry.eqtn = i;
+        entry.RHS = consolidated_eqtns[i].RHS;
+        entry.size_of_eqtn = consolidated_eqtns[i].size_of_eqtn;
+        entry.first_term = log->undo_cells.size();
+        log->equation_undo.push_back(entry);
 
-    for (i = 0, numEqnsCopied=0; i < no_consolidated_eqtns; i++)
-      {
-        if(consolidated_eqtns[i].size_of_eqtn>0)
-          {
-            saved_consolidated_equations[numEqnsCopied].size_of_eqtn = consolidated_eqtns[i].size_of_eqtn;
-            saved_consolidated_equations[numEqnsCopied].RHS = consolidated_eqtns[i].RHS;
-            saved_consolidated_equations[numEqnsCopied].cell_number = new int [consolidated_eqtns[i].size_of_eqtn];
-            saved_consolidated_equations[numEqnsCopied].plus_or_minus = new int [consolidated_eqtns[i].size_of_eqtn];
-
-            for (j=0;j< saved_consolidated_equations[numEqnsCopied].size_of_eqtn;j++)
-              {
-                saved_consolidated_equations[numEqnsCopied].cell_number[j] = consolidated_eqtns[i].cell_number[j];
-                saved_consolidated_equations[numEqnsCopied].plus_or_minus[j] = consolidated_eqtns[i].plus_or_minus[j];
-              }
-            numEqnsCopied++;
+        log->undo_cells.insert(log->undo_cells.end(), consolidated_eqtns[i].cell_number, consolidated_eqtns[i].cell_number + entry.size_of_eqtn);
+        log->undo_signs.insert(log->undo_signs.end(), consolidated_eqtns[i].plus_or_minus, consolidated_eqtns[i].plus_or_minus + entry.size_of_eqtn);
 
-          }
-      }
+        equation_stamp[i] = log->generation;
+    }
 }
 
+void Eliminate::begin_trial(UndoLog *log) {
+    if ((cell_bounds_stamp == NULL) || (equation_stamp == NULL)) {
+        logger->error(1, "called begin_trial before the undo log was allocated");
+    }
 
-void Eliminate::backupCellBounds(void)
-{
-    int i;
-    if (jjData->ncells == 0)
-      {
-        logger->error(1, "called backupCellBoinds when ncells is zero");
-      }
-    else  if  ( (cell_bounds == NULL) || (savedCellBounds==NULL) )
-      {
-        logger->error(1, "called backupCellBoinds with NULL arrays");
-      }
-
-    else
-      {for(i=0;i<jjData->ncells;i++)
-        {
-          savedCellBounds[i] = cell_bounds[i];
-        }
-      }
+    log->generation = undo_generation++;
 }
 
-void Eliminate::restoreSavedCellBounds(void)
-{
-    int i;
-    if (jjData->ncells == 0)
-      {
-        logger->error(1, "called backupCellBoinds when ncells is zero");
-      }
-    else    if  ( (cell_bounds == NULL) || (savedCellBounds==NULL) )
-      {
-        logger->error(1, "called backupCellBounds with NULL arrays");
-      }
-    else
-      {
-        for(i=0;i<jjData->ncells;i++)
-          {
-            cell_bounds[i] = savedCellBounds[i] ;
-          }
-      }
+// Keep the changes made in the trial
+void Eliminate::commit_trial(UndoLog *log) {
+    log->bounds_undo.clear();
+    log->equation_undo.clear();
+    log->undo_cells.clear();
+    log->undo_signs.clear();
 }
 
+// Put back every cell bound and equation changed in the trial as it was before its first change
+void Eliminate::rollback_trial(UndoLog *log) {
+    for (size_t k = 0; k < log->bounds_undo.size(); k++) {
+        cell_bounds[log->bounds_undo[k].cell] = log->bounds_undo[k].bounds;
+    }
 
+    for (size_t k = 0; k < log->equation_undo.size(); k++) {
+        ConsolidatedEquation *eqtn = &consolidated_eqtns[log->equation_undo[k].eqtn];
 
-void Eliminate::release_processing_eqtns_memory() {
-    for(int i=0;i<no_processing_eqtns;i++)
-      {
-        if (processing_eqtns_lower[i].cells_lower_to_add != NULL) {
-            delete[] processing_eqtns_lower[i].cells_lower_to_add;
-            processing_eqtns_lower[i].cells_lower_to_add = NULL;
-        }
-
-        if (processing_eqtns_lower[i].cells_lower_to_sub != NULL) {
-            delete[] processing_eqtns_lower[i].cells_lower_to_sub;
-            processing_eqtns_lower[i].cells_lower_to_sub = NULL;
-        }
-
-        if (processing_eqtns_lower[i].cells_upper_to_add != NULL) {
-            delete[] processing_eqtns_lower[i].cells_upper_to_add;
-            processing_eqtns_lower[i].cells_upper_to_add = NULL;
-        }
-
-        if (processing_eqtns_lower[i].cells_upper_to_sub != NULL) {
-            delete[] processing_eqtns_lower[i].cells_upper_to_sub;
-            processing_eqtns_lower[i].cells_upper_to_sub = NULL;
-        }
-
-        if (processing_eqtns_upper[i].cells_lower_to_add != NULL) {
-            delete[] processing_eqtns_upper[i].cells_lower_to_add;
-            processing_eqtns_upper[i].cells_lower_to_add = NULL;
-        }
-
-        if (processing_eqtns_upper[i].cells_lower_to_sub != NULL) {
-            delete[] processing_eqtns_upper[i].cells_lower_to_sub;
-            processing_eqtns_upper[i].cells_lower_to_sub = NULL;
-        }
-
-        if (processing_eqtns_upper[i].cells_upper_to_add != NULL) {
-            delete[] processing_eqtns_upper[i].cells_upper_to_add;
-            processing_eqtns_upper[i].cells_upper_to_add = NULL;
-        }
+        eqtn->RHS = log->equation_undo[k].RHS;
+        eqtn->size_of_eqtn = log->equation_undo[k].size_of_eqtn;
 
-        if (processing_eqtns_upper[i].cells_upper_to_sub != NULL) {
-            delete[] processing_eqtns_upper[i].cells_upper_to_sub;
-            processing_eqtns_upper[i].cells_upper_to_sub = NULL;
+        if (eqtn->size_of_eqtn > 0) {
+            memcpy(eqtn->cell_number, &log->undo_cells[log->equation_undo[k].first_term], eqtn->size_of_eqtn * sizeof(int));
+            memcpy(eqtn->plus_or_minus, &log->undo_signs[log->equation_undo[k].first_term], eqtn->size_of_eqtn * sizeof(int));
         }
-      }
-
-    delete[] processing_eqtns_lower;
-    processing_eqtns_lower = NULL;
-
-    delete[] processing_eqtns_upper;
-    processing_eqtns_upper = NULL;
+    }
 
-    no_processing_eqtns = 0;
+    commit_trial(log);
 }
 
 void Eliminate::tidy_up_the_consolidated_equations() {
     int i;
-    int j;
 
     /* Tidy up the consolidated equations */
 
     for (i = 0; i < no_consolidated_eqtns; i++) {
-        if (consolidated_eqtns[i].RHS < 0) {
-            consolidated_eqtns[i].RHS = -1 * consolidated_eqtns[i].RHS;
+        tidy_up_equation(NULL, i);
+    }
+}
 
-            for (j = 0; j < consolidated_eqtns[i].size_of_eqtn; j++) {
-                consolidated_eqtns[i].plus_or_minus[j] = -1 * consolidated_eqtns[i].plus_or_minus[j];
-            }
+void Eliminate::tidy_up_equation(UndoLog *log, int i) {
+    int j;
+
+    if (consolidated_eqtns[i].RHS < 0) {
+        save_equation(log, i);
+        consolidated_eqtns[i].RHS = -1 * consolidated_eqtns[i].RHS;
+
+        for (j = 0; j < consolidated_eqtns[i].size_of_eqtn; j++) {
+            consolidated_eqtns[i].plus_or_minus[j] = -1 * consolidated_eqtns[i].plus_or_minus[j];
         }
     }
 }
 
 void Eliminate::consolidate_the_consistency_equations() {
     int i;
-    int j;
     int nsuppressed;
     int cell_no;
-    int consolidated_index;
-    int *numsuppressed = new int[jjData->nsums];
-    int numCreated;
 
     release_Consolidated_Eqtns_memory();
+    release_undo_log();
+    release_cell_equations();
 
-    // Find the required number of consolidated equations
+    // Find the required number of consolidated equations and terms
 
     no_consolidated_eqtns = 0;
+    consolidated_terms = 0;
 
     for (i = 0; i < jjData->nsums; i++)
       {
@@ -367,100 +283,85 @@ void Eliminate::consolidate_the_consistency_equations() {
 
         /* Count the number of suppressed cells in the equation */
 
-        for (j = 0; j < consistency_eqtns[i].size_of_eqtn; j++)
+        for (int64_t k = jjData->equation_offsets[i]; k < jjData->equation_offsets[i + 1]; k++)
           {
-            cell_no = consistency_eqtns[i].cell_index[j];
+            cell_no = jjData->equation_cells[k];
 
-            if ((cell_no >= 0) && (cell_no < jjData->ncells))
+            if ((cells[cell_no].status == 'u') || (cells[cell_no].status == 'm'))
               {
-                if ((cells[cell_no].status == 'u') || (cells[cell_no].status == 'm'))
-                  {
-                    nsuppressed++;
-                  }
+                nsuppressed++;
               }
           }
 
         /* If there is one or more suppressed cell then we increment the number of consolidated equations */
-        numsuppressed[i] = nsuppressed;
-        //
         if (nsuppressed > 0) {
             no_consolidated_eqtns++;
+            consolidated_terms += nsuppressed;
         }
       }
 
-    // Allocate memory for the consolidated equations - after checking it  is clean first
-    if (consolidated_eqtns != NULL) {
-        release_Consolidated_Eqtns_memory();
-    }
-
     consolidated_eqtns = new ConsolidatedEquation[no_consolidated_eqtns];
-
-    for (i = 0; i < no_consolidated_eqtns; i++) {
-        consolidated_eqtns[i].cell_number = NULL;
-        consolidated_eqtns[i].plus_or_minus = NULL;
-    }
-
-
+    consolidated_cells = new int[consolidated_terms];
+    consolidated_signs = new int[consolidated_terms];
 
     // Setup the required number of consolidated equations
 
-    numCreated = 0;// it is used as a loop variable below
+    no_consolidated_eqtns = 0;
+    int64_t nterms = 0;
 
     for (i = 0; i < jjData->nsums; i++)
     {
-        nsuppressed = numsuppressed[i];
-        /* If there is one or more suppressed cell then we write it to the consolidated equations */
-        if (nsuppressed > 0)
-          {
-            if(numCreated>no_consolidated_eqtns)
-                logger->error(1, "something has gone wrong with counts of equations in consolidate_consistency_equations");
-            consolidated_eqtns[numCreated].cell_number = new int [nsuppressed];
-            consolidated_eqtns[numCreated].plus_or_minus = new int [nsuppressed];
+        ConsolidatedEquation eqtn;
 
-            consolidated_eqtns[numCreated].RHS = consistency_eqtns[i].RHS;
+        eqtn.cell_number = consolidated_cells + nterms;
+        eqtn.plus_or_minus = consolidated_signs + nterms;
+        eqtn.size_of_eqtn = 0;
+        eqtn.RHS = equation_RHS[i];
 
-            consolidated_index = 0;
+        for (int64_t k = jjData->equation_offsets[i]; k < jjData->equation_offsets[i + 1]; k++)
+          {
+            cell_no = jjData->equation_cells[k];
 
-            for (j = 0; j < consistency_eqtns[i].size_of_eqtn; j++)
+            if ((cells[cell_no].status == 'u') || (cells[cell_no].status == 'm'))
               {
-                cell_no = consistency_eqtns[i].cell_index[j];
-
-                if ((cell_no >= 0) && (cell_no < jjData->ncells))
-                  {
-                    if ((cells[cell_no].status == 'u') || (cells[cell_no].status == 'm'))
-                      {
-                        consolidated_eqtns[numCreated].cell_number [consolidated_index] = cell_no;
-                        consolidated_eqtns[numCreated].plus_or_minus[consolidated_index] = consistency_eqtns[i].plus_or_minus[j];
-                        consolidated_index++;
-                      }
-                    else
-                      {
-                        consolidated_eqtns[numCreated].RHS = consolidated_eqtns[numCreated].RHS - (consistency_eqtns[i].plus_or_minus[j] * cells[cell_no].nominal_value);
-                      }
-                  }
+                eqtn.cell_number[eqtn.size_of_eqtn] = cell_no;
+                eqtn.plus_or_minus[eqtn.size_of_eqtn] = jjData->term_sign(k);
+                eqtn.size_of_eqtn++;
               }
-            if (consolidated_index != numsuppressed[i])
-                logger->error(1, "mismatch in consolidated equations size: stored %d but should have been %d", consolidated_index,numsuppressed[i]);
             else
-                consolidated_eqtns[numCreated].size_of_eqtn  = consolidated_index;
-            numCreated++;
+              {
+                eqtn.RHS = eqtn.RHS - (jjData->term_sign(k) * cells[cell_no].nominal_value);
+              }
+          }
 
-        } //end if( nsuppressed>0)
+        /* If there is one or more suppressed cell then we write it to the consolidated equations */
+        if (eqtn.size_of_eqtn > 0)
+          {
+            consolidated_eqtns[no_consolidated_eqtns++] = eqtn;
+            nterms += eqtn.size_of_eqtn;
+          }
     }
 
-    /* Display the number of consolidated equations */
-
-    //logger->log(3, "%d consolidated equations", no_consolidated_eqtns);
-
     tidy_up_the_consolidated_equations();
 
     logger->log(3,"%d initial consolidated equations created", no_consolidated_eqtns);
-    delete[] numsuppressed;
-    numsuppressed = NULL;
 }
 
 int Eliminate::simplify_the_consistency_equations() {
     int i;
+    int nos_simplfied;
+
+    nos_simplfied = 0;
+
+    for (i = 0; i < no_consolidated_eqtns; i++) {
+        nos_simplfied += simplify_equation(NULL, i);
+    }
+    tidy_up_the_consolidated_equations();
+    return (nos_simplfied);
+}
+
+// Remove the cells whose values are known from equation i
+int Eliminate::simplify_equation(UndoLog *log, int i) {
     int j;
     int k;
     int nos_simplfied;
@@ -468,347 +369,420 @@ int Eliminate::simplify_the_consistency_equations() {
 
     nos_simplfied = 0;
 
-    for (i = 0; i < no_consolidated_eqtns; i++) {
-        switch (consolidated_eqtns[i].size_of_eqtn) {
-            case 0:
-                break;
+    switch (consolidated_eqtns[i].size_of_eqtn) {
+        case 0:
+            break;
 
-            case 1:
-                cell_no = consolidated_eqtns[i].cell_number[0];
+        case 1:
+            cell_no = consolidated_eqtns[i].cell_number[0];
 
-                if (cell_bounds[cell_no].lower == cell_bounds[cell_no].upper) {
-                    consolidated_eqtns[i].size_of_eqtn = 0;
-                    nos_simplfied++;
-                }
-                break;
+            if (cell_bounds[cell_no].lower == cell_bounds[cell_no].upper) {
+                save_equation(log, i);
+                consolidated_eqtns[i].size_of_eqtn = 0;
+                nos_simplfied++;
+            }
+            break;
 
-            default:
-                for (j = 0; j < consolidated_eqtns[i].size_of_eqtn; j++) {
-                    cell_no = consolidated_eqtns[i].cell_number[j];
+        default:
+            for (j = 0; j < consolidated_eqtns[i].size_of_eqtn; j++) {
+                cell_no = consolidated_eqtns[i].cell_number[j];
 
-                    if (cell_bounds[cell_no].lower == cell_bounds[cell_no].upper) {
-                        /* Remove this cell from the equation as its value is known */
+                if (cell_bounds[cell_no].lower == cell_bounds[cell_no].upper) {
+                    /* Remove this cell from the equation as its value is known */
+                    save_equation(log, i);
 
-                        if (consolidated_eqtns[i].plus_or_minus[j] == 1)
-                          {
-                            consolidated_eqtns[i].RHS = consolidated_eqtns[i].RHS - cell_bounds[cell_no].upper;
-                          }
-                        else
-                          {
-                            consolidated_eqtns[i].RHS = consolidated_eqtns[i].RHS + cell_bounds[cell_no].upper;
-                          }
+                    if (consolidated_eqtns[i].plus_or_minus[j] == 1)
+                      {
+                        consolidated_eqtns[i].RHS = consolidated_eqtns[i].RHS - cell_bounds[cell_no].upper;
+                      }
+                    else
+                      {
+                        consolidated_eqtns[i].RHS = consolidated_eqtns[i].RHS + cell_bounds[cell_no].upper;
+                      }
 
-                        for (k = j + 1; k < consolidated_eqtns[i].size_of_eqtn; k++)
-                          {
-                            consolidated_eqtns[i].cell_number[k - 1] = consolidated_eqtns[i].cell_number[k];
-                            consolidated_eqtns[i].plus_or_minus[k - 1] = consolidated_eqtns[i].plus_or_minus[k];
-                          }
-                        consolidated_eqtns[i].size_of_eqtn--;
-                        nos_simplfied++;
-                    }
+                    for (k = j + 1; k < consolidated_eqtns[i].size_of_eqtn; k++)
+                      {
+                        consolidated_eqtns[i].cell_number[k - 1] = consolidated_eqtns[i].cell_number[k];
+                        consolidated_eqtns[i].plus_or_minus[k - 1] = consolidated_eqtns[i].plus_or_minus[k];
+                      }
+                    consolidated_eqtns[i].size_of_eqtn--;
+                    nos_simplfied++;
                 }
-                break;
-        }
+            }
+            break;
     }
-    tidy_up_the_consolidated_equations();
     return (nos_simplfied);
 }
 
 bool Eliminate::set_initial_lower_and_upper_bounds() {
     bool rc;
     int i;
+
+    rc = true;
+
+    for (i = 0; i < no_consolidated_eqtns; i++) {
+        if (!set_initial_bounds_for_equation(NULL, i)) {
+            rc = false;
+        }
+    }
+    return (rc);
+}
+
+bool Eliminate::set_initial_bounds_for_equation(UndoLog *log, int i) {
+    bool rc;
     int j;
     int no_plus;
     int cell_no;
 
     rc = true;
+    no_plus = 0;
 
-    for (i = 0; i < no_consolidated_eqtns; i++) {
-        no_plus = 0;
-
-        switch (consolidated_eqtns[i].size_of_eqtn) {
-            case 0:
-                /* Something has gone wrong */
-                rc = false;
-                break;
+    switch (consolidated_eqtns[i].size_of_eqtn) {
+        case 0:
+            /* Something has gone wrong */
+            rc = false;
+            break;
 
-            case 1:
-                /* Simplest case, we have a solution */
+        case 1:
+            /* Simplest case, we have a solution */
 
-                cell_no = consolidated_eqtns[i].cell_number[0];
-                cell_bounds[cell_no].lower = consolidated_eqtns[i].RHS;
-                cell_bounds[cell_no].upper = consolidated_eqtns[i].RHS;
-                break;
+            cell_no = consolidated_eqtns[i].cell_number[0];
+            save_cell_bounds(log, cell_no);
+            cell_bounds[cell_no].lower = consolidated_eqtns[i].RHS;
+            cell_bounds[cell_no].upper = consolidated_eqtns[i].RHS;
+            break;
 
-            default:
-                /* See if they are all adds... if they are we can get upper bounds */
+        default:
+            /* See if they are all adds... if they are we can get upper bounds */
 
-                //SPEEDUP:  they all should be by definition
-                no_plus = 0;
+            //SPEEDUP:  they all should be by definition
+            no_plus = 0;
 
-                for (j = 0; j < consolidated_eqtns[i].size_of_eqtn; j++) {
-                    if (consolidated_eqtns[i].plus_or_minus[j] == 1) {
-                        no_plus++;
-                    }
+            for (j = 0; j < consolidated_eqtns[i].size_of_eqtn; j++) {
+                if (consolidated_eqtns[i].plus_or_minus[j] == 1) {
+                    no_plus++;
                 }
+            }
 
-                if (no_plus == consolidated_eqtns[i].size_of_eqtn) {
-                    /* We can give upper bounds */
-
-                    for (j = 0; j < consolidated_eqtns[i].size_of_eqtn; j++) {
-                        cell_no = consolidated_eqtns[i].cell_number[j];
+            if (no_plus == consolidated_eqtns[i].size_of_eqtn) {
+                /* We can give upper bounds */
 
-                        if (cell_bounds[cell_no].lower < 0) {
-                            cell_bounds[cell_no].lower = 0;
-                        }
+                for (j = 0; j < consolidated_eqtns[i].size_of_eqtn; j++) {
+                    cell_no = consolidated_eqtns[i].cell_number[j];
+                    save_cell_bounds(log, cell_no);
 
-                        if (cell_bounds[cell_no].upper > consolidated_eqtns[i].RHS)
-                          {
-                            cell_bounds[cell_no].upper = consolidated_eqtns[i].RHS;
-                          }
+                    if (cell_bounds[cell_no].lower < 0) {
+                        cell_bounds[cell_no].lower = 0;
                     }
+
+                    if (cell_bounds[cell_no].upper > consolidated_eqtns[i].RHS)
+                      {
+                        cell_bounds[cell_no].upper = consolidated_eqtns[i].RHS;
+                      }
                 }
-                break;
-        }
+            }
+            break;
     }
     return (rc);
 }
 
-bool Eliminate::getSafety() {
-    int i,j;
-    int nsup_found_1;
-    int nsup_bounds_broken_1;
-    bool safe;
+// 0 if the bounds protect a primary cell, 1 if they expose it exactly and 2 if they expose it partially
+int Eliminate::cell_exposure(int cell, CellBounds bounds) {
     int_fast64_t temp;
     int_fast64_t safety_margin;
 
-    safe = true;
     safety_margin = 1;
 
-    nsup_found_1 = 0;
-    nsup_bounds_broken_1 = 0;
+    temp = cells[cell].nominal_value - cells[cell].lower_protection_level;
 
+    if (temp < 0)
+      {
+        temp = 1;
+      }
 
-    for (j = 0; j < nPrimaryCells; j++)
+    if (bounds.lower == bounds.upper)
+      {
+        return 1;
+      }
+    else if ( (bounds.lower + safety_margin) > temp)
+      {
+        return 2;
+      }
+    else if ((bounds.upper - safety_margin) < (cells[cell].nominal_value + cells[cell].upper_protection_level))
       {
-        i = primaryCells[j];
+        return 2;
+      }
+    /*
+     else if (cells[i].sliding_protection_level > 0)
+     {
+     if ((cell_bounds[i].upper - cell_bounds[i].lower) < cells[i].sliding_protection_level)
+     {
+     return 2;
+     }
+     }
+     */
 
+    return 0;
+}
 
-        temp = cells[i].nominal_value - cells[i].lower_protection_level;
+void Eliminate::count_exposure(int *nsup_found, int *nsup_bounds_broken) {
+    int exposure;
 
-        if (temp < 0)
-          {
-            temp = 1;
-          }
+    *nsup_found = 0;
+    *nsup_bounds_broken = 0;
 
-        if (cell_bounds[i].lower == cell_bounds[i].upper)
-          {
-            nsup_found_1++;
-          }
-        else if ( (cell_bounds[i].lower + safety_margin) > temp)
+    for (int j = 0; j < nPrimaryCells; j++)
+      {
+        exposure = cell_exposure(primaryCells[j], cell_bounds[primaryCells[j]]);
+
+        if (exposure == 1)
           {
-            nsup_bounds_broken_1++;
+            (*nsup_found)++;
           }
-        else if ((cell_bounds[i].upper - safety_margin) < (cells[i].nominal_value + cells[i].upper_protection_level))
+        else if (exposure == 2)
           {
-            nsup_bounds_broken_1++;
+            (*nsup_bounds_broken)++;
           }
-        /*
-         else if (cells[i].sliding_protection_level > 0)
-         {
-         if ((cell_bounds[i].upper - cell_bounds[i].lower) < cells[i].sliding_protection_level)
-         {
-         nsup_bounds_broken_1++;
-         }
-         }
-         */
-
-
-
-        logger->log(5, "%d cells completely exposed", nsup_found_1);
-        logger->log(5, "%d cells partially exposed", nsup_bounds_broken_1);
-
-        if (initial_nsup_bounds_broken_1 >0) {
-            logger->log(2, "initial number of cells with bounds broken = %d", initial_nsup_bounds_broken_1);
-        }
-
-        if (initial_nsup_found_1 >0) {
-            logger->log(2, "initial number of cells with bounds broken = %d", initial_nsup_bounds_broken_1);
-        }
-
-
+      }
+}
 
-        if ((nsup_found_1 > initial_nsup_found_1) || (nsup_bounds_broken_1 > initial_nsup_bounds_broken_1)) {
-            safe = false;
-        }
+// Each consolidated equation is solved for each of its cells in turn to give new bounds for that cell
+bool Eliminate::improve_lower_and_upper_bounds() {
+    bool rc;
+    bool consistent;
+    int i;
 
+    rc = false;
 
-      }
+    for (i = 0; i < no_consolidated_eqtns; i++)
+      {
+        consistent = true;
 
+        if (improve_equation_bounds(NULL, i, &consistent))
+          {
+            rc = true;
+          }
 
+        if (!consistent)
+          {
+            return(false);
+          }
+      }//end of i loop over consolidated equations
 
-    return (safe);
+    return (rc);
 }
 
-bool Eliminate::improve_lower_and_upper_bounds() {
+// If a bound has to be corrected the bounds are inconsistent, *consistent is set to false and no more bounds should be improved
+bool Eliminate::improve_equation_bounds(UndoLog *log, int i, bool *consistent) {
     bool rc;
-    int i;
-    int j;
-    int k;
-    int sz;
-    int cellno;
-    int cell;
-    int_fast64_t result;
-    int indexik;
-    int lower_bound_improvements;
-    int upper_bound_improvements;
-    int sizeOfEqi;
-    int_fast64_t improvement;
-
-    //logger->log(3, "Enter improve_lower_and_upper_bounds()");
+    ConsolidatedEquation *eqtn = &consolidated_eqtns[i];
 
     rc = false;
-    lower_bound_improvements = 0;
-    upper_bound_improvements = 0;
 
+    // Improve lower bounds
+    if (!BoundKernel<int_fast64_t>::tighten_lower_bounds(eqtn->RHS, eqtn->cell_number, eqtn->plus_or_minus, eqtn->size_of_eqtn, cell_bounds, [this, log, consistent, &rc](int cellno, int_fast64_t result) {
+        int_fast64_t improvement;
 
+        save_cell_bounds(log, cellno);
+        improvement = result - cell_bounds[cellno].lower;
+        logger->log(5,"lower bound for cell %d increased by %" PRIdFAST64, cellno, improvement);
 
-    for (i = 0; i < no_consolidated_eqtns; i++)
+        //set the new value
+        cell_bounds[cellno].lower = result;
+        //test if it is time to leave
+        if((cell_bounds[cellno].lower < 0) || (cell_bounds[cellno].lower >cell_bounds[cellno].upper))
+          {
+            logger->log(3,"improve_lower_and_upper_bounds(): had to correct lower bound on cell %d from %" PRIdFAST64 " to upper bound value",cellno, cell_bounds[cellno].lower);
+            cell_bounds[cellno].lower = cell_bounds[cellno].upper;
+            *consistent = false;
+            return(false);
+          }
+        else if (improvement > UNPICKING_PRECISION)
+          {
+            rc = true;
+          }
+        return(true);
+    }))
       {
-        sizeOfEqi = consolidated_eqtns[i].size_of_eqtn;
-
+        return(false);
+      }
 
-        // Improve lower bounds
-        for (k = 0; k < sizeOfEqi; k++)
-          {
-            indexik = index(i,k);
-            result = processing_eqtns_lower[indexik].RHS;
-            cellno = processing_eqtns_lower[indexik].cellnumber;
+    // Improve upper bounds
+    if (!BoundKernel<int_fast64_t>::tighten_upper_bounds(eqtn->RHS, eqtn->cell_number, eqtn->plus_or_minus, eqtn->size_of_eqtn, cell_bounds, [this, log, consistent, &rc](int cellno, int_fast64_t result) {
+        int_fast64_t improvement;
 
+        save_cell_bounds(log, cellno);
+        improvement = cell_bounds[cellno].upper - result;
+        logger->log(5,"upper bound for cell %d reduced by %" PRIdFAST64, cellno, improvement);
 
-            sz = processing_eqtns_lower[indexik].no_lower_adds;
-            for (j = sz; j >0;) {
-                cell = processing_eqtns_lower[indexik].cells_lower_to_add[--j];
-                result = result + cell_bounds[cell].lower;
-            }
+        //set value
+        cell_bounds[cellno].upper = result;
+        //is it time to leave?
+        if((cell_bounds[cellno].upper < cell_bounds[cellno].lower)|| (cell_bounds[cellno].upper >grand_total))
+          {
+            logger->log(3,"had to correct upper bound on cell %d from %" PRIdFAST64 " to lower bound value %" PRIdFAST64,cellno, cell_bounds[cellno].upper,cell_bounds[cellno].lower);
+            cell_bounds[cellno].upper=cell_bounds[cellno].lower;
+            *consistent = false;
+            return(false);
+          }
+        else if (improvement >UNPICKING_PRECISION)
+          {
+            rc = true;
+          }
+        return(true);
+    }))
+      {
+        return(false);
+      }
 
+    return (rc);
+}
 
-            sz = processing_eqtns_lower[index(i,k)].no_upper_adds;
-            for (j = sz; j >0; ) {
-                cell = processing_eqtns_lower[indexik].cells_upper_to_add[--j];
-                result = result + cell_bounds[cell].upper;
-            }
+void Eliminate::build_cell_equations() {
+    release_cell_equations();
 
+    cell_eqtn_offsets = new int64_t[jjData->ncells + 1];
+    cell_eqtns = new int[consolidated_terms];
+    queued = new char[no_consolidated_eqtns];
 
-            sz = processing_eqtns_lower[index(i,k)].no_lower_subs;
-            for (j =  sz; j>0;) {
-                cell = processing_eqtns_lower[indexik].cells_lower_to_sub[--j];
-                result = result - cell_bounds[cell].lower;
-            }
+    for (CellIndex c = 0; c <= jjData->ncells; c++) {
+        cell_eqtn_offsets[c] = 0;
+    }
 
+    for (int i = 0; i < no_consolidated_eqtns; i++) {
+        queued[i] = 0;
 
-            sz = processing_eqtns_lower[index(i,k)].no_upper_subs;
-            for (j = sz; j >0; ) {
-                cell = processing_eqtns_lower[indexik].cells_upper_to_sub[--j];
-                result = result - cell_bounds[cell].upper;
-            }
+        for (int j = 0; j < consolidated_eqtns[i].size_of_eqtn; j++) {
+            cell_eqtn_offsets[consolidated_eqtns[i].cell_number[j] + 1]++;
+        }
+    }
 
-            if (cell_bounds[cellno].lower < result)
-              {
-                improvement = result - cell_bounds[cellno].lower;
-                logger->log(5,"lower bound for cell %d increased by %" PRIdFAST64, cellno, improvement);
+    for (CellIndex c = 0; c < jjData->ncells; c++) {
+        cell_eqtn_offsets[c + 1] += cell_eqtn_offsets[c];
+    }
 
-                //set the new value
-                cell_bounds[cellno].lower = result;
-                //test if it is time to leave
-                if((cell_bounds[cellno].lower < 0) || (cell_bounds[cellno].lower >cell_bounds[cellno].upper))
-                  {
-                    logger->log(3,"improve_lower_and_upper_bounds(): had to correct lower bound on cell %d from %" PRIdFAST64 " to upper bound value",cellno, cell_bounds[cellno].lower);
-                    cell_bounds[cellno].lower = cell_bounds[cellno].upper;
-                    return(false);                }
+    std::vector<int64_t> next(cell_eqtn_offsets, cell_eqtn_offsets + jjData->ncells);
+    for (int i = 0; i < no_consolidated_eqtns; i++) {
+        for (int j = 0; j < consolidated_eqtns[i].size_of_eqtn; j++) {
+            cell_eqtns[next[consolidated_eqtns[i].cell_number[j]]++] = i;
+        }
+    }
+}
 
-                else if (improvement > UNPICKING_PRECISION)
-                  {
-                    lower_bound_improvements++;
-                    rc = true;
-                  }
-              }
-          }
+void Eliminate::release_cell_equations() {
+    if (cell_eqtn_offsets != NULL) {
+        delete[] cell_eqtn_offsets;
+        delete[] cell_eqtns;
+        delete[] queued;
 
-        // Improve upper bounds
+        cell_eqtn_offsets = NULL;
+        cell_eqtns = NULL;
+        queued = NULL;
+    }
 
-        for (k = 0; k < sizeOfEqi; k++)
-          {
-            indexik = index(i,k);
-            result = processing_eqtns_upper[indexik].RHS;
-            cellno = processing_eqtns_upper[indexik].cellnumber;
-
-            sz = processing_eqtns_upper[indexik].no_lower_adds;
-            for (j = sz; j >0; ) {
-                cell = processing_eqtns_upper[indexik].cells_lower_to_add[--j];
-                result = result + cell_bounds[cell].lower;
-            }
+    if (cell_component != NULL) {
+        delete[] cell_component;
+        cell_component = NULL;
+    }
 
+    number_of_components = 0;
+}
 
-            sz = processing_eqtns_upper[indexik].no_upper_adds;
-            for (j = sz; j >0;) {
-                cell = processing_eqtns_upper[indexik].cells_upper_to_add[--j];
-                result = result + cell_bounds[cell].upper;
-            }
+// Label the cells with their connected components, joining the cells of each consolidated equation
+// Equations only shrink, so cells in different components stay apart as cells are removed
+void Eliminate::build_components() {
+    std::vector<int> stack;
 
+    cell_component = new int[jjData->ncells];
 
-            sz = processing_eqtns_upper[index(i,k)].no_lower_subs;
-            for (j = sz; j >0 ; ) {
-                cell = processing_eqtns_upper[indexik].cells_lower_to_sub[--j];
-                result = result - cell_bounds[cell].lower;
-            }
+    for (CellIndex c = 0; c < jjData->ncells; c++) {
+        cell_component[c] = -1;
+    }
 
+    number_of_components = 0;
 
-            sz = processing_eqtns_upper[indexik].no_upper_subs;
-            for (j = sz; j >0;) {
-                cell = processing_eqtns_upper[indexik].cells_upper_to_sub[--j];
-                result = result - cell_bounds[cell].upper;
-            }
+    for (CellIndex c = 0; c < jjData->ncells; c++) {
+        if (cell_component[c] >= 0) {
+            continue;
+        }
 
+        cell_component[c] = number_of_components;
+        stack.push_back(c);
 
-            if (cell_bounds[cellno].upper > result)
-              {
-                improvement = cell_bounds[cellno].upper - result;
-                logger->log(5,"upper bound for cell %d reduced by %" PRIdFAST64, cellno, improvement);
+        while (!stack.empty()) {
+            int cell = stack.back();
+            stack.pop_back();
 
-                //set value
-                cell_bounds[cellno].upper = result;
-                //is it time to leave?
-                if((cell_bounds[cellno].upper < cell_bounds[cellno].lower)|| (cell_bounds[cellno].upper >grand_total))
-                  {
-                    logger->log(3,"had to correct upper bound on cell %d from %" PRIdFAST64 " to lower bound value %" PRIdFAST64,cellno, cell_bounds[cellno].upper,cell_bounds[cellno].lower);
-                    cell_bounds[cellno].upper=cell_bounds[cellno].lower;
-                    return(false);
+            for (int64_t k = cell_eqtn_offsets[cell]; k < cell_eqtn_offsets[cell + 1]; k++) {
+                ConsolidatedEquation *eqtn = &consolidated_eqtns[cell_eqtns[k]];
 
-                  }
-                else if (improvement >UNPICKING_PRECISION) {
-                    upper_bound_improvements++;
-                    rc = true;
-                  }
-              }
-          }
+                for (int j = 0; j < eqtn->size_of_eqtn; j++) {
+                    if (cell_component[eqtn->cell_number[j]] < 0) {
+                        cell_component[eqtn->cell_number[j]] = number_of_components;
+                        stack.push_back(eqtn->cell_number[j]);
+                    }
+                }
+            }
+        }
 
+        number_of_components++;
+    }
+}
 
+void Eliminate::queue_equations_of_cell(UndoLog *log, int cell) {
+    for (int64_t k = cell_eqtn_offsets[cell]; k < cell_eqtn_offsets[cell + 1]; k++) {
+        if (!queued[cell_eqtns[k]]) {
+            queued[cell_eqtns[k]] = 1;
+            log->worklist.push_back(cell_eqtns[k]);
+        }
+    }
+}
 
+// Propagate a change to the bounds of a cell through the equations it appears in, and on through the cells of any equation that gives a new bound
+// A bound is only passed on if it improves by more than UNPICKING_PRECISION or fixes the value of the cell, as in the whole-table sweeps
+// Returns the number of equations solved
+int Eliminate::propagate_from_cell(UndoLog *log, int cell) {
+    size_t head = 0;
+    bool consistent = true;
+    std::vector<int> terms;
+    std::vector<CellBounds> before;
 
+    queue_equations_of_cell(log, cell);
 
+    while ((head < log->worklist.size()) && (consistent)) {
+        int i = log->worklist[head++];
+        queued[i] = 0;
 
-      }//end of i loop over consolidated equations
+        terms.assign(consolidated_eqtns[i].cell_number, consolidated_eqtns[i].cell_number + consolidated_eqtns[i].size_of_eqtn);
+        before.resize(terms.size());
 
+        for (size_t t = 0; t < terms.size(); t++) {
+            before[t] = cell_bounds[terms[t]];
+        }
 
+        simplify_equation(log, i);
+        tidy_up_equation(log, i);
+        set_initial_bounds_for_equation(log, i);
+        improve_equation_bounds(log, i, &consistent);
 
-    //logger->log(3, "%d lower bound improvements", lower_bound_improvements);
-    //logger->log(3, "%d upper bound improvements", upper_bound_improvements);
+        for (size_t t = 0; t < terms.size(); t++) {
+            CellBounds after = cell_bounds[terms[t]];
 
+            if ((after.lower - before[t].lower > UNPICKING_PRECISION) || (before[t].upper - after.upper > UNPICKING_PRECISION) ||
+                ((after.lower == after.upper) && (before[t].lower != before[t].upper))) {
+                queue_equations_of_cell(log, terms[t]);
+            }
+        }
+    }
 
+    // Equations left when the bounds became inconsistent
+    for (size_t k = head; k < log->worklist.size(); k++) {
+        queued[log->worklist[k]] = 0;
+    }
 
+    log->worklist.clear();
 
-    return (rc);
+    return (int)head;
 }
 
 void Eliminate::RecordExistingExposure(int when) {
@@ -836,9 +810,6 @@ void Eliminate::RecordExistingExposure(int when) {
 
         iterations = 0;
 
-
-        SetUpProcessingEquationsForCurrentConsolidatedEquations();
-
         while ((improve_lower_and_upper_bounds()) && (iterations < 5)) {
             iterations++;
         }
@@ -897,41 +868,49 @@ void Eliminate::RecordExistingExposure(int when) {
 
 }
 
-bool Eliminate::SafeToRemoveSecondaryCell() {
-    int iterations;
-    bool safe;
+// Remove the cell in a new trial and find how many more primary cells are fully and partially exposed
+// The bounds are already as good as the whole-table sweeps make them, so removing the cell only has to be propagated from the cell itself
+// Only the cells in the undo log have new bounds, so only their exposure is counted again
+// The trial is left open, to be committed or rejected by the caller
+void Eliminate::test_removal(UndoLog *log, int cell, int *nsup_found_change, int *nsup_bounds_broken_change) {
+    int equations;
+    int exposure;
 
-    static int maxiterations;
-    safe = false;
+    begin_trial(log);
 
-    simplify_the_consistency_equations();
-    set_initial_lower_and_upper_bounds();
-    while (simplify_the_consistency_equations() > 0)
-      {
-        set_initial_lower_and_upper_bounds();
-      }
+    cells[cell].status = 's';
+    save_cell_bounds(log, cell);
+    cell_bounds[cell].lower = cells[cell].nominal_value;
+    cell_bounds[cell].upper = cells[cell].nominal_value;
 
-    iterations = 0;
+    equations = propagate_from_cell(log, cell);
 
+    logger->log(5, "%d equations solved to test removal of cell %d", equations, cell);
 
-    SetUpProcessingEquationsForCurrentConsolidatedEquations();
-    while ((improve_lower_and_upper_bounds()))// &&(iterations < 6))
-      {
-        iterations++;
-      }
+    *nsup_found_change = 0;
+    *nsup_bounds_broken_change = 0;
 
-    safe = getSafety();
-
-    //just for testing purposes
-    if (iterations > maxiterations)
+    for (size_t k = 0; k < log->bounds_undo.size(); k++)
       {
-        maxiterations = iterations;
-        logger->log(2, "new max iterations value %d", maxiterations);
+        int i = log->bounds_undo[k].cell;
 
-      }
+        if (cells[i].status == 'u')
+          {
+            exposure = cell_exposure(i, log->bounds_undo[k].bounds);
+            *nsup_found_change -= (exposure == 1)? 1: 0;
+            *nsup_bounds_broken_change -= (exposure == 2)? 1: 0;
 
+            exposure = cell_exposure(i, cell_bounds[i]);
+            *nsup_found_change += (exposure == 1)? 1: 0;
+            *nsup_bounds_broken_change += (exposure == 2)? 1: 0;
+          }
+      }
+}
 
-    return (safe);
+void Eliminate::reject_removal(UndoLog *log, int cell) {
+    cells[cell].status = 'm';
+    rollback_trial(log); //because the call to simplify_the_consistency_equations() and the unpicking attempt will have changed some equations and bounds
+    logger->log(5, "not safe to publish cell %d", cell);
 }
 
 void Eliminate::allocate_ordered_cells_memory() {
@@ -946,26 +925,13 @@ void Eliminate::release_ordered_cells_memory() {
 }
 
 void Eliminate::init_ordered_cells() {
-    int i;
-    int j;
-    int k;
-    int l;
-
-    for (i = 0; i < jjData->ncells; i++) {
+    for (int i = 0; i < jjData->ncells; i++) {
         OrderedCells[i] = i;
     }
 
-    for (i = 0; i < jjData->ncells; i++) {
-        for (j = i+1; j < jjData->ncells; j++) {
-            k = OrderedCells[i];
-            l = OrderedCells[j];
+    // Largest weights first, with equal weights where the original exchange sort left them
+    exchange_sort(OrderedCells, jjData->ncells, [this](int c) { return cells[c].loss_of_information_weight; });
 
-            if (cells[k].loss_of_information_weight < cells[l].loss_of_information_weight) {
-                OrderedCells[i] = l;
-                OrderedCells[j] = k;
-            }
-        }
-    }
     /*
      for (i=0; i<jjData->ncells; i++)
      {
@@ -1003,7 +969,7 @@ void Eliminate::eliminate_secondary_suppression() {
         //loop through each consistency equation
         for (i = 0; i < jjData->nsums; i++)
           {
-            sz = consistency_eqtns[i].size_of_eqtn;
+            sz = jjData->consistency_eqtns[i].size_of_eqtn;
 
             if (sz > 0)
               {
@@ -1015,8 +981,8 @@ void Eliminate::eliminate_secondary_suppression() {
 
                 for (j = 0; j < sz; j++)
                   {
-                    k = consistency_eqtns[i].cell_index[j];
-                    if(consistency_eqtns[i].plus_or_minus[j]== -1)
+                    k = jjData->consistency_eqtns[i].cell_index[j];
+                    if(jjData->plus_or_minus(i, j)== -1)
                         count_marginals++;
 
                     if (cells[k].status == 'u')
@@ -1047,7 +1013,7 @@ void Eliminate::eliminate_secondary_suppression() {
                   {
                     for (j = 0; j < sz; j++)
                       {
-                        k = consistency_eqtns[i].cell_index[j];
+                        k = jjData->consistency_eqtns[i].cell_index[j];
 
                         if (cells[k].status == 'm') {
                             cells[k].removable = false;
@@ -1088,13 +1054,31 @@ void Eliminate::eliminate_secondary_suppression() {
         logger->log(2,"woops -seem to need to create consolidated equations ");
         consolidate_the_consistency_equations();
       }
-    backup_Consolidated_Equations();
     number_of_secondary_cells_removed=0;
     init_cell_bounds();
     set_initial_lower_and_upper_bounds() ;
-    backupCellBounds();
 
+    // Bring the bounds to where the whole-table sweeps leave them, so that each removal can be tested by propagating from the removed cell
+    simplify_the_consistency_equations();
+    set_initial_lower_and_upper_bounds();
+    while (simplify_the_consistency_equations() > 0)
+      {
+        set_initial_lower_and_upper_bounds();
+      }
+
+    while (improve_lower_and_upper_bounds())
+      {
+      }
 
+    count_exposure(&current_nsup_found, &current_nsup_bounds_broken);
+
+    allocate_undo_log();
+    build_cell_equations();
+    build_components();
+
+    // Removable cells in the order they are tried, biggest first, and the positions in that order of the cells of each component
+    std::vector<int> candidates;
+    std::vector<std::vector<int> > component_candidates(number_of_components);
 
     for (i = 0; i < jjData->ncells; i++)
       {
@@ -1102,30 +1086,161 @@ void Eliminate::eliminate_secondary_suppression() {
         j = OrderedCells[i];
         if (cells[j].removable)
           {
-            backup_Consolidated_Equations();
-            backupCellBounds();
-            cells[j].status = 's';
-            cell_bounds[j].lower = cells[j].nominal_value;
-            cell_bounds[j].upper =cells[j].nominal_value;
+            component_candidates[cell_component[j]].push_back((int)candidates.size());
+            candidates.push_back(j);
+          }
+      }
+
+    logger->log(3, "%d removable cells in %d components", (int)candidates.size(), number_of_components);
+
+    // Changes in the numbers of exposed primary cells of the removals accepted so far, summed by position in a Fenwick tree
+    int ncandidates = (int)candidates.size();
+    std::vector<int> found_tree(ncandidates + 1, 0);
+    std::vector<int> broken_tree(ncandidates + 1, 0);
+
+    auto add_change = [&found_tree, &broken_tree, ncandidates](int position, int found, int broken) {
+        for (int k = position + 1; k <= ncandidates; k += k & -k) {
+            found_tree[k] += found;
+            broken_tree[k] += broken;
+        }
+    };
+
+    // Sum of the changes of the removals accepted before position
+    auto changes_before = [&found_tree, &broken_tree](int position, int *found, int *broken) {
+        *found = 0;
+        *broken = 0;
+
+        for (int k = position; k > 0; k -= k & -k) {
+            *found += found_tree[k];
+            *broken += broken_tree[k];
+        }
+    };
+
+    // Every accepted removal leaves no more primary cells exposed than at the start, so if the bounds start that way a removal that exposes no
+    // more primary cells is safe whatever is decided for cells in other components
+    // Each component is worked through on its own until it reaches a cell that would expose more, whose decision depends on the cells before
+    // it in the order, so it waits until every earlier cell has been decided
+    bool independent = (current_nsup_found <= initial_nsup_found_1) && (current_nsup_bounds_broken <= initial_nsup_bounds_broken_1);
+    std::vector<size_t> next_candidate(number_of_components, 0);
+    std::vector<int> blocked_at(number_of_components, -1);
+    std::vector<int> found_change(ncandidates, 0);
+    std::vector<int> broken_change(ncandidates, 0);
+    std::vector<char> removed(ncandidates, 0);
+    std::set<int> blocked;
+    std::vector<int> work;
+
+    for (int c = 0; c < number_of_components; c++)
+      {
+        if (!component_candidates[c].empty())
+          {
+            work.push_back(c);
+          }
+      }
+
+    while (!work.empty())
+      {
+        std::vector<size_t> first_candidate(work.size());
+
+        for (size_t k = 0; k < work.size(); k++)
+          {
+            first_candidate[k] = next_candidate[work[k]];
+          }
+
+        sys.parallel_for((int)work.size(), [this, independent, &work, &candidates, &component_candidates, &next_candidate, &blocked_at, &found_change, &broken_change, &removed](int k) {
+            int component = work[k];
+            UndoLog log;
+
+            blocked_at[component] = -1;
+
+            while (next_candidate[component] < component_candidates[component].size())
+              {
+                int position = component_candidates[component][next_candidate[component]];
+                int cell = candidates[position];
+
+                test_removal(&log, cell, &found_change[position], &broken_change[position]);
+
+                if ((!independent) || (found_change[position] > 0) || (broken_change[position] > 0))
+                  {
+                    reject_removal(&log, cell);
+                    blocked_at[component] = position;
+                    return;
+                  }
+
+                logger->log(5, "ok to remove cell %d", cell);
+                commit_trial(&log);
+                removed[position] = 1;
+                next_candidate[component]++;
+              }
+        });
+
+        for (size_t k = 0; k < work.size(); k++)
+          {
+            int component = work[k];
 
-            if (SafeToRemoveSecondaryCell())
+            for (size_t n = first_candidate[k]; n < next_candidate[component]; n++)
               {
-                number_of_secondary_cells_removed++;
-                logger->log(5, "ok to remove cell %d", j);
-                backup_Consolidated_Equations();
-                backupCellBounds();
+                int position = component_candidates[component][n];
+                add_change(position, found_change[position], broken_change[position]);
+              }
+
+            if (blocked_at[component] >= 0)
+              {
+                blocked.insert(blocked_at[component]);
+              }
+          }
+
+        work.clear();
+
+        if (!blocked.empty())
+          {
+            int position = *blocked.begin();
+            int cell = candidates[position];
+            int component = cell_component[cell];
+            int nsup_found;
+            int nsup_bounds_broken;
+            UndoLog log;
+
+            blocked.erase(blocked.begin());
+
+            changes_before(position, &nsup_found, &nsup_bounds_broken);
+            nsup_found += current_nsup_found;
+            nsup_bounds_broken += current_nsup_bounds_broken;
+
+            test_removal(&log, cell, &found_change[position], &broken_change[position]);
+            nsup_found += found_change[position];
+            nsup_bounds_broken += broken_change[position];
+
+            logger->log(5, "%d cells completely exposed", nsup_found);
+            logger->log(5, "%d cells partially exposed", nsup_bounds_broken);
+
+            if ((nsup_found <= initial_nsup_found_1) && (nsup_bounds_broken <= initial_nsup_bounds_broken_1))
+              {
+                logger->log(5, "ok to remove cell %d", cell);
+                commit_trial(&log);
+                removed[position] = 1;
+                add_change(position, found_change[position], broken_change[position]);
               }
             else //reverse the process
               {
-                cells[j].status = 'm';
-                restoreConsolidated_EquationsFromBackup(); //because th call to simplify_the_consistency_equations(); might hae changed some
-                restoreSavedCellBounds(); //because they will have beenchanged during the unicking attempt in SafeToRemoveSecondaryCell()
-                logger->log(5, "not safe to publish cell %d", j);
+                reject_removal(&log, cell);
               }
 
+            next_candidate[component]++;
+            work.push_back(component);
           }
       }
 
+    for (int position = 0; position < ncandidates; position++)
+      {
+        if (removed[position])
+          {
+            number_of_secondary_cells_removed++;
+          }
+      }
+
+    release_undo_log();
+    release_cell_equations();
+
     logger->log(2, "%d secondary cells removed",number_of_secondary_cells_removed);
 }
 
@@ -1157,9 +1272,9 @@ void Eliminate::RemoveExcessSuppression() {
     allocate_cell_bounds_memory();
     init_cell_bounds();
     consolidate_the_consistency_equations();
-    if (allocateMemoryForProcessingEquations() == false)
+    if (no_consolidated_eqtns == 0)
       {
-        logger->error(1, "Unable to allocate memory for processing equations");
+        logger->error(1, "No consolidated equations to process");
       }
 
 
@@ -1179,9 +1294,9 @@ void Eliminate::RemoveExcessSuppression() {
 #endif
     release_ordered_cells_memory();
     release_cell_bounds_memory();
-    release_processing_eqtns_memory();
     release_Consolidated_Eqtns_memory();
-    release_SavedConsolidated_Eqtns_memory();
+    release_undo_log();
+    release_cell_equations();
 
     time(&stop_seconds);
 
@@ -1199,212 +1314,3 @@ double Eliminate::getCost() {
 
     return cost;
 }
-
-int Eliminate::index( int x, int y )  { return x * biggestConsEqn  + y; }
-
-
-
-
-bool  Eliminate::allocateMemoryForProcessingEquations()
-{
-    int i;
-    bool returnval = true;
-    //clean up anythjing that was here before
-
-    no_processing_eqtns = 0;
-
-    if (no_consolidated_eqtns <=0)
-      {
-        returnval = false;
-      }
-    else
-      {
-
-        //phase 1: find out how much memory we need to allocate
-        biggestConsEqn = 0;
-        for (i = 0; i < no_consolidated_eqtns; i++)
-          {
-            if (consolidated_eqtns[i].size_of_eqtn > biggestConsEqn) {
-                biggestConsEqn = consolidated_eqtns[i].size_of_eqtn;
-            }
-          }
-        if (biggestConsEqn==0) {
-            returnval=false;
-            logger->error(1, "Consolidated equations all have size 0");
-        }
-        else
-          {   // then allocate it
-              no_processing_eqtns = biggestConsEqn * no_consolidated_eqtns;
-              processing_eqtns_lower = new  ProcessingEquation [no_processing_eqtns];
-              processing_eqtns_upper = new  ProcessingEquation [no_processing_eqtns];
-              for(i=0;i<no_processing_eqtns;i++)
-                {
-                  processing_eqtns_lower[i].cells_lower_to_add = new int[biggestConsEqn];
-                  processing_eqtns_lower[i].cells_lower_to_sub = new int[biggestConsEqn];
-                  processing_eqtns_lower[i].cells_upper_to_add = new int[biggestConsEqn];
-                  processing_eqtns_lower[i].cells_upper_to_sub = new int[biggestConsEqn];
-
-                  processing_eqtns_upper[i].cells_lower_to_add = new int[biggestConsEqn];
-                  processing_eqtns_upper[i].cells_lower_to_sub = new int[biggestConsEqn];
-                  processing_eqtns_upper[i].cells_upper_to_add = new int[biggestConsEqn];
-                  processing_eqtns_upper[i].cells_upper_to_sub = new int[biggestConsEqn];
-
-                }
-
-          }
-      }
-    return returnval;
-}
-
-void Eliminate::SetUpProcessingEquationsForCurrentConsolidatedEquations(void)
-{
-    int i,j,k,sz;
-    int_fast64_t consolidated_RHS;
-    int indexij,idx;
-    int dest_cell,dest_plus_minus;
-
-    /////////////////////
-    // Initialise memory //
-    /////////////////////
-
-    //phase 1: zero it all
-
-    for (j = no_consolidated_eqtns*biggestConsEqn; j >0  ; )
-      {
-        j--;
-        processing_eqtns_lower[j].no_lower_adds = 0;
-        processing_eqtns_lower[j].no_lower_subs = 0;
-        processing_eqtns_lower[j].no_upper_adds = 0;
-        processing_eqtns_lower[j].no_upper_subs = 0;
-        processing_eqtns_upper[j].no_lower_adds = 0;
-        processing_eqtns_upper[j].no_lower_subs = 0;
-        processing_eqtns_upper[j].no_upper_adds = 0;
-        processing_eqtns_upper[j].no_upper_subs = 0;
-      }
-
-
-    //phase 2: put the real values in
-
-    for (i = 0; i < no_consolidated_eqtns; i++)
-      {
-
-        sz = consolidated_eqtns[i].size_of_eqtn;
-
-        if (sz > 0)
-          {
-            ////////////////////////////////////
-            // Setup the processing equations //
-            ////////////////////////////////////
-
-            consolidated_RHS = consolidated_eqtns[i].RHS;
-
-            for (j = 0; j < sz; j++)
-              {
-                indexij = index(i,j);
-
-                // Setup processing equations
-
-                dest_cell = consolidated_eqtns[i].cell_number[j];
-                dest_plus_minus = consolidated_eqtns[i].plus_or_minus[j];
-
-                processing_eqtns_lower[indexij].cellnumber = dest_cell;
-                processing_eqtns_upper[indexij].cellnumber = dest_cell;
-
-                if (dest_plus_minus == 1)
-                  {
-                    // The cell we are looking at is +ve
-
-                    processing_eqtns_lower[indexij].RHS = consolidated_RHS;
-                    processing_eqtns_upper[indexij].RHS = consolidated_RHS;
-
-                    for (k = 0; k < sz; k++) {//remember k and j are both counters in the ith consolidated equation
-                        if (k != j)
-                          {
-                            // Get all the other cells in the consolidated equation and put them in the right place
-
-                            if (consolidated_eqtns[i].plus_or_minus[k] == 1)
-                              {
-                                // Set up lower calculation
-
-                                idx = processing_eqtns_lower[indexij].no_upper_subs;
-                                processing_eqtns_lower[indexij].cells_upper_to_sub[idx] = consolidated_eqtns[i].cell_number[k];
-                                idx++;
-                                processing_eqtns_lower[indexij].no_upper_subs = idx;
-
-                                // Set up upper calculation
-
-                                idx = processing_eqtns_upper[indexij].no_lower_subs;
-                                processing_eqtns_upper[indexij].cells_lower_to_sub[idx] = consolidated_eqtns[i].cell_number[k];
-                                idx++;
-                                processing_eqtns_upper[indexij].no_lower_subs = idx;
-                              }
-                            else
-                              {
-                                // Set up lower calculation
-
-                                idx = processing_eqtns_lower[indexij].no_lower_adds;
-                                processing_eqtns_lower[indexij].cells_lower_to_add[idx] = consolidated_eqtns[i].cell_number[k];
-                                idx++;
-                                processing_eqtns_lower[indexij].no_lower_adds = idx;
-
-                                // Set up upper calculation
-
-                                idx = processing_eqtns_upper[indexij].no_upper_adds;
-                                processing_eqtns_upper[indexij].cells_upper_to_add[idx] = consolidated_eqtns[i].cell_number[k];
-                                idx++;
-                                processing_eqtns_upper[indexij].no_upper_adds = idx;
-                              }
-                          }
-                    }//end loop over k
-                  }//end dest_plus_minus==1
-                else
-                  {
-                    // The cell we are looking at is -ve
-
-                    processing_eqtns_lower[indexij].RHS = -consolidated_RHS;
-                    processing_eqtns_upper[indexij].RHS = -consolidated_RHS;
-
-                    for (k = 0; k < sz; k++)
-                      {
-                        if (k != j) {
-                            // Get all the other cells in the consolidated equation and put them in the right place
-
-                            if (consolidated_eqtns[i].plus_or_minus[k] == 1) {
-                                // Set up lower calculation
-
-                                idx = processing_eqtns_lower[indexij].no_lower_adds;
-                                processing_eqtns_lower[indexij].cells_lower_to_add[idx] = consolidated_eqtns[i].cell_number[k];
-                                idx++;
-                                processing_eqtns_lower[indexij].no_lower_adds = idx;
-
-                                // Set up upper calculation
-
-                                idx = processing_eqtns_upper[indexij].no_upper_adds;
-                                processing_eqtns_upper[indexij].cells_upper_to_add[idx] = consolidated_eqtns[i].cell_number[k];
-                                idx++;
-                                processing_eqtns_upper[indexij].no_upper_adds = idx;
-                            } else {
-                                // Set up lower calculation
-
-                                idx = processing_eqtns_lower[indexij].no_upper_subs;
-                                processing_eqtns_lower[indexij].cells_upper_to_sub[idx] = consolidated_eqtns[i].cell_number[k];
-                                idx++;
-                                processing_eqtns_lower[indexij].no_upper_subs = idx;
-
-                                // Set up upper calculation
-
-                                idx = processing_eqtns_upper[indexij].no_lower_subs;
-                                processing_eqtns_upper[indexij].cells_lower_to_sub[idx] = consolidated_eqtns[i].cell_number[k];
-                                idx++;
-                                processing_eqtns_upper[indexij].no_lower_subs = idx;
-                            }
-                        }
-                      }
-                  }
-
-              }
-          }
-
-      }
-
-}
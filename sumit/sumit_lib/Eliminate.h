@@ -3,6 +3,9 @@
 #include "stdafx.h"
 #include <cstdint>
 #include <time.h>
+#include <atomic>
+#include <vector>
+#include "BoundKernel.h"
 #include "JJData.h"
 
 #define INT64_PRECISION (int_fast64_t)(1 / FLOAT_PRECISION)
@@ -32,18 +35,24 @@ private:
         bool removable;
     };
 
-    struct ConsistencyEquation {
-        int_fast64_t RHS;
-        CellIndex size_of_eqtn;
-        CellIndex *cell_index;
-        int *plus_or_minus;
+    typedef Bounds<int_fast64_t> CellBounds;
+
+    // Undo log entries for a cell's bounds and for a consolidated equation as they were before the first change made while testing a cell for removal
+    // The terms of a saved equation are held in undo_cells and undo_signs starting at first_term
+    struct BoundsUndo {
+        int cell;
+        CellBounds bounds;
     };
 
-    struct CellBounds {
-        int_fast64_t lower;
-        int_fast64_t upper;
+    struct EquationUndo {
+        int eqtn;
+        int_fast64_t RHS;
+        int size_of_eqtn;
+        size_t first_term;
     };
 
+    // Consolidated equations only contain suppressed cells
+    // Their terms are held contiguously in consolidated_cells and consolidated_signs, and an equation only ever shrinks in place
     struct ConsolidatedEquation {
         int_fast64_t RHS;
         int size_of_eqtn;
@@ -51,39 +60,56 @@ private:
         int *plus_or_minus;
     };
 
-    struct ProcessingEquation {
-        int cellnumber;
-        int_fast64_t RHS;
-        int no_lower_adds;
-        int *cells_lower_to_add;
-        int no_lower_subs;
-        int *cells_lower_to_sub;
-        int no_upper_adds;
-        int *cells_upper_to_add;
-        int no_upper_subs;
-        int *cells_upper_to_sub;
-    };
-
     Cell *cells;
-    ConsistencyEquation *consistency_eqtns;
+    int_fast64_t *equation_RHS;
     CellIndex *primaryCells;
 
     int_fast64_t grand_total;
 
-    int no_consolidated_eqtns,num_BackupConsolidatedEquations;
-    int no_processing_eqtns;
+    int no_consolidated_eqtns;
     int nPrimaryCells;
 
-    struct CellBounds* cell_bounds, *savedCellBounds;
+    CellBounds* cell_bounds;
+
+    struct ConsolidatedEquation *consolidated_eqtns;
+    int *consolidated_cells;
+    int *consolidated_signs;
+    int64_t consolidated_terms;
+
+    // Undo log of the changes made while testing a cell for removal, so that a rejected removal is rolled back in time proportional to what changed
+    // Each test takes a new generation, and a cell or equation is saved at most once per test, when its stamp is not that generation
+    // Cells in different components are tested at the same time, each test with its own log
+    struct UndoLog {
+        int generation;
+        std::vector<BoundsUndo> bounds_undo;
+        std::vector<EquationUndo> equation_undo;
+        std::vector<int> undo_cells;
+        std::vector<int> undo_signs;
+
+        // Equations waiting to be solved again while propagating the removal of a cell
+        std::vector<int> worklist;
+    };
 
-    struct ConsolidatedEquation *consolidated_eqtns, *saved_consolidated_equations;
-    struct ProcessingEquation *processing_eqtns_lower;
-    struct ProcessingEquation *processing_eqtns_upper;
-    int biggestConsEqn;
+    std::atomic<int> undo_generation;
+    int *cell_bounds_stamp;
+    int *equation_stamp;
 
     int initial_nsup_found_1;
     int initial_nsup_bounds_broken_1;
 
+    // Numbers of primary cells fully and partially exposed before any secondary cells are removed
+    int current_nsup_found;
+    int current_nsup_bounds_broken;
+
+    // The consolidated equations each cell appears in are cell_eqtns[cell_eqtn_offsets[cell]] to cell_eqtns[cell_eqtn_offsets[cell + 1] - 1]
+    int64_t *cell_eqtn_offsets;
+    int *cell_eqtns;
+    char *queued;
+
+    // Cells that share a consolidated equation are in the same component, and removing a cell cannot change the bounds of cells in other components
+    int *cell_component;
+    int number_of_components;
+
     int* OrderedCells;
 
     int number_of_secondary_cells_removed;
@@ -97,27 +123,36 @@ private:
     void init_cell_bounds();
     void release_cell_bounds_memory();
     void release_Consolidated_Eqtns_memory(void) ;
-    void release_SavedConsolidated_Eqtns_memory(void) ;
-    void backup_Consolidated_Equations(void);
-    void restoreConsolidated_EquationsFromBackup(void);
-    void backupCellBounds(void);
-    void restoreSavedCellBounds(void);
-    bool allocateMemoryForProcessingEquations();
-    void SetUpProcessingEquationsForCurrentConsolidatedEquations(void);
-    void release_processing_eqtns_memory();
+    void allocate_undo_log();
+    void release_undo_log();
+    void save_cell_bounds(UndoLog *log, int cell);
+    void save_equation(UndoLog *log, int i);
+    void begin_trial(UndoLog *log);
+    void commit_trial(UndoLog *log);
+    void rollback_trial(UndoLog *log);
     void tidy_up_the_consolidated_equations();
     void consolidate_the_consistency_equations();
+    void tidy_up_equation(UndoLog *log, int i);
     int simplify_the_consistency_equations();
+    int simplify_equation(UndoLog *log, int i);
     bool set_initial_lower_and_upper_bounds();
-    bool getSafety();
+    bool set_initial_bounds_for_equation(UndoLog *log, int i);
     bool improve_lower_and_upper_bounds();
+    bool improve_equation_bounds(UndoLog *log, int i, bool *consistent);
+    void build_cell_equations();
+    void release_cell_equations();
+    void build_components();
+    void queue_equations_of_cell(UndoLog *log, int cell);
+    int propagate_from_cell(UndoLog *log, int cell);
+    int cell_exposure(int cell, CellBounds bounds);
+    void count_exposure(int *nsup_found, int *nsup_bounds_broken);
     void RecordExistingExposure(int when);
-    bool SafeToRemoveSecondaryCell();
+    void test_removal(UndoLog *log, int cell, int *nsup_found_change, int *nsup_bounds_broken_change);
+    void reject_removal(UndoLog *log, int cell);
     void allocate_ordered_cells_memory();
     void release_ordered_cells_memory();
     void init_ordered_cells();
     void eliminate_secondary_suppression();
     void display_secondary_suppression();
-    int index(int x, int y);
 
 };
@@ -0,0 +1,159 @@
+#include "stdafx.h"
+#include <chrono>
+#include "EvaluationBackend.h"
+
+EvaluationJob::EvaluationJob() {
+    started_time = 0.0;
+    completed_time = 0.0;
+    transfer_time = 0.0;
+}
+
+EvaluationJob::~EvaluationJob() {
+}
+
+double EvaluationJob::get_started_time() {
+    return started_time;
+}
+
+double EvaluationJob::get_completed_time() {
+    return completed_time;
+}
+
+double EvaluationJob::get_transfer_time() {
+    return transfer_time;
+}
+
+void EvaluationJob::set_started_time(double time) {
+    started_time = time;
+}
+
+void EvaluationJob::set_completed_time(double time) {
+    completed_time = time;
+}
+
+void EvaluationJob::add_transfer_time(double time) {
+    transfer_time += time;
+}
+
+BatchMemberJob::BatchMemberJob(std::shared_ptr<EvaluationBatchJob> batch, int index) {
+    this->batch = batch;
+    this->index = index;
+}
+
+BatchMemberJob::~BatchMemberJob() {
+}
+
+const char *BatchMemberJob::getName() {
+    return batch->getName();
+}
+
+int BatchMemberJob::getStatus() {
+    int status = batch->getStatus();
+
+    if (status >= 0) {
+        copy_times();
+    }
+
+    return status;
+}
+
+double BatchMemberJob::getResult() {
+    return batch->getBatchResult(index);
+}
+
+int BatchMemberJob::getElapsedTime() {
+    return batch->getElapsedTime();
+}
+
+int BatchMemberJob::getCosts(double *costs, int size) {
+    return batch->getBatchCosts(index, costs, size);
+}
+
+void BatchMemberJob::getJJFile(const char *filename) {
+    batch->getBatchJJFile(index, filename);
+}
+
+bool BatchMemberJob::getTelemetry(SolverTelemetry *telemetry) {
+    if (index != 0) {
+        return false;
+    }
+
+    bool found = batch->getTelemetry(telemetry);
+    copy_times();
+
+    return found;
+}
+
+// The batch's times so far, including the transfers made for the other members
+void BatchMemberJob::copy_times() {
+    set_started_time(batch->get_started_time());
+    set_completed_time(batch->get_completed_time());
+    add_transfer_time(batch->get_transfer_time() - get_transfer_time());
+}
+
+EvaluationBackend::EvaluationBackend() {
+    parent = NULL;
+    completion_count = 0;
+}
+
+EvaluationBackend::~EvaluationBackend() {
+}
+
+int EvaluationBackend::runBatch(const char *injjfilename, const CellIndex *const *perms, const double *max_costs, int count, int size, int protection_type, int model_type, EvaluationJob **jobs) {
+    int started = 0;
+
+    for (int i = 0; i < count; i++) {
+        try {
+            jobs[i] = runProtection(injjfilename, perms[i], size, protection_type, model_type, max_costs[i]);
+            started++;
+        } catch (int e) {
+            if (started == 0) {
+                throw e;
+            }
+
+            // The rest wait for a solver to become free
+            break;
+        }
+    }
+
+    return started;
+}
+
+int EvaluationBackend::completions() {
+    std::lock_guard<std::mutex> lock(completion_mutex);
+    return completion_count;
+}
+
+int EvaluationBackend::wait_for_completion(int seen, int timeout) {
+    std::unique_lock<std::mutex> lock(completion_mutex);
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+    while (completion_count == seen) {
+        if (job_finished.wait_until(lock, deadline) == std::cv_status::timeout) {
+            break;
+        }
+    }
+
+    return completion_count;
+}
+
+void EvaluationBackend::notify_completion() {
+    {
+        std::lock_guard<std::mutex> lock(completion_mutex);
+        completion_count++;
+    }
+    job_finished.notify_all();
+
+    if (parent != NULL) {
+        parent->notify_completion();
+    }
+}
+
+void EvaluationBackend::set_parent(EvaluationBackend *parent) {
+    this->parent = parent;
+}
+
+bool EvaluationBackend::has_parent() {
+    return (parent != NULL);
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "stdafx.h"
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include "JJData.h"
+#include "SolverTelemetry.h"
+
+// Thrown when no solver session is available
+#define SESSION_EXCEPTION 111
+
+// Thrown when a server that other servers can stand in for stops responding
+#define SERVER_EXCEPTION 112
+
+// Status of a job whose server stopped responding before it finished, so that it must be run again
+#define JOB_LOST -5
+
+// A single run of the cell suppression solver for one permutation of genes
+// Status values follow the server convention: -2 not started, -1 running, 0 completed, > 0 error, and JOB_LOST if the solver can no
+// longer be reached
+class EvaluationJob {
+
+public:
+    EvaluationJob();
+    virtual ~EvaluationJob();
+
+    // Name used to identify the job in log messages
+    virtual const char *getName() = 0;
+
+    virtual int getStatus() = 0;
+
+    // The following methods are only valid once the job has completed
+    virtual double getResult() = 0;
+    virtual int getElapsedTime() = 0;
+
+    // Copy up to size costs into the supplied array and return the number of costs copied
+    virtual int getCosts(double *costs, int size) = 0;
+
+    // Write the JJ file containing the suppression pattern produced by the solver
+    virtual void getJJFile(const char *filename) = 0;
+
+    // Copy the solver's measurements of its run and return true, or return false if the solver did not report any
+    virtual bool getTelemetry(SolverTelemetry *telemetry) = 0;
+
+    // Wall times (see System::wall_time) at which the solver started and finished - only valid once the job has completed
+    double get_started_time();
+    double get_completed_time();
+
+    // Seconds spent moving the solver's input and results between the client and the solver so far
+    double get_transfer_time();
+
+protected:
+    void set_started_time(double time);
+    void set_completed_time(double time);
+    void add_transfer_time(double time);
+
+private:
+    double started_time;
+    double completed_time;
+    double transfer_time;
+
+};
+
+// A single run of the cell suppression solver for several permutations of genes of the same JJ file
+// The results of each permutation are selected by its index, and the EvaluationJob methods refer to the first permutation
+class EvaluationBatchJob: public EvaluationJob {
+
+public:
+    virtual double getBatchResult(int index) = 0;
+    virtual int getBatchCosts(int index, double *costs, int size) = 0;
+    virtual void getBatchJJFile(int index, const char *filename) = 0;
+
+};
+
+// The results of one permutation of a batch
+// The members of a batch share its solver, which is released once all of them have been deleted
+// Only the first member reports the telemetry of the batch, so that each solver run is counted once
+class BatchMemberJob: public EvaluationJob {
+
+public:
+    BatchMemberJob(std::shared_ptr<EvaluationBatchJob> batch, int index);
+    ~BatchMemberJob();
+    const char *getName();
+    int getStatus();
+    double getResult();
+    int getElapsedTime();
+    int getCosts(double *costs, int size);
+    void getJJFile(const char *filename);
+    bool getTelemetry(SolverTelemetry *telemetry);
+
+private:
+    std::shared_ptr<EvaluationBatchJob> batch;
+    int index;
+
+    void copy_times();
+
+};
+
+// Somewhere to run cell suppression solvers
+// GAProtection only sees this interface, so the solver may run on a remote server or in-process
+class EvaluationBackend {
+
+public:
+    EvaluationBackend();
+    virtual ~EvaluationBackend();
+
+    // Name used to identify the backend in log messages
+    virtual const char *getName() = 0;
+
+    // Return the maximum number of jobs that may exist at any one time
+    virtual int getLimit() = 0;
+
+    // Start a solver for the supplied permutation of genes
+    // Throws SESSION_EXCEPTION if the job limit has been reached
+    // The remote solver interprets a max_cost of zero to mean unlimited cost (and hence no early termination)
+    // Deleting the returned job releases its slot
+    virtual EvaluationJob *runProtection(const char *injjfilename, const CellIndex *perm, int size, int protection_type, int model_type, double max_cost) = 0;
+
+    // Start the first of the count permutations in perms, each with its own max_cost, put a job for each in jobs and return the number started
+    // Throws SESSION_EXCEPTION if the job limit has been reached before any could be started
+    // Backends that share one solver between the permutations override this, and by default each permutation has a solver of its own
+    virtual int runBatch(const char *injjfilename, const CellIndex *const *perms, const double *max_costs, int count, int size, int protection_type, int model_type, EvaluationJob **jobs);
+
+    // Number of jobs that have finished (successfully or not) since the backend was created
+    int completions();
+
+    // Block until the number of completions differs from seen or until timeout milliseconds have passed
+    // Take the value of seen from completions() before checking job status so that no completion is missed
+    int wait_for_completion(int seen, int timeout);
+
+    // Called by jobs, on any thread, once their status has changed to completed or failed
+    void notify_completion();
+
+    // Also notify the completions of this backend's jobs to a backend that shares them out
+    void set_parent(EvaluationBackend *parent);
+    bool has_parent();
+
+private:
+    EvaluationBackend *parent;
+    int completion_count;
+    std::mutex completion_mutex;
+    std::condition_variable job_finished;
+
+};
@@ -1,8 +1,12 @@
 #include "stdafx.h"
 #include <cstring>
+#include <vector>
+#include <algorithm>
 #include "EvaluationCache.h"
 #include "GAProtection.h"
 
+#define INITIAL_CACHE_CAPACITY 64
+
 EvaluationCache::EvaluationCache(int genome_size) {
     this->genome_size = genome_size;
 
@@ -10,22 +14,39 @@ EvaluationCache::EvaluationCache(int genome_size) {
         requests[i] = 0;
         hits[i] = 0;
         misses[i] = 0;
+        evictions[i] = 0;
+    }
+
+    capacity = INITIAL_CACHE_CAPACITY;
+    table = new Entry[capacity];
+    for (size_t i = 0; i < capacity; i++) {
+        table[i].occupied = false;
     }
+    count = 0;
+    clock = 0;
+
+    memory_budget = (long long)DEFAULT_CACHE_BUDGET_MB * 1024 * 1024;
+    memory_used = (long long)(capacity * sizeof(struct Entry));
+    eviction_policy = EVICTION_LRU;
 }
 
 EvaluationCache::~EvaluationCache() {
-#if _MSC_VER==1600
-    // Visual Studio 2010 doesn't fully support C++11
-    for(std::map<Evaluation, struct Result, cmp>::iterator it=map.begin(); it != map.end(); ++it) {
-        remove(it->second);
-    }
-#else
-    for (auto const &key : map) {
-        remove(key.second);
+    for (size_t i = 0; i < capacity; i++) {
+        if (table[i].occupied) {
+            remove(table[i].result);
+        }
     }
-#endif
 
-    map.clear();
+    delete[] table;
+}
+
+void EvaluationCache::set_memory_budget(long long bytes, int eviction_policy) {
+    memory_budget = bytes;
+    this->eviction_policy = eviction_policy;
+
+    logger->log(3, "Evaluation cache budget %lld MB (%s eviction)", bytes / (1024 * 1024), (eviction_policy == EVICTION_FITNESS)? "fitness": "LRU");
+
+    evict();
 }
 
 void EvaluationCache::remove(struct Result result) {
@@ -43,9 +64,139 @@ void EvaluationCache::remove(struct Result result) {
     result.fitness = 0.0;
 }
 
+struct Fingerprint EvaluationCache::fingerprint(const CellIndex *genes, int model_type) {
+    return murmur_hash3_x64_128(genes, (size_t)genome_size * sizeof(CellIndex), (uint32_t)model_type);
+}
+
+// Return the slot holding the key or, if the key is not present, the empty slot where it would go
+size_t EvaluationCache::find_slot(const struct Fingerprint *key, int model_type) {
+    size_t mask = capacity - 1;
+    size_t slot = (size_t)key->h1 & mask;
+
+    while (table[slot].occupied) {
+        if ((table[slot].model_type == model_type) && fingerprint_equals(&table[slot].key, key)) {
+            break;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+// Look up an evaluation and mark it as used
+struct EvaluationCache::Entry *EvaluationCache::find(const CellIndex *genes, int model_type) {
+    struct Fingerprint key = fingerprint(genes, model_type);
+    size_t slot = find_slot(&key, model_type);
+
+    if (table[slot].occupied) {
+        table[slot].last_used = ++clock;
+        return &table[slot];
+    } else {
+        return NULL;
+    }
+}
+
+// Double the capacity of the table
+void EvaluationCache::grow() {
+    struct Entry *old_table = table;
+    size_t old_capacity = capacity;
+
+    capacity *= 2;
+    table = new Entry[capacity];
+    for (size_t i = 0; i < capacity; i++) {
+        table[i].occupied = false;
+    }
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_table[i].occupied) {
+            table[find_slot(&old_table[i].key, old_table[i].model_type)] = old_table[i];
+        }
+    }
+
+    delete[] old_table;
+
+    memory_used += (long long)((capacity - old_capacity) * sizeof(struct Entry));
+}
+
+// Remove the entry in a slot, shifting back any following entries that would otherwise become unreachable
+void EvaluationCache::erase(size_t slot) {
+    size_t mask = capacity - 1;
+
+    memory_used -= table[slot].result.bytes;
+    remove(table[slot].result);
+    count--;
+
+    size_t hole = slot;
+    size_t next = slot;
+
+    for (;;) {
+        next = (next + 1) & mask;
+
+        if (! table[next].occupied) {
+            break;
+        }
+
+        size_t home = (size_t)table[next].key.h1 & mask;
+
+        // Move the entry into the hole unless its home slot lies cyclically in (hole, next]
+        bool reachable = (hole <= next)? ((home > hole) && (home <= next)): ((home > hole) || (home <= next));
+        if (! reachable) {
+            table[hole] = table[next];
+            hole = next;
+        }
+    }
+
+    table[hole].occupied = false;
+}
+
+// Remove results until the memory used is back below 90% of the budget
+// The most recently added result and pinned results are never removed as their JJ files may still be in use
+void EvaluationCache::evict() {
+    if (memory_used <= memory_budget) {
+        return;
+    }
+
+    std::vector<size_t> slots;
+    for (size_t i = 0; i < capacity; i++) {
+        if (table[i].occupied && (table[i].pins == 0) && (table[i].last_used != clock)) {
+            slots.push_back(i);
+        }
+    }
+
+    struct Entry *entries = table;
+    int policy = eviction_policy;
+
+    // Order by eviction preference - oldest first, or least fit (highest cost) first with ties broken by age
+    std::sort(slots.begin(), slots.end(), [entries, policy](size_t a, size_t b) {
+        if ((policy == EVICTION_FITNESS) && (entries[a].result.fitness != entries[b].result.fitness)) {
+            return entries[a].result.fitness > entries[b].result.fitness;
+        }
+        return entries[a].last_used < entries[b].last_used;
+    });
+
+    // Slot numbers change as entries are erased, so note the keys first
+    std::vector<struct Fingerprint> keys;
+    std::vector<int> model_types;
+    long long target = (memory_budget / 10) * 9;
+    long long freed = 0;
+
+    for (size_t i = 0; (i < slots.size()) && ((memory_used - freed) > target); i++) {
+        keys.push_back(entries[slots[i]].key);
+        model_types.push_back(entries[slots[i]].model_type);
+        freed += entries[slots[i]].result.bytes;
+    }
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        erase(find_slot(&keys[i], model_types[i]));
+        evictions[model_types[i]]++;
+    }
+
+    logger->log(4, "Evaluation cache evicted %d results (%lld bytes in use)", (int)keys.size(), memory_used);
+}
+
 bool EvaluationCache::cached(const CellIndex *genes, int model_type) {
-    Evaluation eval = Evaluation(genes, genome_size, model_type);
-    bool cached = (map.count(eval) > 0);
+    bool cached = (find(genes, model_type) != NULL);
 
     requests[model_type]++;
 
@@ -59,37 +210,34 @@ bool EvaluationCache::cached(const CellIndex *genes, int model_type) {
 }
 
 char *EvaluationCache::jjFile(const CellIndex *genes, int model_type) {
-    Evaluation eval = Evaluation(genes, genome_size, model_type);
-    std::map<Evaluation, struct Result, cmp>::iterator it = map.find(eval);
+    struct Entry *entry = find(genes, model_type);
 
-    if (it != map.end()) {
-        return it->second.jj_file;
+    if (entry != NULL) {
+        return entry->result.jj_file;
     } else {
         return NULL;
     }
 }
 
 int EvaluationCache::costs(const CellIndex *genes, int model_type, double **costs) {
-    Evaluation eval = Evaluation(genes, genome_size, model_type);
-    std::map<Evaluation, struct Result, cmp>::iterator it = map.find(eval);
+    struct Entry *entry = find(genes, model_type);
 
-    if (it != map.end()) {
-        for (int i = 0; i < it->second.number_of_costs; i++) {
-            (*costs)[i] = it->second.costs[i];
+    if (entry != NULL) {
+        for (int i = 0; i < entry->result.number_of_costs; i++) {
+            (*costs)[i] = entry->result.costs[i];
         }
 
-        return it->second.number_of_costs;
+        return entry->result.number_of_costs;
     } else {
         return 0;
     }
 }
 
 double EvaluationCache::fitness(const CellIndex *genes, int model_type) {
-    Evaluation eval = Evaluation(genes, genome_size, model_type);
-    std::map<Evaluation, struct Result, cmp>::iterator it = map.find(eval);
+    struct Entry *entry = find(genes, model_type);
 
-    if (it != map.end()) {
-        return it->second.fitness;
+    if (entry != NULL) {
+        return entry->result.fitness;
     } else {
         return 0.0;
     }
@@ -99,22 +247,32 @@ void EvaluationCache::add(const CellIndex *genes, int model_type, char *jj_file,
     struct Result result;
 
     // Remove any previous result
-    Evaluation eval = Evaluation(genes, genome_size, model_type);
-    std::map<Evaluation, struct Result, cmp>::iterator it = map.find(eval);
+    struct Fingerprint key = fingerprint(genes, model_type);
+    size_t slot = find_slot(&key, model_type);
 
-    if (it != map.end()) {
-        remove(it->second);
+    if (table[slot].occupied) {
+        erase(slot);
     }
 
+    // Keep the load factor at or below one half
+    if ((count + 1) * 2 > capacity) {
+        grow();
+    }
+
+    result.bytes = 0;
+
     // Filename and costs must be self-contained, so copy
     if (jj_file != NULL) {
         result.jj_file = new char[strlen(jj_file) + 1];
-        char *p = jj_file;
-        char *q = result.jj_file;
-        while (*p) {
-            *q++ = *p++;
+        strcpy(result.jj_file, jj_file);
+        result.bytes += (long long)(strlen(jj_file) + 1);
+
+        // The cached JJ file counts towards the budget
+        time_t modified;
+        long size;
+        if (sys.get_file_stamp(jj_file, &modified, &size)) {
+            result.bytes += size;
         }
-        *q = *p;
     } else {
         result.jj_file = NULL;
     }
@@ -125,6 +283,7 @@ void EvaluationCache::add(const CellIndex *genes, int model_type, char *jj_file,
         for (int i = 0; i < number_of_costs; i++) {
             result.costs[i] = costs[i];
         }
+        result.bytes += (long long)(number_of_costs * sizeof(double));
     } else {
         result.number_of_costs = 0;
         result.costs = NULL;
@@ -132,32 +291,57 @@ void EvaluationCache::add(const CellIndex *genes, int model_type, char *jj_file,
 
     result.fitness = fitness;
 
-    map[Evaluation(genes, genome_size, model_type)] = result;
+    slot = find_slot(&key, model_type);
+    table[slot].key = key;
+    table[slot].model_type = model_type;
+    table[slot].occupied = true;
+    table[slot].pins = 0;
+    table[slot].last_used = ++clock;
+    table[slot].result = result;
+    count++;
+
+    memory_used += result.bytes;
+
+    evict();
 }
 
-void EvaluationCache::log_genome(const CellIndex *genes, int model_type) {
-    Evaluation eval = Evaluation(genes, genome_size, model_type);
+void EvaluationCache::pin(const CellIndex *genes, int model_type) {
+    struct Entry *entry = find(genes, model_type);
 
-    if (map.count(eval) > 0) {
+    if (entry != NULL) {
+        entry->pins++;
+    }
+}
+
+void EvaluationCache::unpin(const CellIndex *genes, int model_type) {
+    struct Entry *entry = find(genes, model_type);
+
+    if ((entry != NULL) && (entry->pins > 0)) {
+        entry->pins--;
+    }
+}
+
+void EvaluationCache::log_genome(const CellIndex *genes, int model_type) {
+    if (find(genes, model_type) != NULL) {
+        Evaluation eval = Evaluation(genes, genome_size, model_type);
         eval.log_genome();
     }
 }
 
 void EvaluationCache::log_costs(const CellIndex *genes, int model_type) {
-    Evaluation eval = Evaluation(genes, genome_size, model_type);
-    std::map<Evaluation, struct Result, cmp>::iterator it = map.find(eval);
+    struct Entry *entry = find(genes, model_type);
 
-    if (it != map.end()) {
+    if (entry != NULL) {
         char s[32];
         int length = 0;
-        for (int i = 0; i < it->second.number_of_costs; i++) {
-            length += sprintf(s, " %f", it->second.costs[i]);
+        for (int i = 0; i < entry->result.number_of_costs; i++) {
+            length += sprintf(s, " %f", entry->result.costs[i]);
         }
 
         char *str = new char[length + 1];
         char *p = str;
-        for (int i = 0; i < it->second.number_of_costs; i++) {
-            p += sprintf(p, " %f", it->second.costs[i]);
+        for (int i = 0; i < entry->result.number_of_costs; i++) {
+            p += sprintf(p, " %f", entry->result.costs[i]);
         }
 
         logger->log(4, "Costs: %s", str);
@@ -165,3 +349,9 @@ void EvaluationCache::log_costs(const CellIndex *genes, int model_type) {
         delete[] str;
     }
 }
+
+void EvaluationCache::log_statistics() {
+    logger->log(4, "Evaluation cache size %d results, %lld bytes (budget %lld bytes)", (int)count, memory_used, memory_budget);
+    logger->log(4, "Evaluation cache yplus model evictions: %d", evictions[YPLUS_MODEL]);
+    logger->log(4, "Evaluation cache yminus model evictions: %d", evictions[YMINUS_MODEL]);
+}
@@ -1,30 +1,46 @@
 #pragma once
 
 #include "stdafx.h"
-#include <map>
 #include "Evaluation.h"
+#include "Hash.h"
 #include "Solver.h"
 #if defined __APPLE__
 #include <errno.h>
 #endif
 
+#define EVICTION_LRU 0
+#define EVICTION_FITNESS 1
 
+// Default limit on the memory used by cached results plus the size of their cached JJ files
+#define DEFAULT_CACHE_BUDGET_MB 1024
+
+// Evaluations are keyed by a 128-bit fingerprint of the genome so genomes are not stored
+// Results are held in an open addressing hash table with linear probing
 class EvaluationCache {
 public:
     EvaluationCache(int chromosome_size);
     ~EvaluationCache();
 
+    // When the budget is exceeded the least recently used (EVICTION_LRU) or least fit (EVICTION_FITNESS) results are removed
+    void set_memory_budget(long long bytes, int eviction_policy);
+
     bool cached(const CellIndex *genes, int model_type);
     char *jjFile(const CellIndex *genes, int model_type);
     int costs(const CellIndex *genes, int model_type, double **costs);
     double fitness(const CellIndex *genes, int model_type);
     void add(const CellIndex *genes, int model_type, char *jj_file, double *costs, double fitness, int number_of_costs);
+
+    // Pinned results are never evicted - used while a solver may still be reading the cached JJ file
+    void pin(const CellIndex *genes, int model_type);
+    void unpin(const CellIndex *genes, int model_type);
     void log_genome(const CellIndex *genes, int model_type);
     void log_costs(const CellIndex *genes, int model_type);
+    void log_statistics();
 
     int requests[NUMBER_OF_MODELS];
     int hits[NUMBER_OF_MODELS];
     int misses[NUMBER_OF_MODELS];
+    int evictions[NUMBER_OF_MODELS];
 
 private:
 
@@ -33,33 +49,35 @@ private:
         int number_of_costs;
         double *costs;
         double fitness;
+        long long bytes;
     };
 
-    struct cmp {
-        // Compare two evaluations based on model and genome
-        bool operator()(const Evaluation& eval1, const Evaluation& eval2) const {
-            if (eval1.model_type < eval2.model_type) {
-                return true;
-            } else if (eval1.model_type > eval2.model_type) {
-                return false;
-            }
-
-            // Code assumes that genomes of eval1 and eval2 are the same size
-            for (CellIndex i = 0; i < eval1.genome_size; i++) {
-                if (eval1.genes[i] < eval2.genes[i]) {
-                    return true;
-                } else if (eval1.genes[i] > eval2.genes[i]) {
-                    return false;
-                }
-            }
-
-            return false;
-        }
+    struct Entry {
+        struct Fingerprint key;
+        int model_type;
+        bool occupied;
+        int pins;
+        unsigned long long last_used;
+        struct Result result;
     };
 
     int genome_size;
-    std::map<Evaluation, struct Result, cmp> map;
 
+    struct Entry *table;
+    size_t capacity;
+    size_t count;
+    unsigned long long clock;
+
+    long long memory_budget;
+    long long memory_used;
+    int eviction_policy;
+
+    struct Fingerprint fingerprint(const CellIndex *genes, int model_type);
+    struct Entry *find(const CellIndex *genes, int model_type);
+    size_t find_slot(const struct Fingerprint *key, int model_type);
+    void grow();
+    void erase(size_t slot);
+    void evict();
     void remove(struct Result result);
 
 };
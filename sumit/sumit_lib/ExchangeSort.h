@@ -0,0 +1,113 @@
+#pragma once
+
+#include "stdafx.h"
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <vector>
+
+// Orderings left by the quadratic exchange sorts the cells and constraints have always been ordered with, found in O(n log n)
+// GA seeds and saved results depend on where items with equal keys end up, so these reproduce the exact order rather than any stable sort
+//
+// exchange_sort(items, n, key) leaves the items as
+//     for (i = 0; i < n; i++) for (j = i + 1; j < n; j++) if (key(items[i]) < key(items[j])) swap(items[i], items[j]);
+// and all_pairs_sort(items, n, key) as
+//     for (i = 0; i < n; i++) for (j = 0; j < n; j++) if (key(items[i]) > key(items[j])) swap(items[i], items[j]);
+// Both put the largest keys first, so callers wanting the smallest first negate the key. Keys must not be NaN
+//
+// Each pass of the exchange sort moves the first of the items with the largest remaining key to the front, and the rest of the chain of
+// ever larger keys from the front of the pass one step along the chain. Following one key, the items with equal keys are then found in the
+// order of a queue built by scanning the items in turn, where each item joins the end of the queue for its key, and every queue for a smaller
+// key moves its first item to its end
+// All pairs sort does the same after its first pass, which swaps the first item along the chain of ever smaller keys, as every later pass
+// inserts its item into the sorted items before it and leaves the smallest key at its end
+
+template <typename Key>
+void exchange_sort(int *items, int n, Key key) {
+    typedef decltype(key(items[0])) Value;
+
+    if (n < 2) {
+        return;
+    }
+
+    std::vector<Value> values(n);
+    for (int i = 0; i < n; i++) {
+        values[i] = key(items[i]);
+    }
+
+    // Distinct keys, largest first
+    std::vector<Value> distinct(values);
+    std::sort(distinct.begin(), distinct.end(), std::greater<Value>());
+    distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+    int nkeys = (int)distinct.size();
+
+    // Counts of the items scanned for each key, as a Fenwick tree, so the number with a larger key is found in O(log n)
+    std::vector<int> counts(nkeys + 1, 0);
+
+    // Each queue is moved on lazily, by the number of items with a larger key scanned since it was last touched
+    std::vector<std::deque<int> > queues(nkeys);
+    std::vector<int> larger_seen(nkeys, 0);
+
+    auto rotate = [](std::deque<int> &queue, int steps) {
+        int size = (int)queue.size();
+
+        if (size < 2) {
+            return;
+        }
+
+        steps = steps % size;
+        if (steps <= size / 2) {
+            for (int s = 0; s < steps; s++) {
+                queue.push_back(queue.front());
+                queue.pop_front();
+            }
+        } else {
+            for (int s = steps; s < size; s++) {
+                queue.push_front(queue.back());
+                queue.pop_back();
+            }
+        }
+    };
+
+    for (int i = 0; i < n; i++) {
+        int rank = (int)(std::lower_bound(distinct.begin(), distinct.end(), values[i], std::greater<Value>()) - distinct.begin());
+
+        int larger = 0;
+        for (int b = rank; b > 0; b -= b & -b) {
+            larger += counts[b];
+        }
+
+        rotate(queues[rank], larger - larger_seen[rank]);
+        queues[rank].push_back(items[i]);
+        larger_seen[rank] = larger;
+
+        for (int b = rank + 1; b <= nkeys; b += b & -b) {
+            counts[b]++;
+        }
+    }
+
+    int next = 0;
+    int larger = 0;
+    for (int rank = 0; rank < nkeys; rank++) {
+        rotate(queues[rank], larger - larger_seen[rank]);
+
+        for (size_t q = 0; q < queues[rank].size(); q++) {
+            items[next++] = queues[rank][q];
+        }
+
+        larger += (int)queues[rank].size();
+    }
+}
+
+template <typename Key>
+void all_pairs_sort(int *items, int n, Key key) {
+    for (int j = 1; j < n; j++) {
+        if (key(items[0]) > key(items[j])) {
+            int temp = items[0];
+            items[0] = items[j];
+            items[j] = temp;
+        }
+    }
+
+    exchange_sort(items, n, key);
+}
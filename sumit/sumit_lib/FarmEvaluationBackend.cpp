@@ -0,0 +1,336 @@
+#include "stdafx.h"
+#include <string.h>
+#include <algorithm>
+#include "FarmEvaluationBackend.h"
+
+FarmSlot::FarmSlot(FarmEvaluationBackend *farm, int member) {
+    this->farm = farm;
+    this->member = member;
+}
+
+FarmSlot::~FarmSlot() {
+    farm->release_slot(member);
+}
+
+FarmEvaluationJob::FarmEvaluationJob(FarmEvaluationBackend *farm, int member, EvaluationJob *job, std::shared_ptr<FarmSlot> slot) {
+    this->farm = farm;
+    this->member = member;
+    this->job = job;
+    this->slot = slot;
+
+    copy_times();
+}
+
+// The slot is released after the job, so that the server has closed the session before it is given another
+FarmEvaluationJob::~FarmEvaluationJob() {
+    delete job;
+}
+
+const char *FarmEvaluationJob::getName() {
+    return job->getName();
+}
+
+int FarmEvaluationJob::getStatus() {
+    int status = job->getStatus();
+
+    if (status == JOB_LOST) {
+        farm->server_lost(member);
+    }
+
+    if ((status >= 0) || (status == JOB_LOST)) {
+        copy_times();
+    }
+
+    return status;
+}
+
+double FarmEvaluationJob::getResult() {
+    return job->getResult();
+}
+
+int FarmEvaluationJob::getElapsedTime() {
+    return job->getElapsedTime();
+}
+
+int FarmEvaluationJob::getCosts(double *costs, int size) {
+    int number_of_costs = job->getCosts(costs, size);
+    copy_times();
+
+    return number_of_costs;
+}
+
+void FarmEvaluationJob::getJJFile(const char *filename) {
+    job->getJJFile(filename);
+    copy_times();
+}
+
+bool FarmEvaluationJob::getTelemetry(SolverTelemetry *telemetry) {
+    bool found = job->getTelemetry(telemetry);
+    copy_times();
+
+    return found;
+}
+
+// The server job's times so far
+void FarmEvaluationJob::copy_times() {
+    set_started_time(job->get_started_time());
+    set_completed_time(job->get_completed_time());
+    add_transfer_time(job->get_transfer_time() - get_transfer_time());
+}
+
+FarmEvaluationBackend::FarmEvaluationBackend(const char *servers, const char *default_port) {
+    char list[MAX_FARM_LIST_SIZE];
+
+    if (strlen(servers) >= MAX_FARM_LIST_SIZE) {
+        logger->error(1, "Server list too long");
+    }
+    strcpy(list, servers);
+
+    limit = 0;
+    outage_start = 0.0;
+
+    char *p = list;
+    while (p != NULL) {
+        char *next = strchr(p, ',');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+
+        // Ignore spaces around the server names
+        while (*p == ' ') {
+            p++;
+        }
+        char *end = p + strlen(p);
+        while ((end > p) && (end[-1] == ' ')) {
+            *--end = '\0';
+        }
+
+        if (*p != '\0') {
+            const char *port = default_port;
+
+            char *colon = strchr(p, ':');
+            if (colon != NULL) {
+                *colon = '\0';
+                port = colon + 1;
+            }
+
+            if ((*p == '\0') || (*port == '\0') || (strlen(p) >= MAX_HOST_NAME_SIZE) || (strlen(port) >= MAX_PORT_NUMBER_SIZE)) {
+                logger->error(1, "Invalid server in server list: %s", servers);
+            }
+
+            add_member(p, port);
+        }
+
+        p = next;
+    }
+
+    if (members.empty()) {
+        logger->error(1, "None of the servers could be reached: %s", servers);
+    }
+
+    sprintf(name, "farm of %d servers", (int)members.size());
+    logger->log(3, "Server farm of %d servers, session limit %d", (int)members.size(), limit);
+}
+
+FarmEvaluationBackend::~FarmEvaluationBackend() {
+    for (size_t i = 0; i < members.size(); i++) {
+        delete members[i].backend;
+    }
+}
+
+// Servers that cannot be reached when the farm is created are left out of it
+void FarmEvaluationBackend::add_member(const char *host, const char *port) {
+    ServerConnection::set_failover(host, port);
+
+    Member member;
+
+    try {
+        member.backend = new RemoteEvaluationBackend(host, port);
+    } catch (int e) {
+        logger->log(1, "Server %s:%s not responding (error %d) - left out of the farm", host, port, e);
+        return;
+    }
+
+    member.limit = member.backend->getLimit();
+    member.cores = member.backend->getCores();
+    member.running = 0;
+    member.latency = 0.0;
+    member.measured = false;
+    member.down_until = 0.0;
+
+    member.backend->set_parent(this);
+    members.push_back(member);
+    limit += member.limit;
+
+    logger->log(1, "Farm server %s: %d cores, session limit %d", member.backend->getName(), member.cores, member.limit);
+}
+
+const char *FarmEvaluationBackend::getName() {
+    return name;
+}
+
+// The session limits of all of the servers, including any that have stopped responding for now
+int FarmEvaluationBackend::getLimit() {
+    return limit;
+}
+
+EvaluationJob *FarmEvaluationBackend::runProtection(const char *injjfilename, const CellIndex *perm, int size, int protection_type, int model_type, double max_cost) {
+    std::vector<int> order;
+    schedule(&order);
+
+    for (size_t k = 0; k < order.size(); k++) {
+        int m = order[k];
+
+        try {
+            double start = sys.wall_time();
+            EvaluationJob *job = members[m].backend->runProtection(injjfilename, perm, size, protection_type, model_type, max_cost);
+            std::shared_ptr<FarmSlot> slot = take_slot(m, sys.wall_time() - start);
+
+            return new FarmEvaluationJob(this, m, job, slot);
+        } catch (int e) {
+            if (e == SERVER_EXCEPTION) {
+                server_lost(m);
+            }
+
+            // Otherwise the server has no session available, so try the next
+        }
+    }
+
+    check_outage();
+
+    throw SESSION_EXCEPTION;
+}
+
+// The whole batch goes to one server, so that it shares one solver there
+int FarmEvaluationBackend::runBatch(const char *injjfilename, const CellIndex *const *perms, const double *max_costs, int count, int size, int protection_type, int model_type, EvaluationJob **jobs) {
+    std::vector<int> order;
+    schedule(&order);
+
+    for (size_t k = 0; k < order.size(); k++) {
+        int m = order[k];
+
+        try {
+            double start = sys.wall_time();
+            int started = members[m].backend->runBatch(injjfilename, perms, max_costs, count, size, protection_type, model_type, jobs);
+            std::shared_ptr<FarmSlot> slot = take_slot(m, sys.wall_time() - start);
+
+            for (int i = 0; i < started; i++) {
+                jobs[i] = new FarmEvaluationJob(this, m, jobs[i], slot);
+            }
+
+            return started;
+        } catch (int e) {
+            if (e == SERVER_EXCEPTION) {
+                server_lost(m);
+            }
+
+            // Otherwise the server has no session available, so try the next
+        }
+    }
+
+    check_outage();
+
+    throw SESSION_EXCEPTION;
+}
+
+// The servers to try for a new job, best first
+// Load is the fraction of a server's sessions in use, and servers that have stopped responding are tried again once their retry time has passed
+void FarmEvaluationBackend::schedule(std::vector<int> *order) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    double now = sys.wall_time();
+
+    for (int m = 0; m < (int)members.size(); m++) {
+        if (members[m].down_until <= now) {
+            order->push_back(m);
+        }
+    }
+
+    std::stable_sort(order->begin(), order->end(), [this](int a, int b) {
+        const Member *x = &members[a];
+        const Member *y = &members[b];
+
+        // running / limit compared without dividing
+        long long load_x = (long long)x->running * y->limit;
+        long long load_y = (long long)y->running * x->limit;
+
+        if (load_x != load_y) {
+            return (load_x < load_y);
+        }
+
+        return (x->latency < y->latency);
+    });
+}
+
+// Called when no server has started a job
+// While every server has stopped responding the caller waits and tries again as it does for busy servers, so that the servers can come
+// back after their retry time, but the run ends once none has responded for FARM_MAX_OUTAGE_SECONDS
+void FarmEvaluationBackend::check_outage() {
+    double outage;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (size_t i = 0; i < members.size(); i++) {
+            if (members[i].down_until == 0.0) {
+                outage_start = 0.0;
+                return;
+            }
+        }
+
+        double now = sys.wall_time();
+
+        if (outage_start == 0.0) {
+            outage_start = now;
+            logger->log(1, "None of the servers of the farm is responding - waiting up to %.0lf s for one to respond again", FARM_MAX_OUTAGE_SECONDS);
+        }
+
+        outage = now - outage_start;
+    }
+
+    if (outage > FARM_MAX_OUTAGE_SECONDS) {
+        logger->error(1, "None of the servers of the farm has responded for %.0lf s", outage);
+    }
+}
+
+std::shared_ptr<FarmSlot> FarmEvaluationBackend::take_slot(int member, double latency) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Member *m = &members[member];
+
+    m->running++;
+
+    // A server that has responded is back in the farm
+    if (m->down_until != 0.0) {
+        logger->log(1, "Farm server %s responding again", m->backend->getName());
+        m->down_until = 0.0;
+    }
+    outage_start = 0.0;
+
+    if (m->measured) {
+        m->latency = FARM_LATENCY_SMOOTHING * m->latency + (1.0 - FARM_LATENCY_SMOOTHING) * latency;
+    } else {
+        m->latency = latency;
+        m->measured = true;
+    }
+
+    return std::shared_ptr<FarmSlot>(new FarmSlot(this, member));
+}
+
+void FarmEvaluationBackend::release_slot(int member) {
+    std::lock_guard<std::mutex> lock(mutex);
+    members[member].running--;
+}
+
+// Leave the server out until its retry time, unless it is already left out
+void FarmEvaluationBackend::server_lost(int member) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Member *m = &members[member];
+    double now = sys.wall_time();
+
+    if (m->down_until < now) {
+        m->down_until = now + FARM_RETRY_SECONDS;
+        logger->log(1, "Farm server %s not responding - retrying in %.0lf s", m->backend->getName(), FARM_RETRY_SECONDS);
+    }
+}
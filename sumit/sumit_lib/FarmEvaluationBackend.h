@@ -0,0 +1,106 @@
+#pragma once
+
+#include "stdafx.h"
+#include <mutex>
+#include <memory>
+#include <vector>
+#include "EvaluationBackend.h"
+#include "RemoteEvaluationBackend.h"
+
+// Seconds before a server that has stopped responding is tried again
+#define FARM_RETRY_SECONDS 60.0
+
+// Seconds for which every server of a farm may stop responding before the run is ended
+#define FARM_MAX_OUTAGE_SECONDS 3600.0
+
+// Weight kept by a server's smoothed start-up latency when a new job's start-up time is added
+#define FARM_LATENCY_SMOOTHING 0.8
+
+// Most characters in a list of farm servers
+#define MAX_FARM_LIST_SIZE 1024
+
+class FarmEvaluationBackend;
+
+// One of the jobs a farm server is counted as running, held until every job of it has been deleted
+// The members of a batch share a slot, as they share one solver
+class FarmSlot {
+
+public:
+    FarmSlot(FarmEvaluationBackend *farm, int member);
+    ~FarmSlot();
+
+private:
+    FarmEvaluationBackend *farm;
+    int member;
+
+};
+
+// A job running on one server of a farm, which tells the farm when the server has stopped responding
+class FarmEvaluationJob: public EvaluationJob {
+
+public:
+    FarmEvaluationJob(FarmEvaluationBackend *farm, int member, EvaluationJob *job, std::shared_ptr<FarmSlot> slot);
+    ~FarmEvaluationJob();
+    const char *getName();
+    int getStatus();
+    double getResult();
+    int getElapsedTime();
+    int getCosts(double *costs, int size);
+    void getJJFile(const char *filename);
+    bool getTelemetry(SolverTelemetry *telemetry);
+
+private:
+    FarmEvaluationBackend *farm;
+    int member;
+    EvaluationJob *job;
+    std::shared_ptr<FarmSlot> slot;
+
+    void copy_times();
+
+};
+
+// Shares solvers out between several cell suppression servers
+// Each job goes to the least loaded server, and between equally loaded servers to the one that has been quickest to start jobs
+// A server that stops responding is left out for a while and the jobs it was running are reported as lost, so that they can be
+// run again on the others, and while all of them have stopped responding no session is available until one responds again
+class FarmEvaluationBackend: public EvaluationBackend {
+
+    friend class FarmSlot;
+    friend class FarmEvaluationJob;
+
+public:
+    // servers is a comma-separated list of host names or IP addresses, each with an optional :port, and default_port is used for the rest
+    FarmEvaluationBackend(const char *servers, const char *default_port);
+    ~FarmEvaluationBackend();
+    const char *getName();
+    int getLimit();
+    EvaluationJob *runProtection(const char *injjfilename, const CellIndex *perm, int size, int protection_type, int model_type, double max_cost);
+    int runBatch(const char *injjfilename, const CellIndex *const *perms, const double *max_costs, int count, int size, int protection_type, int model_type, EvaluationJob **jobs);
+
+private:
+    struct Member {
+        RemoteEvaluationBackend *backend;
+        int limit;
+        int cores;
+
+        // Guarded by the mutex
+        int running;            // Slots held
+        double latency;         // Smoothed seconds to start a job, including sending its input
+        bool measured;
+        double down_until;      // Wall time before which the server is not tried, or zero if it is responding
+    };
+
+    char name[64];
+    int limit;
+    std::vector<Member> members;
+    std::mutex mutex;
+    double outage_start;        // Wall time when every server was first found to have stopped responding, or zero, guarded by the mutex
+
+    void add_member(const char *host, const char *port);
+    void schedule(std::vector<int> *order);
+    void check_outage();
+    std::shared_ptr<FarmSlot> take_slot(int member, double latency);
+    void release_slot(int member);
+    void server_lost(int member);
+
+};
@@ -1,13 +1,14 @@
 #include "stdafx.h"
 #include <string.h>
 #include <float.h>
+#include <vector>
 #include "GAProtection.h"
 #include "Solver.h"
 #include "Eliminate.h"
 #include "EvaluationCache.h"
 #include "Groups.h"
 
-GAProtection::GAProtection(const char *host, const char *port, const char *injjfilename, const char *outjjfilename, const char *samples_filename, unsigned int seed, int cores, int execution_time, bool run_elimination) {
+GAProtection::GAProtection(EvaluationBackend *backend, const char *injjfilename, const char *outjjfilename, const char *samples_filename, unsigned int seed, int cores, int execution_time, bool run_elimination) {
     time(&start_seconds);
 
     logger->log(2, "Protecting: %s", injjfilename);
@@ -28,46 +29,23 @@ GAProtection::GAProtection(const char *host, const char *port, const char *injjf
         algorithm_for_replacement = REPLACE_TOURNAMENT;
         mutation_type = MUTATION_SWAP;
 
-        strcpy(this->host, host);
-        strcpy(this->port, port);
+        this->backend = backend;
 
         if (seed != 0) {
             random.seed(seed);
         }
 
-        // Check for available server cores
-        int available_cores = 0;
+        // Check for available solver slots
+        int available_cores = backend->getLimit();
 
-        try {
-            Solver *solver = new Solver(host, port);
-            if (solver->getProtocol() != 4) {
-                // Terminate the remote solver before exiting
-                delete solver;
-
-                logger->error(1, "Unsupported version of client server protocol");
-            }
-
-            available_cores = solver->getLimit();
-
-            delete solver;
-
-            switch (available_cores) {
-                case 0:
-                    logger->error(1, "No available server cores (minimum allowable number of cores is two)");
-                    break;
-
-                case 1:
-                    logger->error(1, "Only one available server core (minimum allowable number of cores is two)");
-                    break;
-            }
-        } catch (int e) {
-            // Keep the compiler from complaining
-            e = 0;
+        switch (available_cores) {
+            case 0:
+                logger->error(1, "No available server cores (minimum allowable number of cores is two)");
+                break;
 
-            // Session not available
-            // For now, just give up.  This situation should not occur with only one single-threaded client trying to access the server
-            // If more than one client thread is required to access the server, then the situation will need handling properly (waiting)
-            logger->error(1, "No available server sessions");
+            case 1:
+                logger->error(1, "Only one available server core (minimum allowable number of cores is two)");
+                break;
         }
 
         // Select the actual number of cores to use
@@ -105,12 +83,43 @@ GAProtection::GAProtection(const char *host, const char *port, const char *injjf
 
     number_of_evals = 0;
     number_of_counted_evals = 0;
+    number_of_timed_evals = 0;
+    total_queue_time = 0.0;
+    total_solve_time = 0.0;
+
+    protection_type = INDIVIDUAL_PROTECTION;
+
+    steady_state = false;
+    batch_size = 1;
+    steady_state_slots = 0;
+    number_running = 0;
+    pool_running = NULL;
+    running_jobs = NULL;
+    running_ready_time = NULL;
     stable_fitness = DBL_MAX;
     stable_generations = 0;
     terminated = false;
 }
 
 GAProtection::~GAProtection(void) {
+    if (running_jobs != NULL) {
+        // Abandon any steady-state evaluations still running to release their slots
+        for (int i = 0; i < steady_state_slots; i++) {
+            if (running_jobs[i] != NULL) {
+                delete running_jobs[i];
+            }
+        }
+
+        for (int i = 0; i < steady_state_slots; i++) {
+            delete[] pool_running[i].costs;
+            delete[] pool_running[i].genes;
+        }
+
+        delete[] running_ready_time;
+        delete[] running_jobs;
+        delete[] pool_running;
+    }
+
 //    logger->log(4, "Evaluation cache full model requests: %d", evaluationCache->requests[FULL_MODEL]);
 //    if (evaluationCache->requests[FULL_MODEL] > 0) {
 //        logger->log(4, "Evaluation cache full model hits: %d (%.1f%%)", evaluationCache->hits[FULL_MODEL], (float)(evaluationCache->hits[FULL_MODEL] * 100) / (float)evaluationCache->requests[FULL_MODEL]);
@@ -129,6 +138,15 @@ GAProtection::~GAProtection(void) {
         logger->log(4, "Evaluation cache yminus model misses: %d (%.1f%%)", evaluationCache->misses[YMINUS_MODEL], (float)(evaluationCache->misses[YMINUS_MODEL] * 100) / (float)evaluationCache->requests[YMINUS_MODEL]);
     }
 
+    evaluationCache->log_statistics();
+
+    if (number_of_timed_evals > 0) {
+        logger->log(3, "Solver queue wait %.1lf s (mean %.3lf s), solve time %.1lf s (mean %.3lf s) over %d evaluations", total_queue_time, total_queue_time / number_of_timed_evals, total_solve_time, total_solve_time / number_of_timed_evals, number_of_timed_evals);
+    }
+
+    telemetry_statistics[YPLUS_MODEL].log(3, "yplus");
+    telemetry_statistics[YMINUS_MODEL].log(3, "yminus");
+
     delete evaluationCache;
 
     if (pool_parent != NULL) {
@@ -955,40 +973,43 @@ void GAProtection::apply_mutation() {
     double mutation_rate = 1.0 / (double)number_of_genes;
 
     for (int offspring = random_offspring; offspring < default_number_of_clones; offspring++) {
+        mutate_clone(offspring, mutation_rate);
+    }
+}
 
-        switch (algorithm_for_mutation) {
-            case MUTATION_SWAP:
-                mutation_swap(offspring, mutation_rate);
-                break;
+void GAProtection::mutate_clone(int offspring, double mutation_rate) {
+    switch (algorithm_for_mutation) {
+        case MUTATION_SWAP:
+            mutation_swap(offspring, mutation_rate);
+            break;
 
-            case MUTATION_INSERT:
-                mutation_insert(offspring, mutation_rate);
-                break;
+        case MUTATION_INSERT:
+            mutation_insert(offspring, mutation_rate);
+            break;
 
-            case MUTATION_SCRAMBLE:
-                mutation_scramble(offspring, mutation_rate);
-                break;
+        case MUTATION_SCRAMBLE:
+            mutation_scramble(offspring, mutation_rate);
+            break;
 
-            case MUTATION_INVERSION:
-                mutation_inversion(offspring, mutation_rate);
-                break;
+        case MUTATION_INVERSION:
+            mutation_inversion(offspring, mutation_rate);
+            break;
 
-            case MUTATION_ASSORTED:
-                if (mutation_type == MUTATION_SWAP) {
-                    mutation_swap(offspring, mutation_rate);
-                } else if (mutation_type == MUTATION_INSERT) {
-                    mutation_insert(offspring, mutation_rate);
-                } else if (mutation_type == MUTATION_SCRAMBLE) {
-                    mutation_scramble(offspring, mutation_rate);
-                } else {
-                    mutation_inversion(offspring, mutation_rate);
-                }
-                mutation_type = (mutation_type + 1) % 4;
-                break;
+        case MUTATION_ASSORTED:
+            if (mutation_type == MUTATION_SWAP) {
+                mutation_swap(offspring, mutation_rate);
+            } else if (mutation_type == MUTATION_INSERT) {
+                mutation_insert(offspring, mutation_rate);
+            } else if (mutation_type == MUTATION_SCRAMBLE) {
+                mutation_scramble(offspring, mutation_rate);
+            } else {
+                mutation_inversion(offspring, mutation_rate);
+            }
+            mutation_type = (mutation_type + 1) % 4;
+            break;
 
-            default:
-                break;
-        }
+        default:
+            break;
     }
 }
 
@@ -1189,6 +1210,33 @@ int GAProtection::number_of_evaluations() {
     return number_of_evals;
 }
 
+// Fitness of the best parent found so far, without evaluating it again
+double GAProtection::best_parent_fitness() {
+    return (number_of_genes > 0)? get_best_fitness(): 0.0;
+}
+
+// Number of consecutive checks for termination in which the best fitness has not changed
+int GAProtection::get_stable_generations() {
+    return stable_generations;
+}
+
+int GAProtection::get_elapsed_seconds() {
+    return (int)(time(NULL) - start_seconds);
+}
+
+int GAProtection::get_time_limit() {
+    return max_seconds;
+}
+
+void GAProtection::set_time_limit(int seconds) {
+    max_seconds = seconds;
+}
+
+// Whether time_to_terminate has stopped the GA
+bool GAProtection::has_terminated() {
+    return (number_of_genes == 0) || terminated;
+}
+
 void GAProtection::increase_polling_delay(int *delay) {
     switch (*delay) {
         case 0:
@@ -1317,17 +1365,144 @@ int GAProtection::grow_clones_pool(int model_type) {
     return used_pool_size;
 }
 
-void GAProtection::evaluate_fitness(int number_to_evaluate, struct Individual pool[], int protection_type, int model_type, bool get_outputjjfile, bool count_evals, double max_cost) {
+// Process the result of a completed solver and delete the job
+void GAProtection::complete_evaluation(EvaluationJob *job, struct Individual *individual, int index, int protection_type, int model_type, bool get_outputjjfile, bool count_evals, double ready_time) {
     int elapsed_time;
     bool solver_terminated;
 
-    // Sleep quantum is 10 milliseconds
-    sys.initialise_sleep(10);
+    logger->log(5, "Solver %s completed", job->getName());
+    individual->fitness = job->getResult();
+    elapsed_time = job->getElapsedTime();
+
+    // Get the costs
+    individual->number_of_costs = job->getCosts(individual->costs, number_of_genes);
+
+    // Cross-check fitness and costs
+    if (fabs(individual->fitness - individual->costs[individual->number_of_costs - 1]) >= FLOAT_PRECISION) {
+        logger->error(1, "Fitness (%lf) does not match costs (%lf)", individual->fitness, individual->costs[number_of_genes - 1]);
+    }
+
+    // Keep a copy of the intermediate result for YPLUS as this may be used as the basis for a subsequent YMINUS model when evaluating the best individual
+    // Also, the result may be used during GA elimination
+    char temp_file[MAX_FILENAME_SIZE];
+    char* out_jj_file;
+    if ((model_type == YPLUS_MODEL) || run_elimination) {
+        sys.make_tempfile(temp_file, MAX_FILENAME_SIZE);
+        job->getJJFile(temp_file);
+        out_jj_file = temp_file;
+    } else {
+        out_jj_file = NULL;
+    }
+
+    // Cache JJ file, costs and fitness
+    evaluationCache->add(individual->genes, model_type, out_jj_file, individual->costs, individual->fitness, individual->number_of_costs);
+
+    if (samples_log != NULL) {
+        samples_log->log_sample(individual, individual->fitness, protection_type, model_type, run_elimination? out_jj_file: NULL, elapsed_time);
+    }
+
+    // Get a permanent copy of the output file if required
+    if (get_outputjjfile) {
+        if (out_jj_file == NULL) {
+            // File not yet downloaded
+            job->getJJFile(outjjfilename);
+        } else {
+            // File has already been downloaded so just copy locally
+            // This situation only occurs with GA elimination
+            sys.copy_file(outjjfilename, out_jj_file);
+        }
+    }
+
+    // Time spent waiting for a solver versus time spent solving
+    double queue_time = job->get_started_time() - ready_time;
+    double solve_time = job->get_completed_time() - job->get_started_time();
+    total_queue_time += queue_time;
+    total_solve_time += solve_time;
+    number_of_timed_evals++;
+    logger->log(4, "Solver %s queue wait %.3lf s, solve time %.3lf s", job->getName(), queue_time, solve_time);
+
+    SolverTelemetry telemetry;
+    if (job->getTelemetry(&telemetry)) {
+        telemetry_statistics[model_type].add(&telemetry, solve_time, job->get_transfer_time());
+        logger->log(4, "Solver %s build %.3lf s, initial solve %.3lf s, %d resolves %.3lf s (%lld iterations), genes resumed %d solved %d, transfer %.3lf s", job->getName(), telemetry.build_time, telemetry.initial_solve_time, telemetry.resolves, telemetry.resolve_time, telemetry.iterations, telemetry.genes_resumed, telemetry.genes_solved, job->get_transfer_time());
+    }
+
+    if (model_type != YPLUS_MODEL) {
+        evaluationCache->unpin(individual->genes, YPLUS_MODEL);
+    }
+    delete job;
+
+    solver_terminated = (individual->number_of_costs == number_of_genes)? false: true;
+
+    if (count_evals) {
+        number_of_counted_evals++;
+        logger->log(3, "%s fitness evaluation %d %d %d %lf (evaluation %d)", solver_terminated? "Terminated": "Completed", protection_type, model_type, index, individual->fitness, number_of_counted_evals);
+    } else {
+        logger->log(3, "%s fitness evaluation %d %d %d %lf (uncounted)", solver_terminated? "Terminated": "Completed", protection_type, model_type, index, individual->fitness);
+    }
+    evaluationCache->log_genome(individual->genes, model_type);
+    evaluationCache->log_costs(individual->genes, model_type);
 
+    number_of_evals++;
+}
+
+// Start a solver for the supplied genes - throws SESSION_EXCEPTION if no session is available
+EvaluationJob *GAProtection::start_evaluation(const CellIndex *genes, int protection_type, int model_type, double max_cost) {
+    char *in_jj_file;
+    if (model_type == YPLUS_MODEL) {
+        in_jj_file = injjfilename;
+    } else {
+        in_jj_file = evaluationCache->jjFile(genes, YPLUS_MODEL);
+        if (in_jj_file == NULL) {
+            logger->error(1, "Missing cached yplus jj file");
+        }
+    }
+
+    // The solver interprets a max_cost of zero to mean unlimited cost (and hence no early termination)
+    EvaluationJob *job = backend->runProtection(in_jj_file, genes, number_of_genes, protection_type, model_type, max_cost);
+
+    // The backend may not read the yplus jj file until the solver starts, so keep it until the job has completed
+    if (model_type != YPLUS_MODEL) {
+        evaluationCache->pin(genes, YPLUS_MODEL);
+    }
+    logger->log(5, "Solver %s started", job->getName());
+
+    return job;
+}
+
+// Start a batch of the yplus evaluations still waiting for a solver, from first onwards, and return the number started
+// Throws SESSION_EXCEPTION if no session is available
+int GAProtection::start_batch(int first, int number_to_evaluate, struct Individual pool[], int status[], EvaluationJob *job[], int protection_type, double max_cost) {
+    std::vector<int> members;
+    std::vector<const CellIndex *> perms;
+    std::vector<double> max_costs;
+
+    for (int i = first; (i < number_to_evaluate) && ((int)members.size() < batch_size); i++) {
+        if (status[i] == -3) {
+            members.push_back(i);
+            perms.push_back(pool[i].genes);
+            max_costs.push_back(max_cost);
+        }
+    }
+
+    int count = (int)members.size();
+    std::vector<EvaluationJob *> jobs(count, NULL);
+
+    // The solver interprets a max_cost of zero to mean unlimited cost (and hence no early termination)
+    int started = backend->runBatch(injjfilename, perms.data(), max_costs.data(), count, number_of_genes, protection_type, YPLUS_MODEL, jobs.data());
+
+    for (int k = 0; k < started; k++) {
+        job[members[k]] = jobs[k];
+        status[members[k]] = -2;
+    }
+    logger->log(5, "Solver %s started for %d of %d individuals", jobs[0]->getName(), started, count);
+
+    return started;
+}
+
+void GAProtection::evaluate_fitness(int number_to_evaluate, struct Individual pool[], int protection_type, int model_type, bool get_outputjjfile, bool count_evals, double max_cost) {
     int *status = new int[number_to_evaluate];
-    Solver **solver = new Solver *[number_to_evaluate];
-    int *delay = new int[number_to_evaluate];
-    int *counter = new int[number_to_evaluate];
+    EvaluationJob **job = new EvaluationJob *[number_to_evaluate];
 
     // Check for cached individuals
     for (int i = 0; i < number_to_evaluate; i++) {
@@ -1343,11 +1518,8 @@ void GAProtection::evaluate_fitness(int number_to_evaluate, struct Individual po
         } else {
             status[i] = -3;
         }
-        solver[i] = NULL;
-        delay[i] = 0;
-        counter[i] = 0;
+        job[i] = NULL;
     }
-    logger->log(5, "Unallocated solver delay 0");
 
     // Mark duplicate individuals so that they are not evaluated
     Evaluation **eval = new Evaluation *[number_to_evaluate];
@@ -1372,191 +1544,115 @@ void GAProtection::evaluate_fitness(int number_to_evaluate, struct Individual po
         }
     }
 
+    // Solvers are started as soon as a slot is free and the loop then blocks until one of them finishes
+    // Polling with a backoff only remains for when no slot can be obtained and none of these solvers is running
+    double ready_time = sys.wall_time();
+    int delay = 0;
     bool complete;
 
     do {
         complete = true;
 
-        for (int i = 0; i < number_to_evaluate; i++) {
-            if (counter[i] == 0) {
-                switch (status[i]) {
-                    // Solver not yet allocated - try to obtain one
-                    case -3:
-                        try {
-                            solver[i] = new Solver(host, port);
-
-                            // Check that the version of the server protocol is understood by the client
-                            if (solver[i]->getProtocol() != 4) {
-                                // Terminate all of this client's remote solvers before exiting
-                                for (int j = 0; j < number_to_evaluate; j++) {
-                                    if (solver[j] != NULL) {
-                                        delete solver[j];
-                                    }
-                                }
-
-                                logger->error(1, "Unsupported version of client server protocol");
-                            }
-                            logger->log(5, "Solver %s created", solver[i]->getSession());
+        int running = 0;
+        bool session_unavailable = false;
 
-                            status[i] = -2;
-                            delay[i] = 0;
-                            counter[i] = 0;
-
-                            char *in_jj_file;
-                            if (model_type == YPLUS_MODEL) {
-                                in_jj_file = injjfilename;
-                            } else {
-                                in_jj_file = evaluationCache->jjFile(pool[i].genes, YPLUS_MODEL);
-                                if (in_jj_file == NULL) {
-                                    logger->error(1, "Missing cached yplus jj file");
-                                }
-                            }
+        // Read before checking job status so that a completion in between is not missed
+        int seen = backend->completions();
 
-                            // Create a permutation file for the solver
-                            char temp_file[MAX_FILENAME_SIZE];
-                            sys.make_tempfile(temp_file, MAX_FILENAME_SIZE);
-                            write_perm_file(temp_file, pool[i].genes, number_of_genes);
-
-                            // The remote solver interprets a max_cost of zero to mean unlimited cost (and hence no early termination)
-                            solver[i]->runProtection(in_jj_file, temp_file, protection_type, model_type, max_cost);
-
-                            sys.remove_file(temp_file);
-                        } catch (int e) {
-                            // Keep the compiler from complaining
-                            e = 0;
-
-                            // Session not available - increase delay for all unallocated solvers
-                            increase_polling_delay(&delay[i]);
-
-                            for (int j = 0; j < number_to_evaluate; j++) {
-                                if (status[j] == -3) {
-                                    delay[j] = delay[i];
-                                    counter[j] = delay[i];
-                                }
-                            }
-
-                            logger->log(5, "Unallocated solver delay %d", delay[i]);
-                        }
+        for (int i = 0; i < number_to_evaluate; i++) {
+            switch (status[i]) {
+                // Solver not yet allocated - try to obtain one
+                case -3:
+                    complete = false;
 
-                        complete = false;
+                    if (session_unavailable) {
                         break;
+                    }
 
-                    // Solver running - check completion status
-                    case -2:
-                    case -1:
-                        status[i] = solver[i]->getStatus();
-                        logger->log(5, "Solver %s status %d", solver[i]->getSession(), status[i]);
-                        switch (status[i]) {
-                            case -2:
-                            case -1:
-                                // Solver still running
-                                complete = false;
-
-                                increase_polling_delay(&delay[i]);
-                                counter[i] = delay[i];
-                                logger->log(5, "Solver %s delay %d", solver[i]->getSession(), delay[i]);
-                                break;
-
-                            case 0:
-                                // Solver completed
-                                logger->log(5, "Solver %s completed", solver[i]->getSession());
-                                pool[i].fitness = solver[i]->getResult();
-                                elapsed_time = solver[i]->getElapsedTime();
-
-                                // Get the costs
-                                char temp_file[MAX_FILENAME_SIZE];
-                                sys.make_tempfile(temp_file, MAX_FILENAME_SIZE);
-                                solver[i]->getCostFile(temp_file);
-                                pool[i].number_of_costs = read_cost_file(temp_file, pool[i].costs);
-                                sys.remove_file(temp_file);
-
-                                // Cross-check fitness and costs
-                                if (fabs(pool[i].fitness - pool[i].costs[pool[i].number_of_costs - 1]) >= FLOAT_PRECISION) {
-                                    logger->error(1, "Fitness (%lf) does not match costs (%lf)", pool[i].fitness, pool[i].costs[number_of_genes - 1]);
-                                }
-
-                                // Keep a copy of the intermediate result for YPLUS as this may be used as the basis for a subsequent YMINUS model when evaluating the best individual
-                                // Also, the result may be used during GA elimination
-                                char* out_jj_file;
-                                if ((model_type == YPLUS_MODEL) || run_elimination) {
-                                    sys.make_tempfile(temp_file, MAX_FILENAME_SIZE);
-                                    solver[i]->getJJFile(temp_file);
-                                    out_jj_file = temp_file;
-                                } else {
-                                    out_jj_file = NULL;
-                                }
-
-                                // Cache JJ file, costs and fitness
-                                evaluationCache->add(pool[i].genes, model_type, out_jj_file, pool[i].costs, pool[i].fitness, pool[i].number_of_costs);
-
-                                if (samples_log != NULL) {
-                                    samples_log->log_sample(&pool[i], pool[i].fitness, protection_type, model_type, run_elimination? out_jj_file: NULL, elapsed_time);
-                                }
-
-                                // Get a permanent copy of the output file if required
-                                if (get_outputjjfile) {
-                                    if (out_jj_file == NULL) {
-                                        // File not yet downloaded
-                                        solver[i]->getJJFile(outjjfilename);
-                                    } else {
-                                        // File has already been downloaded so just copy locally
-                                        // This situation only occurs with GA elimination
-                                        sys.copy_file(outjjfilename, out_jj_file);
-                                    }
-                                }
-
-                                delete solver[i];
-                                solver[i] = NULL;
-                                delay[i] = 0;
-                                counter[i] = 0;
-
-                                solver_terminated = (pool[i].number_of_costs == number_of_genes)? false: true;
+                    try {
+                        if ((model_type == YPLUS_MODEL) && (batch_size > 1)) {
+                            running += start_batch(i, number_to_evaluate, pool, status, job, protection_type, max_cost);
+                        } else {
+                            job[i] = start_evaluation(pool[i].genes, protection_type, model_type, max_cost);
 
-                                if (count_evals) {
-                                    number_of_counted_evals++;
-                                    logger->log(3, "%s fitness evaluation %d %d %d %lf (evaluation %d)", solver_terminated? "Terminated": "Completed", protection_type, model_type, i, pool[i].fitness, number_of_counted_evals);
-                                } else {
-                                    logger->log(3, "%s fitness evaluation %d %d %d %lf (uncounted)", solver_terminated? "Terminated": "Completed", protection_type, model_type, i, pool[i].fitness);
-                                }
-                                evaluationCache->log_genome(pool[i].genes, model_type);
-                                evaluationCache->log_costs(pool[i].genes, model_type);
+                            status[i] = -2;
+                            running++;
+                        }
+                        delay = 0;
+                    } catch (int e) {
+                        // Keep the compiler from complaining
+                        e = 0;
 
-                                number_of_evals++;
+                        // Session not available - no point trying again until a solver finishes
+                        session_unavailable = true;
+                    }
+                    break;
 
-                                // Session freed - zero delay for all unallocated solvers
-                                for (int j = 0; j < number_to_evaluate; j++) {
-                                    if (status[j] == -3) {
-                                        delay[j] = 0;
-                                        counter[j] = 0;
-                                    }
-                                }
+                // Solver running - check completion status
+                case -2:
+                case -1:
+                    status[i] = job[i]->getStatus();
+                    logger->log(6, "Solver %s status %d", job[i]->getName(), status[i]);
+                    switch (status[i]) {
+                        case -2:
+                        case -1:
+                            // Solver still running
+                            complete = false;
+                            running++;
+                            break;
+
+                        case 0:
+                            // Solver completed
+                            complete_evaluation(job[i], &pool[i], i, protection_type, model_type, get_outputjjfile, count_evals, ready_time);
+                            job[i] = NULL;
+
+                            // Session freed - unallocated solvers may be started again
+                            session_unavailable = false;
+                            break;
+
+                        case JOB_LOST:
+                            // Server stopped responding - evaluate the individual again on another server
+                            logger->log(3, "Solver %s lost, evaluation %d %d %d restarted", job[i]->getName(), protection_type, model_type, i);
+
+                            if (model_type != YPLUS_MODEL) {
+                                evaluationCache->unpin(pool[i].genes, YPLUS_MODEL);
+                            }
+                            delete job[i];
+                            job[i] = NULL;
 
-                                logger->log(5, "Unallocated solver delay 0");
-                                break;
+                            status[i] = -3;
+                            complete = false;
+                            session_unavailable = false;
+                            break;
 
-                            default:
-                                // Solver error - terminate all of this client's remote solvers before exiting
-                                for (int j = 0; j < number_to_evaluate; j++) {
-                                    if (solver[j] != NULL) {
-                                        delete solver[j];
-                                    }
+                        default:
+                            // Solver error - terminate all of this client's solvers before exiting
+                            for (int j = 0; j < number_to_evaluate; j++) {
+                                if (job[j] != NULL) {
+                                    delete job[j];
                                 }
+                            }
 
-                                logger->error(1, "Solver error %d", status[i]);
-                        }
-                        break;
+                            logger->error(1, "Solver error %d", status[i]);
+                    }
+                    break;
 
-                    // default:
-                        // Solver complete - do nothing
-                }
-            } else {
-                counter[i]--;
-                complete = false;
+                // default:
+                    // Solver complete - do nothing
             }
         }
 
         if (! complete) {
-            sys.sleep();
+            if (running > 0) {
+                backend->wait_for_completion(seen, COMPLETION_WAIT_TIMEOUT);
+            } else {
+                // No slot available and none of these solvers running, so the slots are held elsewhere
+                increase_polling_delay(&delay);
+                logger->log(5, "Unallocated solver delay %d", delay);
+
+                // Sleep quantum is 10 milliseconds
+                backend->wait_for_completion(seen, 10 * delay);
+            }
         }
 
     } while (! complete);
@@ -1588,9 +1684,7 @@ void GAProtection::evaluate_fitness(int number_to_evaluate, struct Individual po
     }
 
     delete[] eval;
-    delete[] counter;
-    delete[] delay;
-    delete[] solver;
+    delete[] job;
     delete[] status;
 }
 
@@ -1603,6 +1697,13 @@ double GAProtection::evaluate_best_parent(int protection_type) {
     copy.genes = new CellIndex[number_of_genes];
     copy.costs = new double[number_of_genes];
     copy_individual(&copy, &pool_parent[best_parent]);
+
+    // The yplus result is the starting point for the yminus model, so re-create it if it has been evicted from the cache
+    if ((! evaluationCache->cached(copy.genes, YMINUS_MODEL)) && (evaluationCache->jjFile(copy.genes, YPLUS_MODEL) == NULL)) {
+        logger->log(3, "Re-evaluating evicted best parent %d", best_parent);
+        evaluate_fitness(1, &copy, protection_type, YPLUS_MODEL, false, false, 0.0);
+    }
+
     // max_cost parameter for evaluate_fitness is set to zero to ensure that the true cost of the solution is determined with no early termination of the remote solver
     evaluate_fitness(1, &copy, protection_type, YMINUS_MODEL, true, false, 0.0);
     delete[] copy.costs;
@@ -1611,37 +1712,232 @@ double GAProtection::evaluate_best_parent(int protection_type) {
     return copy.fitness;
 }
 
-void GAProtection::write_perm_file(const char* filename, int* perm, int size) {
-    FILE *ofp;
+/******************************************************************************************/
+/*                                                                                        */
+/*                                   Steady state                                         */
+/*                                                                                        */
+/******************************************************************************************/
+
+void GAProtection::set_cache_budget(long long bytes, int eviction_policy) {
+    evaluationCache->set_memory_budget(bytes, eviction_policy);
+}
+
+// Yplus evaluations waiting for a solver are started in batches of up to this many, each batch sharing one solver and one copy of the model
+// Batching trades parallel solvers for less setup per evaluation, so it pays when the solver slots are shared with other partitions
+void GAProtection::set_batch_size(int batch_size) {
+    this->batch_size = MAX(1, batch_size);
+}
+
+// In steady-state mode a new individual is bred as soon as a solver slot frees and replacement takes place as each result arrives
+// Evaluations may still be running when protect returns and are collected by the next call
+void GAProtection::set_steady_state(bool steady_state) {
+    this->steady_state = steady_state;
+
+    if (steady_state && (pool_running == NULL) && (number_of_genes > 0)) {
+        // One slot is kept free so that the best parent can always be evaluated
+        steady_state_slots = cores - 1;
+
+        pool_running = new Individual[steady_state_slots];
+        running_jobs = new EvaluationJob *[steady_state_slots];
+        running_ready_time = new double[steady_state_slots];
+
+        for (int i = 0; i < steady_state_slots; i++) {
+            pool_running[i].genes = new CellIndex[number_of_genes];
+            pool_running[i].costs = new double[number_of_genes];
+            pool_running[i].number_of_costs = 0;
+            pool_running[i].fitness = 0.0;
+            running_jobs[i] = NULL;
+            running_ready_time[i] = 0.0;
+        }
 
-    if ((ofp = fopen(filename, "w")) == NULL) {
-        logger->error(1, "Unable to create permutation file: %s", filename);
+        logger->log(3, "Steady-state GA with %d solver slots", steady_state_slots);
     }
+}
+
+void GAProtection::protect_steady_state(bool limit_cost) {
+    // Collect as many counted evaluations per call as a generation of the generational GA
+    int target = MIN(number_of_counted_evals + default_number_of_clones, max_evaluations);
+    int delay = 0;
+
+    while (number_of_counted_evals < target) {
+        // Read before checking job status so that a completion in between is not missed
+        int seen = backend->completions();
+
+        collect_offspring();
+
+        if (number_of_counted_evals >= target) {
+            break;
+        }
+
+        bool slots_full;
+        int started = dispatch_offspring(limit_cost? get_worst_fitness(): 0.0, &slots_full);
+
+        if (number_running > 0) {
+            if (started > 0) {
+                delay = 0;
+            }
+
+            backend->wait_for_completion(seen, COMPLETION_WAIT_TIMEOUT);
+        } else if (slots_full) {
+            // No slot available and none of these solvers running, so the slots are held elsewhere
+            increase_polling_delay(&delay);
+            logger->log(5, "Unallocated solver delay %d", delay);
 
-    for (int i = 0; i < size; i++) {
-        fprintf(ofp, "%d\n", perm[i]);
+            // Sleep quantum is 10 milliseconds
+            backend->wait_for_completion(seen, 10 * delay);
+        } else {
+            // Out of time or no new individuals to evaluate
+            break;
+        }
     }
 
-    fclose(ofp);
+    evaluate_best_parent(protection_type);
 }
 
-int GAProtection::read_cost_file(const char* filename, double* costs) {
-    FILE *ifp;
+// Wait for all running steady-state evaluations and apply their results
+void GAProtection::finish_evaluations() {
+    while (number_running > 0) {
+        int seen = backend->completions();
 
-    int line_number = 0;
+        collect_offspring();
 
-    if ((ifp = fopen(filename, "r")) == NULL) {
-        logger->error(1, "Cost file not found: %s", filename);
+        if (number_running > 0) {
+            backend->wait_for_completion(seen, COMPLETION_WAIT_TIMEOUT);
+        }
     }
+}
+
+// Breed and start new individuals for any free slots and return the number started
+// slots_full is set if the backend had no session available
+int GAProtection::dispatch_offspring(double max_cost, bool *slots_full) {
+    int started = 0;
 
-    for (CellIndex i = 0; i < number_of_genes; i++) {
-        if (fscanf(ifp, "%lf\n",  &costs[i]) != 1) {
+    *slots_full = false;
+
+    for (int i = 0; i < steady_state_slots; i++) {
+        if (running_jobs[i] != NULL) {
+            continue;
+        }
+
+        if (((number_of_counted_evals + number_running) >= max_evaluations) || ((time(NULL) - start_seconds) > max_seconds)) {
             break;
         }
-        line_number++;
+
+        // Find an individual that has not been evaluated and is not being evaluated
+        bool found = false;
+
+        for (int attempts = 0; (attempts < MAX_RANDOMISATION_ATTEMPTS) && (! found); attempts++) {
+            breed_offspring();
+            found = ((! evaluationCache->cached(pool_clones[0].genes, YPLUS_MODEL)) && (! evaluation_running(pool_clones[0].genes)));
+        }
+
+        if (! found) {
+            logger->log(3, "No new individual found after %d attempts", MAX_RANDOMISATION_ATTEMPTS);
+            break;
+        }
+
+        double ready_time = sys.wall_time();
+
+        try {
+            running_jobs[i] = start_evaluation(pool_clones[0].genes, protection_type, YPLUS_MODEL, max_cost);
+        } catch (int e) {
+            // Keep the compiler from complaining
+            e = 0;
+
+            *slots_full = true;
+            break;
+        }
+
+        copy_individual(&pool_running[i], &pool_clones[0]);
+        running_ready_time[i] = ready_time;
+        number_running++;
+        started++;
     }
 
-    fclose(ifp);
+    return started;
+}
+
+// Apply the results of any finished evaluations and return the number collected
+int GAProtection::collect_offspring() {
+    int collected = 0;
+
+    for (int i = 0; i < steady_state_slots; i++) {
+        if (running_jobs[i] == NULL) {
+            continue;
+        }
 
-    return line_number;
+        int status = running_jobs[i]->getStatus();
+        logger->log(6, "Solver %s status %d", running_jobs[i]->getName(), status);
+
+        switch (status) {
+            case -2:
+            case -1:
+                // Solver still running
+                break;
+
+            case 0:
+                complete_evaluation(running_jobs[i], &pool_running[i], i, protection_type, YPLUS_MODEL, false, true, running_ready_time[i]);
+                running_jobs[i] = NULL;
+                number_running--;
+                collected++;
+
+                // Replacement with a clones pool of one
+                copy_individual(&pool_clones[0], &pool_running[i]);
+                replacement(1);
+                break;
+
+            case JOB_LOST:
+                // Server stopped responding - the slot is bred again rather than the individual being restarted
+                logger->log(3, "Solver %s lost, offspring dropped", running_jobs[i]->getName());
+                delete running_jobs[i];
+                running_jobs[i] = NULL;
+                number_running--;
+                break;
+
+            default:
+                // Solver error - terminate all of this client's solvers before exiting
+                for (int j = 0; j < steady_state_slots; j++) {
+                    if (running_jobs[j] != NULL) {
+                        delete running_jobs[j];
+                        running_jobs[j] = NULL;
+                    }
+                }
+
+                logger->error(1, "Solver error %d", status);
+        }
+    }
+
+    return collected;
+}
+
+// Produce a new individual in the first clone
+void GAProtection::breed_offspring() {
+    if (pool_parent_size < POOL_PARENT_SIZE) {
+        // Population still growing - use random individuals
+        copy_individual(&pool_clones[0], &pool_parent[0]);
+        randomise_clone(0);
+    } else {
+        select_for_pool_mating();
+        apply_crossover();
+        copy_individual(&pool_clones[0], &pool_offspring[0]);
+        mutate_clone(0, 1.0 / (double)number_of_genes);
+    }
+}
+
+bool GAProtection::evaluation_running(const CellIndex *genes) {
+    for (int i = 0; i < steady_state_slots; i++) {
+        if (running_jobs[i] != NULL) {
+            GeneIndex j = 0;
+
+            while ((j < number_of_genes) && (pool_running[i].genes[j] == genes[j])) {
+                j++;
+            }
+
+            if (j == number_of_genes) {
+                return true;
+            }
+        }
+    }
+
+    return false;
 }
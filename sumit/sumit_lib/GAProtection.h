@@ -7,6 +7,7 @@
 #include "Individual.h"
 #include "SamplesLog.h"
 #include "EvaluationCache.h"
+#include "EvaluationBackend.h"
 
 #define SELECTION_TRUNCATION 0
 #define SELECTION_TOURNAMENT 1
@@ -39,15 +40,30 @@
 #define MAX_EVALUATIONS 1000
 #define STABLE_FOR_X_GENERATIONS 1000
 
+// Longest time in milliseconds to block waiting for a solver to finish before checking again
+#define COMPLETION_WAIT_TIMEOUT 1000
+
 typedef int GeneIndex;
 
 class GAProtection {
 
 public:
-    GAProtection(const char *host, const char *port, const char *injjfilename, const char *outjjfilename, const char *samples_filename, unsigned int seed, int cores, int execution_time, bool run_elimination);
+    GAProtection(EvaluationBackend *backend, const char *injjfilename, const char *outjjfilename, const char *samples_filename, unsigned int seed, int cores, int execution_time, bool run_elimination);
     virtual ~GAProtection(void);
     bool time_to_terminate();
     int number_of_evaluations();
+    void set_steady_state(bool steady_state);
+    void set_batch_size(int batch_size);
+    void set_cache_budget(long long bytes, int eviction_policy);
+    void finish_evaluations();
+
+    // Progress and time limit, so that time can be moved between the GAs of different partitions
+    double best_parent_fitness();
+    int get_stable_generations();
+    int get_elapsed_seconds();
+    int get_time_limit();
+    void set_time_limit(int seconds);
+    bool has_terminated();
 
     virtual void protect(bool limit_cost) = 0;
     virtual double fitness() = 0;
@@ -67,6 +83,10 @@ protected:
     int pool_clones_size;
     int default_number_of_clones;
 
+    int protection_type;
+    bool steady_state;
+    int batch_size; // Most yplus evaluations sent to one solver
+
     void allocate_pools();
     void select_for_pool_mating();
     void apply_crossover();
@@ -80,12 +100,14 @@ protected:
     void evaluate_fitness(int number_to_evaluate, struct Individual pool[], int protection_type, int model_type, bool get_outputjjfile, bool count_evals, double max_cost);
     double evaluate_best_parent(int protection_type);
     double get_worst_fitness();
+    void protect_steady_state(bool limit_cost);
+    int dispatch_offspring(double max_cost, bool *slots_full);
+    int collect_offspring();
 
 private:
     char outjjfilename[MAX_FILENAME_SIZE];
 
-    char host[MAX_HOST_NAME_SIZE];
-    char port[MAX_PORT_NUMBER_SIZE];
+    EvaluationBackend *backend;
     int cores;
 
     bool run_elimination;
@@ -110,6 +132,10 @@ private:
     int max_evaluations;
     int number_of_evals; // Total number of usages of the solver
     int number_of_counted_evals; // Number of evaluations not including evaluation of best parent
+    int number_of_timed_evals;
+    double total_queue_time; // Seconds from an individual being ready for evaluation to its solver starting
+    double total_solve_time;
+    SolverTelemetryStatistics telemetry_statistics[NUMBER_OF_MODELS]; // What the solvers report about their runs, by model type
     double stable_fitness;
     int stable_generations;
     int max_seconds;
@@ -119,6 +145,13 @@ private:
 
     EvaluationCache *evaluationCache;
 
+    // Steady-state mode - one slot is left free for evaluating the best parent
+    int steady_state_slots;
+    int number_running;
+    struct Individual *pool_running;
+    EvaluationJob **running_jobs;
+    double *running_ready_time;
+
     bool invalid_offspring(int offspring);
     void sort_pool_by_fitness(int number_to_sort, struct Individual Pool[]);
     void copy_individual(struct Individual* to, struct Individual* from);
@@ -148,7 +181,11 @@ private:
     void replace_tournament(int pool_size);
     void replace_worst_by_tournament(int pool_size);
     void increase_polling_delay(int *delay);
-    void write_perm_file(const char* filename, int* perm, int size);
-    int read_cost_file(const char* filename, double* costs);
+    EvaluationJob *start_evaluation(const CellIndex *genes, int protection_type, int model_type, double max_cost);
+    int start_batch(int first, int number_to_evaluate, struct Individual pool[], int status[], EvaluationJob *job[], int protection_type, double max_cost);
+    void complete_evaluation(EvaluationJob *job, struct Individual *individual, int index, int protection_type, int model_type, bool get_outputjjfile, bool count_evals, double ready_time);
+    void mutate_clone(int offspring, double mutation_rate);
+    void breed_offspring();
+    bool evaluation_running(const CellIndex *genes);
 
 };
@@ -4,7 +4,9 @@
 #include "Solver.h"
 #include "Groups.h"
 
-GroupedGAProtection::GroupedGAProtection(const char *host, const char *port, const char *injjfilename, const char *outjjfilename, const char *samples_filename, unsigned int seed, int cores, int execution_time, bool run_elimination) : GAProtection(host, port, injjfilename, outjjfilename, samples_filename, seed, cores, execution_time, run_elimination) {
+GroupedGAProtection::GroupedGAProtection(EvaluationBackend *backend, const char *injjfilename, const char *outjjfilename, const char *samples_filename, unsigned int seed, int cores, int execution_time, bool run_elimination) : GAProtection(backend, injjfilename, outjjfilename, samples_filename, seed, cores, execution_time, run_elimination) {
+    protection_type = GROUP_PROTECTION;
+
     // Create groups
     Groups *groups = new Groups(jjData);
     number_of_genes = groups->number_of_groups;
@@ -35,8 +37,12 @@ GroupedGAProtection::GroupedGAProtection(const char *host, const char *port, con
         // Random order of groups
         fill_parent_pool(YPLUS_MODEL);
 
-        evaluate_fitness(pool_parent_size, pool_parent, GROUP_PROTECTION, YPLUS_MODEL, false, true, 0.0);
-        evaluate_best_parent(GROUP_PROTECTION);
+        {
+            ScopedTimer timer("Initial pool evaluation");
+
+            evaluate_fitness(pool_parent_size, pool_parent, GROUP_PROTECTION, YPLUS_MODEL, false, true, 0.0);
+            evaluate_best_parent(GROUP_PROTECTION);
+        }
     }
 
     delete groups;
@@ -45,7 +51,9 @@ GroupedGAProtection::GroupedGAProtection(const char *host, const char *port, con
 void GroupedGAProtection::protect(bool limit_cost) {
     logger->log(3, "Grouped protection: %s", injjfilename);
 
-    if (number_of_genes > 0) {
+    if ((number_of_genes > 0) && steady_state) {
+        protect_steady_state(limit_cost);
+    } else if (number_of_genes > 0) {
         double max_cost = get_worst_fitness();
 
         select_for_pool_mating();
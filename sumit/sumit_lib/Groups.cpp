@@ -1,7 +1,10 @@
 #include "stdafx.h"
 #include "Groups.h"
+#include "ExchangeSort.h"
 
 Groups::Groups(JJData *jjData) {
+    ScopedTimer timer("Groups");
+
     this->jjData = jjData;
 
     // Select primary cells and store them
@@ -9,112 +12,38 @@ Groups::Groups(JJData *jjData) {
     stored_cells->store_selected_cells();
     stored_cells->order_cells_by_largest_weighting();
 
-    cell_constraints_mapping = new CellToConstraints[jjData->ncells];
-
-    for (CellIndex i = 0; i < jjData->ncells; i++) {
-        cell_constraints_mapping[i].number_of_constraints = 0;
-        cell_constraints_mapping[i].constraint_number = NULL;
-    }
-
-    constraints_cell_mapping = new ConstraintsToCell[jjData->nsums];
+    // Sort constraints by size, smallest first, in the order the original exchange sort left equal sizes
+    SumIndex *permutation = new SumIndex[jjData->nsums];
 
     for (SumIndex i = 0; i < jjData->nsums; i++) {
-        constraints_cell_mapping[i].number_of_cells = 0;
-        constraints_cell_mapping[i].half_sum_lower_protection_levels = 0.0;
-        constraints_cell_mapping[i].half_sum_upper_protection_levels = 0.0;
-        constraints_cell_mapping[i].cell_index = NULL;
+        permutation[i] = i;
     }
 
-    // Sort constraints by size
-    for (SumIndex i = 0; i < jjData->nsums; i++) {
-        for (SumIndex j = 0; j < jjData->nsums; j++) {
-            if ((i < j) && (jjData->consistency_eqtns[i].size_of_eqtn > jjData->consistency_eqtns[j].size_of_eqtn)) {
-                // Swap i and j
-                JJData::ConsistencyEquation temp_constraint;
-                temp_constraint.size_of_eqtn = jjData->consistency_eqtns[i].size_of_eqtn;
-                temp_constraint.cell_index = jjData->consistency_eqtns[i].cell_index;
-                temp_constraint.plus_or_minus = jjData->consistency_eqtns[i].plus_or_minus;
-                temp_constraint.RHS = jjData->consistency_eqtns[i].RHS;
-
-                jjData->consistency_eqtns[i].size_of_eqtn = jjData->consistency_eqtns[j].size_of_eqtn;
-                jjData->consistency_eqtns[i].cell_index = jjData->consistency_eqtns[j].cell_index;
-                jjData->consistency_eqtns[i].plus_or_minus = jjData->consistency_eqtns[j].plus_or_minus;
-                jjData->consistency_eqtns[i].RHS = jjData->consistency_eqtns[j].RHS;
-
-                jjData->consistency_eqtns[j].size_of_eqtn = temp_constraint.size_of_eqtn;
-                jjData->consistency_eqtns[j].cell_index = temp_constraint.cell_index;
-                jjData->consistency_eqtns[j].plus_or_minus = temp_constraint.plus_or_minus;
-                jjData->consistency_eqtns[j].RHS = temp_constraint.RHS;
-            }
-        }
-    }
+    exchange_sort(permutation, jjData->nsums, [jjData](SumIndex i) { return -jjData->consistency_eqtns[i].size_of_eqtn; });
 
-    // Work out how much space is required to store the data
-    for (SumIndex i = 0; i < jjData->nsums; i++) {
-        CellIndex size = jjData->consistency_eqtns[i].size_of_eqtn;
+    jjData->reorder_equations(permutation);
 
-        for (CellIndex j = 0; j < size; j++) {
-            CellIndex c = jjData->consistency_eqtns[i].cell_index[j];
-
-            if (jjData->cells[c].status == 'u') {
-                cell_constraints_mapping[c].number_of_constraints++;
-                constraints_cell_mapping[i].number_of_cells++;
-            }
-        }
-    }
-
-    // Allocate memory and initialise it
-    for (CellIndex i = 0; i < jjData->ncells; i++) {
-        if (cell_constraints_mapping[i].number_of_constraints > 0) {
-            cell_constraints_mapping[i].constraint_number = new CellIndex[cell_constraints_mapping[i].number_of_constraints];
-            cell_constraints_mapping[i].number_of_constraints = 0;
-        }
-    }
-
-    for (SumIndex i = 0; i < jjData->nsums; i++) {
-        if (constraints_cell_mapping[i].number_of_cells > 0) {
-            constraints_cell_mapping[i].cell_index = new CellIndex[constraints_cell_mapping[i].number_of_cells];
-            constraints_cell_mapping[i].number_of_cells = 0;
-        }
-    }
-
-    // Fill in the cell/constraint mappings
-    for (SumIndex i = 0; i < jjData->nsums; i++) {
-        CellIndex size = jjData->consistency_eqtns[i].size_of_eqtn;
-
-        for (CellIndex j = 0; j < size; j++) {
-            CellIndex c = jjData->consistency_eqtns[i].cell_index[j];
-
-            if (jjData->cells[c].status == 'u') {
-                CellIndex k = cell_constraints_mapping[c].number_of_constraints;
-                cell_constraints_mapping[c].constraint_number[k] = i;
-                k++;
-                cell_constraints_mapping[c].number_of_constraints = k;
-
-                k = constraints_cell_mapping[i].number_of_cells;
-                constraints_cell_mapping[i].cell_index[k] = c;
-                k++;
-                constraints_cell_mapping[i].number_of_cells = k;
-            }
-        }
-    }
+    delete[] permutation;
 
     // Calculate half the sum of the protection levels
+    half_sum_lower_protection_levels = new double[jjData->nsums];
+    half_sum_upper_protection_levels = new double[jjData->nsums];
+
     for (SumIndex i = 0; i < jjData->nsums; i++) {
         double sum_lp = 0.0;
         double sum_up = 0.0;
-        CellIndex size = constraints_cell_mapping[i].number_of_cells;
 
-        if (size > 0) {
-            for (CellIndex j = 0; j < size; j++) {
-                CellIndex cell = constraints_cell_mapping[i].cell_index[j];
+        for (int64_t k = jjData->equation_offsets[i]; k < jjData->equation_offsets[i + 1]; k++) {
+            CellIndex cell = jjData->equation_cells[k];
+
+            if (jjData->cells[cell].status == 'u') {
                 sum_lp = sum_lp + jjData->cells[cell].lower_protection_level;
                 sum_up = sum_up + jjData->cells[cell].upper_protection_level;
             }
-
-            constraints_cell_mapping[i].half_sum_lower_protection_levels = sum_lp / 2.0;
-            constraints_cell_mapping[i].half_sum_upper_protection_levels = sum_up / 2.0;
         }
+
+        half_sum_lower_protection_levels[i] = sum_lp / 2.0;
+        half_sum_upper_protection_levels[i] = sum_up / 2.0;
     }
 
     if (stored_cells->size > 0) {
@@ -157,7 +86,6 @@ Groups::Groups(JJData *jjData) {
                     assigned = true;
                 } else if (group[j].size < max_group_size) {
                     bool common_constraint = false;
-                    CellIndex nos_of_constraints = cell_constraints_mapping[cell].number_of_constraints;
 
                     if (cell_already_in_group(cell, j)) {
                         // Skip the checks as the cell is already in the group
@@ -165,8 +93,8 @@ Groups::Groups(JJData *jjData) {
                         assigned = true;
                     }
 
-                    for (CellIndex k = 0; ((k < nos_of_constraints) && (! common_constraint)); k++) {
-                        CellIndex constraint = cell_constraints_mapping[cell].constraint_number[k];
+                    for (int64_t k = jjData->cell_offsets[cell]; ((k < jjData->cell_offsets[cell + 1]) && (! common_constraint)); k++) {
+                        SumIndex constraint = jjData->cell_equations[k];
                         double sum_lp = 0.0;
                         double sum_up = 0.0;
                         CellIndex shared_cell_count = 0;
@@ -180,8 +108,8 @@ Groups::Groups(JJData *jjData) {
                             }
                         }
                         if (shared_cell_count > 0) {
-                            if ((sum_lp + jjData->cells[cell].lower_protection_level > constraints_cell_mapping[constraint].half_sum_lower_protection_levels)
-                                    || (sum_up + jjData->cells[cell].upper_protection_level > constraints_cell_mapping[constraint].half_sum_upper_protection_levels)) {
+                            if ((sum_lp + jjData->cells[cell].lower_protection_level > half_sum_lower_protection_levels[constraint])
+                                    || (sum_up + jjData->cells[cell].upper_protection_level > half_sum_upper_protection_levels[constraint])) {
                                 common_constraint = true;
                             }
                         }
@@ -246,13 +174,16 @@ Groups::~Groups() {
     }
 
     delete[] group;
+
+    delete[] half_sum_lower_protection_levels;
+    delete[] half_sum_upper_protection_levels;
 }
 
 bool Groups::cell_in_constraint(CellIndex cell, CellIndex constraint) {
     bool rc = false;
 
-    for (CellIndex i = 0; i < constraints_cell_mapping[constraint].number_of_cells; i++) {
-        if (cell == constraints_cell_mapping[constraint].cell_index[i]) {
+    for (int64_t k = jjData->equation_offsets[constraint]; k < jjData->equation_offsets[constraint + 1]; k++) {
+        if (cell == jjData->equation_cells[k]) {
             return (true);
         }
     }
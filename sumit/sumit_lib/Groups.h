@@ -22,21 +22,9 @@ public:
 private:
     JJData *jjData;
 
-    struct CellToConstraints {
-        CellIndex number_of_constraints;
-        CellIndex *constraint_number;
-    };
-
-    CellToConstraints *cell_constraints_mapping;
-
-    struct ConstraintsToCell {
-        CellIndex number_of_cells;
-        double half_sum_lower_protection_levels;
-        double half_sum_upper_protection_levels;
-        CellIndex *cell_index;
-    };
-
-    ConstraintsToCell *constraints_cell_mapping;
+    // Half the sum of the protection levels of the primary cells in each consistency equation
+    double *half_sum_lower_protection_levels;
+    double *half_sum_upper_protection_levels;
 
     int max_groups;
     int max_groups_limit;
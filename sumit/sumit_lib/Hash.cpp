@@ -0,0 +1,122 @@
+#include "stdafx.h"
+#include <string.h>
+#include "Hash.h"
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+
+    return k;
+}
+
+static inline uint64_t get_block(const uint8_t *p) {
+    // memcpy avoids unaligned reads
+    uint64_t k;
+    memcpy(&k, p, sizeof(k));
+    return k;
+}
+
+struct Fingerprint murmur_hash3_x64_128(const void *key, size_t length, uint32_t seed) {
+    const uint8_t *data = (const uint8_t *)key;
+    const size_t nblocks = length / 16;
+
+    uint64_t h1 = seed;
+    uint64_t h2 = seed;
+
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+    // Body
+    for (size_t i = 0; i < nblocks; i++) {
+        uint64_t k1 = get_block(data + (i * 16));
+        uint64_t k2 = get_block(data + (i * 16) + 8);
+
+        k1 *= c1;
+        k1 = rotl64(k1, 31);
+        k1 *= c2;
+        h1 ^= k1;
+
+        h1 = rotl64(h1, 27);
+        h1 += h2;
+        h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2;
+        k2 = rotl64(k2, 33);
+        k2 *= c1;
+        h2 ^= k2;
+
+        h2 = rotl64(h2, 31);
+        h2 += h1;
+        h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    // Tail
+    const uint8_t *tail = data + (nblocks * 16);
+
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+
+    switch (length & 15) {
+        case 15: k2 ^= ((uint64_t)tail[14]) << 48; // fall through
+        case 14: k2 ^= ((uint64_t)tail[13]) << 40; // fall through
+        case 13: k2 ^= ((uint64_t)tail[12]) << 32; // fall through
+        case 12: k2 ^= ((uint64_t)tail[11]) << 24; // fall through
+        case 11: k2 ^= ((uint64_t)tail[10]) << 16; // fall through
+        case 10: k2 ^= ((uint64_t)tail[9]) << 8; // fall through
+        case 9:
+            k2 ^= ((uint64_t)tail[8]) << 0;
+            k2 *= c2;
+            k2 = rotl64(k2, 33);
+            k2 *= c1;
+            h2 ^= k2;
+            // fall through
+
+        case 8: k1 ^= ((uint64_t)tail[7]) << 56; // fall through
+        case 7: k1 ^= ((uint64_t)tail[6]) << 48; // fall through
+        case 6: k1 ^= ((uint64_t)tail[5]) << 40; // fall through
+        case 5: k1 ^= ((uint64_t)tail[4]) << 32; // fall through
+        case 4: k1 ^= ((uint64_t)tail[3]) << 24; // fall through
+        case 3: k1 ^= ((uint64_t)tail[2]) << 16; // fall through
+        case 2: k1 ^= ((uint64_t)tail[1]) << 8; // fall through
+        case 1:
+            k1 ^= ((uint64_t)tail[0]) << 0;
+            k1 *= c1;
+            k1 = rotl64(k1, 31);
+            k1 *= c2;
+            h1 ^= k1;
+    }
+
+    // Finalisation
+    h1 ^= (uint64_t)length;
+    h2 ^= (uint64_t)length;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+
+    h1 += h2;
+    h2 += h1;
+
+    struct Fingerprint f;
+    f.h1 = h1;
+    f.h2 = h2;
+
+    return f;
+}
+
+bool fingerprint_equals(const struct Fingerprint *f1, const struct Fingerprint *f2) {
+    return (f1->h1 == f2->h1) && (f1->h2 == f2->h2);
+}
+
+void fingerprint_to_hex(const struct Fingerprint *f, char *hex) {
+    sprintf(hex, "%016" PRIx64 "%016" PRIx64, f->h1, f->h2);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "stdafx.h"
+
+// 128-bit fingerprint of a block of memory
+struct Fingerprint {
+    uint64_t h1;
+    uint64_t h2;
+};
+
+// MurmurHash3 x64 128-bit variant (Austin Appleby, public domain)
+// The output is identical on all platforms of the same endianness
+// length is a size_t so that files of 2 GiB or more are hashed in full, as the server hashes them
+struct Fingerprint murmur_hash3_x64_128(const void *key, size_t length, uint32_t seed);
+
+bool fingerprint_equals(const struct Fingerprint *f1, const struct Fingerprint *f2);
+
+// Write the fingerprint as 32 lower case hexadecimal digits - hex must have room for 33 characters
+void fingerprint_to_hex(const struct Fingerprint *f, char *hex);
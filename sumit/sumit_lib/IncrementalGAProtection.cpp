@@ -5,7 +5,9 @@
 #include "CellStore.h"
 #include "Groups.h"
 
-IncrementalGAProtection::IncrementalGAProtection(const char *host, const char *port, const char *injjfilename, const char *outjjfilename, const char *samples_filename, unsigned int seed, int cores, int execution_time, bool run_elimination) : GAProtection(host, port, injjfilename, outjjfilename, samples_filename, seed, cores, execution_time, run_elimination) {
+IncrementalGAProtection::IncrementalGAProtection(EvaluationBackend *backend, const char *injjfilename, const char *outjjfilename, const char *samples_filename, unsigned int seed, int cores, int execution_time, bool run_elimination) : GAProtection(backend, injjfilename, outjjfilename, samples_filename, seed, cores, execution_time, run_elimination) {
+    protection_type = INDIVIDUAL_PROTECTION;
+
     // Select primary cells and store them
     CellStore *stored_cells = new CellStore(jjData);
     stored_cells->store_selected_cells();
@@ -38,8 +40,12 @@ IncrementalGAProtection::IncrementalGAProtection(const char *host, const char *p
         // Random order of cells
         fill_parent_pool(YPLUS_MODEL);
 
-        evaluate_fitness(pool_parent_size, pool_parent, INDIVIDUAL_PROTECTION, YPLUS_MODEL, false, true, 0.0);
-        evaluate_best_parent(INDIVIDUAL_PROTECTION);
+        {
+            ScopedTimer timer("Initial pool evaluation");
+
+            evaluate_fitness(pool_parent_size, pool_parent, INDIVIDUAL_PROTECTION, YPLUS_MODEL, false, true, 0.0);
+            evaluate_best_parent(INDIVIDUAL_PROTECTION);
+        }
     }
 
     delete stored_cells;
@@ -48,7 +54,9 @@ IncrementalGAProtection::IncrementalGAProtection(const char *host, const char *p
 void IncrementalGAProtection::protect(bool limit_cost) {
     logger->log(3, "Incremental protection: %s", injjfilename);
 
-    if (number_of_genes > 0) {
+    if ((number_of_genes > 0) && steady_state) {
+        protect_steady_state(limit_cost);
+    } else if (number_of_genes > 0) {
         double max_cost = get_worst_fitness();
 
         select_for_pool_mating();
@@ -6,7 +6,7 @@
 class IncrementalGAProtection: public GAProtection {
 
 public:
-    IncrementalGAProtection(const char *host, const char *port, const char *injjfilename, const char *outjjfilename, const char *samplesFilename, unsigned int seed, int cores, int execution_time, bool runElimination);
+    IncrementalGAProtection(EvaluationBackend *backend, const char *injjfilename, const char *outjjfilename, const char *samplesFilename, unsigned int seed, int cores, int execution_time, bool runElimination);
     void protect(bool limit_cost);
     double fitness();
 
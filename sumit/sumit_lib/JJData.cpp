@@ -3,59 +3,113 @@
 #include <math.h>
 #include <string.h>
 #include "JJData.h"
+#include "JJTextReader.h"
+#include "JJTextWriter.h"
+
+// Layout of a binary JJ file (native byte order):
+//   header
+//   cells as one array per field: id, level, status, nominal value, loss of information weight, lower bound, upper bound,
+//   lower protection level, upper protection level, sliding protection level
+//   equations in compressed sparse row form: RHS, offsets (nsums + 1), marginal cell index, cell indices (nterms), sign bits (nterms)
+// Each array starts on an eight byte boundary
+struct BinaryJJHeader {
+    char magic[8];
+    int32_t version;
+    int32_t ncells;
+    int32_t nsums;
+    int32_t nlevels;
+    int32_t nprotected;
+    int32_t max_eqn_size;
+    int64_t nterms;
+};
+
+struct BinaryJJLayout {
+    size_t id;
+    size_t level;
+    size_t status;
+    size_t nominal_value;
+    size_t loss_of_information_weight;
+    size_t lower_bound;
+    size_t upper_bound;
+    size_t lower_protection_level;
+    size_t upper_protection_level;
+    size_t sliding_protection_level;
+    size_t rhs;
+    size_t offsets;
+    size_t marginal_index;
+    size_t cell_index;
+    size_t signs;
+    size_t size;
+};
+
+// Reserve space for an array and return its offset in the file
+static size_t binary_jj_array(size_t* offset, size_t bytes) {
+    size_t start = *offset;
+    *offset = (start + bytes + 7) & ~(size_t)7;
+    return start;
+}
+
+static struct BinaryJJLayout binary_jj_layout(const struct BinaryJJHeader* header) {
+    struct BinaryJJLayout layout;
+    size_t offset = sizeof(struct BinaryJJHeader);
+    size_t ncells = (size_t)header->ncells;
+    size_t nsums = (size_t)header->nsums;
+    size_t nterms = (size_t)header->nterms;
+
+    layout.id = binary_jj_array(&offset, ncells * sizeof(int32_t));
+    layout.level = binary_jj_array(&offset, ncells * sizeof(int32_t));
+    layout.status = binary_jj_array(&offset, ncells * sizeof(char));
+    layout.nominal_value = binary_jj_array(&offset, ncells * sizeof(double));
+    layout.loss_of_information_weight = binary_jj_array(&offset, ncells * sizeof(double));
+    layout.lower_bound = binary_jj_array(&offset, ncells * sizeof(double));
+    layout.upper_bound = binary_jj_array(&offset, ncells * sizeof(double));
+    layout.lower_protection_level = binary_jj_array(&offset, ncells * sizeof(double));
+    layout.upper_protection_level = binary_jj_array(&offset, ncells * sizeof(double));
+    layout.sliding_protection_level = binary_jj_array(&offset, ncells * sizeof(double));
+    layout.rhs = binary_jj_array(&offset, nsums * sizeof(double));
+    layout.offsets = binary_jj_array(&offset, (nsums + 1) * sizeof(int64_t));
+    layout.marginal_index = binary_jj_array(&offset, nsums * sizeof(int32_t));
+    layout.cell_index = binary_jj_array(&offset, nterms * sizeof(CellIndex));
+    layout.signs = binary_jj_array(&offset, (nterms + 7) / 8);
+    layout.size = offset;
+
+    return layout;
+}
 
 JJData::JJData(const char* filename) {
-    FILE *ifp;
-    int file_id;
-    char divider;
+    ScopedTimer timer("JJData");
 
     name = new char[strlen(filename) + 1];
     strcpy(name, filename);
 
-    int line_number = 0;
     nprotected = 0;
     max_eqn_size = 0;
 
-    if ((ifp = fopen(filename, "r")) == NULL) {
-        logger->error(201, "File not found: %s", filename);
-    }
+    mapping = NULL;
+    mapping_size = 0;
+    equation_store_mapped = false;
 
-    // Line 1 - file type
-    line_number++;
-    if (fscanf(ifp, "%d\n", &file_id) != 1) {
-        logger->error(202, "Incorrect format at line %d: %s", line_number, filename);
-    }
+    consistency_eqtns = NULL;
+    equation_offsets = NULL;
+    equation_cells = NULL;
+    equation_signs = NULL;
+    cell_offsets = NULL;
+    cell_equations = NULL;
 
-    if (file_id != 0) {
-        logger->error(203, "Unknown file type: %s", filename);
+    if (is_binary_jj_file(filename)) {
+        read_binary_jj_file(filename);
+        return;
     }
 
-    // Line 2 - number of cells
-    line_number++;
-    if (fscanf(ifp, "%d\n", &ncells) != 1) {
-        logger->error(204, "Incorrect format at line %d: %s", line_number, filename);
-    }
+    JJTextReader reader(filename);
 
     // Cells
+    ncells = reader.read_header();
     cells = new Cell[ncells];
+    reader.read_cells(cells, ncells);
 
     for (CellIndex i = 0; i < ncells; i++) {
-        line_number++;
-        if (fscanf(ifp, " %d %lf %lf %c %lf %lf %lf %lf %lf\n",
-                &cells[i].id,
-                &cells[i].nominal_value,
-                &cells[i].loss_of_information_weight,
-                &cells[i].status,
-                &cells[i].lower_bound,
-                &cells[i].upper_bound,
-                &cells[i].lower_protection_level,
-                &cells[i].upper_protection_level,
-                &cells[i].sliding_protection_level) != 9) {
-            logger->error(205, "Incorrect format at line %d: %s", line_number, filename);
-        }
-
         cells[i].level = 0;
-        map[cells[i].id] = i;
 
         if (cells[i].nominal_value < FLOAT_PRECISION) {
             cells[i].status = 'z';
@@ -66,67 +120,19 @@ JJData::JJData(const char* filename) {
         }
     }
 
+    build_cell_index();
+
     logger->log(2, "%d cells read: %s", ncells, filename);
     logger->log(2, "%d protected cells", nprotected);
 
-    // Number of equations
-    line_number++;
-    if (fscanf(ifp, "%d\n", &nsums) != 1) {
-        logger->error(208, "Incorrect format at line %d: %s", line_number, filename);
-    }
-
     // Consistency equations
-    consistency_eqtns = new ConsistencyEquation[nsums];
-
-    int start_of_constraints = line_number;
-
-    for (SumIndex i = 0; i < nsums; i++) {
-        line_number++;
-
-        if (fscanf(ifp, "%lf ", &consistency_eqtns[i].RHS) != 1) {
-            logger->error(209, "Incorrect total format at line %d: %s", line_number, filename);
-        }
-
-        if (fscanf(ifp, " %d ", &consistency_eqtns[i].size_of_eqtn) != 1) {
-            logger->error(210, "Incorrect equation size format at line %d: %s", line_number, filename);
-        }
-
-        if (consistency_eqtns[i].size_of_eqtn < 2) {
-            logger->error(211, "Equation size too small at line %d: %s", line_number, filename);
-        }
-
-        if ((fscanf(ifp, " %c ", &divider) != 1) || (divider != ':')) {
-            logger->error(212, "Incorrect divider format at line %d: %s", line_number, filename);
-        }
-
-        consistency_eqtns[i].cell_index = new CellIndex[consistency_eqtns[i].size_of_eqtn];
-        consistency_eqtns[i].plus_or_minus = new int[consistency_eqtns[i].size_of_eqtn];
-        consistency_eqtns[i].marginal_index = -1;
-
-        for (CellIndex j = 0; j < consistency_eqtns[i].size_of_eqtn; j++) {
-            CellID id;
-            if (fscanf(ifp, " %d (%d)", &id, &consistency_eqtns[i].plus_or_minus[j]) != 2) {
-                logger->error(213, "Incorrect consistency equation format at line %d: %s", line_number, filename);
-            }
-            consistency_eqtns[i].cell_index[j] = cell_id_to_index(id);
-
-            if (consistency_eqtns[i].plus_or_minus[j] < 0) {
-                if (consistency_eqtns[i].marginal_index == -1) {
-                    consistency_eqtns[i].marginal_index = consistency_eqtns[i].cell_index[j];
-                } else {
-                    logger->error(222, "Duplicate total in consistency equation at line %d: %s", line_number, filename);
-                }
-            }
-        }
-
-        if (consistency_eqtns[i].marginal_index == -1) {
-            logger->error(223, "Missing total in consistency equation at line %d: %s", line_number, filename);
-        }
-    }
+    nsums = reader.read_number_of_equations();
+    reader.read_equations(this, nsums);
+    finish_equation_store();
 
     logger->log(2, "%d consistency equations read: %s", nsums, filename);
 
-    line_number = start_of_constraints;
+    int line_number = reader.get_first_equation_line() - 1;
     bool error = false;
 
     for (SumIndex i = 0; i < nsums; i++) {
@@ -141,13 +147,13 @@ JJData::JJData(const char* filename) {
         double sum = 0.0;
 
         for (CellIndex j = 0; j < size; j++) {
-            sum = sum + (double)consistency_eqtns[i].plus_or_minus[j] * cells[consistency_eqtns[i].cell_index[j]].nominal_value;
+            sum = sum + (double)plus_or_minus(i, j) * cells[consistency_eqtns[i].cell_index[j]].nominal_value;
         }
 
         if (fabs(sum - consistency_eqtns[i].RHS) > MARGINAL_EQUALITY_TOLERANCE) {
             logger->log(1, "Inconsistent constraint at line %d: constraint index = %d, sum = %lf, RHS = %lf", line_number, i, sum, consistency_eqtns[i].RHS);
             for (CellIndex j = 0; j < size; j++) {
-                logger->log(1, "Cell index %d, ID %d, value %lf", consistency_eqtns[i].cell_index[j], cell_index_to_id(consistency_eqtns[i].cell_index[j]), (double)consistency_eqtns[i].plus_or_minus[j] * cells[consistency_eqtns[i].cell_index[j]].nominal_value);
+                logger->log(1, "Cell index %d, ID %d, value %lf", consistency_eqtns[i].cell_index[j], cell_index_to_id(consistency_eqtns[i].cell_index[j]), (double)plus_or_minus(i, j) * cells[consistency_eqtns[i].cell_index[j]].nominal_value);
             }
             error = true;
         }
@@ -165,7 +171,7 @@ JJData::JJData(const char* filename) {
 
         for (SumIndex i = 0; i < nsums; i++) {
             ConsistencyEquation* eqtn = &consistency_eqtns[i];
-            CellIndex marginal_index = cell_id_to_index(find_marginal_id(eqtn));
+            CellIndex marginal_index = cell_id_to_index(find_marginal_id(i));
 
             // Level of marginal is one greater than maximum level of underlying cells
             int level = 0;
@@ -199,8 +205,6 @@ JJData::JJData(const char* filename) {
 
     logger->log(2, "Maximum consistency equation size %d", max_eqn_size);
     logger->log(2, "%d levels", nlevels);
-
-    fclose(ifp);
 }
 
 // Return whether to trace a particular cell
@@ -214,10 +218,23 @@ JJData::JJData(const char* filename) {
 // partition_size is the size of the set of partition_cells
 // partition_id is a one-based identifier used to identify the partition in error and log messages
 JJData::JJData(JJData* parent, CellID* partition_cells, int partition_size, int partition_id) {
+    ScopedTimer timer("JJData partition");
+
     nlevels = parent->nlevels;
     nprotected = 0;
     max_eqn_size = 0;
 
+    mapping = NULL;
+    mapping_size = 0;
+    equation_store_mapped = false;
+
+    consistency_eqtns = NULL;
+    equation_offsets = NULL;
+    equation_cells = NULL;
+    equation_signs = NULL;
+    cell_offsets = NULL;
+    cell_equations = NULL;
+
     // The partition name is one plus the partition index to match partition naming elsewhere in the code
     name = new char[strlen("partition XXXXX") + 1];
     sprintf(name, "partition %d", partition_id);
@@ -313,38 +330,53 @@ JJData::JJData(JJData* parent, CellID* partition_cells, int partition_size, int
             cells[j].upper_bound = max_value * 2;
             cells[j].lower_protection_level = values[i] / 10;
             cells[j].upper_protection_level = values[i] / 10;
-            map[cells[j].id] = j;
             j++;
         }
     }
 
     delete[] values;
 
-    // Determine the number of consistency equations in the partition
-    nsums = 0;
-    ConsistencyEquation partition_eqtn;
+    build_cell_index();
+
+    // Generate revised consistency equations for the partition
+    std::vector<CellIndex> terms;
+    std::vector<bool> signs;
+    std::vector<int64_t> offsets(1, 0);
+    std::vector<double> totals;
+
     for (SumIndex i = 0; i < parent->nsums; i++) {
-        if (generate_partition_consistency_equation(parent, i, &partition_eqtn)) {
-            delete[] partition_eqtn.cell_index;
-            delete[] partition_eqtn.plus_or_minus;
-            nsums++;
+        double RHS;
+
+        if (generate_partition_consistency_equation(parent, i, &terms, &signs, &RHS)) {
+            offsets.push_back((int64_t)terms.size());
+            totals.push_back(RHS);
         }
     }
 
-    // Generate revised consistency equations for the partition
-    consistency_eqtns = new ConsistencyEquation[nsums];
+    allocate_equation_store((SumIndex)totals.size(), (int64_t)terms.size());
 
-    j = 0;
-    for (SumIndex i = 0; i < parent->nsums; i++) {
-        if (generate_partition_consistency_equation(parent, i, &partition_eqtn)) {
-            consistency_eqtns[j++] = partition_eqtn;
+    for (SumIndex i = 0; i < nsums; i++) {
+        consistency_eqtns[i].RHS = totals[i];
+        equation_offsets[i + 1] = offsets[i + 1];
 
-            if (partition_eqtn.size_of_eqtn > max_eqn_size) {
-                max_eqn_size = partition_eqtn.size_of_eqtn;
-            }
+        if (offsets[i + 1] - offsets[i] > max_eqn_size) {
+            max_eqn_size = (CellIndex)(offsets[i + 1] - offsets[i]);
+        }
+    }
+
+    for (size_t k = 0; k < terms.size(); k++) {
+        equation_cells[k] = terms[k];
+        if (signs[k]) {
+            equation_signs[k >> 3] |= (unsigned char)(1 << (k & 7));
         }
     }
 
+    finish_equation_store();
+
+    for (SumIndex i = 0; i < nsums; i++) {
+        consistency_eqtns[i].marginal_index = consistency_eqtns[i].cell_index[find_marginal_index_in_equation(i)];
+    }
+
     logger->log(3, "Maximum consistency equation size %d", max_eqn_size);
     logger->log(3, "%d levels", nlevels);
 }
@@ -354,50 +386,343 @@ JJData::~JJData() {
         delete[] cells;
     }
 
-    if (consistency_eqtns != NULL) {
-        for (SumIndex i = 0; i < nsums; i++) {
-            if (consistency_eqtns[i].cell_index != NULL) {
-                delete[] consistency_eqtns[i].cell_index;
-            }
+    release_equation_store();
 
-            if (consistency_eqtns[i].plus_or_minus != NULL) {
-                delete[] consistency_eqtns[i].plus_or_minus;
-            }
+    if (mapping != NULL) {
+        sys.unmap_file(mapping, mapping_size);
+    }
+
+    delete[] name;
+}
+
+void JJData::allocate_equation_store(SumIndex nsums, int64_t nterms) {
+    this->nsums = nsums;
+
+    consistency_eqtns = new ConsistencyEquation[nsums];
+    equation_offsets = new int64_t[nsums + 1];
+    equation_cells = new CellIndex[nterms];
+    equation_signs = new unsigned char[(nterms + 7) / 8];
+    equation_store_mapped = false;
+
+    equation_offsets[0] = 0;
+    memset(equation_signs, 0, (size_t)((nterms + 7) / 8));
+}
+
+// Point the equations into the store and build its transpose
+void JJData::finish_equation_store() {
+    for (SumIndex i = 0; i < nsums; i++) {
+        consistency_eqtns[i].size_of_eqtn = (CellIndex)(equation_offsets[i + 1] - equation_offsets[i]);
+        consistency_eqtns[i].cell_index = equation_cells + equation_offsets[i];
+    }
+
+    build_cell_equations();
+}
+
+// Counting sort of the terms by cell, which leaves the equations for each cell in ascending order
+// A cell that appears twice in an equation is listed twice
+void JJData::build_cell_equations() {
+    int64_t nterms = equation_offsets[nsums];
+
+    if (cell_offsets != NULL) {
+        delete[] cell_offsets;
+    }
+    if (cell_equations != NULL) {
+        delete[] cell_equations;
+    }
+
+    cell_offsets = new int64_t[ncells + 1];
+    cell_equations = new SumIndex[nterms];
+
+    for (CellIndex c = 0; c <= ncells; c++) {
+        cell_offsets[c] = 0;
+    }
+
+    for (int64_t k = 0; k < nterms; k++) {
+        cell_offsets[equation_cells[k] + 1]++;
+    }
+
+    for (CellIndex c = 0; c < ncells; c++) {
+        cell_offsets[c + 1] += cell_offsets[c];
+    }
+
+    int64_t* next = new int64_t[ncells];
+    for (CellIndex c = 0; c < ncells; c++) {
+        next[c] = cell_offsets[c];
+    }
+
+    for (SumIndex i = 0; i < nsums; i++) {
+        for (int64_t k = equation_offsets[i]; k < equation_offsets[i + 1]; k++) {
+            cell_equations[next[equation_cells[k]]++] = i;
         }
+    }
+
+    delete[] next;
+}
 
+void JJData::release_equation_store() {
+    if (consistency_eqtns != NULL) {
         delete[] consistency_eqtns;
+        consistency_eqtns = NULL;
     }
 
-    delete[] name;
+    // A mapped store belongs to the mapping
+    if (! equation_store_mapped) {
+        if (equation_offsets != NULL) {
+            delete[] equation_offsets;
+        }
+        if (equation_cells != NULL) {
+            delete[] equation_cells;
+        }
+        if (equation_signs != NULL) {
+            delete[] equation_signs;
+        }
+    }
+
+    equation_offsets = NULL;
+    equation_cells = NULL;
+    equation_signs = NULL;
+    equation_store_mapped = false;
+
+    if (cell_offsets != NULL) {
+        delete[] cell_offsets;
+        cell_offsets = NULL;
+    }
+    if (cell_equations != NULL) {
+        delete[] cell_equations;
+        cell_equations = NULL;
+    }
+}
+
+void JJData::reorder_equations(const SumIndex* permutation) {
+    ConsistencyEquation* eqtns = new ConsistencyEquation[nsums];
+    int64_t* offsets = new int64_t[nsums + 1];
+    int64_t nterms = equation_offsets[nsums];
+    CellIndex* terms = new CellIndex[nterms];
+    unsigned char* signs = new unsigned char[(nterms + 7) / 8];
+
+    memset(signs, 0, (size_t)((nterms + 7) / 8));
+
+    offsets[0] = 0;
+    for (SumIndex i = 0; i < nsums; i++) {
+        SumIndex from = permutation[i];
+        int64_t start = equation_offsets[from];
+        int64_t size = equation_offsets[from + 1] - start;
+
+        eqtns[i] = consistency_eqtns[from];
+        offsets[i + 1] = offsets[i] + size;
+
+        for (int64_t j = 0; j < size; j++) {
+            terms[offsets[i] + j] = equation_cells[start + j];
+            if (term_sign(start + j) < 0) {
+                signs[(offsets[i] + j) >> 3] |= (unsigned char)(1 << ((offsets[i] + j) & 7));
+            }
+        }
+    }
+
+    SumIndex n = nsums;
+    release_equation_store();
+    nsums = n;
+
+    consistency_eqtns = eqtns;
+    equation_offsets = offsets;
+    equation_cells = terms;
+    equation_signs = signs;
+
+    finish_equation_store();
 }
 
 void JJData::write_jj_file(const char* filename) {
-    FILE *ofp;
+    JJTextWriter writer(filename);
+    writer.write(this);
+}
 
-    if ((ofp = fopen(filename, "w")) == NULL) {
-        logger->error(216, "Unable to create file: %s", filename);
+bool JJData::is_binary_jj_file(const char* filename) {
+    FILE *ifp;
+    char magic[8];
+
+    if ((ifp = fopen(filename, "rb")) == NULL) {
+        return false;
     }
 
-    fprintf(ofp, "0\n");
-    fprintf(ofp, "%d \n", ncells);
+    bool binary = ((fread(magic, 1, sizeof(magic), ifp) == sizeof(magic)) && (memcmp(magic, BINARY_JJ_MAGIC, sizeof(magic)) == 0));
+
+    fclose(ifp);
+
+    return binary;
+}
+
+// Cells are copied out of the mapping as they are modified during protection, but the equation terms are used in place
+// The file was written from validated data, so only the structure is checked
+void JJData::read_binary_jj_file(const char* filename) {
+    mapping = sys.map_file(filename, &mapping_size);
+    if (mapping == NULL) {
+        logger->error(201, "File not found: %s", filename);
+    }
+
+    const char* base = (const char*)mapping;
+    struct BinaryJJHeader header;
+
+    if (mapping_size < sizeof(header)) {
+        logger->error(225, "Binary JJ file is truncated: %s", filename);
+    }
+    memcpy(&header, base, sizeof(header));
+
+    if (header.version != BINARY_JJ_VERSION) {
+        logger->error(224, "Unsupported binary JJ file version %d: %s", header.version, filename);
+    }
+
+    if ((header.ncells < 0) || (header.nsums < 0) || (header.nterms < 0)) {
+        logger->error(226, "Corrupt binary JJ file: %s", filename);
+    }
+
+    struct BinaryJJLayout layout = binary_jj_layout(&header);
+    if (mapping_size < layout.size) {
+        logger->error(225, "Binary JJ file is truncated: %s", filename);
+    }
+
+    ncells = header.ncells;
+    nsums = header.nsums;
+    nlevels = header.nlevels;
+    nprotected = header.nprotected;
+    max_eqn_size = header.max_eqn_size;
+
+    // Cells
+    const int32_t* id = (const int32_t*)(base + layout.id);
+    const int32_t* level = (const int32_t*)(base + layout.level);
+    const char* status = base + layout.status;
+    const double* nominal_value = (const double*)(base + layout.nominal_value);
+    const double* loss_of_information_weight = (const double*)(base + layout.loss_of_information_weight);
+    const double* lower_bound = (const double*)(base + layout.lower_bound);
+    const double* upper_bound = (const double*)(base + layout.upper_bound);
+    const double* lower_protection_level = (const double*)(base + layout.lower_protection_level);
+    const double* upper_protection_level = (const double*)(base + layout.upper_protection_level);
+    const double* sliding_protection_level = (const double*)(base + layout.sliding_protection_level);
+
+    cells = new Cell[ncells];
 
     for (CellIndex i = 0; i < ncells; i++) {
-        fprintf(ofp, "%d %f %f %c %f %f %f %f %f\n", cells[i].id, cells[i].nominal_value, cells[i].loss_of_information_weight, cells[i].status, cells[i].lower_bound, cells[i].upper_bound, cells[i].lower_protection_level, cells[i].upper_protection_level, cells[i].sliding_protection_level);
+        cells[i].id = id[i];
+        cells[i].nominal_value = nominal_value[i];
+        cells[i].loss_of_information_weight = loss_of_information_weight[i];
+        cells[i].status = status[i];
+        cells[i].lower_bound = lower_bound[i];
+        cells[i].upper_bound = upper_bound[i];
+        cells[i].lower_protection_level = lower_protection_level[i];
+        cells[i].upper_protection_level = upper_protection_level[i];
+        cells[i].sliding_protection_level = sliding_protection_level[i];
+        cells[i].level = level[i];
     }
 
-    fprintf(ofp, "%d\n", nsums);
+    build_cell_index();
 
-    for (SumIndex i = 0; i < nsums; i++) {
-        CellIndex size = consistency_eqtns[i].size_of_eqtn;
+    logger->log(2, "%d cells read: %s", ncells, filename);
+    logger->log(2, "%d protected cells", nprotected);
 
-        fprintf(ofp, "0 %d :", size);
+    // Consistency equations
+    const double* rhs = (const double*)(base + layout.rhs);
+    const int64_t* offsets = (const int64_t*)(base + layout.offsets);
+    const int32_t* marginal_index = (const int32_t*)(base + layout.marginal_index);
+    CellIndex* cell_index = (CellIndex*)((char*)mapping + layout.cell_index);
 
-        for (CellIndex j = 0; j < size; j++) {
-            fprintf(ofp, " %d (%d)", cell_index_to_id(consistency_eqtns[i].cell_index[j]), consistency_eqtns[i].plus_or_minus[j]);
+    if ((offsets[0] != 0) || (offsets[nsums] != header.nterms)) {
+        logger->error(226, "Corrupt binary JJ file: %s", filename);
+    }
+
+    for (int64_t i = 0; i < header.nterms; i++) {
+        if ((cell_index[i] < 0) || (cell_index[i] >= ncells)) {
+            logger->error(226, "Corrupt binary JJ file: %s", filename);
+        }
+    }
+
+    consistency_eqtns = new ConsistencyEquation[nsums];
+    equation_offsets = (int64_t*)((char*)mapping + layout.offsets);
+    equation_cells = cell_index;
+    equation_signs = (unsigned char*)mapping + layout.signs;
+    equation_store_mapped = true;
+
+    for (SumIndex i = 0; i < nsums; i++) {
+        if ((offsets[i + 1] - offsets[i] < 2) || (offsets[i + 1] - offsets[i] > max_eqn_size) || (marginal_index[i] < 0) || (marginal_index[i] >= ncells)) {
+            logger->error(226, "Corrupt binary JJ file: %s", filename);
         }
-        fprintf(ofp, "\n");
+
+        consistency_eqtns[i].RHS = rhs[i];
+        consistency_eqtns[i].marginal_index = marginal_index[i];
+    }
+
+    finish_equation_store();
+
+    logger->log(2, "%d consistency equations read: %s", nsums, filename);
+    logger->log(2, "Maximum consistency equation size %d", max_eqn_size);
+    logger->log(2, "%d levels", nlevels);
+}
+
+void JJData::write_binary_jj_file(const char* filename) {
+    FILE *ofp;
+
+    if ((ofp = fopen(filename, "wb")) == NULL) {
+        logger->error(216, "Unable to create file: %s", filename);
+    }
+
+    struct BinaryJJHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_JJ_MAGIC, sizeof(header.magic));
+    header.version = BINARY_JJ_VERSION;
+    header.ncells = ncells;
+    header.nsums = nsums;
+    header.nlevels = nlevels;
+    header.nprotected = nprotected;
+    header.max_eqn_size = max_eqn_size;
+    header.nterms = equation_offsets[nsums];
+
+    struct BinaryJJLayout layout = binary_jj_layout(&header);
+
+    // Build the file in memory, which also takes care of the padding between arrays
+    char* buffer = new char[layout.size];
+    memset(buffer, 0, layout.size);
+    memcpy(buffer, &header, sizeof(header));
+
+    int32_t* id = (int32_t*)(buffer + layout.id);
+    int32_t* level = (int32_t*)(buffer + layout.level);
+    char* status = buffer + layout.status;
+    double* nominal_value = (double*)(buffer + layout.nominal_value);
+    double* loss_of_information_weight = (double*)(buffer + layout.loss_of_information_weight);
+    double* lower_bound = (double*)(buffer + layout.lower_bound);
+    double* upper_bound = (double*)(buffer + layout.upper_bound);
+    double* lower_protection_level = (double*)(buffer + layout.lower_protection_level);
+    double* upper_protection_level = (double*)(buffer + layout.upper_protection_level);
+    double* sliding_protection_level = (double*)(buffer + layout.sliding_protection_level);
+
+    for (CellIndex i = 0; i < ncells; i++) {
+        id[i] = cells[i].id;
+        level[i] = cells[i].level;
+        status[i] = cells[i].status;
+        nominal_value[i] = cells[i].nominal_value;
+        loss_of_information_weight[i] = cells[i].loss_of_information_weight;
+        lower_bound[i] = cells[i].lower_bound;
+        upper_bound[i] = cells[i].upper_bound;
+        lower_protection_level[i] = cells[i].lower_protection_level;
+        upper_protection_level[i] = cells[i].upper_protection_level;
+        sliding_protection_level[i] = cells[i].sliding_protection_level;
+    }
+
+    double* rhs = (double*)(buffer + layout.rhs);
+    int32_t* marginal_index = (int32_t*)(buffer + layout.marginal_index);
+    for (SumIndex i = 0; i < nsums; i++) {
+        rhs[i] = consistency_eqtns[i].RHS;
+        marginal_index[i] = consistency_eqtns[i].cell_index[find_marginal_index_in_equation(i)];
+    }
+
+    // The equation store is already in file order
+    memcpy(buffer + layout.offsets, equation_offsets, (nsums + 1) * sizeof(int64_t));
+    memcpy(buffer + layout.cell_index, equation_cells, header.nterms * sizeof(CellIndex));
+    memcpy(buffer + layout.signs, equation_signs, (header.nterms + 7) / 8);
+
+    if (fwrite(buffer, 1, layout.size, ofp) != layout.size) {
+        logger->error(216, "Unable to write file: %s", filename);
     }
 
+    delete[] buffer;
+
     fclose(ofp);
 }
 
@@ -443,50 +768,86 @@ void JJData::recombine(const char* partitioned_jj_filename) {
     delete partition;
 }
 
-bool JJData::generate_partition_consistency_equation(JJData* parent, SumIndex index, ConsistencyEquation* partition_equation) {
+// Append the terms of the partition equation to partition_cells and partition_signs (true for a coefficient of -1)
+// Returns false, leaving the vectors unchanged, if the equation has fewer than two terms in the partition
+bool JJData::generate_partition_consistency_equation(JJData* parent, SumIndex index, std::vector<CellIndex>* partition_cells, std::vector<bool>* partition_signs, double* partition_RHS) {
     ConsistencyEquation* parent_eqtn = &parent->consistency_eqtns[index];
-    CellIndex marginal_index_in_eqtn = parent->find_marginal_index_in_equation(parent_eqtn);
-
-    // Initialise new partition consistency equation
-    partition_equation->RHS = parent_eqtn->RHS;
+    CellIndex marginal_index_in_eqtn = parent->find_marginal_index_in_equation(index);
+    size_t start = partition_cells->size();
 
-    CellID* cell_id = new CellID[parent_eqtn->size_of_eqtn];
-    int* plus_or_minus = new int[parent_eqtn->size_of_eqtn];
+    *partition_RHS = parent_eqtn->RHS;
 
-    partition_equation->size_of_eqtn = 0;
     for (CellIndex i = 0; i < parent_eqtn->size_of_eqtn; i++) {
         // Include the term if the cell is present in the partition
         CellID id = parent->cell_index_to_id(parent_eqtn->cell_index[i]);
-        if ((i == marginal_index_in_eqtn) || (map.count(id) > 0)) {
-            cell_id[partition_equation->size_of_eqtn] = id;
-            plus_or_minus[partition_equation->size_of_eqtn] = parent_eqtn->plus_or_minus[i];
-            partition_equation->size_of_eqtn++;
+        if ((i == marginal_index_in_eqtn) || (find_cell_index(id) >= 0)) {
+            partition_cells->push_back(cell_id_to_index(id));
+            partition_signs->push_back(parent->plus_or_minus(index, i) < 0);
         }
     }
 
-    // Resize arrays to number of cells in the new consistency equation
-    if (partition_equation->size_of_eqtn > 1) {
-        partition_equation->cell_index = new CellIndex[partition_equation->size_of_eqtn];
-        partition_equation->plus_or_minus = new int[partition_equation->size_of_eqtn];
+    if (partition_cells->size() - start > 1) {
+        return true;
+    } else {
+        partition_cells->resize(start);
+        partition_signs->resize(start);
+        return false;
+    }
+}
+
+// Cell IDs are usually close to dense, in which case a direct lookup table is used rather than a map
+// Where an ID appears more than once the last cell with that ID is used
+void JJData::build_cell_index() {
+    CellID min_id = 0;
+    CellID max_id = 0;
 
-        for (CellIndex i = 0; i < partition_equation->size_of_eqtn; i++) {
-            partition_equation->cell_index[i] = cell_id_to_index(cell_id[i]);
-            partition_equation->plus_or_minus[i] = plus_or_minus[i];
+    for (CellIndex i = 0; i < ncells; i++) {
+        if ((i == 0) || (cells[i].id < min_id)) {
+            min_id = cells[i].id;
+        }
+        if ((i == 0) || (cells[i].id > max_id)) {
+            max_id = cells[i].id;
         }
     }
 
-    delete[] cell_id;
-    delete[] plus_or_minus;
+    dense_index.clear();
+    map.clear();
 
-    if (partition_equation->size_of_eqtn > 1) {
-        return true;
+    if ((min_id >= 0) && ((long long)max_id < 4 * (long long)ncells + 1024)) {
+        dense_index.assign((size_t)max_id + 1, -1);
+        for (CellIndex i = 0; i < ncells; i++) {
+            dense_index[cells[i].id] = i;
+        }
     } else {
-        return false;
+        for (CellIndex i = 0; i < ncells; i++) {
+            map[cells[i].id] = i;
+        }
+    }
+}
+
+// Return the index of the cell with the given ID, or -1 if there is no such cell
+// Safe to call from several threads at once
+CellIndex JJData::find_cell_index(CellID id) {
+    if (! dense_index.empty()) {
+        if ((id < 0) || (id >= (CellID)dense_index.size())) {
+            return -1;
+        }
+
+        return dense_index[id];
     }
+
+    std::map<CellID, CellIndex>::const_iterator it = map.find(id);
+
+    return (it != map.end())? it->second: -1;
 }
 
 CellIndex JJData::cell_id_to_index(CellID id) {
-    CellIndex index = map[id];
+    CellIndex index = find_cell_index(id);
+
+    // Unknown IDs have always been treated as the first cell
+    if (index == -1) {
+        index = 0;
+    }
 
     if ((index < 0) || (index >= ncells)) {
         logger->error(218, "Invalid cell ID %d: %s", id, name);
@@ -503,11 +864,11 @@ CellID JJData::cell_index_to_id(CellIndex index) {
     return cells[index].id;
 }
 
-CellID JJData::find_marginal_id(ConsistencyEquation* equation) {
+CellID JJData::find_marginal_id(SumIndex equation) {
     CellIndex marginal_index_in_eqtn = -1;
 
-    for (CellIndex i = 0; i < equation->size_of_eqtn; i++) {
-        if (equation->plus_or_minus[i] < 0) {
+    for (CellIndex i = 0; i < consistency_eqtns[equation].size_of_eqtn; i++) {
+        if (plus_or_minus(equation, i) < 0) {
             marginal_index_in_eqtn = i;
             break;
         }
@@ -517,14 +878,14 @@ CellID JJData::find_marginal_id(ConsistencyEquation* equation) {
         logger->error(220, "Missing marginal in consistency equation: %s", name);
     }
 
-    return cells[equation->cell_index[marginal_index_in_eqtn]].id;
+    return cells[consistency_eqtns[equation].cell_index[marginal_index_in_eqtn]].id;
 }
 
-CellIndex JJData::find_marginal_index_in_equation(ConsistencyEquation* equation) {
+CellIndex JJData::find_marginal_index_in_equation(SumIndex equation) {
     CellIndex marginal_index_in_eqtn = -1;
 
-    for (CellIndex i = 0; i < equation->size_of_eqtn; i++) {
-        if (equation->plus_or_minus[i] < 0) {
+    for (CellIndex i = 0; i < consistency_eqtns[equation].size_of_eqtn; i++) {
+        if (plus_or_minus(equation, i) < 0) {
             marginal_index_in_eqtn = i;
             break;
         }
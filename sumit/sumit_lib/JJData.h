@@ -2,7 +2,9 @@
 
 #include "stdafx.h"
 #include <map>
+#include <vector>
 #include <limits.h>
+#include <stdint.h>
 
 #define MAXCELLINDEX = INT_MAX;
 typedef int CellIndex;
@@ -10,6 +12,10 @@ typedef int SumIndex;
 typedef int CellID;
 #define MARGINAL_EQUALITY_TOLERANCE 0.01
 
+// Binary JJ files start with this magic string followed by the format version
+#define BINARY_JJ_MAGIC "SUMITJJB"
+#define BINARY_JJ_VERSION 2
+
 class JJData {
 
 public:
@@ -27,12 +33,12 @@ public:
         int level;
     };
 
+    // The terms of each equation are held in the equation store below - cell_index points to the first of them
     struct ConsistencyEquation {
         double RHS;
         CellIndex size_of_eqtn;
         CellIndex marginal_index;
         CellIndex* cell_index;
-        int* plus_or_minus;
     };
 
     char* name;
@@ -45,6 +51,19 @@ public:
     Cell* cells;
     ConsistencyEquation* consistency_eqtns;
 
+    // Equation store - the terms of all consistency equations in compressed sparse row form
+    // The terms of equation i are equation_offsets[i] to equation_offsets[i + 1] - 1
+    // Every coefficient is 1 or -1, and a set bit in equation_signs marks a term with coefficient -1
+    int64_t* equation_offsets;
+    CellIndex* equation_cells;
+    unsigned char* equation_signs;
+
+    // Transpose of the equation store - the equations containing cell c, in ascending order, are
+    // cell_equations[cell_offsets[c]] to cell_equations[cell_offsets[c + 1] - 1]
+    int64_t* cell_offsets;
+    SumIndex* cell_equations;
+
+    // Reads either a text or a binary JJ file
     JJData(const char* filename);
 
     // Create a partitioned JJ file from a parent table and a list of cells
@@ -56,19 +75,49 @@ public:
 
     ~JJData();
     void write_jj_file(const char* outfilename);
+    void write_binary_jj_file(const char* outfilename);
+    static bool is_binary_jj_file(const char* filename);
     void reset();
     CellIndex get_number_of_cells();
     CellIndex get_number_of_primary_cells();
     void recombine(const char* filename);
     CellIndex cell_id_to_index(CellID id);
+    CellIndex find_cell_index(CellID id);
     CellID cell_index_to_id(CellIndex index);
 
+    int term_sign(int64_t term) {
+        return (equation_signs[term >> 3] & (1 << (term & 7)))? -1: 1;
+    }
+
+    int plus_or_minus(SumIndex equation, CellIndex j) {
+        return term_sign(equation_offsets[equation] + j);
+    }
+
+    // Allocate an empty equation store for nsums equations with nterms terms in total
+    // The caller fills in the offsets, cells, signs and equation totals and then calls finish_equation_store
+    void allocate_equation_store(SumIndex nsums, int64_t nterms);
+    void finish_equation_store();
+
+    // Put the consistency equations in a new order - equation i becomes the equation previously at permutation[i]
+    void reorder_equations(const SumIndex* permutation);
+
 private:
     std::map<CellID, CellIndex> map;
+    std::vector<CellIndex> dense_index;
+
+    // Memory mapped binary JJ file - the equation store points into this rather than being allocated
+    void* mapping;
+    size_t mapping_size;
+    bool equation_store_mapped;
+
+    void read_binary_jj_file(const char* filename);
+    void build_cell_index();
+    void build_cell_equations();
+    void release_equation_store();
 
     bool trace(CellID id);
-    bool generate_partition_consistency_equation(JJData* parent, SumIndex index, ConsistencyEquation* partition_equation);
-    CellID find_marginal_id(ConsistencyEquation* equation);
-    CellIndex find_marginal_index_in_equation(ConsistencyEquation* equation);
+    bool generate_partition_consistency_equation(JJData* parent, SumIndex index, std::vector<CellIndex>* partition_cells, std::vector<bool>* partition_signs, double* partition_RHS);
+    CellID find_marginal_id(SumIndex equation);
+    CellIndex find_marginal_index_in_equation(SumIndex equation);
 
 };
@@ -0,0 +1,653 @@
+#include "stdafx.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "JJTextReader.h"
+
+// Number of chunks per thread - threads take chunks as they become free so that the work is balanced
+// even though the cells and the consistency equations are read in separate passes
+#define CHUNKS_PER_THREAD 8
+
+// Powers of ten that are exactly representable as doubles
+static const double exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool is_space(char c) {
+    return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n') || (c == '\v') || (c == '\f');
+}
+
+static inline bool is_digit(char c) {
+    return (c >= '0') && (c <= '9');
+}
+
+static inline bool is_delimiter(char c) {
+    return is_space(c) || (c == '(') || (c == ')') || (c == ':');
+}
+
+JJTextReader::JJTextReader(const char* filename) {
+    this->filename = filename;
+
+    buffer = (char*)sys.map_file(filename, &size);
+    mapped = (buffer != NULL);
+
+    if (! mapped) {
+        // Empty files cannot be mapped
+        FILE *ifp;
+        if ((ifp = fopen(filename, "rb")) == NULL) {
+            logger->error(201, "File not found: %s", filename);
+        }
+
+        size = (size_t)sys.get_file_size(ifp);
+        buffer = new char[size + 1];
+        if (fread(buffer, 1, size, ifp) != size) {
+            logger->error(202, "Incorrect format at line %d: %s", 1, filename);
+        }
+
+        fclose(ifp);
+    }
+
+    position = buffer;
+    line_number = 0;
+    ncells = 0;
+    nsums = 0;
+}
+
+JJTextReader::~JJTextReader() {
+    if (mapped) {
+        sys.unmap_file(buffer, size);
+    } else {
+        delete[] buffer;
+    }
+}
+
+// Find the next line containing anything other than white space
+// Blank lines are skipped, as they were by the original fscanf reader
+bool JJTextReader::next_record(const char** p, const char* end, const char** record_end) {
+    const char* s = *p;
+
+    while (s < end) {
+        const char* e = (const char*)memchr(s, '\n', (size_t)(end - s));
+        if (e == NULL) {
+            e = end;
+        }
+
+        for (const char* c = s; c < e; c++) {
+            if (! is_space(*c)) {
+                *p = s;
+                *record_end = e;
+                return true;
+            }
+        }
+
+        s = (e < end)? e + 1: end;
+    }
+
+    *p = end;
+
+    return false;
+}
+
+// True if nothing but white space is left of the record, as the fscanf reader failed on a line with extra fields
+bool JJTextReader::at_record_end(const char* p, const char* end) {
+    while ((p < end) && is_space(*p)) {
+        p++;
+    }
+
+    return (p == end);
+}
+
+bool JJTextReader::parse_int(const char** p, const char* end, int* value) {
+    const char* s = *p;
+
+    while ((s < end) && is_space(*s)) {
+        s++;
+    }
+
+    bool negative = false;
+    if ((s < end) && ((*s == '-') || (*s == '+'))) {
+        negative = (*s == '-');
+        s++;
+    }
+
+    if ((s >= end) || (! is_digit(*s))) {
+        return false;
+    }
+
+    long long v = 0;
+    while ((s < end) && is_digit(*s)) {
+        v = v * 10 + (*s - '0');
+        if (v > (long long)INT_MAX + 1) {
+            return false;
+        }
+        s++;
+    }
+
+    v = negative? -v: v;
+    if (v > INT_MAX) {
+        return false;
+    }
+
+    *value = (int)v;
+    *p = s;
+
+    return true;
+}
+
+// Where the decimal mantissa fits exactly in a double and the power of ten is exact, a single multiplication or division gives
+// the correctly rounded result (Clinger's fast path), which is the same as strtod
+// Anything else (long mantissas, large exponents, infinities and NaNs) is passed to strtod
+bool JJTextReader::parse_double(const char** p, const char* end, double* value) {
+    const char* s = *p;
+
+    while ((s < end) && is_space(*s)) {
+        s++;
+    }
+
+    const char* q = s;
+    bool negative = false;
+    if ((q < end) && ((*q == '-') || (*q == '+'))) {
+        negative = (*q == '-');
+        q++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any_digits = false;
+    bool exact = true;
+
+    while ((q < end) && is_digit(*q)) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (uint64_t)(*q - '0');
+            if (mantissa != 0) {
+                digits++;
+            }
+        } else {
+            exponent++;
+            exact = false;
+        }
+        any_digits = true;
+        q++;
+    }
+
+    if ((q < end) && (*q == '.')) {
+        q++;
+        while ((q < end) && is_digit(*q)) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*q - '0');
+                if (mantissa != 0) {
+                    digits++;
+                }
+                exponent--;
+            } else {
+                exact = false;
+            }
+            any_digits = true;
+            q++;
+        }
+    }
+
+    if (any_digits && (q < end) && ((*q == 'e') || (*q == 'E'))) {
+        int exponent_value;
+        const char* e = q + 1;
+        if ((e < end) && (! is_space(*e)) && parse_int(&e, end, &exponent_value) && (exponent_value > -10000) && (exponent_value < 10000)) {
+            exponent += exponent_value;
+            q = e;
+        } else {
+            exact = false;
+        }
+    }
+
+    if (any_digits && exact && ((q >= end) || is_delimiter(*q)) && (mantissa <= ((uint64_t)1 << 53)) && (exponent >= -22) && (exponent <= 22)) {
+        double v = (double)mantissa;
+        if (exponent < 0) {
+            v = v / exact_powers_of_ten[-exponent];
+        } else {
+            v = v * exact_powers_of_ten[exponent];
+        }
+
+        *value = negative? -v: v;
+        *p = q;
+
+        return true;
+    }
+
+    // Slow path
+    const char* token_end = s;
+    while ((token_end < end) && (! is_delimiter(*token_end))) {
+        token_end++;
+    }
+
+    size_t length = (size_t)(token_end - s);
+    if (length == 0) {
+        return false;
+    }
+
+    char small[64];
+    char* token = (length < sizeof(small))? small: new char[length + 1];
+    memcpy(token, s, length);
+    token[length] = '\0';
+
+    char* parsed_end;
+    double v = strtod(token, &parsed_end);
+    size_t used = (size_t)(parsed_end - token);
+
+    if (token != small) {
+        delete[] token;
+    }
+
+    if (used == 0) {
+        return false;
+    }
+
+    *value = v;
+    *p = s + used;
+
+    return true;
+}
+
+bool JJTextReader::parse_char(const char** p, const char* end, char* value) {
+    const char* s = *p;
+
+    while ((s < end) && is_space(*s)) {
+        s++;
+    }
+
+    if (s >= end) {
+        return false;
+    }
+
+    *value = *s;
+    *p = s + 1;
+
+    return true;
+}
+
+CellIndex JJTextReader::read_header() {
+    const char* end = buffer + size;
+    const char* record_end = end;
+    int file_id;
+
+    // Line 1 - file type
+    line_number++;
+    if ((! next_record(&position, end, &record_end)) || (! parse_int(&position, record_end, &file_id))) {
+        logger->error(202, "Incorrect format at line %d: %s", line_number, filename);
+    }
+    position = record_end;
+
+    if (file_id != 0) {
+        logger->error(203, "Unknown file type: %s", filename);
+    }
+
+    // Line 2 - number of cells
+    line_number++;
+    if ((! next_record(&position, end, &record_end)) || (! parse_int(&position, record_end, &ncells))) {
+        logger->error(204, "Incorrect format at line %d: %s", line_number, filename);
+    }
+    position = record_end;
+
+    divide_into_chunks();
+
+    return ncells;
+}
+
+// Divide the remainder of the file into chunks of whole lines and count the records in each
+void JJTextReader::divide_into_chunks() {
+    const char* end = buffer + size;
+    size_t remaining = (size_t)(end - position);
+    int number_of_chunks = (size < PARALLEL_READ_THRESHOLD)? 1: (int)sys.number_of_processors() * CHUNKS_PER_THREAD;
+
+    const char* start = position;
+    for (int k = 0; k < number_of_chunks; k++) {
+        const char* boundary = (k == number_of_chunks - 1)? end: position + (remaining / number_of_chunks) * (k + 1);
+
+        if (boundary < start) {
+            boundary = start;
+        }
+        if (boundary < end) {
+            const char* newline = (const char*)memchr(boundary, '\n', (size_t)(end - boundary));
+            boundary = (newline == NULL)? end: newline + 1;
+        }
+
+        struct Chunk chunk;
+        chunk.start = start;
+        chunk.end = boundary;
+        chunk.first_record = 0;
+        chunk.number_of_records = 0;
+        chunks.push_back(chunk);
+
+        start = boundary;
+    }
+
+    sys.parallel_for((int)chunks.size(), [this](int k) {
+        const char* p = chunks[k].start;
+        const char* record_end;
+
+        while (next_record(&p, chunks[k].end, &record_end)) {
+            chunks[k].number_of_records++;
+            p = record_end;
+        }
+    });
+
+    long long records = 0;
+    for (size_t k = 0; k < chunks.size(); k++) {
+        chunks[k].first_record = records;
+        records += chunks[k].number_of_records;
+    }
+}
+
+// Raise the earliest error found by any thread
+void JJTextReader::report(std::vector<struct Error>& errors) {
+    struct Error* first = NULL;
+
+    for (size_t k = 0; k < errors.size(); k++) {
+        if ((errors[k].line >= 0) && ((first == NULL) || (errors[k].line < first->line))) {
+            first = &errors[k];
+        }
+    }
+
+    if (first == NULL) {
+        return;
+    }
+
+    int line = (int)first->line;
+
+    switch (first->code) {
+        case 205:
+            logger->error(205, "Incorrect format at line %d: %s", line, filename);
+            break;
+        case 209:
+            logger->error(209, "Incorrect total format at line %d: %s", line, filename);
+            break;
+        case 210:
+            logger->error(210, "Incorrect equation size format at line %d: %s", line, filename);
+            break;
+        case 211:
+            logger->error(211, "Equation size too small at line %d: %s", line, filename);
+            break;
+        case 212:
+            logger->error(212, "Incorrect divider format at line %d: %s", line, filename);
+            break;
+        case 213:
+            logger->error(213, "Incorrect consistency equation format at line %d: %s", line, filename);
+            break;
+        case 218:
+            logger->error(218, "Invalid cell ID %d: %s", first->value, filename);
+            break;
+        case 222:
+            logger->error(222, "Duplicate total in consistency equation at line %d: %s", line, filename);
+            break;
+        case 227:
+            logger->error(227, "Coefficient other than 1 or -1 in consistency equation at line %d: %s", line, filename);
+            break;
+        default:
+            logger->error(223, "Missing total in consistency equation at line %d: %s", line, filename);
+            break;
+    }
+}
+
+// Records are numbered from zero after the header - cells come first, then the number of equations, then the equations
+// Record r is therefore on line r + 3
+void JJTextReader::read_cell_chunk(const struct Chunk* chunk, JJData::Cell* cells, struct Error* error) {
+    const char* p = chunk->start;
+    const char* record_end;
+    long long r = chunk->first_record;
+
+    while ((r < ncells) && next_record(&p, chunk->end, &record_end)) {
+        JJData::Cell* cell = &cells[r];
+
+        if (! (parse_int(&p, record_end, &cell->id) &&
+               parse_double(&p, record_end, &cell->nominal_value) &&
+               parse_double(&p, record_end, &cell->loss_of_information_weight) &&
+               parse_char(&p, record_end, &cell->status) &&
+               parse_double(&p, record_end, &cell->lower_bound) &&
+               parse_double(&p, record_end, &cell->upper_bound) &&
+               parse_double(&p, record_end, &cell->lower_protection_level) &&
+               parse_double(&p, record_end, &cell->upper_protection_level) &&
+               parse_double(&p, record_end, &cell->sliding_protection_level))) {
+            error->line = r + 3;
+            error->code = 205;
+            return;
+        }
+
+        // The fscanf reader took an extra field as the start of the next line, and failed there
+        if (! at_record_end(p, record_end)) {
+            error->line = r + 4;
+            error->code = 205;
+            return;
+        }
+
+        p = record_end;
+        r++;
+    }
+}
+
+void JJTextReader::read_cells(JJData::Cell* cells, CellIndex ncells) {
+    this->ncells = ncells;
+
+    std::vector<struct Error> errors(chunks.size());
+    for (size_t k = 0; k < chunks.size(); k++) {
+        errors[k].line = -1;
+    }
+
+    sys.parallel_for((int)chunks.size(), [this, cells, &errors](int k) {
+        if (chunks[k].first_record < this->ncells) {
+            read_cell_chunk(&chunks[k], cells, &errors[k]);
+        }
+    });
+
+    report(errors);
+
+    long long records = chunks.empty()? 0: chunks.back().first_record + chunks.back().number_of_records;
+    if (records < ncells) {
+        logger->error(205, "Incorrect format at line %d: %s", (int)(records + 3), filename);
+    }
+}
+
+SumIndex JJTextReader::read_number_of_equations() {
+    int line = ncells + 3;
+
+    for (size_t k = 0; k < chunks.size(); k++) {
+        if ((chunks[k].first_record <= ncells) && (ncells < chunks[k].first_record + chunks[k].number_of_records)) {
+            const char* p = chunks[k].start;
+            const char* record_end;
+            long long r = chunks[k].first_record;
+
+            while (next_record(&p, chunks[k].end, &record_end)) {
+                if (r == ncells) {
+                    if (! parse_int(&p, record_end, &nsums)) {
+                        break;
+                    }
+
+                    return nsums;
+                }
+
+                p = record_end;
+                r++;
+            }
+        }
+    }
+
+    logger->error(208, "Incorrect format at line %d: %s", line, filename);
+
+    return 0;
+}
+
+void JJTextReader::read_equation_chunk(const struct Chunk* chunk, JJData* jjData, struct Equations* equations, struct Error* error) {
+    const char* p = chunk->start;
+    const char* record_end;
+    long long r = chunk->first_record;
+    long long last = (long long)ncells + nsums;
+
+    while ((r <= last) && next_record(&p, chunk->end, &record_end)) {
+        if (r > ncells) {
+            double RHS;
+            CellIndex size;
+            CellIndex marginal_index = -1;
+            CellIndex marginal_term = -1;
+            char divider;
+
+            error->line = r + 3;
+
+            if (! parse_double(&p, record_end, &RHS)) {
+                error->code = 209;
+                return;
+            }
+
+            if (! parse_int(&p, record_end, &size)) {
+                error->code = 210;
+                return;
+            }
+
+            if (size < 2) {
+                error->code = 211;
+                return;
+            }
+
+            if ((! parse_char(&p, record_end, &divider)) || (divider != ':')) {
+                error->code = 212;
+                return;
+            }
+
+            for (CellIndex j = 0; j < size; j++) {
+                CellID id;
+                int plus_or_minus;
+                char open;
+                char close;
+
+                if (! (parse_int(&p, record_end, &id) &&
+                       parse_char(&p, record_end, &open) && (open == '(') &&
+                       parse_int(&p, record_end, &plus_or_minus) &&
+                       parse_char(&p, record_end, &close) && (close == ')'))) {
+                    error->code = 213;
+                    return;
+                }
+
+                // The equation store only holds the sign of each coefficient
+                if ((plus_or_minus != 1) && (plus_or_minus != -1)) {
+                    error->code = 227;
+                    return;
+                }
+
+                // As JJData::cell_id_to_index
+                CellIndex index = jjData->find_cell_index(id);
+                if (index == -1) {
+                    index = 0;
+                }
+                if (index >= ncells) {
+                    error->code = 218;
+                    error->value = id;
+                    return;
+                }
+                equations->cells.push_back(index);
+
+                if (plus_or_minus < 0) {
+                    if (marginal_index == -1) {
+                        marginal_index = index;
+                        marginal_term = j;
+                    } else {
+                        error->code = 222;
+                        return;
+                    }
+                }
+            }
+
+            if (marginal_index == -1) {
+                error->code = 223;
+                return;
+            }
+
+            // More terms than the equation size, which the fscanf reader took as the start of the next line, and failed there
+            if (! at_record_end(p, record_end)) {
+                error->line = r + 4;
+                error->code = 210;
+                return;
+            }
+
+            equations->RHS.push_back(RHS);
+            equations->size_of_eqtn.push_back(size);
+            equations->marginal_index.push_back(marginal_index);
+            equations->marginal_term.push_back(marginal_term);
+
+            error->line = -1;
+        }
+
+        p = record_end;
+        r++;
+    }
+}
+
+void JJTextReader::read_equations(JJData* jjData, SumIndex nsums) {
+    this->nsums = nsums;
+
+    std::vector<struct Error> errors(chunks.size());
+    std::vector<struct Equations> equations(chunks.size());
+    for (size_t k = 0; k < chunks.size(); k++) {
+        errors[k].line = -1;
+    }
+
+    sys.parallel_for((int)chunks.size(), [this, jjData, &equations, &errors](int k) {
+        long long first = chunks[k].first_record;
+        long long last = first + chunks[k].number_of_records - 1;
+
+        if ((last > ncells) && (first <= (long long)ncells + this->nsums)) {
+            read_equation_chunk(&chunks[k], jjData, &equations[k], &errors[k]);
+        }
+    });
+
+    report(errors);
+
+    long long records = chunks.empty()? 0: chunks.back().first_record + chunks.back().number_of_records;
+    if (records < (long long)ncells + 1 + nsums) {
+        logger->error(209, "Incorrect total format at line %d: %s", (int)(records + 3), filename);
+    }
+
+    // Size the equation store and work out where each chunk's equations go
+    std::vector<SumIndex> first_equation(chunks.size());
+    std::vector<int64_t> first_term(chunks.size());
+    SumIndex i = 0;
+    int64_t nterms = 0;
+
+    for (size_t k = 0; k < chunks.size(); k++) {
+        first_equation[k] = i;
+        first_term[k] = nterms;
+        i += (SumIndex)equations[k].RHS.size();
+        nterms += (int64_t)equations[k].cells.size();
+    }
+
+    jjData->allocate_equation_store(nsums, nterms);
+
+    sys.parallel_for((int)chunks.size(), [jjData, &equations, &first_equation, &first_term](int k) {
+        struct Equations* chunk_equations = &equations[k];
+        int64_t term = first_term[k];
+
+        for (size_t e = 0; e < chunk_equations->RHS.size(); e++) {
+            SumIndex i = first_equation[k] + (SumIndex)e;
+
+            jjData->consistency_eqtns[i].RHS = chunk_equations->RHS[e];
+            jjData->consistency_eqtns[i].marginal_index = chunk_equations->marginal_index[e];
+            term += chunk_equations->size_of_eqtn[e];
+            jjData->equation_offsets[i + 1] = term;
+        }
+
+        if (! chunk_equations->cells.empty()) {
+            memcpy(jjData->equation_cells + first_term[k], chunk_equations->cells.data(), chunk_equations->cells.size() * sizeof(CellIndex));
+        }
+    });
+
+    // Sign bits are shared between neighbouring equations, so are set here rather than by the chunks
+    for (size_t k = 0; k < chunks.size(); k++) {
+        for (size_t e = 0; e < equations[k].RHS.size(); e++) {
+            SumIndex i = first_equation[k] + (SumIndex)e;
+            int64_t term = jjData->equation_offsets[i] + equations[k].marginal_term[e];
+
+            jjData->equation_signs[term >> 3] |= (unsigned char)(1 << (term & 7));
+        }
+    }
+}
+
+int JJTextReader::get_first_equation_line() {
+    return ncells + 4;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "stdafx.h"
+#include <vector>
+#include "JJData.h"
+
+// Files smaller than this are read on a single thread
+#define PARALLEL_READ_THRESHOLD (1024 * 1024)
+
+// Reads a text JJ file
+// The whole file is mapped into memory and divided into chunks of whole lines, which are parsed on separate threads
+// Numbers are converted by hand, falling back to strtod where the fast conversion might not be correctly rounded
+// Errors are reported with the same codes and line numbers as the original fscanf reader, which counted records rather than physical lines
+// Where more than one error is found the earliest in the file is reported
+class JJTextReader {
+
+public:
+    JJTextReader(const char* filename);
+    ~JJTextReader();
+
+    // Read the file type and number of cells
+    CellIndex read_header();
+    void read_cells(JJData::Cell* cells, CellIndex ncells);
+    SumIndex read_number_of_equations();
+
+    // Cell IDs are converted to indices using the cells already read into jjData
+    // The equations are placed in the equation store of jjData, which the caller then finishes
+    void read_equations(JJData* jjData, SumIndex nsums);
+
+    // Line number of the first consistency equation, for diagnostics
+    int get_first_equation_line();
+
+private:
+    struct Chunk {
+        const char* start;
+        const char* end;
+        long long first_record;
+        long long number_of_records;
+    };
+
+    struct Error {
+        long long line;
+        int code;
+        int value;
+    };
+
+    // The equations read from one chunk, until the equation store can be sized
+    struct Equations {
+        std::vector<double> RHS;
+        std::vector<CellIndex> marginal_index;
+        std::vector<CellIndex> size_of_eqtn;
+        std::vector<CellIndex> marginal_term;
+        std::vector<CellIndex> cells;
+    };
+
+    const char* filename;
+    char* buffer;
+    size_t size;
+    bool mapped;
+
+    // Lines 1 and 2 are read first and the remainder of the file is divided into chunks
+    const char* position;
+    int line_number;
+    std::vector<struct Chunk> chunks;
+    CellIndex ncells;
+    SumIndex nsums;
+
+    void divide_into_chunks();
+    void report(std::vector<struct Error>& errors);
+    void read_cell_chunk(const struct Chunk* chunk, JJData::Cell* cells, struct Error* error);
+    void read_equation_chunk(const struct Chunk* chunk, JJData* jjData, struct Equations* equations, struct Error* error);
+
+    static bool next_record(const char** p, const char* end, const char** record_end);
+    static bool at_record_end(const char* p, const char* end);
+    static bool parse_int(const char** p, const char* end, int* value);
+    static bool parse_double(const char** p, const char* end, double* value);
+    static bool parse_char(const char** p, const char* end, char* value);
+
+};
@@ -0,0 +1,120 @@
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include "JJTextWriter.h"
+
+JJTextWriter::JJTextWriter(const char* filename) {
+    this->filename = filename;
+
+    if ((ofp = fopen(filename, "w")) == NULL) {
+        logger->error(216, "Unable to create file: %s", filename);
+    }
+}
+
+JJTextWriter::~JJTextWriter() {
+    fclose(ofp);
+}
+
+void JJTextWriter::write_block(const char* buffer, size_t length) {
+    if (fwrite(buffer, 1, length, ofp) != length) {
+        logger->error(216, "Unable to write file: %s", filename);
+    }
+}
+
+void JJTextWriter::append_int(std::string* out, int value) {
+    char digits[16];
+    int n = 0;
+    unsigned int v = (value < 0)? 0u - (unsigned int)value: (unsigned int)value;
+
+    do {
+        digits[n++] = (char)('0' + (v % 10));
+        v /= 10;
+    } while (v != 0);
+
+    if (value < 0) {
+        out->push_back('-');
+    }
+
+    while (n > 0) {
+        out->push_back(digits[--n]);
+    }
+}
+
+// Floating point values are still formatted by snprintf, as %f must be reproduced exactly
+void JJTextWriter::format_cells(JJData* jjData, CellIndex first, CellIndex last, std::string* out) {
+    char line[4096];
+
+    for (CellIndex i = first; i < last; i++) {
+        JJData::Cell* cell = &jjData->cells[i];
+        int length = snprintf(line, sizeof(line), "%d %f %f %c %f %f %f %f %f\n", cell->id, cell->nominal_value, cell->loss_of_information_weight, cell->status, cell->lower_bound, cell->upper_bound, cell->lower_protection_level, cell->upper_protection_level, cell->sliding_protection_level);
+        out->append(line, (size_t)length);
+    }
+}
+
+void JJTextWriter::format_equations(JJData* jjData, SumIndex first, SumIndex last, std::string* out) {
+    for (SumIndex i = first; i < last; i++) {
+        JJData::ConsistencyEquation* eqtn = &jjData->consistency_eqtns[i];
+
+        out->append("0 ");
+        append_int(out, eqtn->size_of_eqtn);
+        out->append(" :");
+
+        for (CellIndex j = 0; j < eqtn->size_of_eqtn; j++) {
+            out->push_back(' ');
+            append_int(out, jjData->cell_index_to_id(eqtn->cell_index[j]));
+            out->append(" (");
+            append_int(out, jjData->plus_or_minus(i, j));
+            out->push_back(')');
+        }
+
+        out->push_back('\n');
+    }
+}
+
+void JJTextWriter::write(JJData* jjData) {
+    int blocks_per_round = (int)sys.number_of_processors() * 4;
+    std::vector<std::string> blocks(blocks_per_round);
+    char line[64];
+
+    int length = snprintf(line, sizeof(line), "0\n%d \n", jjData->ncells);
+    write_block(line, (size_t)length);
+
+    // Cells
+    for (CellIndex first = 0; first < jjData->ncells; first += (CellIndex)blocks_per_round * WRITE_BLOCK_SIZE) {
+        // Small files are formatted on the calling thread
+        int number_of_blocks = (int)MIN((long long)blocks_per_round, ((long long)jjData->ncells - first + WRITE_BLOCK_SIZE - 1) / WRITE_BLOCK_SIZE);
+
+        sys.parallel_for(number_of_blocks, [jjData, first, &blocks](int k) {
+            CellIndex start = first + k * WRITE_BLOCK_SIZE;
+            CellIndex end = MIN(start + WRITE_BLOCK_SIZE, jjData->ncells);
+
+            blocks[k].clear();
+            format_cells(jjData, start, end, &blocks[k]);
+        });
+
+        for (int k = 0; k < number_of_blocks; k++) {
+            write_block(blocks[k].data(), blocks[k].size());
+        }
+    }
+
+    length = snprintf(line, sizeof(line), "%d\n", jjData->nsums);
+    write_block(line, (size_t)length);
+
+    // Consistency equations
+    for (SumIndex first = 0; first < jjData->nsums; first += (SumIndex)blocks_per_round * WRITE_BLOCK_SIZE) {
+        // Small files are formatted on the calling thread
+        int number_of_blocks = (int)MIN((long long)blocks_per_round, ((long long)jjData->nsums - first + WRITE_BLOCK_SIZE - 1) / WRITE_BLOCK_SIZE);
+
+        sys.parallel_for(number_of_blocks, [jjData, first, &blocks](int k) {
+            SumIndex start = first + k * WRITE_BLOCK_SIZE;
+            SumIndex end = MIN(start + WRITE_BLOCK_SIZE, jjData->nsums);
+
+            blocks[k].clear();
+            format_equations(jjData, start, end, &blocks[k]);
+        });
+
+        for (int k = 0; k < number_of_blocks; k++) {
+            write_block(blocks[k].data(), blocks[k].size());
+        }
+    }
+}
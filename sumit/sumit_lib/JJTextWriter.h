@@ -0,0 +1,28 @@
+#pragma once
+
+#include "stdafx.h"
+#include <string>
+#include "JJData.h"
+
+// Number of cells or consistency equations formatted as one piece of work
+#define WRITE_BLOCK_SIZE 16384
+
+// Writes a text JJ file with exactly the same content as the original fprintf writer
+// Blocks of cells and equations are formatted in memory on separate threads and written in order with one fwrite per block
+class JJTextWriter {
+
+public:
+    JJTextWriter(const char* filename);
+    ~JJTextWriter();
+    void write(JJData* jjData);
+
+private:
+    const char* filename;
+    FILE *ofp;
+
+    void write_block(const char* buffer, size_t length);
+    static void format_cells(JJData* jjData, CellIndex first, CellIndex last, std::string* out);
+    static void format_equations(JJData* jjData, SumIndex first, SumIndex last, std::string* out);
+    static void append_int(std::string* out, int value);
+
+};
@@ -0,0 +1,79 @@
+#include "stdafx.h"
+#include <string.h>
+#include "ModelRegistry.h"
+#include "Hash.h"
+
+ModelRegistry::ModelRegistry() {
+}
+
+ModelRegistry::~ModelRegistry() {
+}
+
+bool ModelRegistry::lookup(const char *filename, char *hash) {
+    time_t modified;
+    long size;
+
+    if (! sys.get_file_stamp(filename, &modified, &size)) {
+        hash_file(filename, hash);
+    } else {
+        bool known = false;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            std::map<std::string, struct FileStamp>::iterator it = files.find(filename);
+            if ((it != files.end()) && (it->second.modified == modified) && (it->second.size == size)) {
+                strcpy(hash, it->second.hash);
+                known = true;
+            }
+        }
+
+        // Hashed without holding the lock, as it reads the whole file
+        if (! known) {
+            struct FileStamp stamp;
+            stamp.modified = modified;
+            stamp.size = size;
+            hash_file(filename, stamp.hash);
+            strcpy(hash, stamp.hash);
+
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if ((int)files.size() >= MAX_REGISTERED_MODELS) {
+                files.clear();
+            }
+            files[filename] = stamp;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return (held.count(hash) > 0);
+}
+
+void ModelRegistry::confirm(const char *hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if ((int)held.size() >= MAX_REGISTERED_MODELS) {
+        held.clear();
+    }
+    held.insert(hash);
+}
+
+void ModelRegistry::forget(const char *hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    held.erase(hash);
+}
+
+// The model is hashed where it is mapped into memory rather than copied
+void ModelRegistry::hash_file(const char *filename, char *hash) {
+    size_t size;
+    void *content = sys.map_file(filename, &size);
+    if (content == NULL) {
+        logger->error(1, "Unable to read model file: %s", filename);
+    }
+
+    struct Fingerprint fingerprint = murmur_hash3_x64_128(content, size, 0);
+    fingerprint_to_hex(&fingerprint, hash);
+
+    sys.unmap_file(content, size);
+}
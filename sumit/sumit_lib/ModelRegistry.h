@@ -0,0 +1,41 @@
+#pragma once
+
+#include "stdafx.h"
+#include <map>
+#include <set>
+#include <string>
+#include <mutex>
+
+// Most files whose fingerprints are remembered, and most models known to be held by the server, before each is forgotten
+#define MAX_REGISTERED_MODELS 4096
+
+// The models a client has sent to one server, shared by all of the client's solvers on that server
+// Each JJ file is only hashed again if its modification time or size changes, and a model the server is known to hold is not checked again
+class ModelRegistry {
+
+public:
+    ModelRegistry();
+    ~ModelRegistry();
+
+    // Write the fingerprint of the file as 32 hexadecimal digits - hash must have room for 33 characters
+    // Returns true if the server is known to hold the model
+    bool lookup(const char *filename, char *hash);
+
+    // The server has confirmed that it holds the model, or has replied that it does not
+    void confirm(const char *hash);
+    void forget(const char *hash);
+
+private:
+    struct FileStamp {
+        time_t modified;
+        long size;
+        char hash[33];
+    };
+
+    std::map<std::string, struct FileStamp> files;
+    std::set<std::string> held;
+    std::mutex mutex;
+
+    void hash_file(const char *filename, char *hash);
+
+};
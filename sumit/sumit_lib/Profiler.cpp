@@ -0,0 +1,154 @@
+#include "stdafx.h"
+#include "Profiler.h"
+
+thread_local Profiler::Stage *Profiler::current = NULL;
+
+Profiler::Profiler() {
+    active = false;
+    start_time = 0.0;
+
+    top.parent = NULL;
+    top.count = 0;
+    top.total_seconds = 0.0;
+    top.max_seconds = 0.0;
+    top.peak_resident_memory = 0;
+}
+
+Profiler::~Profiler() {
+    for (size_t i = 0; i < top.children.size(); i++) {
+        delete_stages(top.children[i]);
+    }
+}
+
+void Profiler::delete_stages(Stage *stage) {
+    for (size_t i = 0; i < stage->children.size(); i++) {
+        delete_stages(stage->children[i]);
+    }
+
+    delete stage;
+}
+
+// Must be called before any other threads are started
+void Profiler::enable() {
+    active = true;
+    start_time = sys.wall_time();
+}
+
+bool Profiler::enabled() {
+    return active;
+}
+
+// Starts the named stage inside the innermost stage running on this thread
+Profiler::Stage* Profiler::enter(const char *name) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Stage *parent = (current != NULL)? current: &top;
+    Stage *stage = NULL;
+
+    for (size_t i = 0; i < parent->children.size(); i++) {
+        if (parent->children[i]->name == name) {
+            stage = parent->children[i];
+            break;
+        }
+    }
+
+    if (stage == NULL) {
+        stage = new Stage;
+        stage->name = name;
+        stage->parent = parent;
+        stage->count = 0;
+        stage->total_seconds = 0.0;
+        stage->max_seconds = 0.0;
+        stage->peak_resident_memory = 0;
+        parent->children.push_back(stage);
+    }
+
+    current = stage;
+
+    return stage;
+}
+
+void Profiler::leave(Stage *stage, double seconds) {
+    long long memory = sys.peak_resident_memory();
+    std::lock_guard<std::mutex> lock(mutex);
+
+    stage->count++;
+    stage->total_seconds += seconds;
+    stage->max_seconds = MAX(stage->max_seconds, seconds);
+    stage->peak_resident_memory = MAX(stage->peak_resident_memory, memory);
+
+    current = (stage->parent != &top)? stage->parent: NULL;
+}
+
+void Profiler::write_json_file(const char *filename) {
+    FILE *ofp;
+
+    if ((ofp = fopen(filename, "w")) == NULL) {
+        logger->error(1, "Unable to create profile file: %s", filename);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    fprintf(ofp, "{\n");
+    fprintf(ofp, "  \"version\": \"%s\",\n", VERSION);
+    fprintf(ofp, "  \"wall_seconds\": %.6f,\n", active? sys.wall_time() - start_time: 0.0);
+    fprintf(ofp, "  \"peak_resident_memory\": %lld,\n", sys.peak_resident_memory());
+    fprintf(ofp, "  \"stages\": [");
+    for (size_t i = 0; i < top.children.size(); i++) {
+        fprintf(ofp, (i == 0)? "\n": ",\n");
+        write_stage(ofp, top.children[i], 2);
+    }
+    fprintf(ofp, "%s]\n}\n", top.children.empty()? "": "\n  ");
+
+    fclose(ofp);
+}
+
+// Self time is the part of the total not spent in the nested stages
+void Profiler::write_stage(FILE *ofp, Stage *stage, int depth) {
+    double nested_seconds = 0.0;
+    for (size_t i = 0; i < stage->children.size(); i++) {
+        nested_seconds += stage->children[i]->total_seconds;
+    }
+
+    int indent = depth * 2;
+
+    fprintf(ofp, "%*s{\n", indent, "");
+    fprintf(ofp, "%*s\"name\": \"", indent + 2, "");
+    for (size_t c = 0; c < stage->name.size(); c++) {
+        if ((stage->name[c] == '"') || (stage->name[c] == '\\')) {
+            fputc('\\', ofp);
+        }
+        fputc(stage->name[c], ofp);
+    }
+    fprintf(ofp, "\",\n");
+    fprintf(ofp, "%*s\"count\": %ld,\n", indent + 2, "", stage->count);
+    fprintf(ofp, "%*s\"total_seconds\": %.6f,\n", indent + 2, "", stage->total_seconds);
+    fprintf(ofp, "%*s\"self_seconds\": %.6f,\n", indent + 2, "", MAX(stage->total_seconds - nested_seconds, 0.0));
+    fprintf(ofp, "%*s\"max_seconds\": %.6f,\n", indent + 2, "", stage->max_seconds);
+    fprintf(ofp, "%*s\"peak_resident_memory\": %lld,\n", indent + 2, "", stage->peak_resident_memory);
+    fprintf(ofp, "%*s\"stages\": [", indent + 2, "");
+    for (size_t i = 0; i < stage->children.size(); i++) {
+        fprintf(ofp, (i == 0)? "\n": ",\n");
+        write_stage(ofp, stage->children[i], depth + 2);
+    }
+    if (!stage->children.empty()) {
+        fprintf(ofp, "\n%*s", indent + 2, "");
+    }
+    fprintf(ofp, "]\n%*s}", indent, "");
+}
+
+ScopedTimer::ScopedTimer(const char *name) {
+    if (profiler.enabled()) {
+        stage = profiler.enter(name);
+        start = sys.wall_time();
+    } else {
+        stage = NULL;
+        start = 0.0;
+    }
+}
+
+ScopedTimer::~ScopedTimer() {
+    if (stage != NULL) {
+        profiler.leave(stage, sys.wall_time() - start);
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdio.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Hierarchical timing of the stages of a run, written as JSON on request
+// Each stage records how often it was entered, its total and longest wall time, and the peak resident memory of the process by the time it
+// finished. Stages entered while another is running on the same thread are nested inside it, and stages started on other threads are
+// nested in the top level
+// Nothing is recorded until the profiler is enabled, so timers may be left in place at little cost
+class Profiler {
+
+public:
+    struct Stage {
+        std::string name;
+        Stage *parent;
+        std::vector<Stage*> children;
+        long count;
+        double total_seconds;
+        double max_seconds;
+        long long peak_resident_memory;
+    };
+
+    Profiler();
+    ~Profiler();
+    void enable();
+    bool enabled();
+    Stage* enter(const char *name);
+    void leave(Stage *stage, double seconds);
+    void write_json_file(const char *filename);
+
+private:
+    std::mutex mutex;
+    bool active;
+    double start_time;
+    Stage top;
+
+    // The innermost running stage of each thread, or NULL for the top level
+    static thread_local Stage *current;
+
+    void delete_stages(Stage *stage);
+    void write_stage(FILE *ofp, Stage *stage, int depth);
+
+};
+
+// Times the enclosing scope as a stage of the global profiler
+class ScopedTimer {
+
+public:
+    ScopedTimer(const char *name);
+    ~ScopedTimer();
+
+private:
+    Profiler::Stage *stage;
+    double start;
+
+};
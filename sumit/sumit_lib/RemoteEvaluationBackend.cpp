@@ -0,0 +1,451 @@
+#include "stdafx.h"
+#include <string.h>
+#include "RemoteEvaluationBackend.h"
+
+RemoteEvaluationJob::RemoteEvaluationJob(EvaluationBackend *backend, Solver *solver, double upload_time, int batch_size) {
+    this->backend = backend;
+    this->solver = solver;
+    this->batch_size = batch_size;
+
+    add_transfer_time(upload_time);
+
+    // The server starts the solver as soon as the permutation file has been transferred
+    set_started_time(sys.wall_time());
+
+    status = -1;
+    result = 0.0;
+    elapsed_time = 0;
+    stopping = false;
+
+    costs_content = NULL;
+    telemetry_content = NULL;
+
+    watcher = std::thread(&RemoteEvaluationJob::watch, this);
+}
+
+RemoteEvaluationJob::~RemoteEvaluationJob() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    // Waits for at most one outstanding wait request
+    watcher.join();
+
+    // Closes the remote session
+    delete solver;
+
+    delete[] costs_content;
+    delete[] telemetry_content;
+
+    for (size_t i = 0; i < jj_files.size(); i++) {
+        sys.remove_file(jj_files[i].c_str());
+    }
+}
+
+// Runs on the watcher thread
+void RemoteEvaluationJob::watch() {
+    for (;;) {
+        int s;
+        double r = 0.0;
+        int t = 0;
+
+        try {
+            s = solver->waitStatus(SERVER_WAIT_TIMEOUT);
+
+            if (s >= 0) {
+                set_completed_time(sys.wall_time());
+            }
+
+            // A single permutation's result is known to the server once it has completed, and is wanted by every caller
+            if ((s == 0) && (batch_size == 0)) {
+                solver->getSummary(&r, &t);
+            }
+
+            if ((s == 0) && backend->has_parent()) {
+                if (batch_size > 0) {
+                    t = solver->getElapsedTime();
+                }
+                prefetch();
+            }
+        } catch (int e) {
+            // Only a server of a farm stops responding without the client exiting, and the farm runs the job again elsewhere
+            logger->log(2, "Solver %s lost (error %d)", getName(), e);
+            s = JOB_LOST;
+            solver->abandon();
+            set_completed_time(sys.wall_time());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            status = s;
+            result = r;
+            elapsed_time = t;
+
+            if (stopping) {
+                return;
+            }
+        }
+
+        if ((s >= 0) || (s == JOB_LOST)) {
+            backend->notify_completion();
+            return;
+        }
+    }
+}
+
+const char *RemoteEvaluationJob::getName() {
+    return solver->getSession();
+}
+
+// No server request is needed as the watcher thread keeps the status up to date
+int RemoteEvaluationJob::getStatus() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return status;
+}
+
+double RemoteEvaluationJob::getResult() {
+    if (batch_size > 0) {
+        return getBatchResult(0);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return result;
+}
+
+int RemoteEvaluationJob::getElapsedTime() {
+    if ((batch_size > 0) && (costs_content == NULL)) {
+        try {
+            return solver->getElapsedTime();
+        } catch (int e) {
+            results_lost(e);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return elapsed_time;
+}
+
+int RemoteEvaluationJob::getCosts(double *costs, int size) {
+    if (batch_size > 0) {
+        return getBatchCosts(0, costs, size);
+    }
+
+    char *content = costs_content;
+    if (content == NULL) {
+        int length;
+
+        double start = sys.wall_time();
+        try {
+            content = solver->getCosts(&length);
+        } catch (int e) {
+            results_lost(e);
+        }
+        add_transfer_time(sys.wall_time() - start);
+    }
+
+    // The costs are parsed where they were received, one to a line
+    const char *p = content;
+    int line_number = 0;
+
+    for (int i = 0; i < size; i++) {
+        char *end;
+        costs[i] = strtod(p, &end);
+        if (end == p) {
+            break;
+        }
+        p = end;
+        line_number++;
+    }
+
+    if (content != costs_content) {
+        delete[] content;
+    }
+
+    return line_number;
+}
+
+void RemoteEvaluationJob::getJJFile(const char *filename) {
+    if (batch_size > 0) {
+        getBatchJJFile(0, filename);
+        return;
+    }
+
+    if (! jj_files.empty()) {
+        sys.copy_file(filename, jj_files[0].c_str());
+        return;
+    }
+
+    double start = sys.wall_time();
+    try {
+        solver->getJJFile(filename);
+    } catch (int e) {
+        results_lost(e);
+    }
+    add_transfer_time(sys.wall_time() - start);
+}
+
+bool RemoteEvaluationJob::getTelemetry(SolverTelemetry *telemetry) {
+    char *content = telemetry_content;
+    if (content == NULL) {
+        int length;
+
+        double start = sys.wall_time();
+        try {
+            content = solver->getTelemetry(&length);
+        } catch (int e) {
+            results_lost(e);
+        }
+        add_transfer_time(sys.wall_time() - start);
+    }
+
+    bool found = telemetry->read_string(content);
+
+    if (content != telemetry_content) {
+        delete[] content;
+    }
+
+    return found;
+}
+
+// The result of a permutation is its final cost, as the server only reports the result of the last permutation of a batch
+double RemoteEvaluationJob::getBatchResult(int index) {
+    get_batch_costs();
+
+    if (batch_costs[index].empty()) {
+        logger->error(1, "No costs for permutation %d of batch %s", index, getName());
+    }
+
+    return batch_costs[index].back();
+}
+
+int RemoteEvaluationJob::getBatchCosts(int index, double *costs, int size) {
+    get_batch_costs();
+
+    int number_of_costs = MIN(size, (int)batch_costs[index].size());
+    for (int i = 0; i < number_of_costs; i++) {
+        costs[i] = batch_costs[index][i];
+    }
+
+    return number_of_costs;
+}
+
+void RemoteEvaluationJob::getBatchJJFile(int index, const char *filename) {
+    if (! jj_files.empty()) {
+        sys.copy_file(filename, jj_files[index].c_str());
+        return;
+    }
+
+    double start = sys.wall_time();
+    try {
+        solver->getJJFile(filename, index);
+    } catch (int e) {
+        results_lost(e);
+    }
+    add_transfer_time(sys.wall_time() - start);
+}
+
+// The cost file of a batch holds, for each permutation in turn, the number of costs followed by the costs, one to a line
+void RemoteEvaluationJob::get_batch_costs() {
+    if (! batch_costs.empty()) {
+        return;
+    }
+
+    char *content = costs_content;
+    if (content == NULL) {
+        int length;
+
+        double start = sys.wall_time();
+        try {
+            content = solver->getCosts(&length);
+        } catch (int e) {
+            results_lost(e);
+        }
+        add_transfer_time(sys.wall_time() - start);
+    }
+
+    const char *p = content;
+    char *end;
+
+    batch_costs.resize(batch_size);
+
+    for (int k = 0; k < batch_size; k++) {
+        int number_of_costs = (int)strtol(p, &end, 10);
+        if (end == p) {
+            logger->error(1, "Missing costs for permutation %d of batch %s", k, getName());
+        }
+        p = end;
+
+        batch_costs[k].resize(number_of_costs);
+        for (int i = 0; i < number_of_costs; i++) {
+            batch_costs[k][i] = strtod(p, &end);
+            if (end == p) {
+                logger->error(1, "Invalid cost %d for permutation %d of batch %s", i, k, getName());
+            }
+            p = end;
+        }
+    }
+
+    if (content != costs_content) {
+        delete[] content;
+    }
+}
+
+// Runs on the watcher thread once the solver of a farm job has completed, and throws if the server stops responding
+// Every result is downloaded, as the job cannot be reported lost once it has been reported complete
+void RemoteEvaluationJob::prefetch() {
+    int length;
+
+    double start = sys.wall_time();
+
+    costs_content = solver->getCosts(&length);
+    telemetry_content = solver->getTelemetry(&length);
+
+    int count = (batch_size > 0) ? batch_size : 1;
+    for (int k = 0; k < count; k++) {
+        char temp[MAX_FILENAME_SIZE];
+        sys.make_tempfile(temp, MAX_FILENAME_SIZE);
+        jj_files.push_back(temp);
+
+        if (batch_size > 0) {
+            solver->getJJFile(temp, k);
+        } else {
+            solver->getJJFile(temp);
+        }
+    }
+
+    add_transfer_time(sys.wall_time() - start);
+}
+
+// Results can only be fetched from the server that ran the solver, so there is nothing to fall back on once it has completed
+// A farm job has already downloaded its results, so this only ends a run on a single server
+void RemoteEvaluationJob::results_lost(int error) {
+    logger->error(1, "Server stopped responding while the results of solver %s were collected (error %d)", getName(), error);
+}
+
+RemoteEvaluationBackend::RemoteEvaluationBackend(const char *host, const char *port) {
+    strcpy(this->host, host);
+    strcpy(this->port, port);
+    sprintf(name, "%s:%s", host, port);
+
+    limit = 0;
+    cores = 0;
+
+    Solver *solver = NULL;
+
+    try {
+        solver = new Solver(host, port, &models);
+
+        // Check that the version of the server protocol is understood by the client
+        if (solver->getProtocol() != SERVER_PROTOCOL) {
+            // Terminate the remote solver before exiting
+            delete solver;
+
+            logger->error(1, "Unsupported version of client server protocol");
+        }
+
+        limit = solver->getLimit();
+        cores = solver->getCores();
+
+        delete solver;
+    } catch (int e) {
+        // A server of a farm that cannot be reached is left out by the farm
+        if (e == SERVER_EXCEPTION) {
+            delete solver;
+            throw e;
+        }
+
+        // Session not available
+        // For now, just give up.  This situation should not occur with only one single-threaded client trying to access the server
+        // If more than one client thread is required to access the server, then the situation will need handling properly (waiting)
+        logger->error(1, "No available server sessions");
+    }
+
+    logger->log(3, "Server %s session limit %d, %d cores", name, limit, cores);
+}
+
+RemoteEvaluationBackend::~RemoteEvaluationBackend() {
+}
+
+const char *RemoteEvaluationBackend::getName() {
+    return name;
+}
+
+int RemoteEvaluationBackend::getLimit() {
+    return limit;
+}
+
+int RemoteEvaluationBackend::getCores() {
+    return cores;
+}
+
+EvaluationJob *RemoteEvaluationBackend::runProtection(const char *injjfilename, const CellIndex *perm, int size, int protection_type, int model_type, double max_cost) {
+    // Throws SESSION_EXCEPTION if no session is available
+    Solver *solver = new Solver(host, port, &models);
+    logger->log(5, "Solver %s created", solver->getSession());
+
+    // The permutation is sent from memory
+    std::string content;
+    format_perm(&content, perm, size);
+
+    double start = sys.wall_time();
+    try {
+        solver->runProtection(injjfilename, content.data(), (int)content.size(), protection_type, model_type, max_cost);
+    } catch (int e) {
+        delete solver;
+        throw e;
+    }
+    double upload_time = sys.wall_time() - start;
+
+    return new RemoteEvaluationJob(this, solver, upload_time, 0);
+}
+
+// One solver runs every permutation of the batch, so the model is sent and set up once
+int RemoteEvaluationBackend::runBatch(const char *injjfilename, const CellIndex *const *perms, const double *max_costs, int count, int size, int protection_type, int model_type, EvaluationJob **jobs) {
+    // Throws SESSION_EXCEPTION if no session is available
+    Solver *solver = new Solver(host, port, &models);
+    logger->log(5, "Solver %s created for a batch of %d", solver->getSession(), count);
+
+    // The batch is sent from memory
+    std::string content;
+    format_batch(&content, perms, max_costs, count, size);
+
+    double start = sys.wall_time();
+    try {
+        solver->runBatch(injjfilename, content.data(), (int)content.size(), count, protection_type, model_type);
+    } catch (int e) {
+        delete solver;
+        throw e;
+    }
+    double upload_time = sys.wall_time() - start;
+
+    std::shared_ptr<EvaluationBatchJob> batch(new RemoteEvaluationJob(this, solver, upload_time, count));
+
+    for (int i = 0; i < count; i++) {
+        jobs[i] = new BatchMemberJob(batch, i);
+    }
+
+    return count;
+}
+
+// The content of a permutation file
+void RemoteEvaluationBackend::format_perm(std::string* out, const CellIndex* perm, int size) {
+    char line[32];
+
+    for (int i = 0; i < size; i++) {
+        int length = sprintf(line, "%d\n", perm[i]);
+        out->append(line, length);
+    }
+}
+
+// The content of a batch file
+void RemoteEvaluationBackend::format_batch(std::string* out, const CellIndex* const* perms, const double* max_costs, int count, int size) {
+    char line[512];
+
+    for (int k = 0; k < count; k++) {
+        int length = snprintf(line, sizeof(line), "%lf\n", max_costs[k]);
+        out->append(line, length);
+
+        format_perm(out, perms[k], size);
+    }
+}
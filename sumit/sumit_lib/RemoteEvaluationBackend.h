@@ -0,0 +1,92 @@
+#pragma once
+
+#include "stdafx.h"
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <string>
+#include "EvaluationBackend.h"
+#include "Solver.h"
+
+#define SERVER_PROTOCOL 9
+
+// Longest time in milliseconds that the server holds a wait request open
+#define SERVER_WAIT_TIMEOUT 1000
+
+// Each job has a thread that long-polls the server and notifies the backend when the solver finishes
+// A job started by runBatch holds the results of all of its permutations
+// In a farm the watcher downloads the results as soon as the solver has completed, so that a server that stops responding before
+// they are collected loses the job rather than ending the run
+class RemoteEvaluationJob: public EvaluationBatchJob {
+
+public:
+    RemoteEvaluationJob(EvaluationBackend *backend, Solver *solver, double upload_time, int batch_size);
+    ~RemoteEvaluationJob();
+    const char *getName();
+    int getStatus();
+    double getResult();
+    int getElapsedTime();
+    int getCosts(double *costs, int size);
+    void getJJFile(const char *filename);
+    bool getTelemetry(SolverTelemetry *telemetry);
+    double getBatchResult(int index);
+    int getBatchCosts(int index, double *costs, int size);
+    void getBatchJJFile(int index, const char *filename);
+
+private:
+    EvaluationBackend *backend;
+    Solver *solver;
+
+    // Zero for a single permutation, whose cost file is not divided into permutations
+    int batch_size;
+
+    // The costs of each permutation of a batch, downloaded when first needed
+    std::vector<std::vector<double> > batch_costs;
+
+    // Downloaded by the watcher thread before the job is reported complete, or NULL and empty outside a farm
+    char *costs_content;
+    char *telemetry_content;
+    std::vector<std::string> jj_files;     // Temporary copies of the JJ file of each permutation
+
+    // Guarded by the mutex
+    int status;
+    double result;          // Fetched by the watcher thread once the solver has completed
+    int elapsed_time;
+    bool stopping;
+
+    std::mutex mutex;
+    std::thread watcher;
+
+    void watch();
+    void prefetch();
+    void get_batch_costs();
+    void results_lost(int error);
+
+};
+
+// Runs solvers on a cell suppression server
+class RemoteEvaluationBackend: public EvaluationBackend {
+
+public:
+    RemoteEvaluationBackend(const char *host, const char *port);
+    ~RemoteEvaluationBackend();
+    const char *getName();
+    int getLimit();
+    int getCores();
+    EvaluationJob *runProtection(const char *injjfilename, const CellIndex *perm, int size, int protection_type, int model_type, double max_cost);
+    int runBatch(const char *injjfilename, const CellIndex *const *perms, const double *max_costs, int count, int size, int protection_type, int model_type, EvaluationJob **jobs);
+
+private:
+    char host[MAX_HOST_NAME_SIZE];
+    char port[MAX_PORT_NUMBER_SIZE];
+    char name[MAX_HOST_NAME_SIZE + MAX_PORT_NUMBER_SIZE];
+    int limit;
+    int cores;
+
+    // Shared by the backend's solvers, so that each model is only hashed and checked once
+    ModelRegistry models;
+
+    void format_perm(std::string* out, const CellIndex* perm, int size);
+    void format_batch(std::string* out, const CellIndex* const* perms, const double* max_costs, int count, int size);
+
+};
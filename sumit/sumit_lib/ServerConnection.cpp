@@ -1,32 +1,157 @@
 #include "stdafx.h"
 #include <errno.h>
 #include <string.h>
+#include <stdarg.h>
 #include "ServerConnection.h"
+#include "ConnectionPool.h"
+#include "EvaluationBackend.h"
 
 #define MAX_LINE_LENGTH 8192
 
+// Shared by all of the process's connections
+static ConnectionPool connection_pool;
+
 ServerConnection::ServerConnection(const char *host, const char *port) {
-    sock = sys.open_socket(host, port);
+    this->host = host;
+    this->port = port;
+
+    sock = connection_pool.acquire(host, port, &reused, &failover);
+    if (sock == -1) {
+        logger->log(3, "Unable to connect to %s:%s", host, port);
+        throw SERVER_EXCEPTION;
+    }
+    reusable = true;
+
+    receive_buffer = new char[RECEIVE_BUFFER_SIZE];
+    receive_start = 0;
+    receive_end = 0;
 }
 
 ServerConnection::~ServerConnection() {
+    delete[] receive_buffer;
+
+    // Anything left unread would be taken as the start of the next reply
+    if (reusable && (receive_start == receive_end)) {
+        connection_pool.release(host, port, sock);
+    } else if (sock != -1) {
+        sys.close_socket(sock);
+    }
+}
+
+void ServerConnection::set_failover(const char *host, const char *port) {
+    connection_pool.set_failover(host, port);
+}
+
+// The server cannot be reached or has stopped responding
+void ServerConnection::fail(const char *fmt, ...) {
+    char message[256];
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+
+    if (! failover) {
+        logger->error(1, "%s", message);
+    }
+
+    logger->log(3, "%s", message);
+    reusable = false;
+
+    throw SERVER_EXCEPTION;
+}
+
+// Replace a pooled connection that the server closed while it was idle
+void ServerConnection::reconnect() {
+    if (! reused) {
+        fail("Connection to %s:%s closed by server", host, port);
+    }
+
+    logger->log(5, "Reconnecting to %s:%s", host, port);
+
+    replace_connection();
+}
+
+void ServerConnection::replace_connection() {
     sys.close_socket(sock);
+    sock = connection_pool.acquire(host, port, &reused, &failover);
+    if (sock == -1) {
+        fail("Unable to connect to %s:%s", host, port);
+    }
+    reusable = true;
+
+    receive_start = 0;
+    receive_end = 0;
 }
 
-void ServerConnection::write(const char *buffer, int length) {
-    do {
+bool ServerConnection::write(const char *buffer, int length) {
+    while (length > 0) {
         int bytes_written = sys.write_socket(sock, buffer, length);
         if (bytes_written == -1) {
-            logger->error(1, "Error %d writing to socket", errno);
+            logger->log(5, "Error %d writing to socket", errno);
+            reusable = false;
+
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                fail("No progress sending to %s:%s for %d s", host, port, FAILOVER_RESPONSE_TIMEOUT);
+            }
+
+            return false;
         }
 
         buffer += bytes_written;
         length -= bytes_written;
-    } while (length);
+    }
+
+    return true;
+}
+
+// Send the request line and header in one write
+bool ServerConnection::write_request(const char *method, const char *resource, const char *query, long content_length) {
+    char request[MAX_LINE_LENGTH];
+
+    int length = snprintf(request, sizeof(request), "%s /%s%s%s HTTP/1.1\r\nHost: %s\r\nUser-Agent: UWECellSuppression\r\nContent-length: %ld\r\n\r\n",
+        method, resource, (query != NULL) ? "?" : "", (query != NULL) ? query : "", host, content_length);
+    if ((length < 0) || (length >= (int)sizeof(request))) {
+        logger->error(1, "Request too long: %s", resource);
+    }
+
+    return write(request, length);
 }
 
-void ServerConnection::write(const char *string) {
-    write(string, (int)strlen(string));
+// Send a request with its content, which is taken from fp or content if either is not NULL, and read the reply header
+// A request that fails on a pooled connection is sent again on another one
+// Returns the length of the reply content
+int ServerConnection::send_request(const char *method, const char *resource, const char *query, FILE *fp, const char *content, long content_length, int *status) {
+    for (;;) {
+        int reply_length;
+        bool sent = write_request(method, resource, query, content_length);
+
+        if (sent && (fp != NULL)) {
+            sent = sys.send_file(sock, fp, content_length);
+            if (! sent) {
+                reusable = false;
+            }
+        } else if (sent && (content != NULL)) {
+            sent = write(content, (int)content_length);
+        }
+
+        if (sent && read_reply_header(status, &reply_length)) {
+            return reply_length;
+        }
+
+        reconnect();
+    }
+}
+
+void ServerConnection::check_put_reply(int status, int reply_length) {
+    if (status != 201) {
+        logger->error(1, "Server returned status %d", status);
+    }
+
+    // The server sends no content, and anything else would be read as the start of the next reply
+    if (reply_length != 0) {
+        reusable = false;
+    }
 }
 
 void ServerConnection::put_file(const char* name, const char *filename, const char *query) {
@@ -35,55 +160,78 @@ void ServerConnection::put_file(const char* name, const char *filename, const ch
         logger->error(1, "Error %d reading content: %s", errno, filename);
     }
 
-    int content_length = sys.get_file_size(fp);
+    long content_length = sys.get_file_size(fp);
 
-    // Send request
-    char request[128];
-    sprintf(request, "PUT /%s?", name);
-    write(request);
-    write(query);
-    sprintf(request, " HTTP/1.1\r\nUser-Agent: UWECellSuppression\r\nContent-length: %d\r\n\r\n", content_length);
-    write(request);
+    int status;
+    int reply_length;
 
-    // Send content
-    char buffer[1500];
+    try {
+        reply_length = send_request("PUT", name, query, fp, NULL, content_length, &status);
+    } catch (int e) {
+        fclose(fp);
+        throw e;
+    }
 
-    int bytes_remaining = content_length;
-    int bytes_to_transfer;
+    fclose(fp);
 
-    do {
-        if (bytes_remaining > (int)sizeof(buffer)) {
-            bytes_to_transfer = sizeof(buffer);
-        } else {
-            bytes_to_transfer = bytes_remaining;
-        }
+    check_put_reply(status, reply_length);
+}
+
+// Send content held in memory, so that it need not be written to a file first
+void ServerConnection::put_content(const char* name, const char *content, int content_length, const char *query) {
+    int status;
+    int reply_length = send_request("PUT", name, query, NULL, content, content_length, &status);
+
+    check_put_reply(status, reply_length);
+}
+
+// As put_content, but return false rather than failing if the server replies that something named in the query is not found
+bool ServerConnection::try_put_content(const char* name, const char *content, int content_length, const char *query) {
+    int status;
+    int reply_length = send_request("PUT", name, query, NULL, content, content_length, &status);
 
-        int bytes_read = (int)fread(buffer, 1, bytes_to_transfer, fp);
-        if (bytes_read != bytes_to_transfer) {
-            logger->error(1, "Error %d reading content: %s", errno, filename);
+    if (status == 404) {
+        if (reply_length != 0) {
+            reusable = false;
         }
+        return false;
+    }
 
-        write(buffer, bytes_read);
+    check_put_reply(status, reply_length);
 
-        bytes_remaining -= bytes_read;
-    } while (bytes_remaining);
+    return true;
+}
 
-    fclose(fp);
+// Refill the empty receive buffer, returning false if the connection has been closed
+bool ServerConnection::receive() {
+    int bytes = sys.read_socket(sock, receive_buffer, RECEIVE_BUFFER_SIZE);
+    if (bytes <= 0) {
+        reusable = false;
+
+        // A server with failover that has stopped responding is not tried again on another connection
+        if ((bytes < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+            fail("No reply from %s:%s for %d s", host, port, FAILOVER_RESPONSE_TIMEOUT);
+        }
+
+        return false;
+    }
 
-    // Get reply header
-    get_reply_header(201);
+    receive_start = 0;
+    receive_end = bytes;
+
+    return true;
 }
 
+// Returns the length of the line, or -1 if the connection has been closed
 int ServerConnection::read_line(char *line) {
     int length = 0;
     bool done = false;
     do {
-        char c;
-        int rc = sys.read_socket(sock, &c, sizeof(c));
-        if (rc < 0) {
-            logger->error(1, "Error %d reading from socket", errno);
-            done = true;
-        } else if (rc > 0) {
+        if ((receive_start == receive_end) && (! receive())) {
+            *line = '\0';
+            return -1;
+        } else {
+            char c = receive_buffer[receive_start++];
             switch (c) {
                 case '\r':
                     // Ignore
@@ -109,48 +257,69 @@ int ServerConnection::read_line(char *line) {
     return length;
 }
 
-int ServerConnection::get_reply_header(int expected_status) {
-    // Read HTTP reply header
-    int status = 0;
-    int content_length = 0;
-    bool done = false;
+void ServerConnection::read_content(char *buffer, int length) {
+    while (length > 0) {
+        if ((receive_start == receive_end) && (! receive())) {
+            fail("Error %d reading content from %s:%s", errno, host, port);
+        }
+
+        int bytes = MIN(length, receive_end - receive_start);
+        memcpy(buffer, &receive_buffer[receive_start], bytes);
+        receive_start += bytes;
+
+        buffer += bytes;
+        length -= bytes;
+    }
+}
+
+// Read the HTTP reply header, whatever its status
+// Returns false if the connection was closed before the reply started
+bool ServerConnection::read_reply_header(int *status, int *content_length) {
     char line[MAX_LINE_LENGTH];
-    do {
-        read_line(line);
-        if (sscanf(line, "HTTP/1.1  %d", &status) == 1) {
-            if (status != expected_status) {
-                logger->error(1, "Server returned status %d", status);
-            }
-        } else if (sscanf(line, "Content-length: %d", &content_length) == 1) {
-            // Consume remainder of reply header (to blank line)
-            do {
-                int length = read_line(line);
-                if (length == 0) {
-                    done = true;
-                }
-            } while (! done);
+
+    *status = 0;
+    *content_length = 0;
+
+    if (read_line(line) < 0) {
+        return false;
+    }
+
+    if (sscanf(line, "HTTP/1.1 %d", status) != 1) {
+        logger->error(1, "Invalid reply from server: %s", line);
+    }
+
+    // Remainder of reply header (to blank line)
+    for (;;) {
+        int length = read_line(line);
+        if (length < 0) {
+            fail("Connection to %s:%s closed during reply", host, port);
+        }
+        if (length == 0) {
+            break;
         }
-    } while (! done);
 
-    return content_length;
+        if (sscanf(line, "Content-length: %d", content_length) == 1) {
+            // Read
+        } else if (strcmp(line, "Connection: close") == 0) {
+            reusable = false;
+        }
+    }
+
+    return true;
 }
 
 int ServerConnection::get(const char *resource, char *reply_buffer, int reply_buffer_length) {
-    // Send request
-    char request[128];
-    sprintf(request, "GET /%s HTTP/1.1\r\n", resource);
-    write(request);
+    int status;
+    int content_length = send_request("GET", resource, NULL, NULL, NULL, 0, &status);
 
-    // Get reply header
-    int content_length = get_reply_header(200);
+    if (status != 200) {
+        logger->error(1, "Server returned status %d", status);
+    }
 
     // Get reply content
     if (content_length < reply_buffer_length) {
-        int bytes = sys.read_socket(sock, reply_buffer, content_length);
-        if (bytes != content_length) {
-            logger->error(1, "Error %d reading content from server", errno);
-        }
-        reply_buffer[bytes] = '\0';
+        read_content(reply_buffer, content_length);
+        reply_buffer[content_length] = '\0';
     } else {
         logger->error(1, "Content length %d is too long", content_length);
         reply_buffer[0] = '\0';
@@ -159,40 +328,88 @@ int ServerConnection::get(const char *resource, char *reply_buffer, int reply_bu
     return content_length;
 }
 
+// Send all of the requests before reading any of the replies, so that together they take a single round trip
+// The server replies in the order of the requests, and any requests left when it closes the connection are sent again on another one
+void ServerConnection::get_pipelined(const char *const *resources, int count, char *const *reply_buffers, int reply_buffer_length) {
+    int next = 0;
+
+    while (next < count) {
+        bool sent = true;
+        for (int i = next; (i < count) && sent; i++) {
+            sent = write_request("GET", resources[i], NULL, 0);
+        }
+
+        int status;
+        int content_length;
+
+        if (! (sent && read_reply_header(&status, &content_length))) {
+            reconnect();
+            continue;
+        }
+
+        for (;;) {
+            if (status != 200) {
+                logger->error(1, "Server returned status %d", status);
+            }
+
+            if (content_length >= reply_buffer_length) {
+                logger->error(1, "Content length %d is too long", content_length);
+            }
+
+            read_content(reply_buffers[next], content_length);
+            reply_buffers[next][content_length] = '\0';
+            next++;
+
+            if (next == count) {
+                break;
+            }
+
+            if (! reusable) {
+                replace_connection();
+                break;
+            }
+
+            if (! read_reply_header(&status, &content_length)) {
+                fail("Connection to %s:%s closed during reply", host, port);
+            }
+        }
+    }
+}
+
+// The content is written to the file straight from the receive buffer
 int ServerConnection::get_file(const char *filename, const char *resource) {
-    // Send request
-    char request[128];
-    sprintf(request, "GET /%s HTTP/1.1\r\n", resource);
-    write(request);
+    int status;
+    int content_length = send_request("GET", resource, NULL, NULL, NULL, 0, &status);
 
-    // Get reply header
-    int content_length = get_reply_header(200);
+    if (status != 200) {
+        logger->error(1, "Server returned status %d", status);
+    }
 
     // Get reply content
     FILE *fp = fopen(filename, "w");
 
-    char buffer[1500];
-
     int bytes_remaining = content_length;
-    int bytes_to_transfer;
 
-    do {
-        if (bytes_remaining > (int)sizeof(buffer)) {
-            bytes_to_transfer = sizeof(buffer);
-        } else {
-            bytes_to_transfer = bytes_remaining;
+    while (bytes_remaining) {
+        if ((receive_start == receive_end) && (! receive())) {
+            if (fp != NULL) {
+                fclose(fp);
+            }
+            fail("Error %d reading content from %s:%s", errno, host, port);
         }
 
-        int bytes_read = sys.read_socket(sock, buffer, bytes_to_transfer);
+        int bytes_read = MIN(bytes_remaining, receive_end - receive_start);
+
         if (fp != NULL) {
-            int bytes_written = (int)fwrite(buffer, 1, bytes_read, fp);
+            int bytes_written = (int)fwrite(&receive_buffer[receive_start], 1, bytes_read, fp);
             if (bytes_written != bytes_read) {
                 logger->error(1, "Unable to write content: %s", resource);
             }
         }
 
+        receive_start += bytes_read;
         bytes_remaining -= bytes_read;
-    } while (bytes_remaining);
+    }
 
     if (fp != NULL) {
         fclose(fp);
@@ -200,3 +417,33 @@ int ServerConnection::get_file(const char *filename, const char *resource) {
 
     return content_length;
 }
+
+// Receive content into memory, so that it need not be read from a file
+// Returns a null-terminated buffer, which the caller must delete
+char *ServerConnection::get_content(const char *resource, int *content_length) {
+    int status;
+    *content_length = send_request("GET", resource, NULL, NULL, NULL, 0, &status);
+
+    if (status != 200) {
+        logger->error(1, "Server returned status %d", status);
+    }
+
+    char *content = new char[*content_length + 1];
+    read_content(content, *content_length);
+    content[*content_length] = '\0';
+
+    return content;
+}
+
+// Return the status of a resource without transferring it, such as 200 if it exists or 404 if not
+int ServerConnection::head(const char *resource) {
+    int status;
+    int content_length = send_request("HEAD", resource, NULL, NULL, NULL, 0, &status);
+
+    // There is no content
+    if (content_length != 0) {
+        reusable = false;
+    }
+
+    return status;
+}
@@ -2,21 +2,51 @@
 
 #include "stdafx.h"
 
+// Size of the buffer that replies are received into, which holds the headers of several replies or a large block of content
+#define RECEIVE_BUFFER_SIZE 65536
+
+// Requests to a cell suppression server, on a keep-alive connection taken from the connection pool
+// The connection is returned to the pool when the ServerConnection is deleted, unless a reply was not read in full
+// Content may be sent from and received into either files or memory
+// Failing to reach a server is an error, unless the server has failover, when SERVER_EXCEPTION is thrown instead
 class ServerConnection {
 
 public:
     ServerConnection(const char *host, const char *port);
     ~ServerConnection();
+    static void set_failover(const char *host, const char *port);
     void put_file(const char* name, const char *filename, const char *session);
+    void put_content(const char* name, const char *content, int content_length, const char *query);
+    bool try_put_content(const char* name, const char *content, int content_length, const char *query);
     int get(const char *request, char *reply_buffer, int reply_buffer_length);
+    void get_pipelined(const char *const *resources, int count, char *const *reply_buffers, int reply_buffer_length);
     int get_file(const char *filename, const char *session);
+    char *get_content(const char *resource, int *content_length);
+    int head(const char *resource);
 
 private:
+    const char *host;
+    const char *port;
     SOCKET sock;
+    bool reused;
+    bool reusable;
+    bool failover;
+
+    // Received data not yet read runs from receive_start to receive_end
+    char *receive_buffer;
+    int receive_start;
+    int receive_end;
 
-    void write(const char *buffer, int length);
-    void write(const char *string);
+    void fail(const char *fmt, ...);
+    void reconnect();
+    void replace_connection();
+    bool write(const char *buffer, int length);
+    bool write_request(const char *method, const char *resource, const char *query, long content_length);
+    int send_request(const char *method, const char *resource, const char *query, FILE *fp, const char *content, long content_length, int *status);
+    void check_put_reply(int status, int reply_length);
+    bool receive();
     int read_line(char *line);
-    int get_reply_header(int expectedStatus);
+    void read_content(char *buffer, int length);
+    bool read_reply_header(int *status, int *content_length);
 
 };
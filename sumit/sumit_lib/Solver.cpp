@@ -4,13 +4,14 @@
 #include "Solver.h"
 #include "ServerConnection.h"
 
-Solver::Solver(const char *host, const char *port) {
+Solver::Solver(const char *host, const char *port, ModelRegistry *models) {
     this->host = host;
     this->port = port;
+    this->models = models;
+    abandoned = false;
 
-    ServerConnection *server = new ServerConnection(host, port);
-    server->get("session", session, sizeof(session));
-    delete server;
+    ServerConnection server(host, port);
+    server.get("session", session, sizeof(session));
 
     if ((session[0] == '0') && (session[1] == '\0')) {
         // No session available
@@ -22,81 +23,141 @@ Solver::~Solver() {
     char request[128];
     char reply[128];
 
-    ServerConnection *server = new ServerConnection(host, port);
-    sprintf(request, "close?session=%s", session);
-    server->get(request, reply, sizeof(reply));
-    delete server;
+    if (abandoned) {
+        return;
+    }
+
+    try {
+        ServerConnection server(host, port);
+        sprintf(request, "close?session=%s", session);
+        server.get(request, reply, sizeof(reply));
+    } catch (int e) {
+        // Keep the compiler from complaining
+        e = 0;
+
+        // A server that has stopped responding is left to remove the orphaned session itself
+        logger->log(3, "Session %s not closed", session);
+    }
 }
 
 char *Solver::getSession() {
     return session;
 }
 
+// Give up on a session whose server has stopped responding, so that it is not waited on again to close it
+void Solver::abandon() {
+    abandoned = true;
+}
+
+
+// Make sure that the server's model store holds the input JJ file
+// Models are stored under the fingerprint of their content, so each one only crosses the network once however many solvers use it
+// The server also stores each output JJ file it sends, so the output of a YPLUS run is already held when it is the model of the YMINUS run
+// The registry remembers each file's fingerprint and the models the server has confirmed, so that neither is worked out again
+void Solver::put_model(const char *injjfilename) {
+    char request[128];
 
-void Solver::run_model(const char *injjfilename, const char *perm_filename, const char *protection_type, const char *model_type, double max_cost) {
-    char query[8192] = {'\0'};
+    if (models->lookup(injjfilename, model_hash)) {
+        return;
+    }
 
-    // Transfer input JJ file to server
-    ServerConnection *server = new ServerConnection(host, port);
+    ServerConnection server(host, port);
+    sprintf(request, "model?hash=%s", model_hash);
+    int status = server.head(request);
 
-    strcat(query, "session=");
-    strcat(query, session);
+    if (status != 200) {
+        logger->log(5, "Sending model %s: %s", model_hash, injjfilename);
 
-    server->put_file("file", injjfilename, query);
+        sprintf(request, "hash=%s", model_hash);
+        server.put_file("model", injjfilename, request);
+    }
 
-    delete server;
+    models->confirm(model_hash);
+}
 
-    // Transfer permutation file to server and run model
-    server = new ServerConnection(host, port);
+// Send a permutation or batch file to start the solver, returning false if the server no longer holds the model
+bool Solver::start_run(const char *resource, const char *content, int content_length, const char *query) {
+    ServerConnection server(host, port);
+    return server.try_put_content(resource, content, content_length, query);
+}
 
-    sprintf(query, "session=%s&protection=%s&model=%s&maxcost=%lf", session, protection_type, model_type, max_cost);
+// The server may have evicted the model since it was confirmed, when it is sent again
+void Solver::run(const char *injjfilename, const char *resource, const char *content, int content_length, const char *query) {
+    if (! start_run(resource, content, content_length, query)) {
+        logger->log(3, "Model %s not held by server %s:%s, sending it again", model_hash, host, port);
 
-    server->put_file("perm", perm_filename, query);
+        models->forget(model_hash);
+        put_model(injjfilename);
 
-    delete server;
+        if (! start_run(resource, content, content_length, query)) {
+            logger->error(1, "Server returned status 404");
+        }
+    }
 }
 
+// Start the solver on a permutation, which is sent from memory as the genes one to a line
 // The remote solver interprets a max_cost of zero to mean unlimited cost (and hence no early termination)
-void Solver::runProtection(const char *injjfilename, const char *perm_filename, int protection_type, int model_type, double max_cost) {
-    char *protection = NULL;
-    char *model = NULL;
+void Solver::runProtection(const char *injjfilename, const char *perm, int perm_length, int protection_type, int model_type, double max_cost) {
+    char query[8192];
+
+    put_model(injjfilename);
 
+    // Transfer permutation to server and run model
+    sprintf(query, "session=%s&jj=%s&protection=%s&model=%s&maxcost=%lf", session, model_hash, protection_name(protection_type), model_name(model_type), max_cost);
+
+    run(injjfilename, "perm", perm, perm_length, query);
+}
+
+// Run count permutations of the same JJ file in one solver
+// The batch holds, for each permutation in turn, its max_cost followed by its genes, one to a line
+void Solver::runBatch(const char *injjfilename, const char *batch, int batch_length, int count, int protection_type, int model_type) {
+    char query[8192];
+
+    put_model(injjfilename);
+
+    // Transfer batch to server and run model
+    sprintf(query, "session=%s&jj=%s&protection=%s&model=%s&count=%d", session, model_hash, protection_name(protection_type), model_name(model_type), count);
+
+    run(injjfilename, "batch", batch, batch_length, query);
+}
+
+const char *Solver::protection_name(int protection_type) {
     switch (protection_type) {
         case INDIVIDUAL_PROTECTION:
-            protection = (char *)"individual";
-            break;
+            return "individual";
         case GROUP_PROTECTION:
-            protection = (char *)"group";
-            break;
+            return "group";
         default:
             logger->error(1, "Unknown protection type");
     }
 
+    // Keep the compiler from complaining
+    return NULL;
+}
+
+const char *Solver::model_name(int model_type) {
     switch (model_type) {
 //        case FULL_MODEL:
-//            model = (char *)"full";
-//            break;
+//            return "full";
         case YPLUS_MODEL:
-            model = (char *)"yplus";
-            break;
+            return "yplus";
         case YMINUS_MODEL:
-            model = (char *)"yminus";
-            break;
+            return "yminus";
         default:
             logger->error(1, "Unknown model type");
     }
 
-    run_model(injjfilename, perm_filename, protection, model, max_cost);
+    // Keep the compiler from complaining
+    return NULL;
 }
 
 int Solver::getLimit() {
     char request[128];
     char reply[128];
 
-    ServerConnection *server = new ServerConnection(host, port);
+    ServerConnection server(host, port);
     sprintf(request, "limit");
-    server->get(request, reply, sizeof(reply));
-    delete server;
+    server.get(request, reply, sizeof(reply));
 
     int limit = 0;
     if (sscanf(reply, "%d", &limit) != 1) {
@@ -110,10 +171,9 @@ int Solver::getCores() {
     char request[128];
     char reply[128];
 
-    ServerConnection *server = new ServerConnection(host, port);
+    ServerConnection server(host, port);
     sprintf(request, "cores");
-    server->get(request, reply, sizeof(reply));
-    delete server;
+    server.get(request, reply, sizeof(reply));
 
     int cores = 0;
     if (sscanf(reply, "%d", &cores) != 1) {
@@ -127,10 +187,9 @@ int Solver::getProtocol() {
     char request[128];
     char reply[128];
 
-    ServerConnection *server = new ServerConnection(host, port);
+    ServerConnection server(host, port);
     sprintf(request, "protocol");
-    server->get(request, reply, sizeof(reply));
-    delete server;
+    server.get(request, reply, sizeof(reply));
 
     int protocol = 0;
     if (sscanf(reply, "%d", &protocol) != 1) {
@@ -144,10 +203,9 @@ int Solver::getStatus() {
     char request[128];
     char reply[128];
 
-    ServerConnection *server = new ServerConnection(host, port);
+    ServerConnection server(host, port);
     sprintf(request, "status?session=%s", session);
-    server->get(request, reply, sizeof(reply));
-    delete server;
+    server.get(request, reply, sizeof(reply));
 
     int status;
     if (sscanf(reply, "%d", &status) != 1) {
@@ -157,14 +215,30 @@ int Solver::getStatus() {
     return status;
 }
 
+// Long-poll for the status - the server replies as soon as the solver finishes or after timeout milliseconds
+int Solver::waitStatus(int timeout) {
+    char request[128];
+    char reply[128];
+
+    ServerConnection server(host, port);
+    sprintf(request, "wait?session=%s&timeout=%d", session, timeout);
+    server.get(request, reply, sizeof(reply));
+
+    int status;
+    if (sscanf(reply, "%d", &status) != 1) {
+        logger->error(1, "Invalid wait response from server (\"%s\")", reply);
+    }
+
+    return status;
+}
+
 double Solver::getResult() {
     char request[128];
     char reply[128];
 
-    ServerConnection *server = new ServerConnection(host, port);
+    ServerConnection server(host, port);
     sprintf(request, "result?session=%s", session);
-    server->get(request, reply, sizeof(reply));
-    delete server;
+    server.get(request, reply, sizeof(reply));
 
     double result;
     if (sscanf(reply, "%lf", &result) != 1) {
@@ -178,10 +252,9 @@ int Solver::getElapsedTime() {
     char request[128];
     char reply[128];
 
-    ServerConnection *server = new ServerConnection(host, port);
+    ServerConnection server(host, port);
     sprintf(request, "time?session=%s", session);
-    server->get(request, reply, sizeof(reply));
-    delete server;
+    server.get(request, reply, sizeof(reply));
 
     int elapsedTime;
     if (sscanf(reply, "%d", &elapsedTime) != 1) {
@@ -191,20 +264,66 @@ int Solver::getElapsedTime() {
     return elapsedTime;
 }
 
-void Solver::getCostFile(const char* filename) {
+// The result and elapsed time of a finished solver, requested together so that they take one round trip
+void Solver::getSummary(double *result, int *elapsedTime) {
+    char result_request[128];
+    char time_request[128];
+    char result_reply[128];
+    char time_reply[128];
+
+    sprintf(result_request, "result?session=%s", session);
+    sprintf(time_request, "time?session=%s", session);
+
+    const char *requests[2] = { result_request, time_request };
+    char *replies[2] = { result_reply, time_reply };
+
+    ServerConnection server(host, port);
+    server.get_pipelined(requests, 2, replies, sizeof(result_reply));
+
+    if (sscanf(result_reply, "%lf", result) != 1) {
+        logger->error(1, "Invalid result response from server (\"%s\")", result_reply);
+    }
+
+    if (sscanf(time_reply, "%d", elapsedTime) != 1) {
+        logger->error(1, "Invalid time response from server (\"%s\")", time_reply);
+    }
+}
+
+// The content of the cost file, which the caller must delete
+char *Solver::getCosts(int *length) {
     char request[128];
 
-    ServerConnection *server = new ServerConnection(host, port);
+    ServerConnection server(host, port);
     sprintf(request, "costs?session=%s", session);
-    server->get_file(filename, request);
-    delete server;
+    char *costs = server.get_content(request, length);
+
+    return costs;
 }
 
 void Solver::getJJFile(const char* filename) {
     char request[128];
 
-    ServerConnection *server = new ServerConnection(host, port);
+    ServerConnection server(host, port);
     sprintf(request, "file?session=%s", session);
-    server->get_file(filename, request);
-    delete server;
+    server.get_file(filename, request);
+}
+
+// The JJ file of one permutation of a batch
+void Solver::getJJFile(const char* filename, int index) {
+    char request[128];
+
+    ServerConnection server(host, port);
+    sprintf(request, "file?session=%s&index=%d", session, index);
+    server.get_file(filename, request);
+}
+
+// The content of the telemetry file, which the caller must delete
+char *Solver::getTelemetry(int *length) {
+    char request[128];
+
+    ServerConnection server(host, port);
+    sprintf(request, "telemetry?session=%s", session);
+    char *telemetry = server.get_content(request, length);
+
+    return telemetry;
 }
@@ -3,6 +3,8 @@
 #include "stdafx.h"
 #include "ServerConnection.h"
 #include "JJData.h"
+#include "EvaluationBackend.h"
+#include "ModelRegistry.h"
 
 #define INDIVIDUAL_PROTECTION 0
 #define GROUP_PROTECTION 1
@@ -13,30 +15,43 @@
 #define YPLUS_MODEL	1
 #define YMINUS_MODEL	2
 
-#define SESSION_EXCEPTION 111
-
 class Solver {
 
 public:
     const char *host;
     const char *port;
 
-    Solver(const char *host, const char *port);
+    Solver(const char *host, const char *port, ModelRegistry *models);
     ~Solver();
     char *getSession();
-    void runProtection(const char *injjfilename, const char *perm_filename, int protection_type, int model_type, double max_cost);
+    void abandon();
+    void runProtection(const char *injjfilename, const char *perm, int perm_length, int protection_type, int model_type, double max_cost);
+    void runBatch(const char *injjfilename, const char *batch, int batch_length, int count, int protection_type, int model_type);
     int getCores();
     int getLimit();
     int getProtocol();
     int getStatus();
+    int waitStatus(int timeout);
     double getResult();
     int getElapsedTime();
-    void getCostFile(const char* filename);
+    void getSummary(double *result, int *elapsedTime);
+    char *getCosts(int *length);
     void getJJFile(const char* filename);
+    void getJJFile(const char* filename, int index);
+    char *getTelemetry(int *length);
 
 private:
     char session[64];
+    bool abandoned;
+    ModelRegistry *models;
+
+    // Fingerprint of the JJ file sent to the server's model store, as 32 hexadecimal digits
+    char model_hash[33];
 
-    void run_model(const char *injjfilename, const char *perm_filename, const char *protection_type, const char *model_type, double max_cost);
+    void put_model(const char *injjfilename);
+    bool start_run(const char *resource, const char *content, int content_length, const char *query);
+    void run(const char *injjfilename, const char *resource, const char *content, int content_length, const char *query);
+    const char *protection_name(int protection_type);
+    const char *model_name(int model_type);
 
 };
@@ -0,0 +1,223 @@
+#include "stdafx.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "SolverTelemetry.h"
+
+SolverTelemetry::SolverTelemetry() {
+    clear();
+}
+
+void SolverTelemetry::clear() {
+    build_time = 0.0;
+    initial_solve_time = 0.0;
+    resolve_time = 0.0;
+    resolves = 0;
+    iterations = 0;
+    number_of_genes = 0;
+    genes_resumed = 0;
+    genes_solved = 0;
+    terminated_at = 0;
+    run_time = 0.0;
+}
+
+// Combine the measurements of another run of the same solver, as when it runs a batch of permutations
+// The termination point becomes the total number of genes costed by the runs that were terminated
+void SolverTelemetry::add(const SolverTelemetry *run) {
+    build_time += run->build_time;
+    initial_solve_time += run->initial_solve_time;
+    resolve_time += run->resolve_time;
+    resolves += run->resolves;
+    iterations += run->iterations;
+    number_of_genes += run->number_of_genes;
+    genes_resumed += run->genes_resumed;
+    genes_solved += run->genes_solved;
+    terminated_at += run->terminated_at;
+    run_time += run->run_time;
+}
+
+// One "key value" pair per line, so that readers skip keys they do not know
+void SolverTelemetry::write_file(const char *filename) {
+    FILE *ofp;
+
+    if ((ofp = fopen(filename, "w")) == NULL) {
+        logger->error(1, "Unable to create telemetry file: %s", filename);
+    }
+
+    fprintf(ofp, "build_time %lf\n", build_time);
+    fprintf(ofp, "initial_solve_time %lf\n", initial_solve_time);
+    fprintf(ofp, "resolve_time %lf\n", resolve_time);
+    fprintf(ofp, "resolves %d\n", resolves);
+    fprintf(ofp, "iterations %lld\n", iterations);
+    fprintf(ofp, "number_of_genes %d\n", number_of_genes);
+    fprintf(ofp, "genes_resumed %d\n", genes_resumed);
+    fprintf(ofp, "genes_solved %d\n", genes_solved);
+    fprintf(ofp, "terminated_at %d\n", terminated_at);
+    fprintf(ofp, "run_time %lf\n", run_time);
+
+    fclose(ofp);
+}
+
+bool SolverTelemetry::read_file(const char *filename) {
+    FILE *ifp;
+
+    clear();
+
+    if ((ifp = fopen(filename, "r")) == NULL) {
+        return false;
+    }
+
+    char key[64];
+    char value[64];
+    int pairs = 0;
+
+    while (fscanf(ifp, "%63s %63s", key, value) == 2) {
+        set_value(key, value);
+        pairs++;
+    }
+
+    fclose(ifp);
+
+    return (pairs > 0);
+}
+
+// Read the content of a telemetry file that is already in memory
+bool SolverTelemetry::read_string(const char *content) {
+    clear();
+
+    char key[64];
+    char value[64];
+    int pairs = 0;
+    int length;
+
+    while (sscanf(content, "%63s %63s%n", key, value, &length) == 2) {
+        set_value(key, value);
+        content += length;
+        pairs++;
+    }
+
+    return (pairs > 0);
+}
+
+// Unknown keys are ignored so that newer solvers can report more
+void SolverTelemetry::set_value(const char *key, const char *value) {
+    if (strcmp(key, "build_time") == 0) {
+        build_time = atof(value);
+    } else if (strcmp(key, "initial_solve_time") == 0) {
+        initial_solve_time = atof(value);
+    } else if (strcmp(key, "resolve_time") == 0) {
+        resolve_time = atof(value);
+    } else if (strcmp(key, "resolves") == 0) {
+        resolves = atoi(value);
+    } else if (strcmp(key, "iterations") == 0) {
+        iterations = atoll(value);
+    } else if (strcmp(key, "number_of_genes") == 0) {
+        number_of_genes = atoi(value);
+    } else if (strcmp(key, "genes_resumed") == 0) {
+        genes_resumed = atoi(value);
+    } else if (strcmp(key, "genes_solved") == 0) {
+        genes_solved = atoi(value);
+    } else if (strcmp(key, "terminated_at") == 0) {
+        terminated_at = atoi(value);
+    } else if (strcmp(key, "run_time") == 0) {
+        run_time = atof(value);
+    }
+}
+
+TelemetryHistogram::TelemetryHistogram() {
+    for (int b = 0; b < TELEMETRY_BUCKETS; b++) {
+        counts[b] = 0;
+    }
+
+    number = 0;
+    total = 0.0;
+    largest = 0.0;
+}
+
+// Bucket b > 0 holds values from 2^(b - 1 + TELEMETRY_SMALLEST_POWER) up to twice that, and the last bucket everything larger
+void TelemetryHistogram::add(double value) {
+    int b = 0;
+
+    if (value >= ldexp(1.0, TELEMETRY_SMALLEST_POWER)) {
+        int exponent;
+        frexp(value, &exponent);
+        b = MIN(exponent - TELEMETRY_SMALLEST_POWER, TELEMETRY_BUCKETS - 1);
+    }
+
+    counts[b]++;
+    number++;
+    total += value;
+    largest = MAX(largest, value);
+}
+
+// Each non-empty bucket is shown as "<upper limit>:count"
+void TelemetryHistogram::log(int level, const char *model_name, const char *measurement) {
+    if (number == 0) {
+        return;
+    }
+
+    char buckets[TELEMETRY_BUCKETS * 24];
+    char *p = buckets;
+
+    buckets[0] = '\0';
+    for (int b = 0; b < TELEMETRY_BUCKETS; b++) {
+        if (counts[b] > 0) {
+            if (b < TELEMETRY_BUCKETS - 1) {
+                p += sprintf(p, " <%g:%ld", ldexp(1.0, b + TELEMETRY_SMALLEST_POWER), counts[b]);
+            } else {
+                p += sprintf(p, " >=%g:%ld", ldexp(1.0, b - 1 + TELEMETRY_SMALLEST_POWER), counts[b]);
+            }
+        }
+    }
+
+    logger->log(level, "Solver %s %s mean %.4lf max %.4lf:%s", model_name, measurement, total / number, largest, buckets);
+}
+
+SolverTelemetryStatistics::SolverTelemetryStatistics() {
+    runs = 0;
+    terminated = 0;
+    genes_resumed = 0;
+    genes_solved = 0;
+}
+
+void SolverTelemetryStatistics::add(const SolverTelemetry *telemetry, double evaluation_time, double transfer_time) {
+    runs++;
+    genes_resumed += telemetry->genes_resumed;
+    genes_solved += telemetry->genes_solved;
+
+    evaluation.add(evaluation_time);
+    overhead.add(MAX(evaluation_time - telemetry->run_time, 0.0));
+    transfer.add(transfer_time);
+
+    if (telemetry->build_time > 0.0) {
+        build.add(telemetry->build_time);
+        initial_solve.add(telemetry->initial_solve_time);
+    }
+
+    if (telemetry->genes_solved > 0) {
+        resolve_per_gene.add(telemetry->resolve_time / telemetry->genes_solved);
+        iterations_per_gene.add((double)telemetry->iterations / telemetry->genes_solved);
+    }
+
+    if ((telemetry->terminated_at > 0) && (telemetry->number_of_genes > 0)) {
+        terminated++;
+        termination.add((double)telemetry->terminated_at / telemetry->number_of_genes);
+    }
+}
+
+void SolverTelemetryStatistics::log(int level, const char *model_name) {
+    if (runs == 0) {
+        return;
+    }
+
+    logger->log(level, "Solver %s telemetry over %d runs: %d terminated early, genes resumed %lld, solved %lld", model_name, runs, terminated, genes_resumed, genes_solved);
+
+    evaluation.log(level, model_name, "evaluation time (s)");
+    overhead.log(level, model_name, "time outside the solver (s)");
+    transfer.log(level, model_name, "transfer time (s)");
+    build.log(level, model_name, "model build time (s)");
+    initial_solve.log(level, model_name, "initial solve time (s)");
+    resolve_per_gene.log(level, model_name, "resolve time per gene (s)");
+    iterations_per_gene.log(level, model_name, "simplex iterations per gene");
+    termination.log(level, model_name, "fraction of genes costed before termination");
+}
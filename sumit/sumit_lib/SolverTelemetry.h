@@ -0,0 +1,77 @@
+#pragma once
+
+#include "stdafx.h"
+
+// Measurements of one run of the cell suppression solver, returned with its results
+// Times are in seconds
+class SolverTelemetry {
+
+public:
+    double build_time;          // Building and loading the LP model, zero when a loaded model was reused
+    double initial_solve_time;  // Initial solve of a newly loaded model
+    double resolve_time;        // All resolves after a change to the column bounds
+    int resolves;
+    long long iterations;       // Simplex iterations over all resolves
+    int number_of_genes;
+    int genes_resumed;          // Genes whose costs were taken from the prefix cache
+    int genes_solved;           // Genes costed by resolves in this run
+    int terminated_at;          // Number of genes costed when the cost limit stopped the run, or zero if every gene was costed
+    double run_time;            // From the solver starting to its results being ready
+
+    SolverTelemetry();
+    void clear();
+    void add(const SolverTelemetry *run);
+    void write_file(const char *filename);
+    bool read_file(const char *filename);
+    bool read_string(const char *content);
+
+private:
+    void set_value(const char *key, const char *value);
+
+};
+
+// Number of power of two buckets in a histogram, the first holding everything below 2^TELEMETRY_SMALLEST_POWER
+#define TELEMETRY_BUCKETS 32
+#define TELEMETRY_SMALLEST_POWER -12
+
+// Distribution of one measurement over many runs
+class TelemetryHistogram {
+
+public:
+    TelemetryHistogram();
+    void add(double value);
+    void log(int level, const char *model_name, const char *measurement);
+
+private:
+    long counts[TELEMETRY_BUCKETS];
+    long number;
+    double total;
+    double largest;
+
+};
+
+// Distributions of the measurements of all runs of one model type, so that slow evaluations can be put down to the LP itself, to the
+// server or to moving files
+class SolverTelemetryStatistics {
+
+public:
+    SolverTelemetryStatistics();
+    void add(const SolverTelemetry *telemetry, double evaluation_time, double transfer_time);
+    void log(int level, const char *model_name);
+
+private:
+    int runs;
+    int terminated;
+    long long genes_resumed;
+    long long genes_solved;
+
+    TelemetryHistogram evaluation;      // Solver start to completion as seen by the client
+    TelemetryHistogram overhead;        // Evaluation time not spent running the solver, such as starting it and waiting for the server
+    TelemetryHistogram transfer;        // Sending the input and fetching the results
+    TelemetryHistogram build;
+    TelemetryHistogram initial_solve;
+    TelemetryHistogram resolve_per_gene;
+    TelemetryHistogram iterations_per_gene;
+    TelemetryHistogram termination;     // Fraction of the genes costed before the cost limit was reached
+
+};
@@ -6,20 +6,36 @@
 #include <process.h>
 #include <io.h>
 #include <fcntl.h>
+#include <psapi.h>
 #else
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <libgen.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <signal.h>
+#include <pthread.h>
 #endif
 
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
 
 System::System() {
 #ifdef _WIN32
@@ -71,6 +87,11 @@ void System::sleep() {
 #endif
 }
 
+// Monotonic time in seconds - only differences between values are meaningful
+double System::wall_time() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 char* System::time_string(time_t* tm) {
     static char str[100];
     time_t t;
@@ -116,11 +137,15 @@ void System::make_tempfile(char* filename, int size) {
 }
 
 SOCKET System::open_socket(const char* host, const char* port) {
+    struct addrinfo* result = resolve_address(host, port);
+    SOCKET sock = connect_socket(result, host);
+    free_address(result);
+
+    return sock;
+}
+
+static int get_address(const char* host, const char* port, struct addrinfo** result) {
     struct addrinfo hints;
-    struct addrinfo* result;
-    struct addrinfo* rp;
-    int status;
-    SOCKET sock = -1;
 
     memset(&hints, 0, sizeof (hints));
     hints.ai_family = AF_UNSPEC;
@@ -129,7 +154,14 @@ SOCKET System::open_socket(const char* host, const char* port) {
     hints.ai_protocol = IPPROTO_TCP;
 #endif
 
-    status = getaddrinfo(host, port, &hints, &result);
+    return getaddrinfo(host, port, &hints, result);
+}
+
+// The addresses of a host, to be connected to by connect_socket and released by free_address
+struct addrinfo* System::resolve_address(const char* host, const char* port) {
+    struct addrinfo* result;
+
+    int status = get_address(host, port, &result);
     if (status != 0) {
 #ifdef _WIN32
         logger->error(3, "Error getting address: %ls", gai_strerror(status));
@@ -138,13 +170,56 @@ SOCKET System::open_socket(const char* host, const char* port) {
 #endif
     }
 
-    for (rp = result; rp != NULL; rp = rp->ai_next) {
+    return result;
+}
+
+// As resolve_address, but return NULL if the host's addresses cannot be looked up
+struct addrinfo* System::try_resolve_address(const char* host, const char* port) {
+    struct addrinfo* result;
+
+    int status = get_address(host, port, &result);
+    if (status != 0) {
+#ifdef _WIN32
+        logger->log(3, "Error getting address of %s: %ls", host, gai_strerror(status));
+#else
+        logger->log(3, "Error getting address of %s: %s", host, gai_strerror(status));
+#endif
+        return NULL;
+    }
+
+    return result;
+}
+
+void System::free_address(struct addrinfo* address) {
+    freeaddrinfo(address);
+}
+
+// Connect to the first of the addresses that accepts a connection
+SOCKET System::connect_socket(const struct addrinfo* address, const char* host) {
+    SOCKET sock = try_connect_socket(address);
+
+    if (sock == -1) {
+        logger->error(4, "Error %d connecting to %s", errno, host);
+    }
+
+    return sock;
+}
+
+// As connect_socket, but return -1 if none of the addresses accepts a connection
+SOCKET System::try_connect_socket(const struct addrinfo* address) {
+    const struct addrinfo* rp;
+    SOCKET sock = -1;
+
+    for (rp = address; rp != NULL; rp = rp->ai_next) {
         sock = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
         if (sock == -1) {
             continue;
         }
 
         if (connect(sock, rp->ai_addr, (int)rp->ai_addrlen) != -1) {
+            // Requests are written whole and then wait for the reply, so Nagle's algorithm would only delay them on keep-alive connections
+            int no_delay = 1;
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
             break;
         }
 #ifdef _WIN32
@@ -155,11 +230,9 @@ SOCKET System::open_socket(const char* host, const char* port) {
     }
 
     if (rp == NULL) {
-        logger->error(4, "Error %d connecting to %s", errno, host);
+        return -1;
     }
 
-    freeaddrinfo(result);
-
     return sock;
 }
 
@@ -171,19 +244,111 @@ void System::close_socket(SOCKET sock) {
 #endif
 }
 
+// Reads and writes that make no progress for this long fail instead of blocking
+void System::set_socket_timeout(SOCKET sock, int seconds) {
+#ifdef _WIN32
+    DWORD timeout = seconds * 1000;
+#else
+    struct timeval timeout;
+    timeout.tv_sec = seconds;
+    timeout.tv_usec = 0;
+#endif
+
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
 int System::read_socket(SOCKET sock, char* buffer, int length) {
     return (int)recv(sock, buffer, length, 0);
 }
 
 int System::write_socket(SOCKET sock, const char* buffer, int length) {
+#ifdef MSG_NOSIGNAL
+    // A connection closed by the server is reported as an error rather than by raising SIGPIPE
+    return (int)send(sock, buffer, length, MSG_NOSIGNAL);
+#else
     return (int)send(sock, buffer, length, 0);
+#endif
+}
+
+// Send the first length bytes of a file, returning false if the connection fails
+// Under Linux the kernel copies the file to the socket, and elsewhere it is sent in large blocks
+bool System::send_file(SOCKET sock, FILE* fp, long length) {
+#ifdef __linux__
+    // sendfile has no equivalent of MSG_NOSIGNAL, so SIGPIPE is blocked while it runs and discarded if a closed connection raised it
+    sigset_t pipe_signal;
+    sigset_t old_mask;
+    sigemptyset(&pipe_signal);
+    sigaddset(&pipe_signal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_signal, &old_mask);
+
+    int fd = fileno(fp);
+    off_t offset = 0;
+    bool sent = true;
+
+    while (offset < length) {
+        ssize_t bytes = sendfile(sock, fd, &offset, (size_t)(length - offset));
+        if (bytes == 0) {
+            logger->error(5, "File ended before %ld bytes were sent", length);
+        } else if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EPIPE) {
+                struct timespec no_wait = {0, 0};
+                sigtimedwait(&pipe_signal, NULL, &no_wait);
+            }
+
+            sent = false;
+            break;
+        }
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    return sent;
+#else
+    char* buffer = new char[SEND_FILE_BLOCK_SIZE];
+    long bytes_remaining = length;
+    bool sent = true;
+
+    rewind(fp);
+
+    while (sent && (bytes_remaining > 0)) {
+        int bytes_to_transfer = (bytes_remaining > SEND_FILE_BLOCK_SIZE)? SEND_FILE_BLOCK_SIZE: (int)bytes_remaining;
+
+        int bytes_read = (int)fread(buffer, 1, bytes_to_transfer, fp);
+        if (bytes_read != bytes_to_transfer) {
+            logger->error(5, "Error %d reading file to send", errno);
+        }
+
+        const char* p = buffer;
+        while (bytes_read > 0) {
+            int bytes_written = write_socket(sock, p, bytes_read);
+            if (bytes_written <= 0) {
+                sent = false;
+                break;
+            }
+
+            p += bytes_written;
+            bytes_read -= bytes_written;
+        }
+
+        bytes_remaining -= bytes_to_transfer;
+    }
+
+    delete[] buffer;
+
+    return sent;
+#endif
 }
 
 // Note that this method resets the read position to the start of the file
-int System::get_file_size(FILE* fp) {
+long System::get_file_size(FILE* fp) {
 #ifdef _WIN32
     // Need to read the file to enumerate the content length due to CRLF translation
-    int size = 0;
+    long size = 0;
     boolean done = false;
     do {
         if (fgetc(fp) != EOF) {
@@ -198,7 +363,7 @@ int System::get_file_size(FILE* fp) {
     } while (! done);
 #else
     fseek(fp, 0, SEEK_END);
-    int size = (int)ftell(fp);
+    long size = ftell(fp);
 #endif
 
     fseek(fp, 0, SEEK_SET);
@@ -206,6 +371,26 @@ int System::get_file_size(FILE* fp) {
     return size;
 }
 
+// Get the modification time and size of a file without opening it
+bool System::get_file_stamp(const char* filename, time_t* modified, long* size) {
+#ifdef _WIN32
+    struct _stat st;
+    if (_stat(filename, &st) != 0) {
+        return false;
+    }
+#else
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        return false;
+    }
+#endif
+
+    *modified = st.st_mtime;
+    *size = (long)st.st_size;
+
+    return true;
+}
+
 void System::copy_file(const char* dest, const char* src) {
     FILE* fp_src = fopen(src, "r");
     if (fp_src == NULL) {
@@ -214,18 +399,18 @@ void System::copy_file(const char* dest, const char* src) {
 
     FILE* fp_dest = fopen(dest, "w");
 
-    int content_length = this->get_file_size(fp_src);
+    long content_length = this->get_file_size(fp_src);
 
     char buffer[4096];
 
-    int bytes_remaining = content_length;
+    long bytes_remaining = content_length;
     int bytes_to_transfer;
 
     do {
         if (bytes_remaining > (int)sizeof(buffer)) {
             bytes_to_transfer = sizeof(buffer);
         } else {
-            bytes_to_transfer = bytes_remaining;
+            bytes_to_transfer = (int)bytes_remaining;
         }
 
         int bytes_read = (int)fread(buffer, 1, bytes_to_transfer, fp_src);
@@ -247,6 +432,66 @@ void System::copy_file(const char* dest, const char* src) {
     fclose(fp_src);
 }
 
+// Map the whole of a file into memory and return its address, or NULL if the file cannot be mapped
+// The mapping is copy-on-write, so the memory may be modified without changing the file
+void* System::map_file(const char* filename, size_t* size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+
+    LARGE_INTEGER file_size;
+    if ((! GetFileSizeEx(file, &file_size)) || (file_size.QuadPart == 0)) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) {
+        return NULL;
+    }
+
+    // The view keeps the mapping open
+    void* address = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+
+    *size = (size_t)file_size.QuadPart;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+        ::close(fd);
+        return NULL;
+    }
+
+    // The mapping remains valid once the file is closed
+    void* address = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED) {
+        return NULL;
+    }
+
+    *size = (size_t)st.st_size;
+#endif
+
+    return address;
+}
+
+void System::unmap_file(void* address, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(address);
+#else
+    munmap(address, size);
+#endif
+}
+
 int System::string_case_compare(const char* s1, const char* s2) {
 #ifdef _WIN32
     return _stricmp(s1, s2);
@@ -339,3 +584,69 @@ int System::close(int fd) {
     return ::close(fd);
 #endif
 }
+
+unsigned int System::number_of_processors() {
+    unsigned int processors = std::thread::hardware_concurrency();
+
+    return (processors > 0)? processors: 1;
+}
+
+// Largest resident set size of the process so far, in bytes
+long long System::peak_resident_memory() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return (long long)counters.PeakWorkingSetSize;
+    }
+
+    return 0;
+#else
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        // Reported in bytes on macOS and in kilobytes elsewhere
+        return (long long)usage.ru_maxrss;
+#else
+        return (long long)usage.ru_maxrss * 1024;
+#endif
+    }
+
+    return 0;
+#endif
+}
+
+// Call function for each of n items on a pool of threads, each of which takes the next item as it becomes free
+// Returns once every item has been processed
+void System::parallel_for(int n, std::function<void(int)> function) {
+    parallel_for(n, (int)number_of_processors(), function);
+}
+
+// As above with at most the given number of threads, for items that spend most of their time waiting rather than computing
+void System::parallel_for(int n, int threads, std::function<void(int)> function) {
+    threads = MIN(threads, n);
+
+    if (threads <= 1) {
+        for (int i = 0; i < n; i++) {
+            function(i);
+        }
+        return;
+    }
+
+    std::atomic<int> next(0);
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&next, n, &function]() {
+            int i;
+            while ((i = next++) < n) {
+                function(i);
+            }
+        }));
+    }
+
+    for (size_t t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+}
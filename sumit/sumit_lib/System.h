@@ -28,6 +28,12 @@
 #endif
 
 #include <stdio.h>
+#include <functional>
+
+// Largest block read from a file and written to a socket when the kernel cannot copy it directly
+#define SEND_FILE_BLOCK_SIZE 65536
+
+struct addrinfo;
 
 class System {
 
@@ -36,14 +42,25 @@ public:
     ~System();
     void initialise_sleep(int milliseconds);
     void sleep();
+    double wall_time();
     char* time_string(time_t* tm);
     void make_tempfile(char* filename, int size);
     SOCKET open_socket(const char* host, const char* port);
+    struct addrinfo* resolve_address(const char* host, const char* port);
+    struct addrinfo* try_resolve_address(const char* host, const char* port);
+    void free_address(struct addrinfo* address);
+    SOCKET connect_socket(const struct addrinfo* address, const char* host);
+    SOCKET try_connect_socket(const struct addrinfo* address);
     void close_socket(SOCKET sock);
+    void set_socket_timeout(SOCKET sock, int seconds);
     int read_socket(SOCKET sock, char* buffer, int length);
     int write_socket(SOCKET sock, const char* buffer, int length);
-    int get_file_size(FILE* fp);
+    bool send_file(SOCKET sock, FILE* fp, long length);
+    long get_file_size(FILE* fp);
+    bool get_file_stamp(const char* filename, time_t* modified, long* size);
     void copy_file(const char* dest, const char* src);
+    void* map_file(const char* filename, size_t* size);
+    void unmap_file(void* address, size_t size);
     int string_case_compare(const char* s1, const char* s2);
     void remove_file(const char* filename);
     char* get_current_working_directory(char* buffer, int size);
@@ -54,6 +71,10 @@ public:
     int duplicate(int fd);
     int duplicate2(int fd1, int fd2);
     int close(int fd);
+    unsigned int number_of_processors();
+    long long peak_resident_memory();
+    void parallel_for(int n, std::function<void(int)> function);
+    void parallel_for(int n, int threads, std::function<void(int)> function);
 
 private:
 #ifdef _WIN32
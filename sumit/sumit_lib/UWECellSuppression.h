@@ -14,5 +14,6 @@
 extern bool debugging;
 extern Logger *logger;
 extern System sys;
+extern Profiler profiler;
 
 int main(int argc, char* argv[]);
@@ -1,6 +1,9 @@
 #include "stdafx.h"
 #include <float.h>
 #include <math.h>
+#include <thread>
+#include <vector>
+#include "Barrier.h"
 #include "Unpicker.h"
 
 Unpicker::Unpicker(const char* injjfilename) {
@@ -18,86 +21,25 @@ Unpicker::Unpicker(const char* injjfilename) {
         }
     }
 
+    consolidated_eqtns = NULL;
+    consolidated_cells = NULL;
+    consolidated_signs = NULL;
     no_consolidated_eqtns = 0;
-    nos_processing_eqtns_lower = 0;
-    nos_processing_eqtns_upper = 0;
+    consolidated_terms = 0;
+
+    level_order = NULL;
+    level_start = NULL;
+    number_of_levels = 0;
 
     NumberOfPrimaryCells = 0;
     NumberOfSecondaryCells = 0;
     NumberOfPrimaryCells_ValueKnownExactly = 0;
     NumberOfPrimaryCells_ValueKnownWithinProtection = 0;
-
-    processing_eqtns_lower = NULL;
-    processing_eqtns_upper = NULL;
 }
 
 Unpicker::~Unpicker(void) {
     delete[] cell_bounds;
 
-    if (consolidated_eqtns != NULL) {
-        for (SumIndex i = 0; i < no_consolidated_eqtns; i++) {
-            if (consolidated_eqtns[i].cell_index != NULL) {
-                delete[] consolidated_eqtns[i].cell_index;
-            }
-
-            if (consolidated_eqtns[i].plus_or_minus != NULL) {
-                delete[] consolidated_eqtns[i].plus_or_minus;
-            }
-        }
-
-        delete[] consolidated_eqtns;
-
-        consolidated_eqtns = NULL;
-    }
-
-    if (processing_eqtns_lower != NULL) {
-        for (SumIndex i = 0; i < nos_processing_eqtns_lower; i++) {
-            if (processing_eqtns_lower[i].cells_lower_to_add != NULL) {
-                delete[] processing_eqtns_lower[i].cells_lower_to_add;
-            }
-
-            if (processing_eqtns_lower[i].cells_lower_to_sub != NULL) {
-                delete[] processing_eqtns_lower[i].cells_lower_to_sub;
-            }
-
-            if (processing_eqtns_lower[i].cells_upper_to_add != NULL) {
-                delete[] processing_eqtns_lower[i].cells_upper_to_add;
-            }
-
-            if (processing_eqtns_lower[i].cells_upper_to_sub != NULL) {
-                delete[] processing_eqtns_lower[i].cells_upper_to_sub;
-            }
-        }
-
-        delete[] processing_eqtns_lower;
-
-        processing_eqtns_lower = NULL;
-    }
-
-    if (processing_eqtns_upper != NULL) {
-        for (SumIndex i = 0; i < nos_processing_eqtns_upper; i++) {
-            if (processing_eqtns_upper[i].cells_lower_to_add != NULL) {
-                delete[] processing_eqtns_upper[i].cells_lower_to_add;
-            }
-
-            if (processing_eqtns_upper[i].cells_lower_to_sub != NULL) {
-                delete[] processing_eqtns_upper[i].cells_lower_to_sub;
-            }
-
-            if (processing_eqtns_upper[i].cells_upper_to_add != NULL) {
-                delete[] processing_eqtns_upper[i].cells_upper_to_add;
-            }
-
-            if (processing_eqtns_upper[i].cells_upper_to_sub != NULL) {
-                delete[] processing_eqtns_upper[i].cells_upper_to_sub;
-            }
-        }
-
-        delete[] processing_eqtns_upper;
-
-        processing_eqtns_upper = NULL;
-    }
-
     delete jjData;
 }
 
@@ -120,29 +62,25 @@ void Unpicker::tidy_up_the_consolidated_equations() {
 
 void Unpicker::consolidate_the_consistency_equations() {
     int i;
-    int j;
     int nsuppressed;
     CellIndex cell_no;
-    int consolidated_index;
-
-    consolidated_eqtns = NULL;
+    int64_t nterms;
 
-    // Find the required number of consolidated equations
+    // Find the required number of consolidated equations and terms
 
     no_consolidated_eqtns = 0;
+    nterms = 0;
 
     for (i = 0; i < jjData->nsums; i++) {
         nsuppressed = 0;
 
         /* Count the number of suppressed cells in the equation */
 
-        for (j = 0; j < jjData->consistency_eqtns[i].size_of_eqtn; j++) {
-            cell_no = jjData->consistency_eqtns[i].cell_index[j];
+        for (int64_t k = jjData->equation_offsets[i]; k < jjData->equation_offsets[i + 1]; k++) {
+            cell_no = jjData->equation_cells[k];
 
-            if ((cell_no >= 0) && (cell_no < jjData->ncells)) {
-                if ((jjData->cells[cell_no].status == 'u') || (jjData->cells[cell_no].status == 'm')) {
-                    nsuppressed++;
-                }
+            if ((jjData->cells[cell_no].status == 'u') || (jjData->cells[cell_no].status == 'm')) {
+                nsuppressed++;
             }
         }
 
@@ -150,66 +88,51 @@ void Unpicker::consolidate_the_consistency_equations() {
 
         if (nsuppressed > 0) {
             no_consolidated_eqtns++;
+            nterms += nsuppressed;
         }
     }
 
     // Allocate memory for the consolidated equations
 
-    consolidated_eqtns = new ConsolidatedEquation[no_consolidated_eqtns];
-
-    for (i = 0; i < no_consolidated_eqtns; i++) {
-        consolidated_eqtns[i].cell_index = NULL;
-        consolidated_eqtns[i].plus_or_minus = NULL;
-    }
+    consolidated_eqtns = arena.allocate<ConsolidatedEquation>(no_consolidated_eqtns);
+    consolidated_cells = arena.allocate<CellIndex>(nterms);
+    consolidated_signs = arena.allocate<int>(nterms);
 
     // Setup the required number of consolidated equations
 
     no_consolidated_eqtns = 0;
+    nterms = 0;
 
     for (i = 0; i < jjData->nsums; i++) {
-        nsuppressed = 0;
-
-        /* Count the number of suppressed cells in the equation */
-
-        for (j = 0; j < jjData->consistency_eqtns[i].size_of_eqtn; j++) {
-            cell_no = jjData->consistency_eqtns[i].cell_index[j];
-
-            if ((cell_no >= 0) && (cell_no < jjData->ncells)) {
-                if ((jjData->cells[cell_no].status == 'u') || (jjData->cells[cell_no].status == 'm')) {
-                    nsuppressed++;
-                }
+        ConsolidatedEquation eqtn;
+
+        eqtn.cell_index = consolidated_cells + nterms;
+        eqtn.plus_or_minus = consolidated_signs + nterms;
+        eqtn.size_of_eqtn = 0;
+        eqtn.RHS = jjData->consistency_eqtns[i].RHS;
+
+        for (int64_t k = jjData->equation_offsets[i]; k < jjData->equation_offsets[i + 1]; k++) {
+            cell_no = jjData->equation_cells[k];
+
+            if ((jjData->cells[cell_no].status == 'u') || (jjData->cells[cell_no].status == 'm')) {
+                eqtn.cell_index[eqtn.size_of_eqtn] = cell_no;
+                eqtn.plus_or_minus[eqtn.size_of_eqtn] = jjData->term_sign(k);
+                eqtn.size_of_eqtn++;
+            } else {
+                eqtn.RHS = eqtn.RHS - (jjData->term_sign(k) * jjData->cells[cell_no].nominal_value);
             }
         }
 
         /* If there is one or more suppressed cell then we write it to the consolidated equations */
 
-        if (nsuppressed > 0) {
-            consolidated_eqtns[no_consolidated_eqtns].cell_index = new CellIndex[nsuppressed];
-            consolidated_eqtns[no_consolidated_eqtns].plus_or_minus = new int[nsuppressed];
-
-            consolidated_eqtns[no_consolidated_eqtns].RHS = jjData->consistency_eqtns[i].RHS;
-
-            consolidated_index = 0;
-
-            for (j = 0; j < jjData->consistency_eqtns[i].size_of_eqtn; j++) {
-                cell_no = jjData->consistency_eqtns[i].cell_index[j];
-
-                if ((cell_no >= 0) && (cell_no < jjData->ncells)) {
-                    if ((jjData->cells[cell_no].status == 'u') || (jjData->cells[cell_no].status == 'm')) {
-                        consolidated_eqtns[no_consolidated_eqtns].cell_index[consolidated_index] = cell_no;
-                        consolidated_eqtns[no_consolidated_eqtns].plus_or_minus[consolidated_index] = jjData->consistency_eqtns[i].plus_or_minus[j];
-                        consolidated_index++;
-                        consolidated_eqtns[no_consolidated_eqtns].size_of_eqtn = consolidated_index;
-                    } else {
-                        consolidated_eqtns[no_consolidated_eqtns].RHS = consolidated_eqtns[no_consolidated_eqtns].RHS - (jjData->consistency_eqtns[i].plus_or_minus[j] * jjData->cells[cell_no].nominal_value);
-                    }
-                }
-            }
-
-            no_consolidated_eqtns++;
+        if (eqtn.size_of_eqtn > 0) {
+            consolidated_eqtns[no_consolidated_eqtns++] = eqtn;
+            nterms += eqtn.size_of_eqtn;
         }
     }
 
+    consolidated_terms = nterms;
+
     tidy_up_the_consolidated_equations();
 }
 
@@ -413,350 +336,162 @@ void Unpicker::print_partial_exposure(const char* filename) {
     }
 }
 
-void Unpicker::release_processing_eqtns_memory() {
-    int i;
-
-    if (processing_eqtns_lower != NULL) {
-        for (i = 0; i < nos_processing_eqtns_lower; i++) {
-            if (processing_eqtns_lower[i].cells_lower_to_add != NULL) {
-                delete[] processing_eqtns_lower[i].cells_lower_to_add;
-            }
-
-            if (processing_eqtns_lower[i].cells_lower_to_sub != NULL) {
-                delete[] processing_eqtns_lower[i].cells_lower_to_sub;
-            }
-
-            if (processing_eqtns_lower[i].cells_upper_to_add != NULL) {
-                delete[] processing_eqtns_lower[i].cells_upper_to_add;
-            }
-
-            if (processing_eqtns_lower[i].cells_upper_to_sub != NULL) {
-                delete[] processing_eqtns_lower[i].cells_upper_to_sub;
-            }
-        }
+// Each consolidated equation is solved for each of its cells in turn to give new bounds for that cell
+bool Unpicker::improve_equation_bounds(int i) {
+    bool rc = false;
+    ConsolidatedEquation *eqtn = &consolidated_eqtns[i];
 
-        delete[] processing_eqtns_lower;
-
-        processing_eqtns_lower = NULL;
-    }
-
-    if (processing_eqtns_upper != NULL) {
-        for (i = 0; i < nos_processing_eqtns_upper; i++) {
-            if (processing_eqtns_upper[i].cells_lower_to_add != NULL) {
-                delete[] processing_eqtns_upper[i].cells_lower_to_add;
-            }
-
-            if (processing_eqtns_upper[i].cells_lower_to_sub != NULL) {
-                delete[] processing_eqtns_upper[i].cells_lower_to_sub;
-            }
-
-            if (processing_eqtns_upper[i].cells_upper_to_add != NULL) {
-                delete[] processing_eqtns_upper[i].cells_upper_to_add;
-            }
-
-            if (processing_eqtns_upper[i].cells_upper_to_sub != NULL) {
-                delete[] processing_eqtns_upper[i].cells_upper_to_sub;
-            }
-        }
+    BoundKernel<double>::tighten_lower_bounds(eqtn->RHS, eqtn->cell_index, eqtn->plus_or_minus, eqtn->size_of_eqtn, cell_bounds, [this, &rc](int cellno, double result) {
+        cell_bounds[cellno].lower = result;
+        rc = true;
+        return true;
+    });
 
-        delete[] processing_eqtns_upper;
+    BoundKernel<double>::tighten_upper_bounds(eqtn->RHS, eqtn->cell_index, eqtn->plus_or_minus, eqtn->size_of_eqtn, cell_bounds, [this, &rc](int cellno, double result) {
+        cell_bounds[cellno].upper = result;
+        rc = true;
+        return true;
+    });
 
-        processing_eqtns_upper = NULL;
-    }
+    return rc;
 }
 
+// One sweep over the consolidated equations in order, each seeing the bounds improved by those before it
 bool Unpicker::improve_lower_and_upper_bounds() {
-    bool rc;
-    int i;
-    int j;
-    int k;
-    int sz;
-    int cellno;
-    int cell;
-    int idx;
-    int dest_cell;
-    int dest_plus_minus;
-    double consolidated_RHS;
-    double result;
-    int required_eqtns;
-    int lower_bound_improvements;
-    int upper_bound_improvements;
-
-    rc = false;
-    lower_bound_improvements = 0;
-    upper_bound_improvements = 0;
+    bool rc = false;
 
-    for (i = 0; i < no_consolidated_eqtns; i++) {
-        required_eqtns = consolidated_eqtns[i].size_of_eqtn;
-
-        /////////////////////
-        // Allocate memory //
-        /////////////////////
-
-        processing_eqtns_lower = new ProcessingEquation[required_eqtns];
-        processing_eqtns_upper = new ProcessingEquation[required_eqtns];
-
-        /////////////////////////////////////////
-        // Initialise the processing equations //
-        /////////////////////////////////////////
-
-        nos_processing_eqtns_lower = 0;
-        nos_processing_eqtns_upper = 0;
-
-        for (j = 0; j < required_eqtns; j++) {
-            processing_eqtns_lower[j].no_lower_adds = 0;
-            processing_eqtns_lower[j].no_lower_subs = 0;
-            processing_eqtns_lower[j].no_upper_adds = 0;
-            processing_eqtns_lower[j].no_upper_subs = 0;
-            processing_eqtns_lower[j].cells_lower_to_add = NULL;
-            processing_eqtns_lower[j].cells_lower_to_sub = NULL;
-            processing_eqtns_lower[j].cells_upper_to_add = NULL;
-            processing_eqtns_lower[j].cells_upper_to_sub = NULL;
-
-            processing_eqtns_upper[j].no_lower_adds = 0;
-            processing_eqtns_upper[j].no_lower_subs = 0;
-            processing_eqtns_upper[j].no_upper_adds = 0;
-            processing_eqtns_upper[j].no_upper_subs = 0;
-            processing_eqtns_upper[j].cells_lower_to_add = NULL;
-            processing_eqtns_upper[j].cells_lower_to_sub = NULL;
-            processing_eqtns_upper[j].cells_upper_to_add = NULL;
-            processing_eqtns_upper[j].cells_upper_to_sub = NULL;
+    for (int i = 0; i < no_consolidated_eqtns; i++) {
+        if (improve_equation_bounds(i)) {
+            rc = true;
         }
+    }
 
-        sz = consolidated_eqtns[i].size_of_eqtn;
-
-        if (sz > 0) {
-            ////////////////////////////////////
-            // Setup the processing equations //
-            ////////////////////////////////////
-
-            consolidated_RHS = consolidated_eqtns[i].RHS;
-
-            for (j = 0; j < sz; j++) {
-                // Allocate memory for processing equations
-
-                processing_eqtns_lower[nos_processing_eqtns_lower].cells_lower_to_add = new int[sz];
-                processing_eqtns_lower[nos_processing_eqtns_lower].cells_lower_to_sub = new int[sz];
-                processing_eqtns_lower[nos_processing_eqtns_lower].cells_upper_to_add = new int[sz];
-                processing_eqtns_lower[nos_processing_eqtns_lower].cells_upper_to_sub = new int[sz];
-
-                processing_eqtns_upper[nos_processing_eqtns_upper].cells_lower_to_add = new int[sz];
-                processing_eqtns_upper[nos_processing_eqtns_upper].cells_lower_to_sub = new int[sz];
-                processing_eqtns_upper[nos_processing_eqtns_upper].cells_upper_to_add = new int[sz];
-                processing_eqtns_upper[nos_processing_eqtns_upper].cells_upper_to_sub = new int[sz];
-
-                // Setup processing equations
-
-                dest_cell = consolidated_eqtns[i].cell_index[j];
-                dest_plus_minus = consolidated_eqtns[i].plus_or_minus[j];
-
-                processing_eqtns_lower[nos_processing_eqtns_lower].cellnumber = dest_cell;
-                processing_eqtns_upper[nos_processing_eqtns_upper].cellnumber = dest_cell;
+    return rc;
+}
 
-                if (dest_plus_minus == 1) {
-                    // The cell we are looking at is +ve
+// Assign each equation to the level after the last level to use any of its cells
+// Equations that share a cell are then solved in the same order as the serial sweep, and equations that do not share a cell can be solved in any order, so the parallel sweep gives exactly the same bounds
+void Unpicker::schedule_equations() {
+    int *level = arena.allocate<int>(no_consolidated_eqtns);
+    int *last_level = arena.allocate<int>(jjData->ncells);
 
-                    processing_eqtns_lower[nos_processing_eqtns_lower].RHS = consolidated_RHS;
-                    processing_eqtns_upper[nos_processing_eqtns_upper].RHS = consolidated_RHS;
+    for (CellIndex c = 0; c < jjData->ncells; c++) {
+        last_level[c] = -1;
+    }
 
-                    for (k = 0; k < sz; k++) {
-                        if (k != j) {
-                            // Get all the other cells in the consolidated equation and put them in the right place
+    number_of_levels = 0;
 
-                            if (consolidated_eqtns[i].plus_or_minus[k] == 1) {
-                                // Set up lower calculation
+    for (int i = 0; i < no_consolidated_eqtns; i++) {
+        int l = 0;
 
-                                idx = processing_eqtns_lower[nos_processing_eqtns_lower].no_upper_subs;
-                                processing_eqtns_lower[nos_processing_eqtns_lower].cells_upper_to_sub[idx] = consolidated_eqtns[i].cell_index[k];
-                                idx++;
-                                processing_eqtns_lower[nos_processing_eqtns_lower].no_upper_subs = idx;
+        for (int j = 0; j < consolidated_eqtns[i].size_of_eqtn; j++) {
+            l = MAX(l, last_level[consolidated_eqtns[i].cell_index[j]] + 1);
+        }
 
-                                // Set up upper calculation
+        for (int j = 0; j < consolidated_eqtns[i].size_of_eqtn; j++) {
+            last_level[consolidated_eqtns[i].cell_index[j]] = l;
+        }
 
-                                idx = processing_eqtns_upper[nos_processing_eqtns_upper].no_lower_subs;
-                                processing_eqtns_upper[nos_processing_eqtns_upper].cells_lower_to_sub[idx] = consolidated_eqtns[i].cell_index[k];
-                                idx++;
-                                processing_eqtns_upper[nos_processing_eqtns_upper].no_lower_subs = idx;
-                            } else {
-                                // Set up lower calculation
+        level[i] = l;
+        number_of_levels = MAX(number_of_levels, l + 1);
+    }
 
-                                idx = processing_eqtns_lower[nos_processing_eqtns_lower].no_lower_adds;
-                                processing_eqtns_lower[nos_processing_eqtns_lower].cells_lower_to_add[idx] = consolidated_eqtns[i].cell_index[k];
-                                idx++;
-                                processing_eqtns_lower[nos_processing_eqtns_lower].no_lower_adds = idx;
+    // Counting sort of the equations by level
+    level_start = arena.allocate<int>(number_of_levels + 1);
+    level_order = arena.allocate<int>(no_consolidated_eqtns);
 
-                                // Set up upper calculation
+    for (int l = 0; l <= number_of_levels; l++) {
+        level_start[l] = 0;
+    }
 
-                                idx = processing_eqtns_upper[nos_processing_eqtns_upper].no_upper_adds;
-                                processing_eqtns_upper[nos_processing_eqtns_upper].cells_upper_to_add[idx] = consolidated_eqtns[i].cell_index[k];
-                                idx++;
-                                processing_eqtns_upper[nos_processing_eqtns_upper].no_upper_adds = idx;
-                            }
-                        }
-                    }
-                } else {
-                    // The cell we are looking at is -ve
+    for (int i = 0; i < no_consolidated_eqtns; i++) {
+        level_start[level[i] + 1]++;
+    }
 
-                    processing_eqtns_lower[nos_processing_eqtns_lower].RHS = -consolidated_RHS;
-                    processing_eqtns_upper[nos_processing_eqtns_upper].RHS = -consolidated_RHS;
+    for (int l = 0; l < number_of_levels; l++) {
+        level_start[l + 1] += level_start[l];
+    }
 
-                    for (k = 0; k < sz; k++) {
-                        if (k != j) {
-                            // Get all the other cells in the consolidated equation and put them in the right place
+    int *next = arena.allocate<int>(number_of_levels);
+    for (int l = 0; l < number_of_levels; l++) {
+        next[l] = level_start[l];
+    }
 
-                            if (consolidated_eqtns[i].plus_or_minus[k] == 1) {
-                                // Set up lower calculation
+    for (int i = 0; i < no_consolidated_eqtns; i++) {
+        level_order[next[level[i]]++] = i;
+    }
 
-                                idx = processing_eqtns_lower[nos_processing_eqtns_lower].no_lower_adds;
-                                processing_eqtns_lower[nos_processing_eqtns_lower].cells_lower_to_add[idx] = consolidated_eqtns[i].cell_index[k];
-                                idx++;
-                                processing_eqtns_lower[nos_processing_eqtns_lower].no_lower_adds = idx;
+    logger->log(4, "Unpicker schedule has %d levels for %d consolidated equations", number_of_levels, no_consolidated_eqtns);
+}
 
-                                // Set up upper calculation
+// Small problems and schedules with too few equations per level to share out are solved serially
+bool Unpicker::use_parallel_schedule() {
+    int threads = (int)sys.number_of_processors();
 
-                                idx = processing_eqtns_upper[nos_processing_eqtns_upper].no_upper_adds;
-                                processing_eqtns_upper[nos_processing_eqtns_upper].cells_upper_to_add[idx] = consolidated_eqtns[i].cell_index[k];
-                                idx++;
-                                processing_eqtns_upper[nos_processing_eqtns_upper].no_upper_adds = idx;
-                            } else {
-                                // Set up lower calculation
+    return (level_order != NULL) && (threads > 1) && (consolidated_terms >= PARALLEL_UNPICK_THRESHOLD) &&
+        ((long long)no_consolidated_eqtns >= (long long)number_of_levels * threads * PARALLEL_UNPICK_LEVEL_WIDTH);
+}
 
-                                idx = processing_eqtns_lower[nos_processing_eqtns_lower].no_upper_subs;
-                                processing_eqtns_lower[nos_processing_eqtns_lower].cells_upper_to_sub[idx] = consolidated_eqtns[i].cell_index[k];
-                                idx++;
-                                processing_eqtns_lower[nos_processing_eqtns_lower].no_upper_subs = idx;
+// Sweeps as improve_lower_and_upper_bounds() does until a sweep improves nothing or max_iterations sweeps have improved something, returning the number that did
+// One team does every sweep, working through the levels in turn, sharing out the equations of each level and waiting for each other at the end of it
+// Each thread flags its improvements for the sweep in improved[sweep % 2], so every thread can read the flags of one sweep while they are cleared for the next
+int Unpicker::improve_bounds_in_parallel(int max_iterations) {
+    int threads = (int)sys.number_of_processors();
+    Barrier barrier(threads);
+    char *improved = arena.allocate<char>(2 * threads);
+    int iterations = 0;
+    std::vector<std::thread> team;
+
+    for (int t = 0; t < 2 * threads; t++) {
+        improved[t] = 0;
+    }
 
-                                // Set up upper calculation
+    for (int t = 0; t < threads; t++) {
+        team.push_back(std::thread([this, t, threads, max_iterations, &barrier, improved, &iterations]() {
+            for (int sweep = 0; ; sweep++) {
+                char *flags = improved + (sweep % 2) * threads;
+                bool any = false;
 
-                                idx = processing_eqtns_upper[nos_processing_eqtns_upper].no_lower_subs;
-                                processing_eqtns_upper[nos_processing_eqtns_upper].cells_lower_to_sub[idx] = consolidated_eqtns[i].cell_index[k];
-                                idx++;
-                                processing_eqtns_upper[nos_processing_eqtns_upper].no_lower_subs = idx;
-                            }
+                for (int l = 0; l < number_of_levels; l++) {
+                    for (int k = level_start[l] + t; k < level_start[l + 1]; k += threads) {
+                        if (improve_equation_bounds(level_order[k])) {
+                            flags[t] = 1;
                         }
                     }
-                }
-
-                nos_processing_eqtns_lower++;
-                nos_processing_eqtns_upper++;
-            }
-
-            ////////////////////////////////////
-            // Solve the processing equations //
-            ////////////////////////////////////
-
-            // Improve lower bounds
-
-            for (k = 0; k < nos_processing_eqtns_lower; k++) {
-                result = processing_eqtns_lower[k].RHS;
-                cellno = processing_eqtns_lower[k].cellnumber;
-
-                sz = processing_eqtns_lower[k].no_lower_adds;
-
-                if (sz > 0) {
-                    for (j = 0; j < sz; j++) {
-                        cell = processing_eqtns_lower[k].cells_lower_to_add[j];
-                        result = result + cell_bounds[cell].lower;
-                    }
-                }
-
-                sz = processing_eqtns_lower[k].no_upper_adds;
-
-                if (sz > 0) {
-                    for (j = 0; j < sz; j++) {
-                        cell = processing_eqtns_lower[k].cells_upper_to_add[j];
-                        result = result + cell_bounds[cell].upper;
-                    }
-                }
-
-                sz = processing_eqtns_lower[k].no_lower_subs;
-
-                if (sz > 0) {
-                    for (j = 0; j < sz; j++) {
-                        cell = processing_eqtns_lower[k].cells_lower_to_sub[j];
-                        result = result - cell_bounds[cell].lower;
-                    }
-                }
-
-                sz = processing_eqtns_lower[k].no_upper_subs;
-
-                if (sz > 0) {
-                    for (j = 0; j < sz; j++) {
-                        cell = processing_eqtns_lower[k].cells_upper_to_sub[j];
-                        result = result - cell_bounds[cell].upper;
-                    }
-                }
-
-                if (cell_bounds[cellno].lower < result) {
-                    cell_bounds[cellno].lower = result;
-                    lower_bound_improvements++;
-                    rc = true;
-                }
-            }
-
-            // Improve upper bounds
-
-            for (k = 0; k < nos_processing_eqtns_upper; k++) {
-                result = processing_eqtns_upper[k].RHS;
-                cellno = processing_eqtns_upper[k].cellnumber;
-
-                sz = processing_eqtns_upper[k].no_lower_adds;
-
-                if (sz > 0) {
-                    for (j = 0; j < sz; j++) {
-                        cell = processing_eqtns_upper[k].cells_lower_to_add[j];
-                        result = result + cell_bounds[cell].lower;
-                    }
-                }
 
-                sz = processing_eqtns_upper[k].no_upper_adds;
-
-                if (sz > 0) {
-                    for (j = 0; j < sz; j++) {
-                        cell = processing_eqtns_upper[k].cells_upper_to_add[j];
-                        result = result + cell_bounds[cell].upper;
-                    }
+                    barrier.wait();
                 }
 
-                sz = processing_eqtns_upper[k].no_lower_subs;
-
-                if (sz > 0) {
-                    for (j = 0; j < sz; j++) {
-                        cell = processing_eqtns_upper[k].cells_lower_to_sub[j];
-                        result = result - cell_bounds[cell].lower;
-                    }
+                for (int u = 0; u < threads; u++) {
+                    any = any || flags[u];
                 }
 
-                sz = processing_eqtns_upper[k].no_upper_subs;
+                improved[((sweep + 1) % 2) * threads + t] = 0;
 
-                if (sz > 0) {
-                    for (j = 0; j < sz; j++) {
-                        cell = processing_eqtns_upper[k].cells_upper_to_sub[j];
-                        result = result - cell_bounds[cell].upper;
+                if ((!any) || (sweep >= max_iterations)) {
+                    if (t == 0) {
+                        iterations = sweep;
                     }
-                }
-
-                if (cell_bounds[cellno].upper > result) {
-                    cell_bounds[cellno].upper = result;
-                    upper_bound_improvements++;
-                    rc = true;
+                    return;
                 }
             }
-        }
-
-        ////////////////////
-        // Release memory //
-        ////////////////////
+        }));
+    }
 
-        release_processing_eqtns_memory();
+    for (int t = 0; t < threads; t++) {
+        team[t].join();
     }
 
-    return rc;
+    return iterations;
 }
 
 void Unpicker::Attack() {
     int iterations;
 
+    // Nothing is allocated from here until the end of the attack, apart from the arena's blocks
+    arena.release();
+    level_order = NULL;
+
     consolidate_the_consistency_equations();
 
     if (set_initial_lower_and_upper_bounds()) {
@@ -766,9 +501,18 @@ void Unpicker::Attack() {
 
         iterations = 0;
 
-        while ((improve_lower_and_upper_bounds()) && (iterations < 10)) {
-            iterations++;
+        // The consolidated equations do not change from here on
+        schedule_equations();
+
+        if (use_parallel_schedule()) {
+            iterations = improve_bounds_in_parallel(10);
+        } else {
+            while ((improve_lower_and_upper_bounds()) && (iterations < 10)) {
+                iterations++;
+            }
         }
+
+        logger->log(4, "Unpicker bounds improved by %d sweeps", iterations);
     }
 
     evaluate_exposure();
@@ -5,8 +5,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include "Arena.h"
+#include "BoundKernel.h"
 #include "JJData.h"
 
+// The bounds are improved on several threads when there are at least this many consolidated equation terms
+#define PARALLEL_UNPICK_THRESHOLD 100000
+
+// and the schedule has at least this many equations per level for each thread
+#define PARALLEL_UNPICK_LEVEL_WIDTH 4
+
 class Unpicker {
 
 public:
@@ -22,11 +30,10 @@ public:
     void print_partial_exposure(const char* filename);
 
 private:
-    struct CellBounds {
-        double lower;
-        double upper;
-    };
+    typedef Bounds<double> CellBounds;
 
+    // Consolidated equations only contain suppressed cells
+    // Their terms are held contiguously in consolidated_cells and consolidated_signs
     struct ConsolidatedEquation {
         double RHS;
         int size_of_eqtn;
@@ -34,27 +41,24 @@ private:
         int *plus_or_minus;
     };
 
-    struct ProcessingEquation {
-        int cellnumber;
-        double RHS;
-        int no_lower_adds;
-        int *cells_lower_to_add;
-        int no_lower_subs;
-        int *cells_lower_to_sub;
-        int no_upper_adds;
-        int *cells_upper_to_add;
-        int no_upper_subs;
-        int *cells_upper_to_sub;
-    };
+    CellBounds *cell_bounds;
 
-    struct CellBounds *cell_bounds;
+    // The consolidated equations, the schedule and their working space are taken from the arena for each attack, and freed together
     struct ConsolidatedEquation *consolidated_eqtns;
-    struct ProcessingEquation *processing_eqtns_lower;
-    struct ProcessingEquation *processing_eqtns_upper;
+    CellIndex *consolidated_cells;
+    int *consolidated_signs;
 
     int no_consolidated_eqtns;
-    int nos_processing_eqtns_lower;
-    int nos_processing_eqtns_upper;
+
+    Arena arena;
+
+    // Schedule for improving the bounds in parallel
+    // Equations in the same level have no cells in common, and every equation that shares a cell with an earlier equation is in a later level
+    // The equations of level l are level_order[level_start[l]] to level_order[level_start[l + 1] - 1], in ascending order
+    int *level_order;
+    int *level_start;
+    int number_of_levels;
+    int64_t consolidated_terms;
 
     int NumberOfPrimaryCells;
     int NumberOfSecondaryCells;
@@ -68,7 +72,10 @@ private:
     int simplify_the_consistency_equations();
     bool set_initial_lower_and_upper_bounds();
     void evaluate_exposure();
-    void release_processing_eqtns_memory();
     bool improve_lower_and_upper_bounds();
+    bool improve_equation_bounds(int i);
+    void schedule_equations();
+    bool use_parallel_schedule();
+    int improve_bounds_in_parallel(int max_iterations);
 
 };
@@ -6,5 +6,6 @@
 #endif
 
 #include "Logger.h"
+#include "Profiler.h"
 #include "System.h"
 #include "UWECellSuppression.h"
@@ -23,8 +23,12 @@ public class Logger {
     }
 
     private Logger() {
+    }
+
+    // Called before anything is logged, so that servers on different ports can keep separate logs
+    public static synchronized void open(String fileName) {
         try {
-            writer = new FileWriter("ServerLog.txt");
+            writer = new FileWriter(fileName);
         } catch (IOException e) {
             writer = null;
         }
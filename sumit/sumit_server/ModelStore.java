@@ -0,0 +1,258 @@
+package uwecellsuppressionserver;
+
+import java.io.BufferedInputStream;
+import java.io.File;
+import java.io.FileInputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.nio.file.Files;
+import java.nio.file.StandardCopyOption;
+import java.util.Iterator;
+import java.util.LinkedHashMap;
+import java.util.Map.Entry;
+import java.util.UUID;
+
+/**
+ * JJ files kept between sessions under the fingerprint of their content, so that each model is only uploaded once
+ * The least recently used models that no running session is using are deleted when the store grows beyond its limit
+ *
+ * @author cns
+ */
+public class ModelStore {
+
+    private class Model {
+        public long size;
+        public int users = 0;
+
+        public Model(long size) {
+            this.size = size;
+        }
+    }
+
+    public final File directory;
+    public final long limit;
+
+    // Access order, so that iteration starts at the least recently used model
+    private final LinkedHashMap<String, Model> models = new LinkedHashMap<>(16, 0.75f, true);
+    private long size = 0;
+
+    public ModelStore(File parent, long limit) {
+        this.limit = limit;
+
+        directory = new File(parent, "models");
+        directory.mkdirs();
+
+        // Models from an earlier run are not known to the store
+        File[] files = directory.listFiles();
+        if (files != null) {
+            for (File file : files) {
+                if (file.isFile()) {
+                    file.delete();
+                }
+            }
+        }
+    }
+
+    // Hashes are 32 hexadecimal digits, which also stops them being used to name files outside the store
+    public static boolean validHash(String hash) {
+        return ((hash != null) && hash.matches("[0-9a-fA-F]{32}"));
+    }
+
+    public synchronized boolean contains(String hash) {
+        return (models.get(hash.toLowerCase()) != null);
+    }
+
+    // Move an uploaded file into the store
+    public synchronized void put(String hash, File file) throws IOException {
+        hash = hash.toLowerCase();
+
+        if (models.get(hash) != null) {
+            // Uploaded by two clients at the same time
+            file.delete();
+            return;
+        }
+
+        long length = file.length();
+        Files.move(file.toPath(), new File(directory, hash).toPath(), StandardCopyOption.REPLACE_EXISTING);
+
+        // Make room before the model is added, so that the client that sent it can use it even if it is over the limit on its own
+        size += length;
+        evict();
+
+        models.put(hash, new Model(length));
+
+        Logger.log("Stored model %s (%d bytes, %d models, %d bytes in store)", hash, length, models.size(), size);
+    }
+
+    // Keep a solver's output file in the store under its fingerprint, as a client that downloads it may send it back as the model of a
+    // later job (the output of a YPLUS run is the model of the YMINUS run that follows it)
+    // The store holds a copy, rather than a link, so that it is not changed if the session runs the solver again
+    public void register(File file) throws IOException {
+        String hash = fingerprint(file);
+        if (contains(hash)) {
+            return;
+        }
+
+        File copy = new File(file.getParentFile(), UUID.randomUUID().toString());
+        Files.copy(file.toPath(), copy.toPath());
+
+        put(hash, copy);
+    }
+
+    // Model file for a session to run, or null if it is not in the store
+    // Each call must be matched by a call to release
+    public synchronized File acquire(String hash) {
+        hash = hash.toLowerCase();
+
+        Model model = models.get(hash);
+        if (model == null) {
+            return null;
+        }
+
+        model.users++;
+
+        return new File(directory, hash);
+    }
+
+    public synchronized void release(String hash) {
+        Model model = models.get(hash.toLowerCase());
+        if (model != null) {
+            model.users--;
+        }
+
+        evict();
+    }
+
+    // MurmurHash3 x64 128-bit fingerprint of a file as 32 hexadecimal digits, which is how clients name their models
+    public static String fingerprint(File file) throws IOException {
+        final long c1 = 0x87c37b91114253d5L;
+        final long c2 = 0x4cf5ad432745937fL;
+
+        long h1 = 0;
+        long h2 = 0;
+        long length = 0;
+
+        byte[] block = new byte[16];
+        int n = 0;
+
+        try (InputStream in = new BufferedInputStream(new FileInputStream(file))) {
+            // Body
+            while ((n = readBlock(in, block)) == block.length) {
+                long k1 = getLong(block, 0);
+                long k2 = getLong(block, 8);
+
+                k1 *= c1;
+                k1 = Long.rotateLeft(k1, 31);
+                k1 *= c2;
+                h1 ^= k1;
+
+                h1 = Long.rotateLeft(h1, 27);
+                h1 += h2;
+                h1 = h1 * 5 + 0x52dce729;
+
+                k2 *= c2;
+                k2 = Long.rotateLeft(k2, 33);
+                k2 *= c1;
+                h2 ^= k2;
+
+                h2 = Long.rotateLeft(h2, 31);
+                h2 += h1;
+                h2 = h2 * 5 + 0x38495ab5;
+
+                length += block.length;
+            }
+        }
+
+        // Tail
+        length += n;
+
+        long k1 = 0;
+        long k2 = 0;
+
+        for (int i = n - 1; i >= 8; i--) {
+            k2 ^= (block[i] & 0xffL) << ((i - 8) * 8);
+        }
+        if (n > 8) {
+            k2 *= c2;
+            k2 = Long.rotateLeft(k2, 33);
+            k2 *= c1;
+            h2 ^= k2;
+        }
+
+        for (int i = Math.min(n, 8) - 1; i >= 0; i--) {
+            k1 ^= (block[i] & 0xffL) << (i * 8);
+        }
+        if (n > 0) {
+            k1 *= c1;
+            k1 = Long.rotateLeft(k1, 31);
+            k1 *= c2;
+            h1 ^= k1;
+        }
+
+        // Finalisation
+        h1 ^= length;
+        h2 ^= length;
+
+        h1 += h2;
+        h2 += h1;
+
+        h1 = fmix64(h1);
+        h2 = fmix64(h2);
+
+        h1 += h2;
+        h2 += h1;
+
+        return String.format("%016x%016x", h1, h2);
+    }
+
+    // Fill the block unless the stream ends first, and return the number of bytes read
+    private static int readBlock(InputStream in, byte[] block) throws IOException {
+        int n = 0;
+        while (n < block.length) {
+            int bytes = in.read(block, n, block.length - n);
+            if (bytes == -1) {
+                break;
+            }
+            n += bytes;
+        }
+
+        return n;
+    }
+
+    // Little-endian, as the client reads the blocks
+    private static long getLong(byte[] block, int offset) {
+        long value = 0;
+        for (int i = 7; i >= 0; i--) {
+            value = (value << 8) | (block[offset + i] & 0xffL);
+        }
+
+        return value;
+    }
+
+    private static long fmix64(long k) {
+        k ^= k >>> 33;
+        k *= 0xff51afd7ed558ccdL;
+        k ^= k >>> 33;
+        k *= 0xc4ceb9fe1a85ec53L;
+        k ^= k >>> 33;
+
+        return k;
+    }
+
+    private void evict() {
+        Iterator<Entry<String, Model>> it = models.entrySet().iterator();
+        while ((size > limit) && it.hasNext()) {
+            Entry<String, Model> entry = it.next();
+            Model model = entry.getValue();
+
+            if (model.users == 0) {
+                new File(directory, entry.getKey()).delete();
+                size -= model.size;
+                it.remove();
+
+                Logger.log("Evicted model %s (%d bytes)", entry.getKey(), model.size);
+            }
+        }
+    }
+
+}
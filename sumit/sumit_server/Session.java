@@ -4,6 +4,8 @@ import java.io.File;
 import java.io.IOException;
 import java.io.InputStream;
 import java.util.UUID;
+import java.util.concurrent.TimeUnit;
+import static uwecellsuppressionserver.UWECellSuppressionServer.models;
 import static uwecellsuppressionserver.UWECellSuppressionServer.store;
 
 /**
@@ -18,7 +20,13 @@ public class Session implements AutoCloseable {
     public final String outfile = UUID.randomUUID().toString();
     public final String permfile = UUID.randomUUID().toString();
     public final String costfile = UUID.randomUUID().toString();
+    public final String telemetryfile = UUID.randomUUID().toString();
     public String query = null;
+    // Number of permutations run by the solver, each with an output file of its own, or zero for a single permutation
+    public int batch = 0;
+    // Hash of the model in the model store used instead of the session's own input file, if any
+    private String model = null;
+    private File modelFile = null;
 
     private Process process = null;
     private InputStream in = null;
@@ -43,13 +51,19 @@ public class Session implements AutoCloseable {
 
         StringBuilder sb = new StringBuilder();
         sb.append("infile=");
-        sb.append(new File(UWECellSuppressionServer.store, infile).toString());
+        if (modelFile != null) {
+            sb.append(modelFile.toString());
+        } else {
+            sb.append(new File(UWECellSuppressionServer.store, infile).toString());
+        }
         sb.append("&outfile=");
         sb.append(new File(UWECellSuppressionServer.store, outfile).toString());
         sb.append("&permfile=");
         sb.append(new File(UWECellSuppressionServer.store, permfile).toString());
         sb.append("&costfile=");
         sb.append(new File(UWECellSuppressionServer.store, costfile).toString());
+        sb.append("&telemetryfile=");
+        sb.append(new File(UWECellSuppressionServer.store, telemetryfile).toString());
         sb.append("&");
         sb.append(query);
         String args = sb.toString();
@@ -79,10 +93,45 @@ public class Session implements AutoCloseable {
             process = null;
         }
 
+        if (model != null) {
+            models.release(model);
+            model = null;
+            modelFile = null;
+        }
+
         new File(store, infile).delete();
         new File(store, outfile).delete();
+        for (int i = 0; i < batch; i++) {
+            new File(store, batchOutfile(i)).delete();
+        }
         new File(store, permfile).delete();
         new File(store, costfile).delete();
+        new File(store, telemetryfile).delete();
+    }
+
+    // Run the solver on a model from the model store, which is kept until the session is closed
+    // Returns false if the store does not hold the model
+    public synchronized boolean useModel(String hash) {
+        if (hash.equalsIgnoreCase(model)) {
+            return true;
+        }
+
+        File file = models.acquire(hash);
+        if (file == null) {
+            return false;
+        }
+
+        if (model != null) {
+            models.release(model);
+        }
+        model = hash;
+        modelFile = file;
+
+        return true;
+    }
+
+    public String batchOutfile(int index) {
+        return outfile + "." + index;
     }
 
     public synchronized int status() {
@@ -146,6 +195,25 @@ public class Session implements AutoCloseable {
         return status;
     }
 
+    // Block until the solver process exits or the timeout expires and then return the status
+    // The lock is not held while waiting so that other requests for this session are not blocked
+    public int waitFor(long timeout) {
+        Process p;
+        synchronized(this) {
+            p = process;
+        }
+
+        if (p != null) {
+            try {
+                p.waitFor(timeout, TimeUnit.MILLISECONDS);
+            } catch (InterruptedException e) {
+                // Ignore - the current status is returned
+            }
+        }
+
+        return status();
+    }
+
     public synchronized String result() {
         if (results != null) {
 //            Logger.log("Session %s result %s", id, results[0]);
@@ -7,9 +7,11 @@ import java.io.FileReader;
 import java.io.FileWriter;
 import java.io.IOException;
 import java.io.InputStreamReader;
+import java.io.OutputStreamWriter;
 import java.io.PrintWriter;
 import java.net.ServerSocket;
 import java.net.Socket;
+import java.net.SocketTimeoutException;
 import java.net.URI;
 import java.net.URISyntaxException;
 import java.nio.file.FileAlreadyExistsException;
@@ -22,34 +24,58 @@ import java.text.SimpleDateFormat;
 import java.util.Iterator;
 import java.util.Map.Entry;
 import java.util.NoSuchElementException;
+import java.util.UUID;
 import java.util.concurrent.Executor;
 import java.util.concurrent.Executors;
 
 public class UWECellSuppressionServer {
 
-    private static final String version = "1.7.0";
-    private static final int protocol = 4;
+    private static final String version = "1.8.0";
+    private static final int protocol = 9;
+    private static final int defaultPort = 1081;
     private static final int additionalCores = -1;
+    // Longest time in milliseconds that a wait request is held open
+    private static final long maxWaitTimeout = 10000;
+    // Longest time in milliseconds that an idle keep-alive connection is held open
+    private static final int idleTimeout = 60000;
+    // Most bytes of models kept in the model store before the least recently used are deleted
+    private static final long modelStoreLimit = 2L * 1024 * 1024 * 1024;
 
     public static File store;
+    public static ModelStore models;
 
     private static final int cores = Runtime.getRuntime().availableProcessors();
-    // Extra thread below is to check for orphaned sessions and is extremely lightweight
-    private static final Executor executor = Executors.newFixedThreadPool(cores + additionalCores + 1);
+    // Threads are created as needed because each running session may hold a thread in a wait request
+    // One further thread checks for orphaned sessions and is extremely lightweight
+    private static final Executor executor = Executors.newCachedThreadPool();
 //    private static final TimeZone tz = TimeZone.getTimeZone("UTC");
 
     private static final Sessions sessions = new Sessions(cores + additionalCores);
 
     public static void main(String[] args) {
+        // Several servers can run on one machine, each on a port of its own with its own log and store
+        int port = defaultPort;
+        if (args.length > 0) {
+            try {
+                port = Integer.parseInt(args[0]);
+            } catch (NumberFormatException e) {
+                System.err.println("Invalid port: " + args[0]);
+                System.exit(1);
+            }
+        }
+        String suffix = (port == defaultPort)? "": "-" + port;
+
+        Logger.open("ServerLog" + suffix + ".txt");
         Logger.log("UWECellSuppressionServer v" + version);
         Logger.log(System.getProperty("os.name") + " " + System.getProperty("os.version") + " " + System.getProperty("os.arch"));
         Logger.log("Java " + System.getProperty("java.version") + " "+ System.getProperty("java.vendor"));
         Logger.log(Runtime.getRuntime().availableProcessors() + " cores");
         Logger.log(additionalCores + " additional cores");
+        Logger.log("Port " + port);
 
         try {
             // Create directory to store files
-            Path path = FileSystems.getDefault().getPath("store");
+            Path path = FileSystems.getDefault().getPath("store" + suffix);
             store = path.toFile();
             try {
                 Files.createDirectory(path);
@@ -70,6 +96,8 @@ public class UWECellSuppressionServer {
                 }
             }
 
+            models = new ModelStore(store, modelStoreLimit);
+
             // Create shutdown hook
             Runtime.getRuntime().addShutdownHook(new Thread() {
                 @Override
@@ -84,7 +112,7 @@ public class UWECellSuppressionServer {
 
             // Handle connections
             try {
-                ServerSocket serverSocket = new ServerSocket(1081);
+                ServerSocket serverSocket = new ServerSocket(port);
 
                 while (true) {
                     Socket socket = serverSocket.accept();
@@ -133,15 +161,143 @@ public class UWECellSuppressionServer {
         return null;
     }
 
+    private static long getTimeout(String query) {
+        String[] elements = query.split("&");
+        for (String s : elements) {
+            if (s.startsWith("timeout=")) {
+                String[] keyValue = s.split("=");
+                if (keyValue.length == 2) {
+                    try {
+                        return Math.min(Long.parseLong(keyValue[1]), maxWaitTimeout);
+                    } catch (NumberFormatException e) {
+                        Logger.log("Badly formatted timeout: %s", s);
+                    }
+                }
+            }
+        }
+
+        return maxWaitTimeout;
+    }
+
+    // Value of a non-negative integer parameter, or -1 if it is missing or badly formatted
+    private static int getCount(String query, String key) {
+        if (query == null) {
+            return -1;
+        }
+
+        String[] elements = query.split("&");
+        for (String s : elements) {
+            if (s.startsWith(key + "=")) {
+                String[] keyValue = s.split("=");
+                if (keyValue.length == 2) {
+                    try {
+                        return Math.max(Integer.parseInt(keyValue[1]), -1);
+                    } catch (NumberFormatException e) {
+                        Logger.log("Badly formatted %s: %s", key, s);
+                    }
+                }
+            }
+        }
+
+        return -1;
+    }
+
+    // Value of a parameter, or null if it is missing
+    private static String getValue(String query, String key) {
+        if (query == null) {
+            return null;
+        }
+
+        String[] elements = query.split("&");
+        for (String s : elements) {
+            if (s.startsWith(key + "=")) {
+                String[] keyValue = s.split("=");
+                if (keyValue.length == 2) {
+                    return keyValue[1];
+                }
+            }
+        }
+
+        return null;
+    }
+
+    // Next request line on a keep-alive connection, or null once the client has closed it or left it idle
+    private static String readRequest(BufferedReader in) {
+        try {
+            String request = in.readLine();
+            if (request == null) {
+                Logger.log("Disconnect");
+            }
+            return request;
+        } catch (SocketTimeoutException e) {
+            Logger.log("Idle connection closed");
+        } catch (IOException e) {
+            Logger.log("Disconnect: %s", e.getMessage());
+        }
+
+        return null;
+    }
+
+    // Read one character of the content of a request, or -1 if the connection has ended or stopped sending
+    private static int readContentCharacter(BufferedReader in) {
+        try {
+            return in.read();
+        } catch (IOException e) {
+            Logger.log("Content not received: %s", e.getMessage());
+            return -1;
+        }
+    }
+
+    // Copy the content of a request to a file
+    // Returns false, having deleted the file, if the connection ended before all of the content was received
+    private static boolean readContent(BufferedReader in, long contentLength, File file) throws IOException {
+        boolean complete = true;
+
+        try (BufferedWriter out = new BufferedWriter(new FileWriter(file))) {
+            for (long i = 0; (i < contentLength) && complete; i++) {
+                int c = readContentCharacter(in);
+                if (c == -1) {
+                    Logger.log("Content ended after %d of %d bytes", i, contentLength);
+                    complete = false;
+                } else {
+                    out.append((char)c);
+                }
+            }
+        }
+
+        if (! complete) {
+            file.delete();
+        }
+
+        return complete;
+    }
+
+    // Read and discard the content of a request that has been rejected, so that the connection can be kept for the next request
+    // Returns false if the connection ended before all of the content was received
+    private static boolean skipContent(BufferedReader in, long contentLength) {
+        for (long i = 0; i < contentLength; i++) {
+            if (readContentCharacter(in) == -1) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Requests are handled in turn until the client closes the connection, asks for it to be closed or leaves it idle
+    // Requests may be pipelined, as they are read and replied to in order
     public static void HandleRequest(Socket socket) {
         try {
             Logger.log("Connection: %s", socket.getRemoteSocketAddress().toString());
 
-            try (BufferedReader in = new BufferedReader(new InputStreamReader(socket.getInputStream()))) {
+            socket.setSoTimeout(idleTimeout);
+
+            try (BufferedReader in = new BufferedReader(new InputStreamReader(socket.getInputStream()));
+                    PrintWriter out = new PrintWriter(new BufferedWriter(new OutputStreamWriter(socket.getOutputStream())))) {
 
-                String request = in.readLine();
+                String request = readRequest(in);
 
-                if (request != null) {
+                while (request != null) {
                     Logger.log("Request: %s", request);
 
                     String[] tokens = request.split(" ");
@@ -151,6 +307,29 @@ public class UWECellSuppressionServer {
                     int status = 200;
                     String response = "";
                     boolean html = false;
+                    boolean keepAlive = true;
+                    boolean contentRead = false;
+
+                    // Request header, to blank line
+                    long contentLength = 0;
+                    String header = in.readLine();
+                    while ((header != null) && (! header.equals(""))) {
+                        String lower = header.toLowerCase();
+                        if (lower.startsWith("content-length:")) {
+                            try {
+                                contentLength = Long.parseLong(header.substring(15).trim());
+                            } catch (NumberFormatException e) {
+                                Logger.log("Badly formatted header: %s", header);
+                                keepAlive = false;
+                            }
+                        } else if (lower.equals("connection: close")) {
+                            keepAlive = false;
+                        }
+                        header = in.readLine();
+                    }
+                    if (header == null) {
+                        keepAlive = false;
+                    }
 
                     try {
                         URI uri = new URI(tokens[1]);
@@ -269,6 +448,17 @@ public class UWECellSuppressionServer {
                                         }
                                         break;
 
+                                    case "/wait":
+                                        // Long-poll - reply with the status as soon as the solver finishes or when the timeout expires
+                                        session = getSession(query);
+                                        if (session != null) {
+                                            session.keepAlive();
+                                            sb.append(session.waitFor(getTimeout(query)));
+                                        } else {
+                                            status = 404;
+                                        }
+                                        break;
+
                                     case "/result":
                                         session = getSession(query);
                                         if (session != null) {
@@ -290,8 +480,14 @@ public class UWECellSuppressionServer {
                                     case "/file":
                                         session = getSession(query);
                                         if (session != null) {
+                                            // Batches have an output file for each permutation
+                                            int index = getCount(query, "index");
+                                            String name = session.outfile;
+                                            if ((index >= 0) && (index < session.batch)) {
+                                                name = session.batchOutfile(index);
+                                            }
                                             try {
-                                                File outfile = new File(store, session.outfile);
+                                                File outfile = new File(store, name);
                                                 if (Files.exists(outfile.toPath())) {
                                                     try (BufferedReader file = new BufferedReader(new FileReader(outfile))) {
                                                         int c;
@@ -302,12 +498,19 @@ public class UWECellSuppressionServer {
                                                             }
                                                         } while (c != -1);
                                                     }
+
+                                                    // So that the client need not send the file back if it is the model of its next job
+                                                    try {
+                                                        models.register(outfile);
+                                                    } catch (IOException e) {
+                                                        Logger.log("Output file not stored as a model: %s", e.getMessage());
+                                                    }
                                                 } else {
-                                                    Logger.log("Internal error retrieving resource: %s", session.outfile);
+                                                    Logger.log("Internal error retrieving resource: %s", name);
                                                     status = 404;
                                                 }
                                             } catch (InvalidPathException e) {
-                                                Logger.log("Internal error retrieving resource: %s", session.outfile);
+                                                Logger.log("Internal error retrieving resource: %s", name);
                                                 status = 404;
                                             }
                                         } else {
@@ -343,6 +546,34 @@ public class UWECellSuppressionServer {
                                         }
                                         break;
 
+                                    case "/telemetry":
+                                        session = getSession(query);
+                                        if (session != null) {
+                                            try {
+                                                File telemetryfile = new File(store, session.telemetryfile);
+                                                if (Files.exists(telemetryfile.toPath())) {
+                                                    try (BufferedReader file = new BufferedReader(new FileReader(telemetryfile))) {
+                                                        int c;
+                                                        do {
+                                                            c = file.read();
+                                                            if (c != -1) {
+                                                                sb.append((char)c);
+                                                            }
+                                                        } while (c != -1);
+                                                    }
+                                                } else {
+                                                    Logger.log("Internal error retrieving resource: %s", session.telemetryfile);
+                                                    status = 404;
+                                                }
+                                            } catch (InvalidPathException e) {
+                                                Logger.log("Internal error retrieving resource: %s", session.telemetryfile);
+                                                status = 404;
+                                            }
+                                        } else {
+                                            status = 404;
+                                        }
+                                        break;
+
                                     default:
                                         Logger.log("Unknown resource: %s", resource);
                                         status = 404;
@@ -351,58 +582,78 @@ public class UWECellSuppressionServer {
                                 response = sb.toString();
                                 break;
 
+                            case "HEAD":
+                                switch(resource) {
+                                    // Whether the model store holds a model, so that the client need only send it once
+                                    case "/model":
+                                        String hash = getValue(query, "hash");
+                                        if ((! ModelStore.validHash(hash)) || (! models.contains(hash))) {
+                                            status = 404;
+                                        }
+                                        break;
+
+                                    default:
+                                        Logger.log("Unknown resource: %s", resource);
+                                        status = 404;
+                                }
+                                break;
+
                             case "PUT":
                                 switch(resource) {
                                     case "/file":
                                         session = getSession(query);
                                         if (session != null) {
-                                            String line;
-                                            int contentLength = 0;
-                                            boolean done = false;
-                                            do {
-                                                line = in.readLine();
-                                                if (line.equals("")) {
-                                                    try (BufferedWriter out = new BufferedWriter(new FileWriter(new File(store, session.infile)))) {
-                                                        for (int i = 0; i < contentLength; i++) {
-                                                            char c = (char)in.read();
-                                                            out.append(c);
-                                                        }
-                                                        done = true;
-                                                    }
-                                                } else if (line.toLowerCase().startsWith("content-length:")) {
-                                                    String t[] = line.split(" ");
-                                                    contentLength = Integer.valueOf(t[1]);
-                                                }
-                                            } while (! done);
+                                            contentRead = readContent(in, contentLength, new File(store, session.infile));
 
-                                            status = 201;
+                                            status = contentRead? 201: 404;
+                                        } else {
+                                            status = 404;
+                                        }
+                                        break;
+
+                                    case "/model":
+                                        String hash = getValue(query, "hash");
+                                        if (ModelStore.validHash(hash)) {
+                                            File upload = new File(store, UUID.randomUUID().toString());
+                                            contentRead = readContent(in, contentLength, upload);
+
+                                            // A model is only stored under the fingerprint of what was actually received
+                                            if (! contentRead) {
+                                                status = 404;
+                                            } else if (! ModelStore.fingerprint(upload).equalsIgnoreCase(hash)) {
+                                                Logger.log("Model does not match its hash: %s", hash);
+                                                upload.delete();
+                                                status = 404;
+                                            } else {
+                                                models.put(hash, upload);
+                                                status = 201;
+                                            }
                                         } else {
+                                            Logger.log("Invalid model hash: %s", query);
                                             status = 404;
                                         }
                                         break;
 
+                                    // A batch file holds several permutations, each with its own maximum cost, for one solver
+                                    // The model is either taken from the model store or was sent to the session's own input file
                                     case "/perm":
+                                    case "/batch":
                                         session = getSession(query);
+                                        String jj = getValue(query, "jj");
+                                        if ((session != null) && (jj != null) && ((! ModelStore.validHash(jj)) || (! session.useModel(jj)))) {
+                                            Logger.log("Model not in store: %s", jj);
+                                            session = null;
+                                        }
                                         if (session != null) {
-                                            String line;
-                                            int contentLength = 0;
-                                            boolean done = false;
-                                            do {
-                                                line = in.readLine();
-                                                if (line.equals("")) {
-                                                    try (BufferedWriter out = new BufferedWriter(new FileWriter(new File(store, session.permfile)))) {
-                                                        for (int i = 0; i < contentLength; i++) {
-                                                            char c = (char)in.read();
-                                                            out.append(c);
-                                                        }
-                                                        done = true;
-                                                    }
-                                                } else if (line.toLowerCase().startsWith("content-length:")) {
-                                                    String t[] = line.split(" ");
-                                                    contentLength = Integer.valueOf(t[1]);
-                                                }
-                                            } while (! done);
-
+                                            contentRead = readContent(in, contentLength, new File(store, session.permfile));
+                                        } else {
+                                            // The client sends the model again if it is no longer in the store, on the same connection
+                                            contentRead = skipContent(in, contentLength);
+                                        }
+                                        if ((session != null) && contentRead) {
+                                            if (resource.equals("/batch")) {
+                                                session.batch = Math.max(getCount(query, "count"), 0);
+                                            }
                                             session.run(query);
 
                                             status = 201;
@@ -422,53 +673,65 @@ public class UWECellSuppressionServer {
                         status = 404;
                     }
 
-                    try (PrintWriter out = new PrintWriter(socket.getOutputStream(), true)) {
-                        out.print("HTTP/1.1 ");
-                        out.print(status);
-                        out.printf(" ");
+                    // Unless all of the content of a request has been read, the rest would be taken as the next request
+                    if (method.equals("PUT") && (! contentRead)) {
+                        keepAlive = false;
+                    }
 
-                        switch (status) {
-                            case 100:
-                                out.println("Continue");
-                                break;
+                    out.print("HTTP/1.1 ");
+                    out.print(status);
+                    out.printf(" ");
 
-                            case 201:
-                                out.println("Created");
-                                break;
+                    switch (status) {
+                        case 100:
+                            out.println("Continue");
+                            break;
 
-                            case 200:
-                                out.println("OK");
-                                break;
+                        case 201:
+                            out.println("Created");
+                            break;
 
-                            case 404:
-                                out.println("Not Found");
-                                break;
+                        case 200:
+                            out.println("OK");
+                            break;
 
-                            default:
-                                out.println();
-                        }
+                        case 404:
+                            out.println("Not Found");
+                            break;
 
-                        if (html) {
-                            out.print("Content-type: text/html\r\n");
-                        } else {
-                            out.print("Content-Type: text/html; charset=iso-8859-1\r\n");
-                        }
-                        out.print("Server-name: UWECSP\r\n");
-                        out.print("Content-length: ");
-                        out.print(response.length());
-                        out.print("\r\n");
-                        out.print("\r\n");
-                        out.print(response);
-                        out.flush();
-
-                        if (response.length() < 64) {
-                            Logger.log("Reply: %s", response);
-                        } else {
-                            Logger.log("Reply length: %d", response.length());
-                        }
+                        default:
+                            out.println();
+                    }
+
+                    if (html) {
+                        out.print("Content-type: text/html\r\n");
+                    } else {
+                        out.print("Content-Type: text/html; charset=iso-8859-1\r\n");
+                    }
+                    out.print("Server-name: UWECSP\r\n");
+                    if (keepAlive) {
+                        out.print("Connection: keep-alive\r\n");
+                    } else {
+                        out.print("Connection: close\r\n");
+                    }
+                    out.print("Content-length: ");
+                    out.print(response.length());
+                    out.print("\r\n");
+                    out.print("\r\n");
+                    out.print(response);
+                    out.flush();
+
+                    if (response.length() < 64) {
+                        Logger.log("Reply: %s", response);
+                    } else {
+                        Logger.log("Reply length: %d", response.length());
+                    }
+
+                    if (keepAlive) {
+                        request = readRequest(in);
+                    } else {
+                        request = null;
                     }
-                } else {
-                    Logger.log("Disconnect");
                 }
             }
         } catch (IOException e) {